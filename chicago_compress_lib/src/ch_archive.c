@@ -1,5 +1,19 @@
 #include "ch_archive.h"
 #include "thirdparty/brotli/include/brotli/decode.h"
+#include "thirdparty/hashmap/hashmap.h"
+#include "ch_fingerprint.h"
+
+#include <errno.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 ch_archive_result ch_load_file(const char* file_path, ch_byte_array* ba, size_t max_allowed_size)
 {
@@ -83,100 +97,549 @@ const char* ch_brotli_decompress(ch_byte_array in, ch_byte_array* out)
     return out_err;
 }
 
-// the offsets for the various fields are relative to one of the pointers from the header and they should all lie inside the array
-
-#define CH_CHECK_PTR(p)                                                        \
-    if ((char*)(p) <= (char*)bytes.arr || (char*)(p) >= bytes.arr + bytes.len) \
-    return CH_ARCH_INVALID_COLLECTION
-
-#define CH_FIXUP_TYPED(packed, rel_to, type)            \
-    do {                                                \
-        if (packed##_rel_off == CH_REL_OFF_NULL) {      \
-            packed = NULL;                              \
-        } else {                                        \
-            packed = (type)(rel_to + packed##_rel_off); \
-            CH_CHECK_PTR(packed);                       \
-        }                                               \
-    } while (0)
-
-#define CH_FIXUP(packed, rel_to) CH_FIXUP_TYPED(packed, rel_to, void*)
-
-ch_archive_result ch_verify_and_fixup_collection_pointers(ch_byte_array bytes,
-                                                          ch_datamap_collection_header** header_out)
-{
-    if (bytes.len < sizeof(ch_datamap_collection_header))
-        return CH_ARCH_INVALID_COLLECTION;
-
-    ch_datamap_collection_header* hd = (ch_datamap_collection_header*)bytes.arr;
-    *header_out = hd;
-
-    if (strncmp(hd->magic, CH_COLLECTION_FILE_MAGIC, sizeof hd->magic))
-        return CH_ARCH_INVALID_COLLECTION;
-    if (hd->version != CH_DATAMAP_STRUCT_VERSION || hd->n_datamaps == 0)
-        return CH_ARCH_INVALID_COLLECTION_VERSION;
-
-    CH_FIXUP_TYPED(hd->dms, bytes.arr, ch_datamap*);
-    CH_FIXUP_TYPED(hd->tds, bytes.arr, ch_type_description*);
-    CH_FIXUP_TYPED(hd->lnks, bytes.arr, ch_linked_name*);
-    CH_FIXUP_TYPED(hd->strs, bytes.arr, const char*);
-    CH_CHECK_PTR((char*)(hd->dms + hd->n_datamaps) - 1);
-    CH_CHECK_PTR((char*)(hd->lnks + hd->n_linked_names) - 1);
-
-    // fixup datamaps & type descs
-    for (size_t i = 0; i < hd->n_datamaps; i++) {
-        ch_datamap* dm = (ch_datamap*)&hd->dms[i]; // cast away const
-        CH_FIXUP(dm->base_map, hd->dms);
-        CH_FIXUP(dm->class_name, hd->strs);
-        CH_FIXUP(dm->module_name, hd->strs);
-        CH_FIXUP(dm->fields, hd->tds);
-        if (!!dm->fields ^ !!dm->n_fields)
-            return CH_ARCH_INVALID_COLLECTION;
-        for (size_t j = 0; j < dm->n_fields; j++) {
-            ch_type_description* td = (ch_type_description*)&dm->fields[j];
-            CH_FIXUP(td->name, hd->strs);
-            CH_FIXUP(td->external_name, hd->strs);
-            CH_FIXUP(td->embedded_map, hd->dms);
-            if (td->ch_offset >= dm->ch_size)
-                return CH_ARCH_INVALID_COLLECTION;
+uint64_t ch_archive_hash(const void* data, size_t len)
+{
+    return hashmap_xxhash3(data, len, 0, 0);
+}
+
+ch_archive_result ch_archive_get_index(const void* archive,
+                                       size_t len,
+                                       const ch_archive_entry** entries,
+                                       uint32_t* n_entries)
+{
+    *entries = NULL;
+    *n_entries = 0;
+    const ch_archive_header* hd = archive;
+    if (len < sizeof *hd || strncmp(hd->magic, CH_ARCHIVE_MAGIC, sizeof hd->magic) ||
+        hd->version != CH_ARCHIVE_VERSION)
+        return CH_ARCH_BAD_ARCHIVE;
+    if ((uint64_t)hd->n_entries * sizeof(ch_archive_entry) > len - sizeof *hd)
+        return CH_ARCH_BAD_ARCHIVE;
+    const ch_archive_entry* arch_entries = (const ch_archive_entry*)(hd + 1);
+    for (uint32_t i = 0; i < hd->n_entries; i++) {
+        const ch_archive_entry* entry = &arch_entries[i];
+        if (!memchr(entry->game.name, '\0', sizeof entry->game.name) ||
+            !memchr(entry->game.version, '\0', sizeof entry->game.version) ||
+            (uint64_t)entry->offset + entry->compressed_size > len ||
+            (uint64_t)entry->fingerprint_offset + entry->fingerprint_size > len)
+            return CH_ARCH_BAD_ARCHIVE;
+    }
+    *entries = arch_entries;
+    *n_entries = hd->n_entries;
+    return CH_ARCH_OK;
+}
+
+const ch_archive_entry* ch_archive_find(const ch_archive_entry* entries,
+                                        uint32_t n_entries,
+                                        const char* game_name,
+                                        const char* game_version)
+{
+    for (uint32_t i = 0; i < n_entries; i++)
+        if (!strcmp(entries[i].game.name, game_name) && !strcmp(entries[i].game.version, game_version))
+            return &entries[i];
+    return NULL;
+}
+
+ch_archive_result ch_archive_extract_to(const void* archive,
+                                        size_t len,
+                                        const ch_archive_entry* entry,
+                                        void* out,
+                                        size_t out_size)
+{
+    if ((uint64_t)entry->offset + entry->compressed_size > len || out_size != entry->size)
+        return CH_ARCH_BAD_ARCHIVE;
+    ch_byte_array in = {.arr = (char*)archive + entry->offset, .len = entry->compressed_size};
+
+    switch (entry->compression) {
+        case CH_ARCH_COMPRESSION_NONE:
+            if (entry->compressed_size != entry->size)
+                return CH_ARCH_BAD_ARCHIVE;
+            memcpy(out, in.arr, entry->size);
+            break;
+        case CH_ARCH_COMPRESSION_BROTLI:
+            if (ch_brotli_decompress_to(in, out, out_size))
+                return CH_ARCH_BROTLI_FAILED;
+            break;
+        case CH_ARCH_COMPRESSION_DEFLATE:
+            if (tinfl_decompress_mem_to_mem(out, out_size, in.arr, in.len, 0) != out_size)
+                return CH_ARCH_DEFLATE_FAILED;
+            break;
+        default:
+            return CH_ARCH_BAD_ARCHIVE;
+    }
+    if (ch_archive_hash(out, out_size) != entry->hash)
+        return CH_ARCH_BAD_ARCHIVE;
+    return CH_ARCH_OK;
+}
+
+ch_archive_result ch_archive_extract(const void* archive,
+                                     size_t len,
+                                     const ch_archive_entry* entry,
+                                     ch_byte_array* out)
+{
+    memset(out, 0, sizeof *out);
+    if ((uint64_t)entry->offset + entry->compressed_size > len)
+        return CH_ARCH_BAD_ARCHIVE;
+    // the size comes from the index, don't let a bad archive make us allocate whatever it wants
+    if (entry->size > CH_COLLECTION_FILE_MAX_SIZE)
+        return CH_ARCH_FILE_TOO_BIG;
+    char* arr = malloc(entry->size ? entry->size : 1);
+    if (!arr)
+        return CH_ARCH_OOM;
+    ch_archive_result res = ch_archive_extract_to(archive, len, entry, arr, entry->size);
+    if (res != CH_ARCH_OK) {
+        free(arr);
+        return res;
+    }
+    out->arr = arr;
+    out->len = entry->size;
+    return CH_ARCH_OK;
+}
+
+static unsigned long ch_process_id(void)
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+static bool ch_replace_file(const char* from, const char* to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
+#else
+    return !rename(from, to);
+#endif
+}
+
+ch_archive_result ch_archive_detect_game(const void* archive,
+                                         size_t len,
+                                         const void* save_bytes,
+                                         size_t n_save_bytes,
+                                         const ch_archive_entry** best_entry,
+                                         float* best_score,
+                                         uint32_t* n_best)
+{
+    *best_entry = NULL;
+    *best_score = 0.f;
+    *n_best = 0;
+    const ch_archive_entry* entries;
+    uint32_t n_entries;
+    ch_archive_result res = ch_archive_get_index(archive, len, &entries, &n_entries);
+    if (res != CH_ARCH_OK)
+        return res;
+    ch_save_symbols symbols;
+    ch_err err = ch_save_symbols_read(save_bytes, n_save_bytes, &symbols);
+    if (err)
+        return err == CH_ERR_OUT_OF_MEMORY ? CH_ARCH_OOM : CH_ARCH_READ_FAIL;
+    for (uint32_t i = 0; i < n_entries; i++) {
+        if (entries[i].fingerprint_size == 0)
+            continue;
+        const unsigned char* fingerprint = (const unsigned char*)archive + entries[i].fingerprint_offset;
+        float score = ch_fingerprint_score(fingerprint, entries[i].fingerprint_size, &symbols);
+        /*
+        * A collection that has every name of the best match (e.g. a later version of the same game) gets the same
+        * score, so ties go to the smaller fingerprint - the one with the fewest names that aren't in the save.
+        */
+        if (!*best_entry || score > *best_score) {
+            *best_entry = &entries[i];
+            *best_score = score;
+            *n_best = 1;
+        } else if (score == *best_score) {
+            if (entries[i].fingerprint_size < (*best_entry)->fingerprint_size)
+                *best_entry = &entries[i];
+            ++*n_best;
         }
     }
+    ch_save_symbols_free(&symbols);
+    return *best_entry ? CH_ARCH_OK : CH_ARCH_NOT_FOUND;
+}
 
-    for (size_t i = 0; i < hd->n_linked_names; i++) {
-        ch_linked_name* ln = (ch_linked_name*)&hd->lnks[i];
-        CH_FIXUP(ln->linked_name, hd->strs);
-        CH_FIXUP(ln->dm, hd->dms);
+static bool ch_make_dir(const char* path)
+{
+#ifdef _WIN32
+    return !_mkdir(path) || errno == EEXIST;
+#else
+    return !mkdir(path, 0755) || errno == EEXIST;
+#endif
+}
+
+ch_archive_result ch_archive_cache_dir(char* buf, size_t buf_size)
+{
+    int n;
+#ifdef _WIN32
+    const char* base = getenv("LOCALAPPDATA");
+    if (!base || !*base)
+        return CH_ARCH_OPEN_FAIL;
+    n = snprintf(buf, buf_size, "%s\\chicago", base);
+#else
+    const char* base = getenv("XDG_CACHE_HOME");
+    if (base && *base) {
+        if (!ch_make_dir(base))
+            return CH_ARCH_OPEN_FAIL;
+        n = snprintf(buf, buf_size, "%s/chicago", base);
+    } else {
+        base = getenv("HOME");
+        if (!base || !*base)
+            return CH_ARCH_OPEN_FAIL;
+        n = snprintf(buf, buf_size, "%s/.cache", base);
+        if (n < 0 || (size_t)n >= buf_size || !ch_make_dir(buf))
+            return CH_ARCH_OPEN_FAIL;
+        n = snprintf(buf, buf_size, "%s/.cache/chicago", base);
     }
+#endif
+    if (n < 0 || (size_t)n >= buf_size || !ch_make_dir(buf))
+        return CH_ARCH_OPEN_FAIL;
+    return CH_ARCH_OK;
+}
+
+ch_archive_result ch_archive_get_cached(const void* archive,
+                                        size_t len,
+                                        const ch_archive_entry* entry,
+                                        const char* cache_dir,
+                                        bool refresh,
+                                        const void** data,
+                                        size_t* data_len,
+                                        bool* is_mapped)
+{
+    *data = NULL;
+    *data_len = 0;
+    *is_mapped = false;
 
+    char dir_buf[512];
+    char path[600];
+    char tmp_path[640];
+    bool have_cache = true;
+    if (!cache_dir) {
+        have_cache = ch_archive_cache_dir(dir_buf, sizeof dir_buf) == CH_ARCH_OK;
+        cache_dir = dir_buf;
+    }
+    if (have_cache) {
+        int n = snprintf(path, sizeof path, "%s/%016llx.chic", cache_dir, (unsigned long long)entry->hash);
+        have_cache = n > 0 && (size_t)n < sizeof path;
+    }
+
+    // the name only says what the file should be, a truncated or corrupted file is extracted again
+    if (have_cache && !refresh) {
+        ch_archive_result res = ch_map_file(path, data, data_len, CH_COLLECTION_FILE_MAX_SIZE);
+        if (res == CH_ARCH_OK && *data_len == entry->size && ch_archive_hash(*data, *data_len) == entry->hash) {
+            *is_mapped = true;
+            return CH_ARCH_OK;
+        }
+        ch_unmap_file(*data, *data_len);
+        *data = NULL;
+        *data_len = 0;
+    }
+
+    if (entry->size > CH_COLLECTION_FILE_MAX_SIZE)
+        return CH_ARCH_FILE_TOO_BIG;
+
+    /*
+    * The entry is decompressed straight into a mapping of a temp file, which is then moved into place so that other
+    * processes never map a partially written file. The temp file is per process so that two processes filling the
+    * cache at the same time don't write into the same file.
+    */
+    if (have_cache && entry->size > 0) {
+        int n = snprintf(tmp_path, sizeof tmp_path, "%s.%lu.tmp", path, ch_process_id());
+        void* tmp_data;
+        if (n > 0 && (size_t)n < sizeof tmp_path &&
+            ch_map_new_file(tmp_path, entry->size, &tmp_data) == CH_ARCH_OK) {
+            ch_archive_result res = ch_archive_extract_to(archive, len, entry, tmp_data, entry->size);
+            ch_unmap_file(tmp_data, entry->size);
+            if (res == CH_ARCH_OK && ch_replace_file(tmp_path, path)) {
+                // another process could have replaced the file in the meantime
+                if (ch_map_file(path, data, data_len, CH_COLLECTION_FILE_MAX_SIZE) == CH_ARCH_OK) {
+                    if (*data_len == entry->size) {
+                        *is_mapped = true;
+                        return CH_ARCH_OK;
+                    }
+                    ch_unmap_file(*data, *data_len);
+                    *data = NULL;
+                    *data_len = 0;
+                }
+            } else {
+                remove(tmp_path);
+                // a bad entry won't extract any better into memory
+                if (res != CH_ARCH_OK)
+                    return res;
+            }
+        }
+    }
+
+    ch_byte_array ba;
+    ch_archive_result res = ch_archive_extract(archive, len, entry, &ba);
+    if (res != CH_ARCH_OK)
+        return res;
+    *data = ba.arr;
+    *data_len = ba.len;
     return CH_ARCH_OK;
 }
 
-ch_archive_result ch_create_collection_lookup(const ch_datamap_collection_header* header, ch_datamap_collection* out)
+ch_archive_result ch_add_to_ch_archive(const char* file_name, const ch_game_info* game, ch_byte_array data)
 {
-    out->lookup = hashmap_new(sizeof(ch_datamap_lookup_entry),
-                              header->n_datamaps + header->n_linked_names,
-                              0,
+    if (!memchr(game->name, '\0', sizeof game->name) || !memchr(game->version, '\0', sizeof game->version))
+        return CH_ARCH_BAD_ARCHIVE;
+    if (data.len >= CH_ARCHIVE_FILE_MAX_SIZE)
+        return CH_ARCH_FILE_TOO_BIG;
+
+    ch_byte_array old = {0};
+    const ch_archive_entry* old_entries = NULL;
+    uint32_t n_old_entries = 0;
+    ch_archive_result res = ch_load_file(file_name, &old, CH_ARCHIVE_FILE_MAX_SIZE);
+    if (res == CH_ARCH_OK)
+        res = ch_archive_get_index(old.arr, old.len, &old_entries, &n_old_entries);
+    else if (res == CH_ARCH_OPEN_FAIL)
+        res = CH_ARCH_OK; // new archive
+    if (res != CH_ARCH_OK) {
+        ch_free_array(&old);
+        return res;
+    }
+    const ch_archive_entry* replaced = ch_archive_find(old_entries, n_old_entries, game->name, game->version);
+
+    ch_archive_entry new_entry = {
+        .game = *game,
+        .hash = ch_archive_hash(data.arr, data.len),
+        .size = (uint32_t)data.len,
+        .compression = CH_ARCH_COMPRESSION_DEFLATE,
+    };
+    // best compression, negative window bits for a raw deflate stream
+    size_t compressed_len = 0;
+    void* compressed = tdefl_compress_mem_to_heap(data.arr,
+                                                  data.len,
+                                                  &compressed_len,
+                                                  (int)tdefl_create_comp_flags_from_zip_params(10, -15, 0));
+    const void* new_data = compressed;
+    if (!compressed || compressed_len >= data.len) {
+        new_entry.compression = CH_ARCH_COMPRESSION_NONE;
+        new_data = data.arr;
+        compressed_len = data.len;
+    }
+    new_entry.compressed_size = (uint32_t)compressed_len;
+
+    // the data is only fingerprinted if it's a collection
+    unsigned char* fingerprint = NULL;
+    ch_datamap_collection collection;
+    if (ch_collection_open(data.arr, data.len, &collection) == CH_ERR_NONE) {
+        size_t fingerprint_size = ch_fingerprint_size(&collection);
+        fingerprint = malloc(fingerprint_size);
+        if (fingerprint) {
+            ch_fingerprint_build(&collection, fingerprint, fingerprint_size);
+            new_entry.fingerprint_size = (uint32_t)fingerprint_size;
+        }
+        ch_collection_free(&collection);
+        if (!fingerprint) {
+            mz_free(compressed);
+            ch_free_array(&old);
+            return CH_ARCH_OOM;
+        }
+    }
+
+    size_t n_entries = n_old_entries + !replaced;
+    ch_archive_entry* entries = calloc(n_entries, sizeof *entries);
+    size_t tmp_name_len = strlen(file_name) + sizeof ".tmp";
+    char* tmp_name = malloc(tmp_name_len);
+    if (!entries || !tmp_name) {
+        res = CH_ARCH_OOM;
+        goto end;
+    }
+    snprintf(tmp_name, tmp_name_len, "%s.tmp", file_name);
+
+    // the old entries keep their order, the new one goes last
+    uint64_t offset = sizeof(ch_archive_header) + n_entries * sizeof *entries;
+    size_t entry_idx = 0;
+    for (uint32_t i = 0; i < n_old_entries; i++) {
+        if (&old_entries[i] == replaced)
+            continue;
+        entries[entry_idx] = old_entries[i];
+        entries[entry_idx].fingerprint_offset = (uint32_t)offset;
+        offset += old_entries[i].fingerprint_size;
+        entries[entry_idx++].offset = (uint32_t)offset;
+        offset += old_entries[i].compressed_size;
+    }
+    new_entry.fingerprint_offset = (uint32_t)offset;
+    offset += new_entry.fingerprint_size;
+    new_entry.offset = (uint32_t)offset;
+    entries[entry_idx] = new_entry;
+    if (offset + compressed_len > CH_ARCHIVE_FILE_MAX_SIZE) {
+        res = CH_ARCH_FILE_TOO_BIG;
+        goto end;
+    }
+
+    FILE* f = fopen(tmp_name, "wb");
+    if (!f) {
+        res = CH_ARCH_OPEN_FAIL;
+        goto end;
+    }
+    ch_archive_header hd = {.version = CH_ARCHIVE_VERSION, .n_entries = (uint32_t)n_entries};
+    memcpy(hd.magic, CH_ARCHIVE_MAGIC, sizeof hd.magic);
+    bool ok = fwrite(&hd, sizeof hd, 1, f) == 1 && fwrite(entries, sizeof *entries, n_entries, f) == n_entries;
+    // the old entries are copied without decompressing them
+    for (uint32_t i = 0; ok && i < n_old_entries; i++) {
+        const ch_archive_entry* old_entry = &old_entries[i];
+        if (old_entry == replaced)
+            continue;
+        ok = fwrite(old.arr + old_entry->fingerprint_offset, 1, old_entry->fingerprint_size, f) ==
+                 old_entry->fingerprint_size &&
+             fwrite(old.arr + old_entry->offset, 1, old_entry->compressed_size, f) == old_entry->compressed_size;
+    }
+    ok = ok && fwrite(fingerprint, 1, new_entry.fingerprint_size, f) == new_entry.fingerprint_size;
+    ok = ok && fwrite(new_data, 1, compressed_len, f) == compressed_len;
+    ok = !fclose(f) && ok;
+    if (!ok || !ch_replace_file(tmp_name, file_name)) {
+        remove(tmp_name);
+        res = CH_ARCH_WRITE_FAIL;
+    }
+
+end:
+    free(tmp_name);
+    free(entries);
+    free(fingerprint);
+    mz_free(compressed);
+    ch_free_array(&old);
+    return res;
+}
+
+const char* ch_brotli_decompress_to(ch_byte_array in, void* out, size_t out_size)
+{
+    BrotliDecoderState* dec_state = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+    if (!dec_state)
+        return "out of memory";
+    size_t bytes_rem_in = in.len;
+    const uint8_t* read_bytes_cursor = (const uint8_t*)in.arr;
+    size_t bytes_rem_out = out_size;
+    uint8_t* out_cursor = out;
+    const char* out_err = NULL;
+    BrotliDecoderResult res =
+        BrotliDecoderDecompressStream(dec_state, &bytes_rem_in, &read_bytes_cursor, &bytes_rem_out, &out_cursor, NULL);
+    if (res == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT)
+        out_err = "decompressed data is bigger than expected";
+    else if (res == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT)
+        out_err = "compressed data is truncated";
+    else if (res != BROTLI_DECODER_RESULT_SUCCESS)
+        out_err = BrotliDecoderErrorString(BrotliDecoderGetErrorCode(dec_state));
+    else if (bytes_rem_out != 0)
+        out_err = "decompressed data is smaller than expected";
+    BrotliDecoderDestroyInstance(dec_state);
+    return out_err;
+}
+
+#ifdef _WIN32
+
+ch_archive_result ch_map_file(const char* file_path, const void** data, size_t* len, size_t max_allowed_size)
+{
+    *data = NULL;
+    *len = 0;
+    HANDLE file =
+        CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return CH_ARCH_OPEN_FAIL;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return CH_ARCH_READ_FAIL;
+    }
+    if ((unsigned long long)size.QuadPart > max_allowed_size) {
+        CloseHandle(file);
+        return CH_ARCH_FILE_TOO_BIG;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return CH_ARCH_READ_FAIL;
+    // the view keeps the mapping alive
+    *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!*data)
+        return CH_ARCH_READ_FAIL;
+    *len = (size_t)size.QuadPart;
+    return CH_ARCH_OK;
+}
+
+ch_archive_result ch_map_new_file(const char* file_path, size_t size, void** data)
+{
+    *data = NULL;
+    HANDLE file = CreateFileA(file_path,
+                              GENERIC_READ | GENERIC_WRITE,
                               0,
-                              ch_datamap_collection_name_hash,
-                              ch_datamap_collection_name_compare,
                               NULL,
+                              CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL,
                               NULL);
-    if (!out->lookup)
-        return CH_ARCH_OOM;
+    if (file == INVALID_HANDLE_VALUE)
+        return CH_ARCH_OPEN_FAIL;
+    // the mapping sets the size of the file
+    HANDLE mapping = CreateFileMappingA(file,
+                                        NULL,
+                                        PAGE_READWRITE,
+                                        (DWORD)((unsigned long long)size >> 32),
+                                        (DWORD)size,
+                                        NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return CH_ARCH_WRITE_FAIL;
+    *data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(mapping);
+    return *data ? CH_ARCH_OK : CH_ARCH_WRITE_FAIL;
+}
 
-    for (size_t i = 0; i < header->n_datamaps; i++) {
-        ch_datamap_lookup_entry entry = {.name = header->dms[i].class_name, .datamap = &header->dms[i]};
-        const void* v = hashmap_set(out->lookup, &entry);
-        assert(!v);
-        if (hashmap_oom(out->lookup))
-            return CH_ARCH_OOM;
+void ch_unmap_file(const void* data, size_t len)
+{
+    (void)len;
+    if (data)
+        UnmapViewOfFile(data);
+}
+
+#else
+
+ch_archive_result ch_map_file(const char* file_path, const void** data, size_t* len, size_t max_allowed_size)
+{
+    *data = NULL;
+    *len = 0;
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1)
+        return CH_ARCH_OPEN_FAIL;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return CH_ARCH_READ_FAIL;
     }
-    for (size_t i = 0; i < header->n_linked_names; i++) {
-        ch_datamap_lookup_entry entry = {.name = header->lnks[i].linked_name, .datamap = header->lnks[i].dm};
-        const void* v = hashmap_set(out->lookup, &entry);
-        assert(!v);
-        if (hashmap_oom(out->lookup))
-            return CH_ARCH_OOM;
+    if ((size_t)st.st_size > max_allowed_size) {
+        close(fd);
+        return CH_ARCH_FILE_TOO_BIG;
     }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return CH_ARCH_READ_FAIL;
+    *data = p;
+    *len = (size_t)st.st_size;
+    return CH_ARCH_OK;
+}
 
+ch_archive_result ch_map_new_file(const char* file_path, size_t size, void** data)
+{
+    *data = NULL;
+    int fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return CH_ARCH_OPEN_FAIL;
+    if (ftruncate(fd, (off_t)size)) {
+        close(fd);
+        return CH_ARCH_WRITE_FAIL;
+    }
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return CH_ARCH_WRITE_FAIL;
+    *data = p;
     return CH_ARCH_OK;
 }
+
+void ch_unmap_file(const void* data, size_t len)
+{
+    if (data)
+        munmap((void*)data, len);
+}
+
+#endif
@@ -30,40 +30,163 @@ typedef enum ch_archive_result {
     CH_ARCH_OOM,
     CH_ARCH_OPEN_FAIL,
     CH_ARCH_READ_FAIL,
+    CH_ARCH_WRITE_FAIL,
     CH_ARCH_BROTLI_FAILED,
+    CH_ARCH_DEFLATE_FAILED,
     CH_ARCH_FILE_TOO_BIG,
-    CH_ARCH_INVALID_COLLECTION,
-    CH_ARCH_INVALID_COLLECTION_VERSION,
+    CH_ARCH_BAD_ARCHIVE,
+    CH_ARCH_NOT_FOUND,
 } ch_archive_result;
 
 #define CH_COLLECTION_FILE_MAX_SIZE (1024 * 1024 * 32)
+#define CH_ARCHIVE_FILE_MAX_SIZE (1024 * 1024 * 512)
 
-// returns a fail reason or NULL on success
+/*
+* For streams of unknown size, the output buffer is grown until everything fits. Returns a fail reason or NULL on
+* success.
+*/
 const char* ch_brotli_decompress(ch_byte_array in, ch_byte_array* out);
 
 /*
-* 1) Loads example.zip.br
-* 2) Decompresses it
-* 3) Adds the byte array to the .zip archive (TODO would like to set the name and stuff of the new file)
-* 4) Recompresses it
-* 5) Writes to example.zip.br.tmp
-* 6) Rename example.zip.br.tmp -> example.zip.br
+* Decompresses in a single pass into a buffer of exactly the decompressed size, fails if the stream isn't exactly
+* that big. Returns a fail reason or NULL on success.
+*/
+const char* ch_brotli_decompress_to(ch_byte_array in, void* out, size_t out_size);
+
+/*
+* An archive of collections for multiple games (.cha):
+*
+* ch_archive_header | ch_archive_entry[n_entries] | (fingerprint, entry data)...
+*
+* The index is uncompressed and each entry is compressed on its own, so getting a single collection out of the
+* archive only reads the index and decompresses that entry. Each collection also has an uncompressed fingerprint
+* (see ch_fingerprint.h) for finding the collection that a save was made with. The archive is meant to be mapped (see
+* ch_map_file) so that the other entries aren't even read from disk. Entries are brotli compressed by
+* datamaps/files_to_archive.py, ch_add_to_ch_archive uses deflate since there's no brotli encoder in the tree.
 */
-void ch_add_to_ch_archive(const char* file_name, ch_byte_array extra);
+
+#define CH_ARCHIVE_MAGIC "chiarch"
+#define CH_ARCHIVE_VERSION 2
+
+typedef enum ch_archive_compression {
+    CH_ARCH_COMPRESSION_NONE,
+    CH_ARCH_COMPRESSION_BROTLI,
+    CH_ARCH_COMPRESSION_DEFLATE, // raw deflate stream, no zlib header
+} ch_archive_compression;
+
+typedef struct ch_archive_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_entries;
+} ch_archive_header;
+
+typedef struct ch_archive_entry {
+    ch_game_info game;        // both strings are null terminated
+    uint64_t hash;            // ch_archive_hash of the uncompressed data
+    uint32_t offset;          // of the compressed data from the start of the archive
+    uint32_t compressed_size;
+    uint32_t size;
+    uint32_t compression;     // ch_archive_compression
+    uint32_t fingerprint_offset;
+    uint32_t fingerprint_size; // 0 if the entry isn't a collection
+} ch_archive_entry;
+
+uint64_t ch_archive_hash(const void* data, size_t len);
+
+// checks the header & index, the entries point into the archive
+ch_archive_result ch_archive_get_index(const void* archive,
+                                       size_t len,
+                                       const ch_archive_entry** entries,
+                                       uint32_t* n_entries);
+
+// returns NULL if the archive doesn't have the game
+const ch_archive_entry* ch_archive_find(const ch_archive_entry* entries,
+                                        uint32_t n_entries,
+                                        const char* game_name,
+                                        const char* game_version);
 
 /*
-* Call after loading a ch_datamap_collection into memory. This checks the file structure
-* and changes all of the relative file offsets into pointers that will point to somewhere
-* within the loaded file. Only the datamap, typedescs, & string pointers are set. If
-* this function returns OK, then the array can be casted to a ch_datamap_collection*.
+* Decompresses a single entry into a buffer of entry->size bytes and checks its hash, free with ch_free_array. Entries
+* bigger than CH_COLLECTION_FILE_MAX_SIZE fail with CH_ARCH_FILE_TOO_BIG.
 */
-ch_archive_result ch_verify_and_fixup_collection_pointers(ch_byte_array collection,
-                                                          ch_datamap_collection_header** header_out);
+ch_archive_result ch_archive_extract(const void* archive,
+                                     size_t len,
+                                     const ch_archive_entry* entry,
+                                     ch_byte_array* out);
 
-ch_archive_result ch_create_collection_lookup(const ch_datamap_collection_header* header, ch_datamap_collection* out);
+/*
+* Same as ch_archive_extract but decompresses straight into a buffer given by the caller (e.g. a mapping or an
+* arena), which must be exactly entry->size bytes. A collection can then be opened in place with ch_collection_open
+* if the buffer is aligned to 4 bytes.
+*/
+ch_archive_result ch_archive_extract_to(const void* archive,
+                                        size_t len,
+                                        const ch_archive_entry* entry,
+                                        void* out,
+                                        size_t out_size);
+
+/*
+* Scores the symbols of the save against the fingerprint of every entry (see ch_fingerprint.h) and gives the entry
+* with the highest score, only the symbol tables of the save are read. Collections that are a superset of the save's
+* symbols all score 1, ties go to the entry with the smallest fingerprint (the fewest names). n_best is the number of
+* entries that had the best score, more than 1 means the match is ambiguous. Fails with CH_ARCH_NOT_FOUND if no entry
+* has a fingerprint.
+*/
+ch_archive_result ch_archive_detect_game(const void* archive,
+                                         size_t len,
+                                         const void* save_bytes,
+                                         size_t n_save_bytes,
+                                         const ch_archive_entry** best_entry,
+                                         float* best_score,
+                                         uint32_t* n_best);
+
+/*
+* Collections extracted from archives are cached per user (in %LOCALAPPDATA%/chicago on Windows, otherwise in
+* $XDG_CACHE_HOME/chicago or ~/.cache/chicago) as <entry hash>.chic. Since collections don't need any fixups after
+* loading, the cached file is exactly what's in the archive and can be mapped directly. The file name has the hash,
+* and the hash of a cached file is checked again before it's used.
+*
+* Writes the default cache directory to buf and creates it if it doesn't exist.
+*/
+ch_archive_result ch_archive_cache_dir(char* buf, size_t buf_size);
+
+/*
+* Maps the cached file for the entry, extracting it to the cache first if it isn't there. The entry is decompressed
+* straight into the mapped cache file, so there are no copies in memory. If cache_dir is NULL the default directory
+* is used. With refresh, the cached file is extracted & overwritten even if it's there (e.g. because it failed to
+* open). If the cache can't be written to, the entry is extracted to memory instead and *is_mapped is false (free
+* with free() instead of ch_unmap_file).
+*/
+ch_archive_result ch_archive_get_cached(const void* archive,
+                                        size_t len,
+                                        const ch_archive_entry* entry,
+                                        const char* cache_dir,
+                                        bool refresh,
+                                        const void** data,
+                                        size_t* data_len,
+                                        bool* is_mapped);
+
+/*
+* Adds the data to the archive (creating it if it doesn't exist), replacing the entry with the same game name &
+* version if there is one. The other entries are copied as is, only the new data is compressed. The new archive is
+* written to <file_name>.tmp and then moved over the old one.
+*/
+ch_archive_result ch_add_to_ch_archive(const char* file_name, const ch_game_info* game, ch_byte_array data);
 
 ch_archive_result ch_load_file(const char* file_path, ch_byte_array* ba, size_t max_allowed_size);
 
+/*
+* Maps the whole file read-only, e.g. for collection files which can be used as is (see ch_collection_open). The
+* pages are shared with any other process that maps the same file.
+*/
+ch_archive_result ch_map_file(const char* file_path, const void** data, size_t* len, size_t max_allowed_size);
+/*
+* Creates (or truncates) the file with the given size (which can't be 0) and maps it read-write, e.g. to decompress
+* into it with ch_archive_extract_to. The data is written to the file when it's unmapped with ch_unmap_file.
+*/
+ch_archive_result ch_map_new_file(const char* file_path, size_t size, void** data);
+void ch_unmap_file(const void* data, size_t len);
+
 static inline void ch_free_array(ch_byte_array* ba)
 {
     free(ba->arr);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum ch_field_type {
@@ -48,6 +49,8 @@ typedef enum ch_field_type {
 struct ch_type_description;
 
 size_t ch_field_type_byte_size(ch_field_type ft);
+// true if the field is restored as an array of char*
+bool ch_field_type_is_str(ch_field_type ft);
 const char* ch_field_type_string(ch_field_type ft);
 
 // This field is masked for global entity save/restore
@@ -154,53 +157,18 @@ typedef struct ch_custom_ops {
     ch_restore_custom restore_fn;
     void* user_data;
     const struct ch_dump_custom_fns* dump_fns;
+    const struct ch_cmp_custom_fns* cmp_fns;
+    const struct ch_store_custom_fns* store_fns;
+    const struct ch_ent_refs_custom_fns* refs_fns; // only for fields which can have EHANDLEs in them
 } ch_custom_ops;
 
-// when written to file, structures will be saved relative to some point in the file;
-// when loaded they'll be fixed up to just be the raw pointers
-#define CH_PACKED_PTR(ptr_type, name) \
-    union {                           \
-        ptr_type name;                \
-        size_t name##_rel_off;        \
-    }
-
-/*
-* The two main options I see are to treat 0 as "NULL" and add 1 to every offset or to
-* use SIZE_MAX as "NULL" and keep offsets as is. Counterintuitively to me, this has
-* less than a percent difference on the compressed size of the file. For DEFLATE, the
-* file size is ~350 bytes smaller when using 0, but for LZMA it's ~160 bytes bigger.
-* To make the file writing slightly easier to maintain, we'll keep it at SIZE_MAX.
-*/
-#define CH_REL_OFF_NULL SIZE_MAX
-
-// update whenever changes are made to ch_type_description or ch_datamap
-#define CH_DATAMAP_STRUCT_VERSION 5
-#define CH_COLLECTION_FILE_MAGIC "chicago"
-
-typedef struct ch_datamap_collection_header {
-    char magic[8];  // CH_COLLECTION_FILE_MAGIC
-    size_t version; // CH_DATAMAP_STRUCT_VERSION
-    size_t n_datamaps;
-    size_t n_linked_names;
-    // offsets from file start
-    CH_PACKED_PTR(const struct ch_datamap*, dms);
-    CH_PACKED_PTR(const struct ch_type_description*, tds);
-    CH_PACKED_PTR(const char*, strs);
-    CH_PACKED_PTR(const struct ch_linked_name*, lnks);
-} ch_datamap_collection_header;
-
-typedef struct ch_linked_name {
-    CH_PACKED_PTR(const char*, linked_name);
-    CH_PACKED_PTR(const struct ch_datamap*, dm);
-} ch_linked_name;
-
 // a slightly modified version of the game's datamap_t
 typedef struct ch_datamap {
-    CH_PACKED_PTR(const char*, class_name);
-    CH_PACKED_PTR(const struct ch_datamap*, base_map);
-    CH_PACKED_PTR(const struct ch_type_description*, fields);
+    const char* class_name;
+    const struct ch_datamap* base_map;
+    const struct ch_type_description* fields;
     size_t n_fields;
-    CH_PACKED_PTR(const char*, module_name);
+    const char* module_name;
     size_t ch_size;
 } ch_datamap;
 
@@ -209,11 +177,99 @@ typedef struct ch_type_description {
     ch_field_type type;
     unsigned short flags;
     unsigned short n_elems;
-    CH_PACKED_PTR(const char*, name);
-    CH_PACKED_PTR(const char*, external_name);
+    const char* name;
+    const char* external_name;
     size_t game_offset;
     size_t ch_offset;
     size_t total_size_bytes;
-    CH_PACKED_PTR(const struct ch_custom_ops*, save_restore_ops);
-    CH_PACKED_PTR(const struct ch_datamap*, embedded_map);
+    const struct ch_custom_ops* save_restore_ops;
+    const struct ch_datamap* embedded_map;
 } ch_type_description;
+
+/*
+* The collection file format. Everything is fixed width (the same file works for x86 & x64 builds) and there are no
+* pointers: strings are referenced by their offset in the string section, and datamaps & type descriptions by their
+* index in their sections. This means that the file is never modified after it's loaded, so it can be mapped
+* read-only and shared between processes. The ch_datamap & ch_type_description structs are created in memory when
+* each datamap is first looked up (see ch_collection_lookup).
+*
+* Datamaps are sorted so that the base & embedded maps of each datamap come before it.
+*
+* Names (class names & linked names) are looked up with a minimal perfect hash stored in the file: the name is
+* hashed into one of the buckets, and the bucket's displacement either points directly to a slot (if it has the
+* CH_DC_MPH_DIRECT bit) or is the seed of a second hash of the name which gives the slot. The slot has the name
+* (to reject names which aren't in the collection) and the datamap.
+*
+* Custom fields store which of chicago's ops they use as a ch_custom_op_id. The writer finds the game ops of the
+* example field of each id and gives that id to every field with the same game ops (e.g. all CBaseEntityOutput fields
+* get CH_OP_ENT_OUTPUT), so binding the ops when the collection is loaded is just filling a table.
+*/
+
+// update whenever changes are made to the ch_dc_* structs
+#define CH_DATAMAP_STRUCT_VERSION 7
+#define CH_COLLECTION_FILE_MAGIC "chicago"
+
+#define CH_DC_NULL UINT32_MAX
+#define CH_DC_MPH_DIRECT 0x80000000u
+#define CH_DC_MPH_SEED 0x63686963u
+// the average number of names per bucket is a tradeoff between the size of the table & the time to build it
+#define CH_DC_MPH_N_BUCKETS(n_names) ((n_names) / 4 + 1)
+
+// id, example module, class, field - the ids are stored in collection files so only append to this list
+#define CH_FOR_EACH_CUSTOM_OP(GEN)                                            \
+    GEN(CH_OP_THINK_FUNCS, "server.dll", "CBaseEntity", "m_aThinkFunctions") \
+    GEN(CH_OP_EHANDLE_VECTOR, "server.dll", "CSceneEntity", "m_hActorList")  \
+    GEN(CH_OP_ENT_OUTPUT, "server.dll", "CBaseEntity", "m_OnUser1")          \
+    GEN(CH_OP_VARIANT, "server.dll", "CBaseEntityOutput", "m_Value")         \
+    GEN(CH_OP_ACTIVITY, "server.dll", "CAI_BaseNPC", "m_IdealActivity")
+
+#define CH_GEN_CUSTOM_OP_ENUM(id, module, class, field) id,
+
+typedef enum ch_custom_op_id {
+    CH_FOR_EACH_CUSTOM_OP(CH_GEN_CUSTOM_OP_ENUM) CH_OP_COUNT,
+} ch_custom_op_id;
+
+typedef struct ch_dc_header {
+    char magic[8];      // CH_COLLECTION_FILE_MAGIC
+    uint32_t version;   // CH_DATAMAP_STRUCT_VERSION
+    uint32_t file_size; // including the header
+    uint32_t n_datamaps;
+    uint32_t n_tds;
+    uint32_t n_names; // class names & linked names
+    uint32_t n_mph_buckets;
+    uint32_t strs_size;
+    // offsets from file start, each section is 4 byte aligned
+    uint32_t dms_off;       // ch_dc_datamap[n_datamaps]
+    uint32_t tds_off;       // ch_dc_type_description[n_tds]
+    uint32_t mph_disps_off; // uint32_t[n_mph_buckets]
+    uint32_t mph_slots_off; // ch_dc_mph_slot[n_names]
+    uint32_t strs_off;      // null terminated strings, the section ends with a '\0'
+} ch_dc_header;
+
+typedef struct ch_dc_datamap {
+    uint32_t class_name; // offset in the string section
+    uint32_t module_name;
+    uint32_t base_map; // index of the datamap or CH_DC_NULL
+    uint32_t fields;   // index of the first type description
+    uint32_t n_fields;
+    uint32_t ch_size;
+} ch_dc_datamap;
+
+typedef struct ch_dc_type_description {
+    uint16_t type;
+    uint16_t flags;
+    uint16_t n_elems;
+    uint16_t _pad;
+    uint32_t name;          // offset in the string section
+    uint32_t external_name; // offset in the string section or CH_DC_NULL
+    uint32_t game_offset;
+    uint32_t ch_offset;
+    uint32_t total_size_bytes; // for embedded fields, the ch_size of one element
+    uint32_t save_restore_ops; // ch_custom_op_id or CH_DC_NULL (no ops or chicago doesn't support them)
+    uint32_t embedded_map;     // index of the datamap or CH_DC_NULL
+} ch_dc_type_description;
+
+typedef struct ch_dc_mph_slot {
+    uint32_t name; // offset in the string section
+    uint32_t dm;   // index of the datamap
+} ch_dc_mph_slot;
@@ -0,0 +1,301 @@
+#include "ch_collection_diff.h"
+#include "ch_save_internal.h"
+
+// the fields of the datamap in b with the same name, in order
+typedef struct ch_col_diff_name_entry {
+    const char* name;
+    uint32_t first; // the rest are in ch_col_diff_builder.next_b
+} ch_col_diff_name_entry;
+
+typedef struct ch_col_diff_builder {
+    ch_collection_diff* diff;
+    ch_col_diff_datamap* last_dm;
+    struct hashmap* fields_b; // ch_col_diff_name_entry, for the datamap being diffed
+} ch_col_diff_builder;
+
+const char* ch_col_diff_change_string(ch_col_diff_changes change)
+{
+    switch (change) {
+        case CH_COL_DIFF_MODULE:
+            return "module";
+        case CH_COL_DIFF_BASE:
+            return "base";
+        case CH_COL_DIFF_TYPE:
+            return "type";
+        case CH_COL_DIFF_FLAGS:
+            return "flags";
+        case CH_COL_DIFF_N_ELEMS:
+            return "n_elems";
+        case CH_COL_DIFF_OFFSET:
+            return "offset";
+        case CH_COL_DIFF_SIZE:
+            return "size";
+        case CH_COL_DIFF_EXTERNAL_NAME:
+            return "external_name";
+        case CH_COL_DIFF_CUSTOM_OPS:
+            return "custom_ops";
+        case CH_COL_DIFF_EMBEDDED:
+            return "embedded";
+        default:
+            return "unknown";
+    }
+}
+
+static int ch_col_diff_name_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    return strcmp(((const ch_col_diff_name_entry*)a)->name, ((const ch_col_diff_name_entry*)b)->name);
+}
+
+static uint64_t ch_col_diff_name_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const char* name = ((const ch_col_diff_name_entry*)item)->name;
+    return hashmap_xxhash3(name, strlen(name), seed0, seed1);
+}
+
+static bool ch_col_diff_str_equal(const char* a, const char* b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+static bool ch_col_diff_dm_names_equal(const ch_datamap* a, const ch_datamap* b)
+{
+    return ch_col_diff_str_equal(a ? a->class_name : NULL, b ? b->class_name : NULL);
+}
+
+static ch_col_diff_changes ch_col_diff_tds(const ch_type_description* a, const ch_type_description* b)
+{
+    ch_col_diff_changes changes = 0;
+    if (a->type != b->type)
+        changes |= CH_COL_DIFF_TYPE;
+    if (a->flags != b->flags)
+        changes |= CH_COL_DIFF_FLAGS;
+    if (a->n_elems != b->n_elems)
+        changes |= CH_COL_DIFF_N_ELEMS;
+    if (a->game_offset != b->game_offset)
+        changes |= CH_COL_DIFF_OFFSET;
+    // the size of embedded fields is chicago's size of the embedded class
+    if (a->type != FIELD_EMBEDDED && b->type != FIELD_EMBEDDED && a->total_size_bytes != b->total_size_bytes)
+        changes |= CH_COL_DIFF_SIZE;
+    if (!ch_col_diff_str_equal(a->external_name, b->external_name))
+        changes |= CH_COL_DIFF_EXTERNAL_NAME;
+    // the ops are the same static structs in both collections
+    if (a->save_restore_ops != b->save_restore_ops)
+        changes |= CH_COL_DIFF_CUSTOM_OPS;
+    if (!ch_col_diff_dm_names_equal(a->embedded_map, b->embedded_map))
+        changes |= CH_COL_DIFF_EMBEDDED;
+    return changes;
+}
+
+static ch_err ch_col_diff_new_dm(ch_col_diff_builder* builder,
+                                 ch_col_diff_kind kind,
+                                 const ch_datamap* dm_a,
+                                 const ch_datamap* dm_b,
+                                 ch_col_diff_datamap** dm_out)
+{
+    ch_col_diff_datamap* dm;
+    CH_CHECKED_ALLOC(dm, ch_arena_calloc(builder->diff->_arena, sizeof *dm));
+    dm->kind = kind;
+    dm->dm_a = dm_a;
+    dm->dm_b = dm_b;
+    *dm_out = dm;
+    return CH_ERR_NONE;
+}
+
+static void ch_col_diff_link_dm(ch_col_diff_builder* builder, ch_col_diff_datamap* dm)
+{
+    if (builder->last_dm)
+        builder->last_dm->next = dm;
+    else
+        builder->diff->datamaps = dm;
+    builder->last_dm = dm;
+    switch (dm->kind) {
+        case CH_COL_DIFF_ADDED:
+            builder->diff->n_added++;
+            break;
+        case CH_COL_DIFF_REMOVED:
+            builder->diff->n_removed++;
+            break;
+        case CH_COL_DIFF_CHANGED:
+            builder->diff->n_changed++;
+            break;
+    }
+}
+
+static ch_err ch_col_diff_append_field(ch_col_diff_builder* builder,
+                                       ch_col_diff_datamap* dm,
+                                       ch_col_diff_field** last_field,
+                                       ch_col_diff_kind kind,
+                                       ch_col_diff_changes changes,
+                                       const ch_type_description* td_a,
+                                       const ch_type_description* td_b)
+{
+    ch_col_diff_field* field;
+    CH_CHECKED_ALLOC(field, ch_arena_alloc(builder->diff->_arena, sizeof *field));
+    *field = (ch_col_diff_field){
+        .kind = kind,
+        .changes = changes,
+        .td_a = td_a,
+        .td_b = td_b,
+    };
+    if (*last_field)
+        (*last_field)->next = field;
+    else
+        dm->fields = field;
+    *last_field = field;
+    dm->n_fields++;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_col_diff_fields(ch_col_diff_builder* builder, ch_col_diff_datamap* dm)
+{
+    const ch_datamap* dm_a = dm->dm_a;
+    const ch_datamap* dm_b = dm->dm_b;
+    uint32_t* next_b;
+    bool* used_b;
+    CH_CHECKED_ALLOC(next_b, ch_arena_alloc(builder->diff->_arena, sizeof(uint32_t) * (dm_b->n_fields + 1)));
+    CH_CHECKED_ALLOC(used_b, ch_arena_calloc(builder->diff->_arena, sizeof(bool) * (dm_b->n_fields + 1)));
+
+    // build side: the fields of b, inserted backwards so that each chain is in field order
+    hashmap_clear(builder->fields_b, false);
+    for (size_t i = dm_b->n_fields; i-- > 0;) {
+        ch_col_diff_name_entry entry = {.name = dm_b->fields[i].name, .first = (uint32_t)i};
+        const ch_col_diff_name_entry* existing = hashmap_get(builder->fields_b, &entry);
+        next_b[i] = existing ? existing->first : UINT32_MAX;
+        hashmap_set(builder->fields_b, &entry);
+        if (hashmap_oom(builder->fields_b))
+            return CH_ERR_OUT_OF_MEMORY;
+    }
+
+    // probe side: the fields of a
+    ch_col_diff_field* last_field = NULL;
+    for (size_t i = 0; i < dm_a->n_fields; i++) {
+        const ch_type_description* td_a = &dm_a->fields[i];
+        ch_col_diff_name_entry entry_lookup = {.name = td_a->name};
+        const ch_col_diff_name_entry* entry = hashmap_get(builder->fields_b, &entry_lookup);
+        uint32_t j = entry ? entry->first : UINT32_MAX;
+        while (j != UINT32_MAX && used_b[j])
+            j = next_b[j];
+        if (j == UINT32_MAX) {
+            CH_RET_IF_ERR(
+                ch_col_diff_append_field(builder, dm, &last_field, CH_COL_DIFF_REMOVED, 0, td_a, NULL));
+            continue;
+        }
+        used_b[j] = true;
+        ch_col_diff_changes changes = ch_col_diff_tds(td_a, &dm_b->fields[j]);
+        if (changes)
+            CH_RET_IF_ERR(ch_col_diff_append_field(builder,
+                                                   dm,
+                                                   &last_field,
+                                                   CH_COL_DIFF_CHANGED,
+                                                   changes,
+                                                   td_a,
+                                                   &dm_b->fields[j]));
+    }
+    for (size_t j = 0; j < dm_b->n_fields; j++)
+        if (!used_b[j])
+            CH_RET_IF_ERR(
+                ch_col_diff_append_field(builder, dm, &last_field, CH_COL_DIFF_ADDED, 0, NULL, &dm_b->fields[j]));
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_col_diff_dm_pair(ch_col_diff_builder* builder, const ch_datamap* dm_a, const ch_datamap* dm_b)
+{
+    ch_col_diff_datamap* dm;
+    CH_RET_IF_ERR(ch_col_diff_new_dm(builder, CH_COL_DIFF_CHANGED, dm_a, dm_b, &dm));
+    if (!ch_col_diff_str_equal(dm_a->module_name, dm_b->module_name))
+        dm->changes |= CH_COL_DIFF_MODULE;
+    if (!ch_col_diff_dm_names_equal(dm_a->base_map, dm_b->base_map))
+        dm->changes |= CH_COL_DIFF_BASE;
+    CH_RET_IF_ERR(ch_col_diff_fields(builder, dm));
+    if (dm->changes || dm->n_fields > 0)
+        ch_col_diff_link_dm(builder, dm);
+    else
+        builder->diff->n_unchanged++;
+    return CH_ERR_NONE;
+}
+
+// the datamap called name, linked names don't count
+static ch_err ch_col_diff_find_dm(const ch_datamap_collection* collection, const char* name, const ch_datamap** dm)
+{
+    *dm = NULL;
+    uint32_t idx = ch_collection_find(collection, name);
+    if (idx == CH_DC_NULL)
+        return CH_ERR_NONE;
+    const ch_datamap* found;
+    CH_RET_IF_ERR(ch_collection_get(collection, idx, &found));
+    if (!strcmp(found->class_name, name))
+        *dm = found;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_diff_collections_impl(ch_col_diff_builder* builder)
+{
+    const ch_datamap_collection* a = builder->diff->a;
+    const ch_datamap_collection* b = builder->diff->b;
+    ch_col_diff_datamap* dm;
+    for (uint32_t i = 0; i < a->header->n_datamaps; i++) {
+        const ch_datamap *dm_a, *dm_b;
+        CH_RET_IF_ERR(ch_collection_get(a, i, &dm_a));
+        CH_RET_IF_ERR(ch_col_diff_find_dm(b, dm_a->class_name, &dm_b));
+        if (dm_b) {
+            CH_RET_IF_ERR(ch_col_diff_dm_pair(builder, dm_a, dm_b));
+        } else {
+            CH_RET_IF_ERR(ch_col_diff_new_dm(builder, CH_COL_DIFF_REMOVED, dm_a, NULL, &dm));
+            ch_col_diff_link_dm(builder, dm);
+        }
+    }
+    for (uint32_t i = 0; i < b->header->n_datamaps; i++) {
+        const ch_datamap *dm_a, *dm_b;
+        CH_RET_IF_ERR(ch_collection_get(b, i, &dm_b));
+        CH_RET_IF_ERR(ch_col_diff_find_dm(a, dm_b->class_name, &dm_a));
+        if (dm_a)
+            continue;
+        CH_RET_IF_ERR(ch_col_diff_new_dm(builder, CH_COL_DIFF_ADDED, NULL, dm_b, &dm));
+        ch_col_diff_link_dm(builder, dm);
+    }
+    return CH_ERR_NONE;
+}
+
+ch_err ch_diff_collections(const ch_datamap_collection* a, const ch_datamap_collection* b, ch_collection_diff** diff)
+{
+    assert(a && b && diff);
+    *diff = NULL;
+    ch_arena* arena = ch_arena_new(1024 * 64);
+    if (!arena)
+        return CH_ERR_OUT_OF_MEMORY;
+    ch_collection_diff* new_diff = ch_arena_calloc(arena, sizeof *new_diff);
+    struct hashmap* fields_b = hashmap_new(sizeof(ch_col_diff_name_entry),
+                                           256,
+                                           0,
+                                           0,
+                                           ch_col_diff_name_hash,
+                                           ch_col_diff_name_compare,
+                                           NULL,
+                                           NULL);
+    if (!new_diff || !fields_b) {
+        if (fields_b)
+            hashmap_free(fields_b);
+        ch_arena_free(arena);
+        return CH_ERR_OUT_OF_MEMORY;
+    }
+    new_diff->a = a;
+    new_diff->b = b;
+    new_diff->_arena = arena;
+
+    ch_col_diff_builder builder = {.diff = new_diff, .fields_b = fields_b};
+    ch_err err = ch_diff_collections_impl(&builder);
+    hashmap_free(fields_b);
+    if (err) {
+        ch_arena_free(arena);
+        return err;
+    }
+    *diff = new_diff;
+    return CH_ERR_NONE;
+}
+
+void ch_collection_diff_free(ch_collection_diff* diff)
+{
+    if (diff)
+        ch_arena_free(diff->_arena);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "ch_save.h"
+
+/*
+* Structural diff of two collections, e.g. of two versions of the same game. Datamaps are matched by class name with
+* the perfect hash of the other collection, and fields of matched datamaps are matched by name with a hash join (the
+* game's datamaps have duplicate field names, those are matched in the order they appear in).
+*
+* Offsets are compared with the game offsets, chicago's own offsets depend on the layout options the collections
+* were written with. For the same reason the size of embedded fields isn't compared, the embedded class is compared
+* by name instead (and a change in it is reported on its own datamap). Custom fields compare their chicago ops.
+*
+* The diff points into both collections, so they must outlive it.
+*/
+
+typedef enum ch_col_diff_kind {
+    CH_COL_DIFF_ADDED,   // only in b
+    CH_COL_DIFF_REMOVED, // only in a
+    CH_COL_DIFF_CHANGED,
+} ch_col_diff_kind;
+
+// what changed for a datamap/field that's in both collections
+typedef enum ch_col_diff_changes {
+    CH_COL_DIFF_MODULE = 1 << 0, // datamap
+    CH_COL_DIFF_BASE = 1 << 1,   // datamap
+    CH_COL_DIFF_TYPE = 1 << 2,
+    CH_COL_DIFF_FLAGS = 1 << 3,
+    CH_COL_DIFF_N_ELEMS = 1 << 4,
+    CH_COL_DIFF_OFFSET = 1 << 5,
+    CH_COL_DIFF_SIZE = 1 << 6,
+    CH_COL_DIFF_EXTERNAL_NAME = 1 << 7,
+    CH_COL_DIFF_CUSTOM_OPS = 1 << 8,
+    CH_COL_DIFF_EMBEDDED = 1 << 9,
+} ch_col_diff_changes;
+
+#define CH_COL_DIFF_N_CHANGES 10
+
+// the name of a single ch_col_diff_changes bit, e.g. "offset"
+const char* ch_col_diff_change_string(ch_col_diff_changes change);
+
+typedef struct ch_col_diff_field {
+    ch_col_diff_kind kind;
+    ch_col_diff_changes changes; // only for changed fields
+    const ch_type_description *td_a, *td_b; // NULL for added/removed fields respectively
+    struct ch_col_diff_field* next;
+} ch_col_diff_field;
+
+typedef struct ch_col_diff_datamap {
+    ch_col_diff_kind kind;
+    ch_col_diff_changes changes;
+    const ch_datamap *dm_a, *dm_b; // NULL for added/removed datamaps respectively
+    ch_col_diff_field* fields;     // only for changed datamaps, sorted by the order in a (then in b)
+    size_t n_fields;
+    struct ch_col_diff_datamap* next;
+} ch_col_diff_datamap;
+
+typedef struct ch_collection_diff {
+    const ch_datamap_collection *a, *b;
+    ch_col_diff_datamap* datamaps; // sorted by the order in a (then in b)
+    size_t n_added, n_removed, n_changed, n_unchanged;
+
+    struct ch_arena* _arena;
+} ch_collection_diff;
+
+ch_err ch_diff_collections(const ch_datamap_collection* a, const ch_datamap_collection* b, ch_collection_diff** diff);
+void ch_collection_diff_free(ch_collection_diff* diff);
+
+ch_err ch_dump_collection_diff_to_text(FILE* f, const ch_collection_diff* diff, const char* indent_str);
+// machine readable version, see ch_dump_collection_diff.c for the format
+ch_err ch_dump_collection_diff_to_msgpack(FILE* f, const ch_collection_diff* diff);
@@ -0,0 +1,253 @@
+#include "ch_compare.h"
+
+// a chunk of a restored class
+typedef struct ch_cmp_segment {
+    size_t offset;
+    size_t size;
+    const ch_type_description* td; // a string or custom field, otherwise the chunk is compared as raw bytes
+} ch_cmp_segment;
+
+typedef struct ch_cmp_plan {
+    const ch_datamap* dm;
+    const ch_flat_field* fields;
+    size_t n_fields;
+    const ch_cmp_segment* segments;
+    size_t n_segments;
+} ch_cmp_plan;
+
+struct ch_cmp_ctx {
+    ch_arena* arena;
+    struct hashmap* plans; // ch_cmp_plan
+};
+
+// hashed in place of a NULL pointer so that NULL and "" hash differently
+static const unsigned char ch_cmp_null_marker = 0xFF;
+
+static int ch_cmp_plan_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_cmp_plan* pa = a;
+    const ch_cmp_plan* pb = b;
+    return pa->dm < pb->dm ? -1 : pa->dm > pb->dm;
+}
+
+static uint64_t ch_cmp_plan_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_cmp_plan* p = item;
+    return hashmap_xxhash3(&p->dm, sizeof p->dm, seed0, seed1);
+}
+
+ch_cmp_ctx* ch_cmp_ctx_new(void)
+{
+    ch_arena* arena = ch_arena_new(1024 * 64);
+    if (!arena)
+        return NULL;
+    ch_cmp_ctx* ctx = ch_arena_calloc(arena, sizeof *ctx);
+    if (ctx) {
+        ctx->arena = arena;
+        ctx->plans = hashmap_new(sizeof(ch_cmp_plan), 256, 0, 0, ch_cmp_plan_hash, ch_cmp_plan_compare, NULL, NULL);
+    }
+    if (!ctx || !ctx->plans) {
+        ch_arena_free(arena);
+        return NULL;
+    }
+    return ctx;
+}
+
+void ch_cmp_ctx_free(ch_cmp_ctx* ctx)
+{
+    if (!ctx)
+        return;
+    hashmap_free(ctx->plans);
+    ch_arena_free(ctx->arena);
+}
+
+static size_t ch_cmp_ptr_field_size(const ch_type_description* td)
+{
+    return td->type == FIELD_CUSTOM ? sizeof(void*) : sizeof(char*) * td->n_elems;
+}
+
+static int ch_cmp_flat_field_offset_compare(const void* a, const void* b)
+{
+    const ch_flat_field* fa = *(const ch_flat_field* const*)a;
+    const ch_flat_field* fb = *(const ch_flat_field* const*)b;
+    return fa->offset < fb->offset ? -1 : fa->offset > fb->offset;
+}
+
+static ch_err ch_cmp_get_plan(ch_cmp_ctx* ctx, const ch_datamap* dm, const ch_cmp_plan** plan_out)
+{
+    ch_cmp_plan plan = {.dm = dm};
+    const ch_cmp_plan* existing = hashmap_get(ctx->plans, &plan);
+    if (existing) {
+        *plan_out = existing;
+        return CH_ERR_NONE;
+    }
+
+    ch_flat_field* fields;
+    // every element of embedded arrays is needed, otherwise the pointers in the later elements would be hashed
+    ch_flatten_flags flags = CH_FLATTEN_INCLUDE_CUSTOM | CH_FLATTEN_ALL_EMBEDDED_ELEMS;
+    CH_RET_IF_ERR(ch_flatten_fields(ctx->arena, dm, flags, &fields, &plan.n_fields));
+    plan.fields = fields;
+
+    // pointer fields split up the class into raw chunks
+    size_t n_ptr_fields = 0;
+    for (const ch_flat_field* f = fields; f; f = f->next)
+        if (f->td->type == FIELD_CUSTOM || ch_field_type_is_str(f->td->type))
+            n_ptr_fields++;
+
+    const ch_flat_field** ptr_fields;
+    CH_CHECKED_ALLOC(ptr_fields, ch_arena_alloc(ctx->arena, sizeof(ch_flat_field*) * n_ptr_fields));
+    n_ptr_fields = 0;
+    for (const ch_flat_field* f = fields; f; f = f->next)
+        if (f->td->type == FIELD_CUSTOM || ch_field_type_is_str(f->td->type))
+            ptr_fields[n_ptr_fields++] = f;
+    qsort(ptr_fields, n_ptr_fields, sizeof *ptr_fields, ch_cmp_flat_field_offset_compare);
+
+    ch_cmp_segment* segments;
+    CH_CHECKED_ALLOC(segments, ch_arena_alloc(ctx->arena, sizeof(ch_cmp_segment) * (2 * n_ptr_fields + 1)));
+    size_t cur = 0;
+    for (size_t i = 0; i < n_ptr_fields; i++) {
+        const ch_flat_field* f = ptr_fields[i];
+        // the game's datamaps sometimes have the same field twice
+        if (f->offset < cur)
+            continue;
+        if (f->offset > cur)
+            segments[plan.n_segments++] = (ch_cmp_segment){.offset = cur, .size = f->offset - cur};
+        segments[plan.n_segments++] = (ch_cmp_segment){
+            .offset = f->offset,
+            .size = ch_cmp_ptr_field_size(f->td),
+            .td = f->td,
+        };
+        cur = f->offset + ch_cmp_ptr_field_size(f->td);
+    }
+    if (cur < dm->ch_size)
+        segments[plan.n_segments++] = (ch_cmp_segment){.offset = cur, .size = dm->ch_size - cur};
+    plan.segments = segments;
+
+    if (!hashmap_set(ctx->plans, &plan) && hashmap_oom(ctx->plans))
+        return CH_ERR_OUT_OF_MEMORY;
+    *plan_out = hashmap_get(ctx->plans, &plan);
+    return CH_ERR_NONE;
+}
+
+ch_err ch_cmp_get_flat_fields(ch_cmp_ctx* ctx, const ch_datamap* dm, const ch_flat_field** fields, size_t* n_fields)
+{
+    const ch_cmp_plan* plan;
+    CH_RET_IF_ERR(ch_cmp_get_plan(ctx, dm, &plan));
+    *fields = plan->fields;
+    *n_fields = plan->n_fields;
+    return CH_ERR_NONE;
+}
+
+void ch_cmp_hash_str(const char* str, uint64_t* hash)
+{
+    if (str)
+        *hash = hashmap_xxhash3(str, strlen(str), *hash, 0);
+    else
+        *hash = hashmap_xxhash3(&ch_cmp_null_marker, 1, *hash, 0);
+}
+
+bool ch_cmp_str_equal(const char* a, const char* b)
+{
+    if (!a || !b)
+        return a == b;
+    return !strcmp(a, b);
+}
+
+void ch_cmp_hash_simple_val(ch_field_type ft, size_t n_elems, size_t total_size_bytes, const void* val, uint64_t* hash)
+{
+    if (ch_field_type_is_str(ft)) {
+        for (size_t i = 0; i < n_elems; i++)
+            ch_cmp_hash_str(((const char* const*)val)[i], hash);
+    } else {
+        *hash = hashmap_xxhash3(val, total_size_bytes, *hash, 0);
+    }
+}
+
+bool ch_cmp_simple_val_equal(ch_field_type ft, size_t n_elems, size_t total_size_bytes, const void* a, const void* b)
+{
+    if (ch_field_type_is_str(ft)) {
+        for (size_t i = 0; i < n_elems; i++)
+            if (!ch_cmp_str_equal(((const char* const*)a)[i], ((const char* const*)b)[i]))
+                return false;
+        return true;
+    }
+    return !memcmp(a, b, total_size_bytes);
+}
+
+static const ch_cmp_custom_fns* ch_cmp_get_custom_fns(const ch_type_description* td)
+{
+    return td->save_restore_ops ? td->save_restore_ops->cmp_fns : NULL;
+}
+
+ch_err ch_cmp_hash_field(ch_cmp_ctx* ctx, const ch_type_description* td, const unsigned char* data, uint64_t* hash)
+{
+    assert(td->type != FIELD_EMBEDDED);
+    if (td->type != FIELD_CUSTOM) {
+        ch_cmp_hash_simple_val(td->type, td->n_elems, td->total_size_bytes, data, hash);
+        return CH_ERR_NONE;
+    }
+    const void* custom = *(const void* const*)data;
+    const ch_cmp_custom_fns* fns = ch_cmp_get_custom_fns(td);
+    if (!custom) {
+        *hash = hashmap_xxhash3(&ch_cmp_null_marker, 1, *hash, 0);
+        return CH_ERR_NONE;
+    }
+    // custom fields that can't be compared are treated as always equal
+    return fns ? fns->hash(ctx, td, custom, hash) : CH_ERR_NONE;
+}
+
+ch_err ch_cmp_field_equal(ch_cmp_ctx* ctx,
+                          const ch_type_description* td,
+                          const unsigned char* a,
+                          const unsigned char* b,
+                          bool* equal)
+{
+    assert(td->type != FIELD_EMBEDDED);
+    if (td->type != FIELD_CUSTOM) {
+        *equal = ch_cmp_simple_val_equal(td->type, td->n_elems, td->total_size_bytes, a, b);
+        return CH_ERR_NONE;
+    }
+    const void* custom_a = *(const void* const*)a;
+    const void* custom_b = *(const void* const*)b;
+    const ch_cmp_custom_fns* fns = ch_cmp_get_custom_fns(td);
+    if (!custom_a || !custom_b) {
+        *equal = custom_a == custom_b;
+        return CH_ERR_NONE;
+    }
+    *equal = true;
+    return fns ? fns->equal(ctx, td, custom_a, custom_b, equal) : CH_ERR_NONE;
+}
+
+ch_err ch_cmp_hash_class(ch_cmp_ctx* ctx, const ch_datamap* dm, const unsigned char* data, uint64_t* hash)
+{
+    const ch_cmp_plan* plan;
+    CH_RET_IF_ERR(ch_cmp_get_plan(ctx, dm, &plan));
+    for (size_t i = 0; i < plan->n_segments; i++) {
+        const ch_cmp_segment* seg = &plan->segments[i];
+        if (seg->td)
+            CH_RET_IF_ERR(ch_cmp_hash_field(ctx, seg->td, data + seg->offset, hash));
+        else
+            *hash = hashmap_xxhash3(data + seg->offset, seg->size, *hash, 0);
+    }
+    return CH_ERR_NONE;
+}
+
+ch_err ch_cmp_class_equal(ch_cmp_ctx* ctx,
+                          const ch_datamap* dm,
+                          const unsigned char* a,
+                          const unsigned char* b,
+                          bool* equal)
+{
+    const ch_cmp_plan* plan;
+    CH_RET_IF_ERR(ch_cmp_get_plan(ctx, dm, &plan));
+    *equal = true;
+    for (size_t i = 0; i < plan->n_segments && *equal; i++) {
+        const ch_cmp_segment* seg = &plan->segments[i];
+        if (seg->td)
+            CH_RET_IF_ERR(ch_cmp_field_equal(ctx, seg->td, a + seg->offset, b + seg->offset, equal));
+        else
+            *equal = !memcmp(a + seg->offset, b + seg->offset, seg->size);
+    }
+    return CH_ERR_NONE;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ch_save_internal.h"
+
+/*
+* Hashing & comparison of restored data. Restored classes can't just be memcmp'd between saves since strings and
+* custom fields are pointers into each save's arena, so those are followed and hashed/compared by value. All other
+* bytes of a class (including padding, which is always zero) are hashed/compared as big raw chunks. The layout of
+* each datamap is only worked out once and is cached in the ctx, so reuse the ctx when comparing many classes.
+*
+* Classes with different datamaps are never equal, even if the datamaps have the same name.
+*/
+
+typedef struct ch_cmp_ctx ch_cmp_ctx;
+
+// the hash functions use the value in *hash as a seed and update it
+typedef struct ch_cmp_custom_fns {
+    ch_err (*hash)(ch_cmp_ctx* ctx, const ch_type_description* td, const void* restored_field, uint64_t* hash);
+    ch_err (*equal)(ch_cmp_ctx* ctx, const ch_type_description* td, const void* a, const void* b, bool* equal);
+} ch_cmp_custom_fns;
+
+extern const ch_cmp_custom_fns g_cmp_cr_utl_vec_fns, g_cmp_cr_ent_output_fns, g_cmp_cr_variant_fns,
+    g_cmp_cr_activity_fns;
+
+ch_cmp_ctx* ch_cmp_ctx_new(void);
+void ch_cmp_ctx_free(ch_cmp_ctx* ctx);
+
+// all fields of the datamap (including custom fields & all embedded array elements), cached in the ctx
+ch_err ch_cmp_get_flat_fields(ch_cmp_ctx* ctx, const ch_datamap* dm, const ch_flat_field** fields, size_t* n_fields);
+
+ch_err ch_cmp_hash_class(ch_cmp_ctx* ctx, const ch_datamap* dm, const unsigned char* data, uint64_t* hash);
+ch_err ch_cmp_class_equal(ch_cmp_ctx* ctx,
+                          const ch_datamap* dm,
+                          const unsigned char* a,
+                          const unsigned char* b,
+                          bool* equal);
+
+// a single (non-embedded) field, a & b must have the same type description
+ch_err ch_cmp_hash_field(ch_cmp_ctx* ctx, const ch_type_description* td, const unsigned char* data, uint64_t* hash);
+ch_err ch_cmp_field_equal(ch_cmp_ctx* ctx,
+                          const ch_type_description* td,
+                          const unsigned char* a,
+                          const unsigned char* b,
+                          bool* equal);
+
+// values of a simple field type (not embedded or custom) e.g. the elements of a CUtlVector
+void ch_cmp_hash_simple_val(ch_field_type ft, size_t n_elems, size_t total_size_bytes, const void* val, uint64_t* hash);
+bool ch_cmp_simple_val_equal(ch_field_type ft, size_t n_elems, size_t total_size_bytes, const void* a, const void* b);
+
+void ch_cmp_hash_str(const char* str, uint64_t* hash);
+bool ch_cmp_str_equal(const char* a, const char* b);
@@ -0,0 +1,167 @@
+#include "ch_compare.h"
+#include "custom_restore/ch_utl_vector.h"
+#include "custom_restore/ch_ent_output.h"
+#include "custom_restore/ch_variant.h"
+#include "custom_restore/ch_activity.h"
+
+static ch_err ch_cmp_utl_vec_hash(ch_cmp_ctx* ctx,
+                                  const ch_type_description* td,
+                                  const void* vec_data,
+                                  uint64_t* hash)
+{
+    const ch_cr_utl_vector* vec = vec_data;
+    (void)td;
+    *hash = hashmap_xxhash3(&vec->n_elems, sizeof vec->n_elems, *hash, 0);
+    if (vec->embedded_map) {
+        for (size_t i = 0; i < vec->n_elems; i++)
+            CH_RET_IF_ERR(ch_cmp_hash_class(ctx, vec->embedded_map, CH_UTL_VEC_ELEM_PTR(*vec, i), hash));
+    } else {
+        ch_cmp_hash_simple_val(vec->field_type, vec->n_elems, vec->elem_size * vec->n_elems, vec->elems, hash);
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_cmp_utl_vec_equal(ch_cmp_ctx* ctx,
+                                   const ch_type_description* td,
+                                   const void* a_data,
+                                   const void* b_data,
+                                   bool* equal)
+{
+    const ch_cr_utl_vector* a = a_data;
+    const ch_cr_utl_vector* b = b_data;
+    (void)td;
+    *equal = a->n_elems == b->n_elems && a->embedded_map == b->embedded_map && a->field_type == b->field_type &&
+             a->elem_size == b->elem_size;
+    if (!*equal)
+        return CH_ERR_NONE;
+    if (a->embedded_map) {
+        for (size_t i = 0; i < a->n_elems && *equal; i++)
+            CH_RET_IF_ERR(ch_cmp_class_equal(ctx,
+                                             a->embedded_map,
+                                             CH_UTL_VEC_ELEM_PTR(*a, i),
+                                             CH_UTL_VEC_ELEM_PTR(*b, i),
+                                             equal));
+    } else {
+        *equal = ch_cmp_simple_val_equal(a->field_type, a->n_elems, a->elem_size * a->n_elems, a->elems, b->elems);
+    }
+    return CH_ERR_NONE;
+}
+
+const ch_cmp_custom_fns g_cmp_cr_utl_vec_fns = {
+    .hash = ch_cmp_utl_vec_hash,
+    .equal = ch_cmp_utl_vec_equal,
+};
+
+static ch_err ch_cmp_ent_output_hash(ch_cmp_ctx* ctx,
+                                     const ch_type_description* td,
+                                     const void* output_data,
+                                     uint64_t* hash)
+{
+    const ch_cr_ent_output* output = output_data;
+    (void)td;
+    CH_RET_IF_ERR(ch_cmp_hash_class(ctx, output->ent_output_val.dm, output->ent_output_val.data, hash));
+    *hash = hashmap_xxhash3(&output->actions.n_elems, sizeof output->actions.n_elems, *hash, 0);
+    for (size_t i = 0; i < output->actions.n_elems; i++)
+        CH_RET_IF_ERR(ch_cmp_hash_class(ctx, output->actions.dm, CH_RCA_ELEM_DATA(output->actions, i), hash));
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_cmp_ent_output_equal(ch_cmp_ctx* ctx,
+                                      const ch_type_description* td,
+                                      const void* a_data,
+                                      const void* b_data,
+                                      bool* equal)
+{
+    const ch_cr_ent_output* a = a_data;
+    const ch_cr_ent_output* b = b_data;
+    (void)td;
+    *equal = a->ent_output_val.dm == b->ent_output_val.dm && a->actions.dm == b->actions.dm &&
+             a->actions.n_elems == b->actions.n_elems;
+    if (*equal)
+        CH_RET_IF_ERR(
+            ch_cmp_class_equal(ctx, a->ent_output_val.dm, a->ent_output_val.data, b->ent_output_val.data, equal));
+    for (size_t i = 0; i < a->actions.n_elems && *equal; i++)
+        CH_RET_IF_ERR(ch_cmp_class_equal(ctx,
+                                         a->actions.dm,
+                                         CH_RCA_ELEM_DATA(a->actions, i),
+                                         CH_RCA_ELEM_DATA(b->actions, i),
+                                         equal));
+    return CH_ERR_NONE;
+}
+
+const ch_cmp_custom_fns g_cmp_cr_ent_output_fns = {
+    .hash = ch_cmp_ent_output_hash,
+    .equal = ch_cmp_ent_output_equal,
+};
+
+static ch_err ch_cmp_variant_hash(ch_cmp_ctx* ctx,
+                                  const ch_type_description* td,
+                                  const void* var_data,
+                                  uint64_t* hash)
+{
+    const ch_cr_variant* var = var_data;
+    (void)ctx;
+    (void)td;
+    *hash = hashmap_xxhash3(&var->ft, sizeof var->ft, *hash, 0);
+    if (var->ft == FIELD_STRING)
+        ch_cmp_hash_str(var->val_str, hash);
+    else
+        *hash = hashmap_xxhash3(&var->val_bool, ch_cr_variant_val_size(var->ft), *hash, 0);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_cmp_variant_equal(ch_cmp_ctx* ctx,
+                                   const ch_type_description* td,
+                                   const void* a_data,
+                                   const void* b_data,
+                                   bool* equal)
+{
+    const ch_cr_variant* a = a_data;
+    const ch_cr_variant* b = b_data;
+    (void)ctx;
+    (void)td;
+    if (a->ft != b->ft)
+        *equal = false;
+    else if (a->ft == FIELD_STRING)
+        *equal = ch_cmp_str_equal(a->val_str, b->val_str);
+    else
+        *equal = !memcmp(&a->val_bool, &b->val_bool, ch_cr_variant_val_size(a->ft));
+    return CH_ERR_NONE;
+}
+
+const ch_cmp_custom_fns g_cmp_cr_variant_fns = {
+    .hash = ch_cmp_variant_hash,
+    .equal = ch_cmp_variant_equal,
+};
+
+static ch_err ch_cmp_activity_hash(ch_cmp_ctx* ctx,
+                                   const ch_type_description* td,
+                                   const void* act_data,
+                                   uint64_t* hash)
+{
+    const ch_cr_activity* act = act_data;
+    (void)ctx;
+    (void)td;
+    *hash = hashmap_xxhash3(&act->index, sizeof act->index, *hash, 0);
+    ch_cmp_hash_str(act->name, hash);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_cmp_activity_equal(ch_cmp_ctx* ctx,
+                                    const ch_type_description* td,
+                                    const void* a_data,
+                                    const void* b_data,
+                                    bool* equal)
+{
+    const ch_cr_activity* a = a_data;
+    const ch_cr_activity* b = b_data;
+    (void)ctx;
+    (void)td;
+    *equal = a->index == b->index && ch_cmp_str_equal(a->name, b->name);
+    return CH_ERR_NONE;
+}
+
+const ch_cmp_custom_fns g_cmp_cr_activity_fns = {
+    .hash = ch_cmp_activity_hash,
+    .equal = ch_cmp_activity_equal,
+};
@@ -0,0 +1,313 @@
+#include "ch_diff.h"
+#include "ch_compare.h"
+
+typedef struct ch_diff_builder {
+    ch_save_diff* diff;
+    ch_cmp_ctx* cmp;
+    ch_diff_entity* last_ent;
+} ch_diff_builder;
+
+static ch_err ch_diff_new_entity(ch_diff_builder* builder,
+                                 ch_diff_ent_kind kind,
+                                 const char* sf_name,
+                                 size_t ent_idx,
+                                 const ch_restored_entity* ent_a,
+                                 const ch_restored_entity* ent_b,
+                                 ch_diff_entity** ent_out)
+{
+    ch_diff_entity* ent;
+    CH_CHECKED_ALLOC(ent, ch_arena_calloc(builder->diff->_arena, sizeof *ent));
+    ent->kind = kind;
+    ent->sf_name = sf_name;
+    ent->ent_idx = ent_idx;
+    ent->ent_a = ent_a;
+    ent->ent_b = ent_b;
+    *ent_out = ent;
+    return CH_ERR_NONE;
+}
+
+static void ch_diff_link_entity(ch_diff_builder* builder, ch_diff_entity* ent)
+{
+    if (builder->last_ent)
+        builder->last_ent->next = ent;
+    else
+        builder->diff->entities = ent;
+    builder->last_ent = ent;
+    switch (ent->kind) {
+        case CH_DIFF_ENT_ADDED:
+            builder->diff->n_added++;
+            break;
+        case CH_DIFF_ENT_REMOVED:
+            builder->diff->n_removed++;
+            break;
+        case CH_DIFF_ENT_CHANGED:
+            builder->diff->n_changed++;
+            break;
+    }
+}
+
+static ch_err ch_diff_append_entity(ch_diff_builder* builder,
+                                    ch_diff_ent_kind kind,
+                                    const char* sf_name,
+                                    size_t ent_idx,
+                                    const ch_restored_entity* ent_a,
+                                    const ch_restored_entity* ent_b)
+{
+    ch_diff_entity* ent;
+    CH_RET_IF_ERR(ch_diff_new_entity(builder, kind, sf_name, ent_idx, ent_a, ent_b, &ent));
+    ch_diff_link_entity(builder, ent);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_diff_append_field(ch_diff_builder* builder,
+                                   ch_diff_entity* ent,
+                                   ch_diff_field** last_field,
+                                   const char* name,
+                                   const ch_type_description* td_a,
+                                   const unsigned char* data_a,
+                                   const ch_type_description* td_b,
+                                   const unsigned char* data_b)
+{
+    ch_diff_field* field;
+    CH_CHECKED_ALLOC(field, ch_arena_alloc(builder->diff->_arena, sizeof *field));
+    *field = (ch_diff_field){
+        .name = name,
+        .td_a = td_a,
+        .td_b = td_b,
+        .data_a = data_a,
+        .data_b = data_b,
+    };
+    if (*last_field)
+        (*last_field)->next = field;
+    else
+        ent->fields = field;
+    *last_field = field;
+    ent->n_fields++;
+    return CH_ERR_NONE;
+}
+
+static bool ch_diff_tds_compatible(const ch_type_description* a, const ch_type_description* b)
+{
+    if (a->type != b->type || a->n_elems != b->n_elems || a->total_size_bytes != b->total_size_bytes)
+        return false;
+    // custom fields can only be compared if they were restored the same way
+    return a->type != FIELD_CUSTOM || a->save_restore_ops == b->save_restore_ops;
+}
+
+static ch_err ch_diff_fields_same_dm(ch_diff_builder* builder,
+                                     ch_diff_entity* ent,
+                                     const ch_datamap* dm,
+                                     const unsigned char* data_a,
+                                     const unsigned char* data_b)
+{
+    const ch_flat_field* fields;
+    size_t n_fields;
+    CH_RET_IF_ERR(ch_cmp_get_flat_fields(builder->cmp, dm, &fields, &n_fields));
+    ch_diff_field* last_field = NULL;
+    for (const ch_flat_field* f = fields; f; f = f->next) {
+        bool equal;
+        CH_RET_IF_ERR(ch_cmp_field_equal(builder->cmp, f->td, data_a + f->offset, data_b + f->offset, &equal));
+        if (!equal)
+            CH_RET_IF_ERR(ch_diff_append_field(builder,
+                                               ent,
+                                               &last_field,
+                                               f->name,
+                                               f->td,
+                                               data_a + f->offset,
+                                               f->td,
+                                               data_b + f->offset));
+    }
+    return CH_ERR_NONE;
+}
+
+// the entity was restored with different datamaps, match up the fields by name
+static ch_err ch_diff_fields_by_name(ch_diff_builder* builder,
+                                     ch_diff_entity* ent,
+                                     const ch_restored_class* rc_a,
+                                     const ch_restored_class* rc_b)
+{
+    const ch_flat_field *fields_a, *fields_b;
+    size_t n_fields_a, n_fields_b;
+    CH_RET_IF_ERR(ch_cmp_get_flat_fields(builder->cmp, rc_a->dm, &fields_a, &n_fields_a));
+    CH_RET_IF_ERR(ch_cmp_get_flat_fields(builder->cmp, rc_b->dm, &fields_b, &n_fields_b));
+
+    // the game's datamaps have duplicate names, so keep track of which fields in b were already used
+    const ch_flat_field** arr_b;
+    bool* used_b;
+    CH_CHECKED_ALLOC(arr_b, ch_arena_alloc(builder->diff->_arena, sizeof(ch_flat_field*) * n_fields_b));
+    CH_CHECKED_ALLOC(used_b, ch_arena_calloc(builder->diff->_arena, sizeof(bool) * n_fields_b));
+    size_t n = 0;
+    for (const ch_flat_field* f = fields_b; f; f = f->next)
+        arr_b[n++] = f;
+
+    ch_diff_field* last_field = NULL;
+    size_t cursor = 0;
+    for (const ch_flat_field* fa = fields_a; fa; fa = fa->next) {
+        // fields are usually in the same order in both datamaps, so start looking after the last match
+        const ch_flat_field* fb = NULL;
+        for (size_t i = 0; i < n_fields_b && !fb; i++) {
+            size_t j = (cursor + i) % n_fields_b;
+            if (!used_b[j] && !strcmp(arr_b[j]->name, fa->name)) {
+                fb = arr_b[j];
+                used_b[j] = true;
+                cursor = j + 1;
+            }
+        }
+        const unsigned char* data_a = rc_a->data + fa->offset;
+        if (!fb) {
+            CH_RET_IF_ERR(ch_diff_append_field(builder, ent, &last_field, fa->name, fa->td, data_a, NULL, NULL));
+            continue;
+        }
+        const unsigned char* data_b = rc_b->data + fb->offset;
+        bool equal = ch_diff_tds_compatible(fa->td, fb->td);
+        if (equal)
+            CH_RET_IF_ERR(ch_cmp_field_equal(builder->cmp, fa->td, data_a, data_b, &equal));
+        if (!equal)
+            CH_RET_IF_ERR(ch_diff_append_field(builder, ent, &last_field, fa->name, fa->td, data_a, fb->td, data_b));
+    }
+    for (size_t i = 0; i < n_fields_b; i++)
+        if (!used_b[i])
+            CH_RET_IF_ERR(ch_diff_append_field(builder,
+                                               ent,
+                                               &last_field,
+                                               arr_b[i]->name,
+                                               NULL,
+                                               NULL,
+                                               arr_b[i]->td,
+                                               rc_b->data + arr_b[i]->offset));
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_diff_entity_pair(ch_diff_builder* builder,
+                                  const char* sf_name,
+                                  size_t ent_idx,
+                                  const ch_restored_entity* ent_a,
+                                  const ch_restored_entity* ent_b)
+{
+    const ch_restored_class* rc_a = &ent_a->class_info;
+    const ch_restored_class* rc_b = &ent_b->class_info;
+
+    // the class wasn't restored (e.g. the NPC header failed to restore), there's nothing to compare
+    if (!rc_a->dm || !rc_a->data || !rc_b->dm || !rc_b->data) {
+        bool same = !rc_a->data && !rc_b->data && rc_a->dm == rc_b->dm;
+        if (same)
+            builder->diff->n_unchanged++;
+        else
+            CH_RET_IF_ERR(ch_diff_append_entity(builder, CH_DIFF_ENT_CHANGED, sf_name, ent_idx, ent_a, ent_b));
+        return CH_ERR_NONE;
+    }
+
+    if (rc_a->dm == rc_b->dm) {
+        uint64_t hash_a = 0, hash_b = 0;
+        CH_RET_IF_ERR(ch_cmp_hash_class(builder->cmp, rc_a->dm, rc_a->data, &hash_a));
+        CH_RET_IF_ERR(ch_cmp_hash_class(builder->cmp, rc_b->dm, rc_b->data, &hash_b));
+        if (hash_a == hash_b) {
+            builder->diff->n_unchanged++;
+            return CH_ERR_NONE;
+        }
+    }
+
+    ch_diff_entity* ent;
+    CH_RET_IF_ERR(ch_diff_new_entity(builder, CH_DIFF_ENT_CHANGED, sf_name, ent_idx, ent_a, ent_b, &ent));
+    if (rc_a->dm == rc_b->dm)
+        CH_RET_IF_ERR(ch_diff_fields_same_dm(builder, ent, rc_a->dm, rc_a->data, rc_b->data));
+    else
+        CH_RET_IF_ERR(ch_diff_fields_by_name(builder, ent, rc_a, rc_b));
+
+    // datamaps can differ without any of the values differing, and custom fields without cmp fns compare equal
+    if (ent->n_fields > 0)
+        ch_diff_link_entity(builder, ent);
+    else
+        builder->diff->n_unchanged++;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_diff_block_ents(ch_diff_builder* builder,
+                                 const char* sf_name,
+                                 const ch_block_entities* ents_a,
+                                 const ch_block_entities* ents_b)
+{
+    size_t n_a = ents_a ? ents_a->entity_table.n_elems : 0;
+    size_t n_b = ents_b ? ents_b->entity_table.n_elems : 0;
+    size_t n = max(n_a, n_b);
+    for (size_t i = 0; i < n; i++) {
+        const ch_restored_entity* ent_a = i < n_a ? ents_a->entities[i] : NULL;
+        const ch_restored_entity* ent_b = i < n_b ? ents_b->entities[i] : NULL;
+        if (ent_a && ent_b && ch_cmp_str_equal(ent_a->classname, ent_b->classname)) {
+            CH_RET_IF_ERR(ch_diff_entity_pair(builder, sf_name, i, ent_a, ent_b));
+            continue;
+        }
+        if (ent_a)
+            CH_RET_IF_ERR(ch_diff_append_entity(builder, CH_DIFF_ENT_REMOVED, sf_name, i, ent_a, NULL));
+        if (ent_b)
+            CH_RET_IF_ERR(ch_diff_append_entity(builder, CH_DIFF_ENT_ADDED, sf_name, i, NULL, ent_b));
+    }
+    return CH_ERR_NONE;
+}
+
+static const ch_state_file* ch_diff_find_sf(const ch_parsed_save_data* save, const char* name)
+{
+    for (size_t i = 0; i < save->n_state_files; i++)
+        if (!strncmp(save->state_files[i].name, name, sizeof save->state_files[i].name))
+            return &save->state_files[i];
+    return NULL;
+}
+
+static ch_err ch_diff_saves_impl(ch_diff_builder* builder)
+{
+    const ch_parsed_save_data* a = builder->diff->a;
+    const ch_parsed_save_data* b = builder->diff->b;
+    for (size_t i = 0; i < a->n_state_files; i++) {
+        const ch_state_file* sf_a = &a->state_files[i];
+        const ch_state_file* sf_b = ch_diff_find_sf(b, sf_a->name);
+        CH_RET_IF_ERR(ch_diff_block_ents(builder,
+                                         sf_a->name,
+                                         ch_sf_get_block_entities(sf_a),
+                                         sf_b ? ch_sf_get_block_entities(sf_b) : NULL));
+    }
+    for (size_t i = 0; i < b->n_state_files; i++) {
+        const ch_state_file* sf_b = &b->state_files[i];
+        if (!ch_diff_find_sf(a, sf_b->name))
+            CH_RET_IF_ERR(ch_diff_block_ents(builder, sf_b->name, NULL, ch_sf_get_block_entities(sf_b)));
+    }
+    return CH_ERR_NONE;
+}
+
+ch_err ch_diff_saves(const ch_parsed_save_data* a, const ch_parsed_save_data* b, ch_save_diff** diff)
+{
+    assert(a && b && diff);
+    *diff = NULL;
+    ch_arena* arena = ch_arena_new(1024 * 64);
+    if (!arena)
+        return CH_ERR_OUT_OF_MEMORY;
+    ch_save_diff* new_diff = ch_arena_calloc(arena, sizeof *new_diff);
+    ch_cmp_ctx* cmp = ch_cmp_ctx_new();
+    if (!new_diff || !cmp) {
+        ch_cmp_ctx_free(cmp);
+        ch_arena_free(arena);
+        return CH_ERR_OUT_OF_MEMORY;
+    }
+    new_diff->a = a;
+    new_diff->b = b;
+    new_diff->_arena = arena;
+
+    ch_diff_builder builder = {.diff = new_diff, .cmp = cmp};
+    ch_err err = ch_diff_saves_impl(&builder);
+    if (err) {
+        ch_cmp_ctx_free(cmp);
+        ch_arena_free(arena);
+        return err;
+    }
+    // the field names in the diff point into the cmp ctx, so keep it around until the diff is freed
+    new_diff->_cmp = cmp;
+    *diff = new_diff;
+    return CH_ERR_NONE;
+}
+
+void ch_save_diff_free(ch_save_diff* diff)
+{
+    if (!diff)
+        return;
+    ch_cmp_ctx_free(diff->_cmp);
+    ch_arena_free(diff->_arena);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* Structural diff of the entities in two saves. State files are matched by name, and entities are matched by their
+* index in the entity table and their classname - if the classname changed then the old entity is reported as
+* removed and the new one as added. For entities in both saves, a hash of the whole restored class (following
+* strings & custom fields) is compared first so that unchanged entities are skipped without a field by field
+* compare. The hashes are 64 bits so a collision (and a missed change) is technically possible but very unlikely.
+*
+* Changed fields are flattened the same way as for the exports (see ch_flatten_fields) except that every element of
+* embedded arrays is compared and reported with its index, e.g. "m_Array[1].m_iValue". Custom fields are compared
+* as a whole and reported as a single changed field. Entities which couldn't be fully restored in one of the saves
+* are reported as changed without any fields. If the entity was restored with a different datamap in each
+* save (i.e. the saves were parsed with different collections) fields are matched by name instead, and fields
+* which only exist on one side have a NULL td & data on the other side.
+*
+* The diff points into both saves, so they must outlive it.
+*/
+
+typedef enum ch_diff_ent_kind {
+    CH_DIFF_ENT_ADDED,   // only in b
+    CH_DIFF_ENT_REMOVED, // only in a
+    CH_DIFF_ENT_CHANGED,
+} ch_diff_ent_kind;
+
+typedef struct ch_diff_field {
+    const char* name; // flattened name, e.g. "m_Collision.m_vecMins"
+    const ch_type_description *td_a, *td_b;
+    const unsigned char *data_a, *data_b;
+    struct ch_diff_field* next;
+} ch_diff_field;
+
+typedef struct ch_diff_entity {
+    ch_diff_ent_kind kind;
+    const char* sf_name;
+    size_t ent_idx;
+    const ch_restored_entity *ent_a, *ent_b; // NULL for added/removed entities respectively
+    ch_diff_field* fields;                   // only for changed entities
+    size_t n_fields;
+    struct ch_diff_entity* next;
+} ch_diff_entity;
+
+typedef struct ch_save_diff {
+    const ch_parsed_save_data *a, *b;
+    ch_diff_entity* entities; // sorted by state file in a (then in b) and entity index
+    size_t n_added, n_removed, n_changed, n_unchanged;
+
+    struct ch_arena* _arena;
+    struct ch_cmp_ctx* _cmp;
+} ch_save_diff;
+
+ch_err ch_diff_saves(const ch_parsed_save_data* a, const ch_parsed_save_data* b, ch_save_diff** diff);
+void ch_save_diff_free(ch_save_diff* diff);
+
+ch_err ch_dump_save_diff_to_text(FILE* f, const ch_save_diff* diff, const char* indent_str);
@@ -0,0 +1,269 @@
+#include "ch_ent_refs.h"
+
+// the fields of a datamap which can have EHANDLEs in them
+typedef struct ch_ent_refs_dm_fields {
+    const ch_datamap* dm;
+    const ch_flat_field** fields;
+    size_t n_fields;
+} ch_ent_refs_dm_fields;
+
+struct ch_ent_refs {
+    ch_arena* arena;
+    const ch_block_entities* block;
+    size_t n_ents;
+    int32_t* id_to_idx; // entity table index for each id, -1 if there's no entity with that id
+    size_t n_refs;
+    ch_ent_ref* out_refs; // sorted by from_idx, out_offsets[i] is the first ref from entity i
+    size_t* out_offsets;
+    ch_ent_ref* in_refs; // sorted by to_idx then from_idx, in_offsets[i] is the first ref to entity i
+    size_t* in_offsets;
+};
+
+struct ch_ent_refs_builder {
+    ch_ent_refs* refs;
+    struct hashmap* dm_fields; // ch_ent_refs_dm_fields
+    size_t cur_from_idx;
+    const char* cur_field_name;
+    ch_ent_ref* out_refs;
+    size_t out_refs_cap;
+};
+
+static uint64_t ch_ent_refs_dm_fields_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_ent_refs_dm_fields* entry = item;
+    return hashmap_xxhash3(&entry->dm, sizeof entry->dm, seed0, seed1);
+}
+
+static int ch_ent_refs_dm_fields_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_ent_refs_dm_fields* ea = a;
+    const ch_ent_refs_dm_fields* eb = b;
+    return ea->dm < eb->dm ? -1 : ea->dm > eb->dm;
+}
+
+const ch_restored_entity* ch_ent_refs_resolve(const ch_ent_refs* refs, uint32_t ehandle, size_t* ent_idx)
+{
+    int32_t id = (int32_t)ehandle;
+    if (id < 0 || (size_t)id >= refs->n_ents || refs->id_to_idx[id] < 0)
+        return NULL;
+    if (ent_idx)
+        *ent_idx = (size_t)refs->id_to_idx[id];
+    return refs->block->entities[refs->id_to_idx[id]];
+}
+
+ch_err ch_ent_refs_visit_ehandles(ch_ent_refs_builder* builder, const uint32_t* ehandles, size_t n)
+{
+    ch_ent_refs* refs = builder->refs;
+    for (size_t i = 0; i < n; i++) {
+        size_t to_idx;
+        const ch_restored_entity* to = ch_ent_refs_resolve(refs, ehandles[i], &to_idx);
+        if (!to)
+            continue;
+        if (refs->n_refs == builder->out_refs_cap) {
+            size_t new_cap = max(64, builder->out_refs_cap * 2);
+            ch_ent_ref* new_refs = realloc(builder->out_refs, sizeof(ch_ent_ref) * new_cap);
+            if (!new_refs)
+                return CH_ERR_OUT_OF_MEMORY;
+            builder->out_refs = new_refs;
+            builder->out_refs_cap = new_cap;
+        }
+        builder->out_refs[refs->n_refs++] = (ch_ent_ref){
+            .from_idx = builder->cur_from_idx,
+            .to_idx = to_idx,
+            .from = refs->block->entities[builder->cur_from_idx],
+            .to = to,
+            .field_name = builder->cur_field_name,
+        };
+    }
+    return CH_ERR_NONE;
+}
+
+static bool ch_ent_refs_field_has_ehandles(const ch_type_description* td)
+{
+    if (td->type == FIELD_EHANDLE)
+        return true;
+    return td->type == FIELD_CUSTOM && td->save_restore_ops && td->save_restore_ops->refs_fns;
+}
+
+static ch_err ch_ent_refs_get_dm_fields(ch_ent_refs_builder* builder,
+                                        const ch_datamap* dm,
+                                        const ch_ent_refs_dm_fields** dm_fields_out)
+{
+    ch_ent_refs_dm_fields dm_fields = {.dm = dm};
+    const ch_ent_refs_dm_fields* existing = hashmap_get(builder->dm_fields, &dm_fields);
+    if (existing) {
+        *dm_fields_out = existing;
+        return CH_ERR_NONE;
+    }
+    ch_arena* arena = builder->refs->arena;
+    ch_flat_field* fields;
+    size_t n_fields;
+    CH_RET_IF_ERR(ch_flatten_fields(arena, dm, CH_FLATTEN_INCLUDE_CUSTOM, &fields, &n_fields));
+    for (const ch_flat_field* f = fields; f; f = f->next)
+        if (ch_ent_refs_field_has_ehandles(f->td))
+            dm_fields.n_fields++;
+    CH_CHECKED_ALLOC(dm_fields.fields, ch_arena_alloc(arena, sizeof(ch_flat_field*) * dm_fields.n_fields));
+    dm_fields.n_fields = 0;
+    for (const ch_flat_field* f = fields; f; f = f->next)
+        if (ch_ent_refs_field_has_ehandles(f->td))
+            dm_fields.fields[dm_fields.n_fields++] = f;
+    if (!hashmap_set(builder->dm_fields, &dm_fields) && hashmap_oom(builder->dm_fields))
+        return CH_ERR_OUT_OF_MEMORY;
+    *dm_fields_out = hashmap_get(builder->dm_fields, &dm_fields);
+    return CH_ERR_NONE;
+}
+
+/*
+* Classes nested in custom fields are visited with this too, the field name of the refs stays the name of the
+* outermost field.
+*/
+ch_err ch_ent_refs_visit_class(ch_ent_refs_builder* builder, const ch_datamap* dm, const unsigned char* data)
+{
+    if (!dm || !data)
+        return CH_ERR_NONE;
+    const ch_ent_refs_dm_fields* dm_fields;
+    CH_RET_IF_ERR(ch_ent_refs_get_dm_fields(builder, dm, &dm_fields));
+    bool outermost = !builder->cur_field_name;
+    for (size_t i = 0; i < dm_fields->n_fields; i++) {
+        const ch_flat_field* field = dm_fields->fields[i];
+        if (outermost)
+            builder->cur_field_name = field->name;
+        if (field->td->type == FIELD_EHANDLE) {
+            CH_RET_IF_ERR(
+                ch_ent_refs_visit_ehandles(builder, (const uint32_t*)(data + field->offset), field->td->n_elems));
+        } else {
+            const void* restored_field = *(const void* const*)(data + field->offset);
+            if (restored_field)
+                CH_RET_IF_ERR(field->td->save_restore_ops->refs_fns->visit(builder, field->td, restored_field));
+        }
+    }
+    if (outermost)
+        builder->cur_field_name = NULL;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_ent_refs_build(ch_ent_refs* refs, ch_ent_refs_builder* builder)
+{
+    const ch_block_entities* block = refs->block;
+    refs->n_ents = block->entity_table.n_elems;
+    if (refs->n_ents > INT32_MAX)
+        return CH_ERR_OUT_OF_MEMORY;
+    CH_CHECKED_ALLOC(refs->id_to_idx, ch_arena_alloc(refs->arena, sizeof(int32_t) * refs->n_ents));
+    memset(refs->id_to_idx, -1, sizeof(int32_t) * refs->n_ents);
+    const ch_type_description* td_id = NULL;
+    ch_find_field(block->entity_table.dm, "id", true, &td_id);
+    for (size_t i = 0; i < refs->n_ents; i++) {
+        // the ids are the entity table indices in practice, fall back to that if the table doesn't have them
+        int32_t id = (int32_t)i;
+        if (td_id && td_id->type == FIELD_INTEGER)
+            id = CH_FIELD_AT(CH_RCA_ELEM_DATA(block->entity_table, i), td_id, int32_t);
+        if (id >= 0 && (size_t)id < refs->n_ents && block->entities[i])
+            refs->id_to_idx[id] = (int32_t)i;
+    }
+
+    for (size_t i = 0; i < refs->n_ents; i++) {
+        const ch_restored_entity* ent = block->entities[i];
+        if (!ent)
+            continue;
+        builder->cur_from_idx = i;
+        CH_RET_IF_ERR(ch_ent_refs_visit_class(builder, ent->class_info.dm, ent->class_info.data));
+    }
+
+    // refs were visited in entity order, so they're already sorted by from_idx
+    CH_CHECKED_ALLOC(refs->out_refs, ch_arena_alloc(refs->arena, sizeof(ch_ent_ref) * refs->n_refs));
+    CH_CHECKED_ALLOC(refs->in_refs, ch_arena_alloc(refs->arena, sizeof(ch_ent_ref) * refs->n_refs));
+    CH_CHECKED_ALLOC(refs->out_offsets, ch_arena_calloc(refs->arena, sizeof(size_t) * (refs->n_ents + 1)));
+    CH_CHECKED_ALLOC(refs->in_offsets, ch_arena_calloc(refs->arena, sizeof(size_t) * (refs->n_ents + 1)));
+    if (refs->n_refs > 0)
+        memcpy(refs->out_refs, builder->out_refs, sizeof(ch_ent_ref) * refs->n_refs);
+
+    // counting sort by to_idx for the incoming refs, stable so they stay sorted by from_idx
+    for (size_t i = 0; i < refs->n_refs; i++) {
+        refs->out_offsets[refs->out_refs[i].from_idx + 1]++;
+        refs->in_offsets[refs->out_refs[i].to_idx + 1]++;
+    }
+    for (size_t i = 0; i < refs->n_ents; i++) {
+        refs->out_offsets[i + 1] += refs->out_offsets[i];
+        refs->in_offsets[i + 1] += refs->in_offsets[i];
+    }
+    size_t* in_cursors;
+    CH_CHECKED_ALLOC(in_cursors, ch_arena_alloc(refs->arena, sizeof(size_t) * (refs->n_ents + 1)));
+    memcpy(in_cursors, refs->in_offsets, sizeof(size_t) * (refs->n_ents + 1));
+    for (size_t i = 0; i < refs->n_refs; i++)
+        refs->in_refs[in_cursors[refs->out_refs[i].to_idx]++] = refs->out_refs[i];
+    return CH_ERR_NONE;
+}
+
+ch_err ch_ent_refs_new(const ch_state_file* sf, ch_ent_refs** refs_out)
+{
+    assert(sf && refs_out);
+    *refs_out = NULL;
+    static const ch_block_entities empty_block = {0};
+    const ch_block_entities* block = ch_sf_get_block_entities(sf);
+    ch_arena* arena = ch_arena_new(1024 * 64);
+    if (!arena)
+        return CH_ERR_OUT_OF_MEMORY;
+    ch_ent_refs* refs = ch_arena_calloc(arena, sizeof *refs);
+    if (!refs) {
+        ch_arena_free(arena);
+        return CH_ERR_OUT_OF_MEMORY;
+    }
+    refs->arena = arena;
+    refs->block = block ? block : &empty_block;
+
+    ch_ent_refs_builder builder = {
+        .refs = refs,
+        .dm_fields = hashmap_new(sizeof(ch_ent_refs_dm_fields),
+                                 64,
+                                 0,
+                                 0,
+                                 ch_ent_refs_dm_fields_hash,
+                                 ch_ent_refs_dm_fields_compare,
+                                 NULL,
+                                 NULL),
+    };
+    ch_err err = builder.dm_fields ? ch_ent_refs_build(refs, &builder) : CH_ERR_OUT_OF_MEMORY;
+    if (builder.dm_fields)
+        hashmap_free(builder.dm_fields);
+    free(builder.out_refs);
+    if (err) {
+        ch_ent_refs_free(refs);
+        return err;
+    }
+    *refs_out = refs;
+    return CH_ERR_NONE;
+}
+
+void ch_ent_refs_free(ch_ent_refs* refs)
+{
+    if (refs)
+        ch_arena_free(refs->arena);
+}
+
+void ch_ent_refs_get_outgoing(const ch_ent_refs* refs, size_t ent_idx, const ch_ent_ref** out, size_t* n_out)
+{
+    if (ent_idx >= refs->n_ents) {
+        *out = NULL;
+        *n_out = 0;
+        return;
+    }
+    *out = refs->out_refs + refs->out_offsets[ent_idx];
+    *n_out = refs->out_offsets[ent_idx + 1] - refs->out_offsets[ent_idx];
+}
+
+void ch_ent_refs_get_incoming(const ch_ent_refs* refs, size_t ent_idx, const ch_ent_ref** in, size_t* n_in)
+{
+    if (ent_idx >= refs->n_ents) {
+        *in = NULL;
+        *n_in = 0;
+        return;
+    }
+    *in = refs->in_refs + refs->in_offsets[ent_idx];
+    *n_in = refs->in_offsets[ent_idx + 1] - refs->in_offsets[ent_idx];
+}
+
+size_t ch_ent_refs_count(const ch_ent_refs* refs)
+{
+    return refs->n_refs;
+}
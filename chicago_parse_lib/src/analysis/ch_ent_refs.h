@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ch_save_internal.h"
+
+/*
+* EHANDLE resolution & the reference graph between the entities of a single state file. EHANDLEs are saved as the
+* id of the entity in the entity table (see CSave::WriteEHandle), or -1 for NULL. The graph has an edge for every
+* EHANDLE which resolves to a restored entity, including EHANDLEs in custom fields which have refs_fns in their
+* ch_custom_ops (e.g. CUtlVector<EHANDLE> fields like CSceneEntity::m_hActorList, or EHANDLE variants).
+*
+* EHANDLEs in embedded classes are found the same way as for ch_flatten_fields, so only the first element of
+* embedded arrays is checked.
+*
+* The refs point into the save, so the save must outlive them.
+*/
+
+typedef struct ch_ent_refs ch_ent_refs;
+
+typedef struct ch_ent_ref {
+    size_t from_idx, to_idx; // indices in the entity table
+    const ch_restored_entity *from, *to;
+    const char* field_name; // flattened name of the field the EHANDLE is in, e.g. "m_hOwnerEntity"
+} ch_ent_ref;
+
+ch_err ch_ent_refs_new(const ch_state_file* sf, ch_ent_refs** refs);
+void ch_ent_refs_free(ch_ent_refs* refs);
+
+// returns NULL if the handle is NULL or doesn't point to a restored entity, ent_idx is optional
+const ch_restored_entity* ch_ent_refs_resolve(const ch_ent_refs* refs, uint32_t ehandle, size_t* ent_idx);
+
+// references from the entity at ent_idx to other entities, in field order
+void ch_ent_refs_get_outgoing(const ch_ent_refs* refs, size_t ent_idx, const ch_ent_ref** out, size_t* n_out);
+// references from other entities to the entity at ent_idx, sorted by the referencing entity
+void ch_ent_refs_get_incoming(const ch_ent_refs* refs, size_t ent_idx, const ch_ent_ref** in, size_t* n_in);
+
+size_t ch_ent_refs_count(const ch_ent_refs* refs);
+
+// for visiting EHANDLEs in custom fields
+
+typedef struct ch_ent_refs_builder ch_ent_refs_builder;
+
+typedef struct ch_ent_refs_custom_fns {
+    ch_err (*visit)(ch_ent_refs_builder* builder, const ch_type_description* td, const void* restored_field);
+} ch_ent_refs_custom_fns;
+
+extern const ch_ent_refs_custom_fns g_ent_refs_cr_utl_vec_fns, g_ent_refs_cr_ent_output_fns,
+    g_ent_refs_cr_variant_fns;
+
+ch_err ch_ent_refs_visit_ehandles(ch_ent_refs_builder* builder, const uint32_t* ehandles, size_t n);
+ch_err ch_ent_refs_visit_class(ch_ent_refs_builder* builder, const ch_datamap* dm, const unsigned char* data);
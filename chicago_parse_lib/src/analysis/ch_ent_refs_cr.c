@@ -0,0 +1,53 @@
+#include "ch_ent_refs.h"
+#include "custom_restore/ch_utl_vector.h"
+#include "custom_restore/ch_ent_output.h"
+#include "custom_restore/ch_variant.h"
+
+static ch_err ch_ent_refs_utl_vec_visit(ch_ent_refs_builder* builder,
+                                        const ch_type_description* td,
+                                        const void* restored_field)
+{
+    (void)td;
+    const ch_cr_utl_vector* vec = restored_field;
+    if (vec->embedded_map) {
+        for (uint32_t i = 0; i < vec->n_elems; i++)
+            CH_RET_IF_ERR(ch_ent_refs_visit_class(builder, vec->embedded_map, CH_UTL_VEC_ELEM_PTR(*vec, i)));
+        return CH_ERR_NONE;
+    }
+    if (vec->field_type != FIELD_EHANDLE)
+        return CH_ERR_NONE;
+    return ch_ent_refs_visit_ehandles(builder, (const uint32_t*)vec->elems, vec->n_elems);
+}
+
+const ch_ent_refs_custom_fns g_ent_refs_cr_utl_vec_fns = {
+    .visit = ch_ent_refs_utl_vec_visit,
+};
+
+static ch_err ch_ent_refs_ent_output_visit(ch_ent_refs_builder* builder,
+                                           const ch_type_description* td,
+                                           const void* restored_field)
+{
+    (void)td;
+    // the targets of the actions are names, not handles
+    const ch_cr_ent_output* output = restored_field;
+    return ch_ent_refs_visit_class(builder, output->ent_output_val.dm, output->ent_output_val.data);
+}
+
+const ch_ent_refs_custom_fns g_ent_refs_cr_ent_output_fns = {
+    .visit = ch_ent_refs_ent_output_visit,
+};
+
+static ch_err ch_ent_refs_variant_visit(ch_ent_refs_builder* builder,
+                                        const ch_type_description* td,
+                                        const void* restored_field)
+{
+    (void)td;
+    const ch_cr_variant* var = restored_field;
+    if (var->ft != FIELD_EHANDLE)
+        return CH_ERR_NONE;
+    return ch_ent_refs_visit_ehandles(builder, &var->val_ehandle, 1);
+}
+
+const ch_ent_refs_custom_fns g_ent_refs_cr_variant_fns = {
+    .visit = ch_ent_refs_variant_visit,
+};
@@ -0,0 +1,523 @@
+#include <ctype.h>
+
+#include "ch_io_graph.h"
+#include "ch_save_internal.h"
+#include "custom_restore/ch_ent_output.h"
+
+// the entities with a name are postings[first, first + count)
+typedef struct ch_io_name_entry {
+    const char* name;
+    size_t first;
+    size_t count;
+} ch_io_name_entry;
+
+typedef struct ch_io_name_index {
+    struct hashmap* map; // ch_io_name_entry
+    size_t* postings;
+} ch_io_name_index;
+
+// the fields of a datamap that the graph cares about
+typedef struct ch_io_dm_info {
+    const ch_datamap* dm;
+    const ch_flat_field* name_field; // m_iName, NULL if the datamap doesn't have it
+    const ch_flat_field** outputs;
+    size_t n_outputs;
+} ch_io_dm_info;
+
+// CEventAction fields
+typedef struct ch_io_action_fields {
+    const ch_datamap* dm;
+    const ch_type_description *target, *input, *parameter, *delay, *times_to_fire;
+} ch_io_action_fields;
+
+struct ch_io_graph {
+    ch_arena* arena;
+    const ch_block_entities* block;
+    size_t n_ents;
+    struct hashmap* dm_infos; // ch_io_dm_info
+    ch_io_name_index targetnames;
+    ch_io_name_index classnames;
+
+    ch_io_edge* edges; // sorted by from_idx, out_offsets[i] is the first edge of entity i
+    size_t n_edges;
+    size_t* out_offsets;
+    const ch_io_edge** in_edges; // in_offsets[i] is the first edge which targets entity i
+    size_t* in_offsets;
+
+    // scratch for traversals & resolves
+    ch_io_step* steps;     // n_edges
+    bool* edge_visited;    // n_edges
+    bool* ent_expanded;    // n_ents
+    size_t* resolve_buf;
+    size_t resolve_buf_cap;
+};
+
+static uint64_t ch_io_name_hash(const char* name, uint64_t seed0, uint64_t seed1)
+{
+    // FNV-1a over the lowercase name
+    uint64_t hash = 0xcbf29ce484222325 ^ seed0;
+    for (const char* c = name; *c; c++)
+        hash = (hash ^ (unsigned char)tolower((unsigned char)*c)) * 0x100000001b3;
+    return hash ^ seed1;
+}
+
+static uint64_t ch_io_name_entry_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    return ch_io_name_hash(((const ch_io_name_entry*)item)->name, seed0, seed1);
+}
+
+static int ch_io_name_entry_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    return _stricmp(((const ch_io_name_entry*)a)->name, ((const ch_io_name_entry*)b)->name);
+}
+
+static uint64_t ch_io_dm_info_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_io_dm_info* info = item;
+    return hashmap_xxhash3(&info->dm, sizeof info->dm, seed0, seed1);
+}
+
+static int ch_io_dm_info_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_io_dm_info* ia = a;
+    const ch_io_dm_info* ib = b;
+    return ia->dm < ib->dm ? -1 : ia->dm > ib->dm;
+}
+
+static ch_err ch_io_get_dm_info(ch_io_graph* graph, const ch_datamap* dm, const ch_io_dm_info** info_out)
+{
+    ch_io_dm_info info = {.dm = dm};
+    const ch_io_dm_info* existing = hashmap_get(graph->dm_infos, &info);
+    if (existing) {
+        *info_out = existing;
+        return CH_ERR_NONE;
+    }
+    ch_flat_field* fields;
+    size_t n_fields;
+    CH_RET_IF_ERR(ch_flatten_fields(graph->arena, dm, CH_FLATTEN_INCLUDE_CUSTOM, &fields, &n_fields));
+    for (const ch_flat_field* f = fields; f; f = f->next) {
+        if (ch_td_is_ent_output(f->td))
+            info.n_outputs++;
+        else if (!info.name_field && f->td->type == FIELD_STRING && f->td->n_elems == 1 && !strcmp(f->name, "m_iName"))
+            info.name_field = f;
+    }
+    CH_CHECKED_ALLOC(info.outputs, ch_arena_alloc(graph->arena, sizeof(ch_flat_field*) * info.n_outputs));
+    info.n_outputs = 0;
+    for (const ch_flat_field* f = fields; f; f = f->next)
+        if (ch_td_is_ent_output(f->td))
+            info.outputs[info.n_outputs++] = f;
+    if (!hashmap_set(graph->dm_infos, &info) && hashmap_oom(graph->dm_infos))
+        return CH_ERR_OUT_OF_MEMORY;
+    *info_out = hashmap_get(graph->dm_infos, &info);
+    return CH_ERR_NONE;
+}
+
+// NULL if the entity doesn't have a name
+static ch_err ch_io_get_ent_name(ch_io_graph* graph, size_t ent_idx, bool targetname, const char** name)
+{
+    const ch_restored_entity* ent = graph->block->entities[ent_idx];
+    *name = NULL;
+    if (!ent)
+        return CH_ERR_NONE;
+    if (!targetname) {
+        *name = ent->classname;
+        return CH_ERR_NONE;
+    }
+    // the entity failed to restore partway through
+    if (!ent->class_info.dm || !ent->class_info.data)
+        return CH_ERR_NONE;
+    const ch_io_dm_info* info;
+    CH_RET_IF_ERR(ch_io_get_dm_info(graph, ent->class_info.dm, &info));
+    if (info->name_field)
+        *name = *(const char* const*)(ent->class_info.data + info->name_field->offset);
+    return CH_ERR_NONE;
+}
+
+/*
+* Two passes over the entities: the first counts the entities with each name, then each name gets a range in the
+* postings and the second pass fills them in. Postings of each name are sorted by entity index.
+*/
+static ch_err ch_io_build_name_index(ch_io_graph* graph, ch_io_name_index* index, bool targetname)
+{
+    index->map = hashmap_new(sizeof(ch_io_name_entry),
+                             256,
+                             0,
+                             0,
+                             ch_io_name_entry_hash,
+                             ch_io_name_entry_compare,
+                             NULL,
+                             NULL);
+    if (!index->map)
+        return CH_ERR_OUT_OF_MEMORY;
+    size_t n_postings = 0;
+    for (size_t i = 0; i < graph->n_ents; i++) {
+        ch_io_name_entry entry = {0};
+        CH_RET_IF_ERR(ch_io_get_ent_name(graph, i, targetname, &entry.name));
+        if (!entry.name || !*entry.name)
+            continue;
+        n_postings++;
+        ch_io_name_entry* existing = (ch_io_name_entry*)hashmap_get(index->map, &entry);
+        if (existing) {
+            existing->count++;
+        } else {
+            entry.count = 1;
+            if (!hashmap_set(index->map, &entry) && hashmap_oom(index->map))
+                return CH_ERR_OUT_OF_MEMORY;
+        }
+    }
+    CH_CHECKED_ALLOC(index->postings, ch_arena_alloc(graph->arena, sizeof(size_t) * n_postings));
+    size_t iter = 0, first = 0;
+    void* item;
+    while (hashmap_iter(index->map, &iter, &item)) {
+        ch_io_name_entry* entry = item;
+        entry->first = first;
+        first += entry->count;
+        entry->count = 0;
+    }
+    for (size_t i = 0; i < graph->n_ents; i++) {
+        ch_io_name_entry entry = {0};
+        CH_RET_IF_ERR(ch_io_get_ent_name(graph, i, targetname, &entry.name));
+        if (!entry.name || !*entry.name)
+            continue;
+        ch_io_name_entry* existing = (ch_io_name_entry*)hashmap_get(index->map, &entry);
+        index->postings[existing->first + existing->count++] = i;
+    }
+    return CH_ERR_NONE;
+}
+
+static void ch_io_name_lookup(const ch_io_name_index* index, const char* name, const size_t** idxs, size_t* n)
+{
+    ch_io_name_entry lookup = {.name = name};
+    const ch_io_name_entry* entry = hashmap_get(index->map, &lookup);
+    *idxs = entry ? index->postings + entry->first : NULL;
+    *n = entry ? entry->count : 0;
+}
+
+static int ch_io_size_t_compare(const void* a, const void* b)
+{
+    size_t sa = *(const size_t*)a;
+    size_t sb = *(const size_t*)b;
+    return sa < sb ? -1 : sa > sb;
+}
+
+// all entities whose targetname starts with the prefix, written to graph->resolve_buf
+static ch_err ch_io_resolve_wildcard(ch_io_graph* graph, const char* prefix, size_t prefix_len, size_t* n_ents)
+{
+    *n_ents = 0;
+    size_t iter = 0;
+    void* item;
+    while (hashmap_iter(graph->targetnames.map, &iter, &item)) {
+        const ch_io_name_entry* entry = item;
+        if (_strnicmp(entry->name, prefix, prefix_len))
+            continue;
+        if (*n_ents + entry->count > graph->resolve_buf_cap) {
+            size_t new_cap = max(*n_ents + entry->count, graph->resolve_buf_cap * 2);
+            size_t* new_buf = realloc(graph->resolve_buf, sizeof(size_t) * new_cap);
+            if (!new_buf)
+                return CH_ERR_OUT_OF_MEMORY;
+            graph->resolve_buf = new_buf;
+            graph->resolve_buf_cap = new_cap;
+        }
+        memcpy(graph->resolve_buf + *n_ents, graph->targetnames.postings + entry->first, sizeof(size_t) * entry->count);
+        *n_ents += entry->count;
+    }
+    qsort(graph->resolve_buf, *n_ents, sizeof(size_t), ch_io_size_t_compare);
+    return CH_ERR_NONE;
+}
+
+/*
+* The results either point into the graph or into graph->resolve_buf (for wildcards). For !self, from_idx_ptr is
+* used as the result so it must stay alive.
+*/
+static ch_err ch_io_resolve(ch_io_graph* graph,
+                            const char* name,
+                            const size_t* from_idx_ptr,
+                            const size_t** ent_idxs,
+                            size_t* n_ents)
+{
+    *ent_idxs = NULL;
+    *n_ents = 0;
+    if (!name || !*name)
+        return CH_ERR_NONE;
+    if (name[0] == '!') {
+        if (!_stricmp(name, "!self") && *from_idx_ptr < graph->n_ents) {
+            *ent_idxs = from_idx_ptr;
+            *n_ents = 1;
+        } else if (!_stricmp(name, "!player")) {
+            ch_io_name_lookup(&graph->classnames, "player", ent_idxs, n_ents);
+        }
+        return CH_ERR_NONE;
+    }
+    size_t len = strlen(name);
+    if (name[len - 1] == '*') {
+        CH_RET_IF_ERR(ch_io_resolve_wildcard(graph, name, len - 1, n_ents));
+        *ent_idxs = graph->resolve_buf;
+        return CH_ERR_NONE;
+    }
+    ch_io_name_lookup(&graph->targetnames, name, ent_idxs, n_ents);
+    if (*n_ents == 0)
+        ch_io_name_lookup(&graph->classnames, name, ent_idxs, n_ents);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_io_get_action_fields(ch_io_action_fields* fields, const ch_datamap* dm)
+{
+    if (fields->dm == dm)
+        return CH_ERR_NONE;
+    *fields = (ch_io_action_fields){.dm = dm};
+    CH_RET_IF_ERR(ch_find_field(dm, "m_iTarget", true, &fields->target));
+    CH_RET_IF_ERR(ch_find_field(dm, "m_iTargetInput", true, &fields->input));
+    CH_RET_IF_ERR(ch_find_field(dm, "m_iParameter", true, &fields->parameter));
+    CH_RET_IF_ERR(ch_find_field(dm, "m_flDelay", true, &fields->delay));
+    CH_RET_IF_ERR(ch_find_field(dm, "m_nTimesToFire", true, &fields->times_to_fire));
+    if (fields->target->type != FIELD_STRING || fields->input->type != FIELD_STRING ||
+        fields->parameter->type != FIELD_STRING || fields->delay->type != FIELD_FLOAT ||
+        fields->times_to_fire->type != FIELD_INTEGER) {
+        fields->dm = NULL;
+        return CH_ERR_BAD_FIELD_TYPE;
+    }
+    return CH_ERR_NONE;
+}
+
+// if edges is NULL the edges are only counted
+static ch_err ch_io_collect_edges(ch_io_graph* graph, ch_io_edge* edges, size_t* n_edges)
+{
+    ch_io_action_fields action_fields = {0};
+    *n_edges = 0;
+    for (size_t i = 0; i < graph->n_ents; i++) {
+        const ch_restored_entity* ent = graph->block->entities[i];
+        if (edges)
+            graph->out_offsets[i] = *n_edges;
+        if (!ent || !ent->class_info.dm || !ent->class_info.data)
+            continue;
+        const ch_io_dm_info* info;
+        CH_RET_IF_ERR(ch_io_get_dm_info(graph, ent->class_info.dm, &info));
+        for (size_t j = 0; j < info->n_outputs; j++) {
+            const ch_flat_field* field = info->outputs[j];
+            const ch_cr_ent_output* output = *(const ch_cr_ent_output* const*)(ent->class_info.data + field->offset);
+            if (!output || !output->actions.dm || output->actions.n_elems == 0)
+                continue;
+            if (!edges) {
+                *n_edges += output->actions.n_elems;
+                continue;
+            }
+            CH_RET_IF_ERR(ch_io_get_action_fields(&action_fields, output->actions.dm));
+            for (size_t k = 0; k < output->actions.n_elems; k++) {
+                const unsigned char* action = CH_RCA_ELEM_DATA(output->actions, k);
+                edges[(*n_edges)++] = (ch_io_edge){
+                    .from_idx = i,
+                    .output_td = field->td,
+                    .output_name = field->name,
+                    .target = CH_FIELD_AT(action, action_fields.target, const char*),
+                    .input = CH_FIELD_AT(action, action_fields.input, const char*),
+                    .parameter = CH_FIELD_AT(action, action_fields.parameter, const char*),
+                    .delay = CH_FIELD_AT(action, action_fields.delay, float),
+                    .times_to_fire = CH_FIELD_AT(action, action_fields.times_to_fire, int32_t),
+                };
+            }
+        }
+    }
+    if (edges)
+        graph->out_offsets[graph->n_ents] = *n_edges;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_io_resolve_edges(ch_io_graph* graph)
+{
+    CH_CHECKED_ALLOC(graph->in_offsets, ch_arena_calloc(graph->arena, sizeof(size_t) * (graph->n_ents + 1)));
+    size_t n_in_edges = 0;
+    for (size_t i = 0; i < graph->n_edges; i++) {
+        ch_io_edge* edge = &graph->edges[i];
+        CH_RET_IF_ERR(ch_io_resolve(graph, edge->target, &edge->from_idx, &edge->target_idxs, &edge->n_targets));
+        if (edge->n_targets > 0 && edge->target_idxs == graph->resolve_buf) {
+            // wildcard, make a copy
+            size_t* targets;
+            CH_CHECKED_ALLOC(targets, ch_arena_alloc(graph->arena, sizeof(size_t) * edge->n_targets));
+            memcpy(targets, graph->resolve_buf, sizeof(size_t) * edge->n_targets);
+            edge->target_idxs = targets;
+        }
+        for (size_t j = 0; j < edge->n_targets; j++)
+            graph->in_offsets[edge->target_idxs[j] + 1]++;
+        n_in_edges += edge->n_targets;
+    }
+    for (size_t i = 0; i < graph->n_ents; i++)
+        graph->in_offsets[i + 1] += graph->in_offsets[i];
+
+    size_t* in_cursors;
+    CH_CHECKED_ALLOC(in_cursors, ch_arena_alloc(graph->arena, sizeof(size_t) * (graph->n_ents + 1)));
+    memcpy(in_cursors, graph->in_offsets, sizeof(size_t) * (graph->n_ents + 1));
+    CH_CHECKED_ALLOC(graph->in_edges, ch_arena_alloc(graph->arena, sizeof(ch_io_edge*) * n_in_edges));
+    for (size_t i = 0; i < graph->n_edges; i++)
+        for (size_t j = 0; j < graph->edges[i].n_targets; j++)
+            graph->in_edges[in_cursors[graph->edges[i].target_idxs[j]]++] = &graph->edges[i];
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_io_build(ch_io_graph* graph)
+{
+    graph->dm_infos =
+        hashmap_new(sizeof(ch_io_dm_info), 64, 0, 0, ch_io_dm_info_hash, ch_io_dm_info_compare, NULL, NULL);
+    if (!graph->dm_infos)
+        return CH_ERR_OUT_OF_MEMORY;
+    CH_RET_IF_ERR(ch_io_build_name_index(graph, &graph->targetnames, true));
+    CH_RET_IF_ERR(ch_io_build_name_index(graph, &graph->classnames, false));
+
+    CH_RET_IF_ERR(ch_io_collect_edges(graph, NULL, &graph->n_edges));
+    CH_CHECKED_ALLOC(graph->edges, ch_arena_alloc(graph->arena, sizeof(ch_io_edge) * graph->n_edges));
+    CH_CHECKED_ALLOC(graph->out_offsets, ch_arena_alloc(graph->arena, sizeof(size_t) * (graph->n_ents + 1)));
+    CH_RET_IF_ERR(ch_io_collect_edges(graph, graph->edges, &graph->n_edges));
+    CH_RET_IF_ERR(ch_io_resolve_edges(graph));
+
+    CH_CHECKED_ALLOC(graph->steps, ch_arena_alloc(graph->arena, sizeof(ch_io_step) * graph->n_edges));
+    CH_CHECKED_ALLOC(graph->edge_visited, ch_arena_calloc(graph->arena, sizeof(bool) * graph->n_edges));
+    CH_CHECKED_ALLOC(graph->ent_expanded, ch_arena_calloc(graph->arena, sizeof(bool) * graph->n_ents));
+    return CH_ERR_NONE;
+}
+
+ch_err ch_io_graph_new(const ch_state_file* sf, ch_io_graph** graph_out)
+{
+    assert(sf && graph_out);
+    *graph_out = NULL;
+    static const ch_block_entities empty_block = {0};
+    const ch_block_entities* block = ch_sf_get_block_entities(sf);
+    ch_arena* arena = ch_arena_new(1024 * 64);
+    if (!arena)
+        return CH_ERR_OUT_OF_MEMORY;
+    ch_io_graph* graph = ch_arena_calloc(arena, sizeof *graph);
+    if (!graph) {
+        ch_arena_free(arena);
+        return CH_ERR_OUT_OF_MEMORY;
+    }
+    graph->arena = arena;
+    graph->block = block ? block : &empty_block;
+    graph->n_ents = graph->block->entity_table.n_elems;
+    ch_err err = ch_io_build(graph);
+    if (err) {
+        ch_io_graph_free(graph);
+        return err;
+    }
+    *graph_out = graph;
+    return CH_ERR_NONE;
+}
+
+void ch_io_graph_free(ch_io_graph* graph)
+{
+    if (!graph)
+        return;
+    if (graph->dm_infos)
+        hashmap_free(graph->dm_infos);
+    if (graph->targetnames.map)
+        hashmap_free(graph->targetnames.map);
+    if (graph->classnames.map)
+        hashmap_free(graph->classnames.map);
+    free(graph->resolve_buf);
+    ch_arena_free(graph->arena);
+}
+
+void ch_io_graph_get_outputs(const ch_io_graph* graph, size_t ent_idx, const ch_io_edge** edges, size_t* n_edges)
+{
+    if (ent_idx >= graph->n_ents) {
+        *edges = NULL;
+        *n_edges = 0;
+        return;
+    }
+    *edges = graph->edges + graph->out_offsets[ent_idx];
+    *n_edges = graph->out_offsets[ent_idx + 1] - graph->out_offsets[ent_idx];
+}
+
+void ch_io_graph_get_inputs(const ch_io_graph* graph,
+                            size_t ent_idx,
+                            const ch_io_edge* const** edges,
+                            size_t* n_edges)
+{
+    if (ent_idx >= graph->n_ents) {
+        *edges = NULL;
+        *n_edges = 0;
+        return;
+    }
+    *edges = graph->in_edges + graph->in_offsets[ent_idx];
+    *n_edges = graph->in_offsets[ent_idx + 1] - graph->in_offsets[ent_idx];
+}
+
+ch_err ch_io_graph_resolve(ch_io_graph* graph,
+                           const char* name,
+                           size_t from_idx,
+                           const size_t** ent_idxs,
+                           size_t* n_ents)
+{
+    assert(graph && name && ent_idxs && n_ents);
+    // !self needs a pointer that outlives this call
+    if (name[0] == '!' && !_stricmp(name, "!self") && from_idx < graph->n_ents) {
+        if (graph->resolve_buf_cap == 0) {
+            CH_CHECKED_ALLOC(graph->resolve_buf, malloc(sizeof(size_t)));
+            graph->resolve_buf_cap = 1;
+        }
+        graph->resolve_buf[0] = from_idx;
+        *ent_idxs = graph->resolve_buf;
+        *n_ents = 1;
+        return CH_ERR_NONE;
+    }
+    return ch_io_resolve(graph, name, &from_idx, ent_idxs, n_ents);
+}
+
+static bool ch_io_output_name_matches(const ch_io_edge* edge, const char* output_name)
+{
+    if (!output_name || !_stricmp(edge->output_name, output_name))
+        return true;
+    return edge->output_td->external_name && !_stricmp(edge->output_td->external_name, output_name);
+}
+
+ch_err ch_io_graph_traverse(ch_io_graph* graph,
+                            size_t ent_idx,
+                            const char* output_name,
+                            size_t max_depth,
+                            const ch_io_step** steps,
+                            size_t* n_steps)
+{
+    assert(graph && steps && n_steps);
+    size_t n = 0;
+    const ch_io_edge* edges;
+    size_t n_edges;
+    ch_io_graph_get_outputs(graph, ent_idx, &edges, &n_edges);
+    for (size_t i = 0; i < n_edges; i++) {
+        if (!ch_io_output_name_matches(&edges[i], output_name))
+            continue;
+        graph->edge_visited[&edges[i] - graph->edges] = true;
+        graph->steps[n++] = (ch_io_step){.edge = &edges[i], .delay = edges[i].delay, .prev_idx = SIZE_MAX};
+    }
+    // the steps are also the queue
+    for (size_t i = 0; i < n; i++) {
+        const ch_io_step step = graph->steps[i];
+        if (step.depth >= max_depth)
+            continue;
+        for (size_t j = 0; j < step.edge->n_targets; j++) {
+            size_t target_idx = step.edge->target_idxs[j];
+            if (graph->ent_expanded[target_idx])
+                continue;
+            graph->ent_expanded[target_idx] = true;
+            ch_io_graph_get_outputs(graph, target_idx, &edges, &n_edges);
+            for (size_t k = 0; k < n_edges; k++) {
+                if (graph->edge_visited[&edges[k] - graph->edges])
+                    continue;
+                graph->edge_visited[&edges[k] - graph->edges] = true;
+                graph->steps[n++] = (ch_io_step){
+                    .edge = &edges[k],
+                    .depth = step.depth + 1,
+                    .delay = step.delay + edges[k].delay,
+                    .prev_idx = i,
+                };
+            }
+        }
+    }
+    // reset the scratch for the next traversal
+    for (size_t i = 0; i < n; i++) {
+        graph->edge_visited[graph->steps[i].edge - graph->edges] = false;
+        for (size_t j = 0; j < graph->steps[i].edge->n_targets; j++)
+            graph->ent_expanded[graph->steps[i].edge->target_idxs[j]] = false;
+    }
+    *steps = graph->steps;
+    *n_steps = n;
+    return CH_ERR_NONE;
+}
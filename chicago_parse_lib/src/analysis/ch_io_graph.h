@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* The entity I/O graph of a single state file: an edge for every action of every output (e.g. "OnTrigger -> door,
+* Open, delay 1") linked to the entities that the action targets. Targets are resolved the same way as the game's
+* event queue does it:
+* - by targetname (case insensitive, a trailing * matches any suffix)
+* - if no entity has that targetname, by classname
+* - !self is the entity with the output and !player is the player, other ! names (e.g. !activator) depend on who
+*   fired the output and are left unresolved
+*
+* Everything is built in one go and stored as adjacency arrays, so getting the outputs & inputs of an entity and
+* name lookups don't scan anything.
+*
+* The graph points into the save, so the save must outlive it.
+*/
+
+typedef struct ch_io_graph ch_io_graph;
+
+typedef struct ch_io_edge {
+    size_t from_idx; // index of the entity with the output in the entity table
+    const ch_type_description* output_td;
+    const char* output_name; // flattened name of the output field, e.g. "m_OnTrigger"
+    const char* target;
+    const char* input;
+    const char* parameter;
+    float delay;
+    int32_t times_to_fire; // -1 for infinite
+    const size_t* target_idxs; // the resolved targets (entity table indices)
+    size_t n_targets;
+} ch_io_edge;
+
+typedef struct ch_io_step {
+    const ch_io_edge* edge;
+    size_t depth;    // 0 for the outputs of the starting entity
+    float delay;     // time from the starting output firing to this action firing (along the path it was found by)
+    size_t prev_idx; // index in the steps of the action that fired the entity with this output, SIZE_MAX for depth 0
+} ch_io_step;
+
+ch_err ch_io_graph_new(const ch_state_file* sf, ch_io_graph** graph);
+void ch_io_graph_free(ch_io_graph* graph);
+
+// the actions of all outputs of an entity, in field order
+void ch_io_graph_get_outputs(const ch_io_graph* graph, size_t ent_idx, const ch_io_edge** edges, size_t* n_edges);
+// the actions which target the entity
+void ch_io_graph_get_inputs(const ch_io_graph* graph,
+                            size_t ent_idx,
+                            const ch_io_edge* const** edges,
+                            size_t* n_edges);
+
+// resolves a target name the same way as the targets of the edges, from_idx is used for !self
+ch_err ch_io_graph_resolve(ch_io_graph* graph,
+                           const char* name,
+                           size_t from_idx,
+                           const size_t** ent_idxs,
+                           size_t* n_ents);
+
+/*
+* A breadth first traversal of everything that fires when the given output of an entity fires (all outputs if
+* output_name is NULL). The output name can be the field name (m_OnTrigger) or the external name (OnTrigger). Each
+* entity that is reached has all of its outputs followed since there's no way to tell which inputs fire which
+* outputs. Each edge is visited at most once. The steps are valid until the next traversal or resolve.
+*/
+ch_err ch_io_graph_traverse(ch_io_graph* graph,
+                            size_t ent_idx,
+                            const char* output_name,
+                            size_t max_depth,
+                            const ch_io_step** steps,
+                            size_t* n_steps);
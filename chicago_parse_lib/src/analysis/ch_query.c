@@ -0,0 +1,619 @@
+#include <stdlib.h>
+#include <math.h>
+#include <ctype.h>
+
+#include "ch_query.h"
+#include "ch_save_internal.h"
+
+typedef enum ch_query_key {
+    CH_QK_CLASSNAME,
+    CH_QK_TARGETNAME,
+    CH_QK_EDICT,
+    CH_QK_DATAMAP,
+    CH_QK_INDEX_COUNT,
+    CH_QK_FIELD = CH_QK_INDEX_COUNT, // not indexed
+} ch_query_key;
+
+static const char* const ch_query_key_names[CH_QK_INDEX_COUNT] = {
+    [CH_QK_CLASSNAME] = "classname",
+    [CH_QK_TARGETNAME] = "targetname",
+    [CH_QK_EDICT] = "edict",
+    [CH_QK_DATAMAP] = "datamap",
+};
+
+typedef enum ch_query_op {
+    CH_QOP_EQ,
+    CH_QOP_NE,
+    CH_QOP_LT,
+    CH_QOP_LE,
+    CH_QOP_GT,
+    CH_QOP_GE,
+} ch_query_op;
+
+static const struct {
+    const char* str;
+    ch_query_op op;
+} ch_query_op_strs[] = {
+    {"=", CH_QOP_EQ},
+    {"==", CH_QOP_EQ},
+    {"!=", CH_QOP_NE},
+    {"<", CH_QOP_LT},
+    {"<=", CH_QOP_LE},
+    {">", CH_QOP_GT},
+    {">=", CH_QOP_GE},
+};
+
+typedef struct ch_query_cond {
+    ch_query_key key;
+    ch_query_op op;
+    const char* field_name; // only for CH_QK_FIELD
+    const char* str;
+    bool is_num;
+    double num;
+} ch_query_cond;
+
+// the value of a special key for a single entity, only one of str/num is used depending on the key
+typedef struct ch_query_key_val {
+    const char* str;
+    int64_t num;
+} ch_query_key_val;
+
+// the postings of a key are the entity IDs in index->postings[first, first + count)
+typedef struct ch_query_index_entry {
+    ch_query_key_val val;
+    uint32_t first;
+    uint32_t count;
+} ch_query_index_entry;
+
+typedef struct ch_query_index {
+    struct hashmap* map; // ch_query_index_entry, NULL until the index is built
+    uint32_t* postings;
+} ch_query_index;
+
+// a name of NULL is a marker that all fields of the datamap have been added
+typedef struct ch_query_field_entry {
+    const ch_datamap* dm;
+    const char* name;
+    const ch_flat_field* field;
+} ch_query_field_entry;
+
+typedef struct ch_query_ent {
+    ch_query_match match;
+    int32_t edict;
+    bool has_edict;
+} ch_query_ent;
+
+struct ch_query_ctx {
+    ch_arena* arena;
+    ch_query_ent* ents; // all entities of the save in state file & entity index order
+    uint32_t n_ents;
+    ch_query_index indexes[CH_QK_INDEX_COUNT];
+    struct hashmap* fields; // ch_query_field_entry
+
+    // scratch buffers which are reused between queries
+    char* tokens;
+    size_t tokens_cap;
+    ch_query_cond* conds;
+    size_t conds_cap;
+    ch_query_match* matches;
+    size_t matches_cap;
+};
+
+static uint64_t ch_query_key_val_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_query_key_val* val = item;
+    if (val->str) {
+        // FNV-1a over the lowercase string, names are matched case insensitively
+        uint64_t hash = 0xcbf29ce484222325 ^ seed0;
+        for (const char* c = val->str; *c; c++)
+            hash = (hash ^ (unsigned char)tolower((unsigned char)*c)) * 0x100000001b3;
+        return hash ^ seed1;
+    }
+    return hashmap_xxhash3(&val->num, sizeof val->num, seed0, seed1);
+}
+
+static int ch_query_key_val_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_query_key_val* va = a;
+    const ch_query_key_val* vb = b;
+    if (va->str && vb->str)
+        return _stricmp(va->str, vb->str);
+    if (va->str || vb->str)
+        return va->str ? 1 : -1;
+    return va->num < vb->num ? -1 : va->num > vb->num;
+}
+
+static uint64_t ch_query_field_entry_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_query_field_entry* entry = item;
+    uint64_t hash = hashmap_xxhash3(&entry->dm, sizeof entry->dm, seed0, seed1);
+    return entry->name ? hashmap_xxhash3(entry->name, strlen(entry->name), hash, seed1) : hash;
+}
+
+static int ch_query_field_entry_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_query_field_entry* ea = a;
+    const ch_query_field_entry* eb = b;
+    if (ea->dm != eb->dm)
+        return ea->dm < eb->dm ? -1 : 1;
+    if (ea->name && eb->name)
+        return strcmp(ea->name, eb->name);
+    return (ea->name != NULL) - (eb->name != NULL);
+}
+
+static ch_err ch_query_reserve(void** buf, size_t* cap, size_t n, size_t elem_size)
+{
+    if (n <= *cap)
+        return CH_ERR_NONE;
+    size_t new_cap = max(n, *cap * 2);
+    void* new_buf = realloc(*buf, new_cap * elem_size);
+    if (!new_buf)
+        return CH_ERR_OUT_OF_MEMORY;
+    *buf = new_buf;
+    *cap = new_cap;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_query_collect_ents(ch_query_ctx* ctx, const ch_parsed_save_data* save_data)
+{
+    size_t n_ents = 0;
+    for (size_t i = 0; i < save_data->n_state_files; i++) {
+        const ch_block_entities* block = ch_sf_get_block_entities(&save_data->state_files[i]);
+        if (block)
+            n_ents += block->entity_table.n_elems;
+    }
+    if (n_ents > UINT32_MAX)
+        return CH_ERR_OUT_OF_MEMORY;
+    CH_CHECKED_ALLOC(ctx->ents, ch_arena_alloc(ctx->arena, sizeof(ch_query_ent) * n_ents));
+
+    for (size_t i = 0; i < save_data->n_state_files; i++) {
+        const ch_state_file* sf = &save_data->state_files[i];
+        const ch_block_entities* block = ch_sf_get_block_entities(sf);
+        if (!block)
+            continue;
+        const ch_type_description* td_edict = NULL;
+        ch_find_field(block->entity_table.dm, "edictindex", true, &td_edict);
+        for (size_t j = 0; j < block->entity_table.n_elems; j++) {
+            // skip entities which failed to restore partway through
+            const ch_restored_entity* re = block->entities[j];
+            if (!re || !re->class_info.dm || !re->class_info.data)
+                continue;
+            ch_query_ent* ent = &ctx->ents[ctx->n_ents++];
+            *ent = (ch_query_ent){
+                .match = {.sf = sf, .ent_idx = j, .ent = block->entities[j]},
+                .has_edict = td_edict && td_edict->type == FIELD_INTEGER,
+            };
+            if (ent->has_edict)
+                ent->edict = CH_FIELD_AT(CH_RCA_ELEM_DATA(block->entity_table, j), td_edict, int32_t);
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+ch_err ch_query_ctx_new(const ch_parsed_save_data* save_data, ch_query_ctx** ctx_out)
+{
+    assert(save_data && ctx_out);
+    *ctx_out = NULL;
+    ch_arena* arena = ch_arena_new(1024 * 64);
+    if (!arena)
+        return CH_ERR_OUT_OF_MEMORY;
+    ch_query_ctx* ctx = ch_arena_calloc(arena, sizeof *ctx);
+    if (!ctx) {
+        ch_arena_free(arena);
+        return CH_ERR_OUT_OF_MEMORY;
+    }
+    ctx->arena = arena;
+    ctx->fields = hashmap_new(sizeof(ch_query_field_entry),
+                              256,
+                              0,
+                              0,
+                              ch_query_field_entry_hash,
+                              ch_query_field_entry_compare,
+                              NULL,
+                              NULL);
+    ch_err err = ctx->fields ? ch_query_collect_ents(ctx, save_data) : CH_ERR_OUT_OF_MEMORY;
+    if (err) {
+        ch_query_ctx_free(ctx);
+        return err;
+    }
+    *ctx_out = ctx;
+    return CH_ERR_NONE;
+}
+
+void ch_query_ctx_free(ch_query_ctx* ctx)
+{
+    if (!ctx)
+        return;
+    for (int i = 0; i < CH_QK_INDEX_COUNT; i++)
+        if (ctx->indexes[i].map)
+            hashmap_free(ctx->indexes[i].map);
+    if (ctx->fields)
+        hashmap_free(ctx->fields);
+    free(ctx->tokens);
+    free(ctx->conds);
+    free(ctx->matches);
+    ch_arena_free(ctx->arena);
+}
+
+// field is set to NULL if the datamap doesn't have a field with the given name
+static ch_err ch_query_find_field(ch_query_ctx* ctx,
+                                  const ch_datamap* dm,
+                                  const char* name,
+                                  const ch_flat_field** field)
+{
+    ch_query_field_entry entry = {.dm = dm};
+    if (!hashmap_get(ctx->fields, &entry)) {
+        ch_flat_field* fields;
+        size_t n_fields;
+        CH_RET_IF_ERR(ch_flatten_fields(ctx->arena, dm, 0, &fields, &n_fields));
+        for (const ch_flat_field* f = fields; f; f = f->next) {
+            // the game's datamaps sometimes have the same field twice, use the first one
+            ch_query_field_entry field_entry = {.dm = dm, .name = f->name, .field = f};
+            if (!hashmap_get(ctx->fields, &field_entry) && !hashmap_set(ctx->fields, &field_entry) &&
+                hashmap_oom(ctx->fields))
+                return CH_ERR_OUT_OF_MEMORY;
+        }
+        if (!hashmap_set(ctx->fields, &entry) && hashmap_oom(ctx->fields))
+            return CH_ERR_OUT_OF_MEMORY;
+    }
+    entry.name = name;
+    const ch_query_field_entry* found = hashmap_get(ctx->fields, &entry);
+    *field = found ? found->field : NULL;
+    return CH_ERR_NONE;
+}
+
+// has_val is set to false if the entity doesn't have the key, NULL strings are treated as ""
+static ch_err ch_query_get_key_val(ch_query_ctx* ctx,
+                                   const ch_query_ent* ent,
+                                   ch_query_key key,
+                                   ch_query_key_val* val,
+                                   bool* has_val)
+{
+    const ch_restored_entity* re = ent->match.ent;
+    *val = (ch_query_key_val){0};
+    *has_val = true;
+    switch (key) {
+        case CH_QK_CLASSNAME:
+            val->str = re->classname ? re->classname : "";
+            break;
+        case CH_QK_TARGETNAME: {
+            const ch_flat_field* field;
+            CH_RET_IF_ERR(ch_query_find_field(ctx, re->class_info.dm, "m_iName", &field));
+            *has_val = field && field->td->type == FIELD_STRING && field->td->n_elems == 1;
+            if (*has_val) {
+                const char* name = *(const char* const*)(re->class_info.data + field->offset);
+                val->str = name ? name : "";
+            }
+            break;
+        }
+        case CH_QK_EDICT:
+            *has_val = ent->has_edict;
+            val->num = ent->edict;
+            break;
+        case CH_QK_DATAMAP:
+            val->str = re->class_info.dm->class_name;
+            break;
+        default:
+            assert(0);
+            *has_val = false;
+            break;
+    }
+    return CH_ERR_NONE;
+}
+
+/*
+* Two passes over the entities: the first counts how many entities have each key, then each key gets a range in the
+* postings array, and the second pass fills in the ranges. The postings of each key end up sorted by entity ID.
+*/
+static ch_err ch_query_build_index(ch_query_ctx* ctx, ch_query_key key)
+{
+    ch_query_index* index = &ctx->indexes[key];
+    if (index->map)
+        return CH_ERR_NONE;
+    struct hashmap* map = hashmap_new(sizeof(ch_query_index_entry),
+                                      256,
+                                      0,
+                                      0,
+                                      ch_query_key_val_hash,
+                                      ch_query_key_val_compare,
+                                      NULL,
+                                      NULL);
+    if (!map)
+        return CH_ERR_OUT_OF_MEMORY;
+
+    ch_err err = CH_ERR_NONE;
+    uint32_t n_postings = 0;
+    for (uint32_t i = 0; i < ctx->n_ents && !err; i++) {
+        ch_query_index_entry entry = {0};
+        bool has_val;
+        err = ch_query_get_key_val(ctx, &ctx->ents[i], key, &entry.val, &has_val);
+        if (err || !has_val)
+            continue;
+        n_postings++;
+        ch_query_index_entry* existing = (ch_query_index_entry*)hashmap_get(map, &entry);
+        if (existing) {
+            existing->count++;
+        } else {
+            entry.count = 1;
+            if (!hashmap_set(map, &entry) && hashmap_oom(map))
+                err = CH_ERR_OUT_OF_MEMORY;
+        }
+    }
+    if (!err) {
+        index->postings = ch_arena_alloc(ctx->arena, sizeof(uint32_t) * n_postings);
+        if (!index->postings)
+            err = CH_ERR_OUT_OF_MEMORY;
+    }
+    if (err) {
+        hashmap_free(map);
+        return err;
+    }
+
+    size_t iter = 0;
+    void* item;
+    uint32_t first = 0;
+    while (hashmap_iter(map, &iter, &item)) {
+        ch_query_index_entry* entry = item;
+        entry->first = first;
+        first += entry->count;
+        entry->count = 0;
+    }
+    for (uint32_t i = 0; i < ctx->n_ents; i++) {
+        ch_query_index_entry entry = {0};
+        bool has_val;
+        // the first pass already did all the field lookups, so this can't fail
+        ch_query_get_key_val(ctx, &ctx->ents[i], key, &entry.val, &has_val);
+        if (!has_val)
+            continue;
+        ch_query_index_entry* existing = (ch_query_index_entry*)hashmap_get(map, &entry);
+        index->postings[existing->first + existing->count++] = i;
+    }
+    index->map = map;
+    return CH_ERR_NONE;
+}
+
+static bool ch_query_is_op_char(char c)
+{
+    return c == '=' || c == '!' || c == '<' || c == '>';
+}
+
+/*
+* Splits the query into tokens and writes them as null terminated strings to ctx->tokens. Quoted strings have their
+* quotes stripped, and a run of operator characters is a single token.
+*/
+static ch_err ch_query_tokenize(ch_query_ctx* ctx, const char* query, size_t* n_tokens)
+{
+    // each token is at most as long as the query plus a null terminator
+    size_t query_len = strlen(query);
+    CH_RET_IF_ERR(ch_query_reserve((void**)&ctx->tokens, &ctx->tokens_cap, query_len * 2 + 1, 1));
+    char* out = ctx->tokens;
+    *n_tokens = 0;
+    for (const char* p = query;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            p++;
+        if (!*p)
+            break;
+        const char* start = p;
+        if (*p == '"') {
+            start = ++p;
+            while (*p && *p != '"')
+                p++;
+            if (!*p)
+                return CH_ERR_QUERY_SYNTAX;
+            memcpy(out, start, p - start);
+            out += p++ - start;
+        } else {
+            bool op = ch_query_is_op_char(*p);
+            while (*p && *p != '"' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' &&
+                   ch_query_is_op_char(*p) == op)
+                p++;
+            memcpy(out, start, p - start);
+            out += p - start;
+        }
+        *out++ = '\0';
+        ++*n_tokens;
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_query_parse(ch_query_ctx* ctx, const char* query, size_t* n_conds)
+{
+    size_t n_tokens;
+    CH_RET_IF_ERR(ch_query_tokenize(ctx, query, &n_tokens));
+    *n_conds = 0;
+    if (n_tokens == 0)
+        return CH_ERR_NONE;
+    // <key> <op> <value> (and <key> <op> <value>)*
+    if (n_tokens % 4 != 3)
+        return CH_ERR_QUERY_SYNTAX;
+    CH_RET_IF_ERR(ch_query_reserve((void**)&ctx->conds, &ctx->conds_cap, (n_tokens + 1) / 4, sizeof(ch_query_cond)));
+
+    const char* tok = ctx->tokens;
+    for (size_t i = 0; i < n_tokens; i += 4) {
+        if (i > 0) {
+            if (_stricmp(tok, "and"))
+                return CH_ERR_QUERY_SYNTAX;
+            tok += strlen(tok) + 1;
+        }
+        ch_query_cond* cond = &ctx->conds[(*n_conds)++];
+        *cond = (ch_query_cond){.key = CH_QK_FIELD, .field_name = tok};
+        for (int k = 0; k < CH_QK_INDEX_COUNT; k++)
+            if (!strcmp(tok, ch_query_key_names[k]))
+                cond->key = (ch_query_key)k;
+        tok += strlen(tok) + 1;
+
+        size_t op_idx = 0;
+        while (op_idx < CH_ARRAYSIZE(ch_query_op_strs) && strcmp(tok, ch_query_op_strs[op_idx].str))
+            op_idx++;
+        if (op_idx == CH_ARRAYSIZE(ch_query_op_strs))
+            return CH_ERR_QUERY_SYNTAX;
+        cond->op = ch_query_op_strs[op_idx].op;
+        tok += strlen(tok) + 1;
+
+        cond->str = tok;
+        char* end;
+        cond->num = strtod(tok, &end);
+        cond->is_num = *tok && !*end;
+        tok += strlen(tok) + 1;
+    }
+    return CH_ERR_NONE;
+}
+
+static bool ch_query_op_matches(ch_query_op op, int cmp)
+{
+    switch (op) {
+        case CH_QOP_EQ:
+            return cmp == 0;
+        case CH_QOP_NE:
+            return cmp != 0;
+        case CH_QOP_LT:
+            return cmp < 0;
+        case CH_QOP_LE:
+            return cmp <= 0;
+        case CH_QOP_GT:
+            return cmp > 0;
+        case CH_QOP_GE:
+            return cmp >= 0;
+        default:
+            assert(0);
+            return false;
+    }
+}
+
+static bool ch_query_num_matches(const ch_query_cond* cond, double val)
+{
+    if (!cond->is_num || isnan(val))
+        return false;
+    return ch_query_op_matches(cond->op, (val > cond->num) - (val < cond->num));
+}
+
+static bool ch_query_field_matches(const ch_query_cond* cond, const ch_type_description* td, const unsigned char* val)
+{
+    if (ch_field_type_is_str(td->type)) {
+        if (td->n_elems != 1)
+            return false;
+        const char* str = *(const char* const*)val;
+        return ch_query_op_matches(cond->op, strcmp(str ? str : "", cond->str));
+    }
+    if (td->type == FIELD_CHARACTER && td->n_elems > 1) {
+        // char array, not necessarily null terminated
+        size_t len = strnlen((const char*)val, td->n_elems);
+        int cmp = strncmp((const char*)val, cond->str, len);
+        if (cmp == 0 && cond->str[len])
+            cmp = -1;
+        return ch_query_op_matches(cond->op, cmp);
+    }
+    if (td->n_elems != 1)
+        return false;
+    switch (td->type) {
+        case FIELD_FLOAT:
+        case FIELD_TIME:
+            return ch_query_num_matches(cond, *(const float*)val);
+        case FIELD_INTEGER:
+        case FIELD_TICK:
+        case FIELD_CLASSPTR:
+        case FIELD_EDICT:
+            return ch_query_num_matches(cond, *(const int32_t*)val);
+        case FIELD_EHANDLE:
+        case FIELD_COLOR32:
+            return ch_query_num_matches(cond, *(const uint32_t*)val);
+        case FIELD_SHORT:
+            return ch_query_num_matches(cond, *(const int16_t*)val);
+        case FIELD_BOOLEAN:
+        case FIELD_CHARACTER:
+            return ch_query_num_matches(cond, *(const int8_t*)val);
+        default:
+            return false;
+    }
+}
+
+static ch_err ch_query_cond_matches(ch_query_ctx* ctx, const ch_query_cond* cond, const ch_query_ent* ent, bool* match)
+{
+    const ch_restored_entity* re = ent->match.ent;
+    if (cond->key == CH_QK_FIELD) {
+        const ch_flat_field* field;
+        CH_RET_IF_ERR(ch_query_find_field(ctx, re->class_info.dm, cond->field_name, &field));
+        *match = field && ch_query_field_matches(cond, field->td, re->class_info.data + field->offset);
+        return CH_ERR_NONE;
+    }
+    ch_query_key_val val;
+    bool has_val;
+    CH_RET_IF_ERR(ch_query_get_key_val(ctx, ent, cond->key, &val, &has_val));
+    if (!has_val)
+        *match = false;
+    else if (cond->key == CH_QK_EDICT)
+        *match = ch_query_num_matches(cond, (double)val.num);
+    else
+        *match = ch_query_op_matches(cond->op, _stricmp(val.str, cond->str));
+    return CH_ERR_NONE;
+}
+
+/*
+* Finds the smallest posting list out of all the = conditions on special keys. If there are none, candidates is
+* set to NULL and all entities have to be checked.
+*/
+static ch_err ch_query_get_candidates(ch_query_ctx* ctx,
+                                      size_t n_conds,
+                                      const uint32_t** candidates,
+                                      uint32_t* n_candidates)
+{
+    *candidates = NULL;
+    *n_candidates = ctx->n_ents;
+    for (size_t i = 0; i < n_conds; i++) {
+        const ch_query_cond* cond = &ctx->conds[i];
+        if (cond->key == CH_QK_FIELD || cond->op != CH_QOP_EQ)
+            continue;
+        CH_RET_IF_ERR(ch_query_build_index(ctx, cond->key));
+        const ch_query_index* index = &ctx->indexes[cond->key];
+        ch_query_index_entry lookup = {0};
+        if (cond->key == CH_QK_EDICT) {
+            // edict indices are integers, anything else can't match
+            if (!cond->is_num || cond->num != (double)(int64_t)cond->num) {
+                *n_candidates = 0;
+                return CH_ERR_NONE;
+            }
+            lookup.val.num = (int64_t)cond->num;
+        } else {
+            lookup.val.str = cond->str;
+        }
+        const ch_query_index_entry* entry = hashmap_get(index->map, &lookup);
+        if (!entry) {
+            *n_candidates = 0;
+            return CH_ERR_NONE;
+        }
+        if (!*candidates || entry->count < *n_candidates) {
+            *candidates = index->postings + entry->first;
+            *n_candidates = entry->count;
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+ch_err ch_query_run(ch_query_ctx* ctx, const char* query, const ch_query_match** matches, size_t* n_matches)
+{
+    assert(ctx && query && matches && n_matches);
+    *matches = NULL;
+    *n_matches = 0;
+    size_t n_conds;
+    CH_RET_IF_ERR(ch_query_parse(ctx, query, &n_conds));
+    const uint32_t* candidates;
+    uint32_t n_candidates;
+    CH_RET_IF_ERR(ch_query_get_candidates(ctx, n_conds, &candidates, &n_candidates));
+
+    size_t n = 0;
+    for (uint32_t i = 0; i < n_candidates; i++) {
+        const ch_query_ent* ent = &ctx->ents[candidates ? candidates[i] : i];
+        bool match = true;
+        for (size_t j = 0; j < n_conds && match; j++)
+            CH_RET_IF_ERR(ch_query_cond_matches(ctx, &ctx->conds[j], ent, &match));
+        if (!match)
+            continue;
+        CH_RET_IF_ERR(ch_query_reserve((void**)&ctx->matches, &ctx->matches_cap, n + 1, sizeof(ch_query_match)));
+        ctx->matches[n++] = ent->match;
+    }
+    *matches = ctx->matches;
+    *n_matches = n;
+    return CH_ERR_NONE;
+}
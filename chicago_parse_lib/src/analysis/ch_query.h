@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* Queries over the entities of a parsed save, e.g.:
+* classname = prop_physics and m_iHealth > 0
+* targetname = "door 1"
+* datamap = CPhysicsProp and edict < 100
+*
+* A query is a list of conditions joined by "and", each condition is <key> <op> <value> where op is one of
+* = == != < <= > >=. Values can be quoted with "" if they have spaces in them. An empty query matches everything.
+* The following keys are special:
+* - classname: the classname of the entity
+* - targetname: the m_iName field of the entity
+* - edict: the edict index from the entity table
+* - datamap: the class name of the datamap the entity was restored with (e.g. CPhysicsProp)
+* Any other key is the name of a flattened field of the entity's class (see ch_flatten_fields), e.g. m_iHealth or
+* m_Collision.m_vecMins. Only strings, char arrays, and single numerical fields can be compared. A condition on a
+* field which the entity doesn't have (or can't be compared) never matches. The special keys are compared case
+* insensitively (like the game does for entity names), string fields are compared case sensitively. Entities which
+* weren't fully restored are never matched.
+*
+* The special keys have secondary indexes which are built from the entity tables the first time they are used. If
+* a query has an = condition on any special key, only the entities with that key are checked instead of all of them.
+*
+* The ctx points into the save, so the save must outlive it. Reuse the ctx for many queries on the same save.
+*/
+
+typedef struct ch_query_ctx ch_query_ctx;
+
+typedef struct ch_query_match {
+    const ch_state_file* sf;
+    size_t ent_idx; // index in the entity table
+    const ch_restored_entity* ent;
+} ch_query_match;
+
+ch_err ch_query_ctx_new(const ch_parsed_save_data* save_data, ch_query_ctx** ctx);
+void ch_query_ctx_free(ch_query_ctx* ctx);
+
+// matches are sorted by state file & entity index, and are valid until the next query on the same ctx
+ch_err ch_query_run(ch_query_ctx* ctx, const char* query, const ch_query_match** matches, size_t* n_matches);
@@ -0,0 +1,420 @@
+#include <math.h>
+
+#include "ch_spatial.h"
+#include "ch_save_internal.h"
+
+#define CH_SPATIAL_LEAF_SIZE 8
+// the tree is split at the median so it's balanced, this is plenty for 2^32 entities
+#define CH_SPATIAL_MAX_DEPTH 64
+
+typedef struct ch_spatial_node {
+    float mins[3], maxs[3];
+    uint32_t first; // first child for inner nodes (the second is first + 1), first entity for leaves
+    uint32_t count; // number of entities for leaves, 0 for inner nodes
+} ch_spatial_node;
+
+typedef struct ch_spatial_knn {
+    const ch_spatial_ent* ent;
+    float dist_sq;
+} ch_spatial_knn;
+
+struct ch_spatial_index {
+    ch_arena* arena;
+    ch_spatial_ent* ents; // in leaf order, each leaf has a contiguous range
+    uint32_t n_ents;
+    ch_spatial_node* nodes; // the root is the first node
+    uint32_t n_nodes;
+
+    // scratch buffers which are reused between queries
+    const ch_spatial_ent** results;
+    size_t results_cap;
+    ch_spatial_knn* heap;
+    size_t heap_cap;
+};
+
+// cached origin field of each datamap, td is NULL if the datamap doesn't have a usable field
+typedef struct ch_spatial_dm_field {
+    const ch_datamap* dm;
+    const ch_type_description* td;
+} ch_spatial_dm_field;
+
+static uint64_t ch_spatial_dm_field_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_spatial_dm_field* entry = item;
+    return hashmap_xxhash3(&entry->dm, sizeof entry->dm, seed0, seed1);
+}
+
+static int ch_spatial_dm_field_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_spatial_dm_field* ea = a;
+    const ch_spatial_dm_field* eb = b;
+    return ea->dm < eb->dm ? -1 : ea->dm > eb->dm;
+}
+
+#define CH_SPATIAL_DEFINE_AXIS_COMPARE(axis)                                    \
+    static int ch_spatial_ent_compare_##axis(const void* a, const void* b)      \
+    {                                                                           \
+        float pa = ((const ch_spatial_ent*)a)->pos[axis];                       \
+        float pb = ((const ch_spatial_ent*)b)->pos[axis];                       \
+        return pa < pb ? -1 : pa > pb;                                          \
+    }
+
+CH_SPATIAL_DEFINE_AXIS_COMPARE(0)
+CH_SPATIAL_DEFINE_AXIS_COMPARE(1)
+CH_SPATIAL_DEFINE_AXIS_COMPARE(2)
+
+static int (*const ch_spatial_axis_compares[3])(const void*, const void*) = {
+    ch_spatial_ent_compare_0,
+    ch_spatial_ent_compare_1,
+    ch_spatial_ent_compare_2,
+};
+
+static void ch_spatial_build_node(ch_spatial_index* index, uint32_t node_idx, uint32_t first, uint32_t count)
+{
+    assert(count > 0);
+    ch_spatial_node* node = &index->nodes[node_idx];
+    const ch_spatial_ent* ents = &index->ents[first];
+    for (int i = 0; i < 3; i++)
+        node->mins[i] = node->maxs[i] = ents[0].pos[i];
+    for (uint32_t j = 1; j < count; j++) {
+        for (int i = 0; i < 3; i++) {
+            node->mins[i] = min(node->mins[i], ents[j].pos[i]);
+            node->maxs[i] = max(node->maxs[i], ents[j].pos[i]);
+        }
+    }
+    if (count <= CH_SPATIAL_LEAF_SIZE) {
+        node->first = first;
+        node->count = count;
+        return;
+    }
+    // split along the longest axis at the median
+    int axis = 0;
+    for (int i = 1; i < 3; i++)
+        if (node->maxs[i] - node->mins[i] > node->maxs[axis] - node->mins[axis])
+            axis = i;
+    qsort(&index->ents[first], count, sizeof(ch_spatial_ent), ch_spatial_axis_compares[axis]);
+    uint32_t child = index->n_nodes;
+    index->n_nodes += 2;
+    node->first = child;
+    node->count = 0;
+    ch_spatial_build_node(index, child, first, count / 2);
+    ch_spatial_build_node(index, child + 1, first + count / 2, count - count / 2);
+}
+
+static ch_err ch_spatial_collect_ents(ch_spatial_index* index, const ch_state_file* sf, const char* origin_field)
+{
+    const ch_block_entities* block = ch_sf_get_block_entities(sf);
+    if (!block)
+        return CH_ERR_NONE;
+    if (block->entity_table.n_elems > UINT32_MAX / 2)
+        return CH_ERR_OUT_OF_MEMORY;
+    CH_CHECKED_ALLOC(index->ents, ch_arena_alloc(index->arena, sizeof(ch_spatial_ent) * block->entity_table.n_elems));
+
+    struct hashmap* dm_fields = hashmap_new(sizeof(ch_spatial_dm_field),
+                                            64,
+                                            0,
+                                            0,
+                                            ch_spatial_dm_field_hash,
+                                            ch_spatial_dm_field_compare,
+                                            NULL,
+                                            NULL);
+    if (!dm_fields)
+        return CH_ERR_OUT_OF_MEMORY;
+    for (size_t i = 0; i < block->entity_table.n_elems; i++) {
+        const ch_restored_entity* ent = block->entities[i];
+        // skip entities which failed to restore partway through
+        if (!ent || !ent->class_info.dm || !ent->class_info.data)
+            continue;
+        ch_spatial_dm_field field = {.dm = ent->class_info.dm};
+        const ch_spatial_dm_field* cached = hashmap_get(dm_fields, &field);
+        if (cached) {
+            field = *cached;
+        } else {
+            ch_find_field(field.dm, origin_field, true, &field.td);
+            if (field.td &&
+                ((field.td->type != FIELD_VECTOR && field.td->type != FIELD_POSITION_VECTOR) || field.td->n_elems != 1))
+                field.td = NULL;
+            if (!hashmap_set(dm_fields, &field) && hashmap_oom(dm_fields)) {
+                hashmap_free(dm_fields);
+                return CH_ERR_OUT_OF_MEMORY;
+            }
+        }
+        if (!field.td)
+            continue;
+        const float* pos = CH_FIELD_AT_PTR(ent->class_info.data, field.td, const float);
+        if (!isfinite(pos[0]) || !isfinite(pos[1]) || !isfinite(pos[2]))
+            continue;
+        ch_spatial_ent* sent = &index->ents[index->n_ents++];
+        sent->ent = ent;
+        sent->ent_idx = i;
+        memcpy(sent->pos, pos, sizeof sent->pos);
+    }
+    hashmap_free(dm_fields);
+    return CH_ERR_NONE;
+}
+
+ch_err ch_spatial_index_new(const ch_state_file* sf, const char* origin_field, ch_spatial_index** index_out)
+{
+    assert(sf && index_out);
+    *index_out = NULL;
+    ch_arena* arena = ch_arena_new(1024 * 64);
+    if (!arena)
+        return CH_ERR_OUT_OF_MEMORY;
+    ch_spatial_index* index = ch_arena_calloc(arena, sizeof *index);
+    if (!index) {
+        ch_arena_free(arena);
+        return CH_ERR_OUT_OF_MEMORY;
+    }
+    index->arena = arena;
+    ch_err err = ch_spatial_collect_ents(index, sf, origin_field ? origin_field : "m_vecAbsOrigin");
+    if (!err && index->n_ents > 0) {
+        // each inner node has two non-empty children, so there are at most 2n-1 nodes
+        index->nodes = ch_arena_alloc(arena, sizeof(ch_spatial_node) * (2 * index->n_ents - 1));
+        if (index->nodes) {
+            index->n_nodes = 1;
+            ch_spatial_build_node(index, 0, 0, index->n_ents);
+        } else {
+            err = CH_ERR_OUT_OF_MEMORY;
+        }
+    }
+    if (err) {
+        ch_spatial_index_free(index);
+        return err;
+    }
+    *index_out = index;
+    return CH_ERR_NONE;
+}
+
+void ch_spatial_index_free(ch_spatial_index* index)
+{
+    if (!index)
+        return;
+    free(index->results);
+    free(index->heap);
+    ch_arena_free(index->arena);
+}
+
+void ch_spatial_get_ents(const ch_spatial_index* index, const ch_spatial_ent** ents, size_t* n_ents)
+{
+    *ents = index->ents;
+    *n_ents = index->n_ents;
+}
+
+static ch_err ch_spatial_reserve(void** buf, size_t* cap, size_t n, size_t elem_size)
+{
+    if (n <= *cap)
+        return CH_ERR_NONE;
+    size_t new_cap = max(n, *cap * 2);
+    void* new_buf = realloc(*buf, new_cap * elem_size);
+    if (!new_buf)
+        return CH_ERR_OUT_OF_MEMORY;
+    *buf = new_buf;
+    *cap = new_cap;
+    return CH_ERR_NONE;
+}
+
+static float ch_spatial_point_dist_sq(const float a[3], const float b[3])
+{
+    float d[3] = {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+static float ch_spatial_box_dist_sq(const ch_spatial_node* node, const float point[3])
+{
+    float dist_sq = 0;
+    for (int i = 0; i < 3; i++) {
+        float d = max(node->mins[i] - point[i], max(0, point[i] - node->maxs[i]));
+        dist_sq += d * d;
+    }
+    return dist_sq;
+}
+
+typedef enum ch_spatial_shape {
+    CH_SPATIAL_BOX,
+    CH_SPATIAL_SPHERE,
+} ch_spatial_shape;
+
+typedef struct ch_spatial_range {
+    ch_spatial_shape shape;
+    float mins[3], maxs[3]; // box
+    float center[3];        // sphere
+    float radius_sq;
+} ch_spatial_range;
+
+static bool ch_spatial_range_hits_node(const ch_spatial_range* range, const ch_spatial_node* node)
+{
+    if (range->shape == CH_SPATIAL_SPHERE)
+        return ch_spatial_box_dist_sq(node, range->center) <= range->radius_sq;
+    for (int i = 0; i < 3; i++)
+        if (node->maxs[i] < range->mins[i] || node->mins[i] > range->maxs[i])
+            return false;
+    return true;
+}
+
+static bool ch_spatial_range_hits_point(const ch_spatial_range* range, const float pos[3])
+{
+    if (range->shape == CH_SPATIAL_SPHERE)
+        return ch_spatial_point_dist_sq(pos, range->center) <= range->radius_sq;
+    for (int i = 0; i < 3; i++)
+        if (pos[i] < range->mins[i] || pos[i] > range->maxs[i])
+            return false;
+    return true;
+}
+
+static ch_err ch_spatial_query_range(ch_spatial_index* index,
+                                     const ch_spatial_range* range,
+                                     const ch_spatial_ent* const** results,
+                                     size_t* n_results)
+{
+    size_t n = 0;
+    uint32_t stack[CH_SPATIAL_MAX_DEPTH + 1];
+    size_t stack_size = 0;
+    if (index->n_nodes > 0)
+        stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const ch_spatial_node* node = &index->nodes[stack[--stack_size]];
+        if (!ch_spatial_range_hits_node(range, node))
+            continue;
+        if (node->count == 0) {
+            assert(stack_size + 2 <= CH_ARRAYSIZE(stack));
+            stack[stack_size++] = node->first;
+            stack[stack_size++] = node->first + 1;
+            continue;
+        }
+        CH_RET_IF_ERR(ch_spatial_reserve((void**)&index->results,
+                                         &index->results_cap,
+                                         n + node->count,
+                                         sizeof(ch_spatial_ent*)));
+        for (uint32_t i = node->first; i < node->first + node->count; i++)
+            if (ch_spatial_range_hits_point(range, index->ents[i].pos))
+                index->results[n++] = &index->ents[i];
+    }
+    *results = index->results;
+    *n_results = n;
+    return CH_ERR_NONE;
+}
+
+ch_err ch_spatial_query_box(ch_spatial_index* index,
+                            const float mins[3],
+                            const float maxs[3],
+                            const ch_spatial_ent* const** results,
+                            size_t* n_results)
+{
+    assert(index && mins && maxs && results && n_results);
+    ch_spatial_range range = {.shape = CH_SPATIAL_BOX};
+    memcpy(range.mins, mins, sizeof range.mins);
+    memcpy(range.maxs, maxs, sizeof range.maxs);
+    return ch_spatial_query_range(index, &range, results, n_results);
+}
+
+ch_err ch_spatial_query_sphere(ch_spatial_index* index,
+                               const float center[3],
+                               float radius,
+                               const ch_spatial_ent* const** results,
+                               size_t* n_results)
+{
+    assert(index && center && results && n_results);
+    if (radius < 0) {
+        *results = index->results;
+        *n_results = 0;
+        return CH_ERR_NONE;
+    }
+    ch_spatial_range range = {.shape = CH_SPATIAL_SPHERE, .radius_sq = radius * radius};
+    memcpy(range.center, center, sizeof range.center);
+    return ch_spatial_query_range(index, &range, results, n_results);
+}
+
+// max heap of the k closest entities found so far, the root is the furthest one
+typedef struct ch_spatial_knn_ctx {
+    const ch_spatial_index* index;
+    const float* point;
+    ch_spatial_knn* heap;
+    size_t n, k;
+} ch_spatial_knn_ctx;
+
+static void ch_spatial_heap_sift_down(ch_spatial_knn* heap, size_t i, size_t n)
+{
+    for (;;) {
+        size_t largest = i;
+        size_t l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && heap[l].dist_sq > heap[largest].dist_sq)
+            largest = l;
+        if (r < n && heap[r].dist_sq > heap[largest].dist_sq)
+            largest = r;
+        if (largest == i)
+            return;
+        ch_spatial_knn tmp = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = tmp;
+        i = largest;
+    }
+}
+
+static void ch_spatial_heap_push(ch_spatial_knn_ctx* ctx, ch_spatial_knn item)
+{
+    if (ctx->n == ctx->k) {
+        if (item.dist_sq >= ctx->heap[0].dist_sq)
+            return;
+        ctx->heap[0] = item;
+        ch_spatial_heap_sift_down(ctx->heap, 0, ctx->n);
+        return;
+    }
+    size_t i = ctx->n++;
+    while (i > 0 && ctx->heap[(i - 1) / 2].dist_sq < item.dist_sq) {
+        ctx->heap[i] = ctx->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    ctx->heap[i] = item;
+}
+
+static void ch_spatial_knn_visit(ch_spatial_knn_ctx* ctx, uint32_t node_idx)
+{
+    const ch_spatial_node* node = &ctx->index->nodes[node_idx];
+    if (node->count > 0) {
+        for (uint32_t i = node->first; i < node->first + node->count; i++) {
+            const ch_spatial_ent* ent = &ctx->index->ents[i];
+            ch_spatial_heap_push(ctx, (ch_spatial_knn){ent, ch_spatial_point_dist_sq(ent->pos, ctx->point)});
+        }
+        return;
+    }
+    // visit the closer child first so that the heap fills up with close entities quickly
+    uint32_t children[2] = {node->first, node->first + 1};
+    float dists[2] = {
+        ch_spatial_box_dist_sq(&ctx->index->nodes[children[0]], ctx->point),
+        ch_spatial_box_dist_sq(&ctx->index->nodes[children[1]], ctx->point),
+    };
+    int first = dists[1] < dists[0];
+    for (int i = 0; i < 2; i++) {
+        int c = i ^ first;
+        if (ctx->n < ctx->k || dists[c] < ctx->heap[0].dist_sq)
+            ch_spatial_knn_visit(ctx, children[c]);
+    }
+}
+
+ch_err ch_spatial_query_nearest(ch_spatial_index* index,
+                                const float point[3],
+                                size_t k,
+                                const ch_spatial_ent* const** results,
+                                size_t* n_results)
+{
+    assert(index && point && results && n_results);
+    k = min(k, index->n_ents);
+    CH_RET_IF_ERR(ch_spatial_reserve((void**)&index->heap, &index->heap_cap, k, sizeof(ch_spatial_knn)));
+    CH_RET_IF_ERR(ch_spatial_reserve((void**)&index->results, &index->results_cap, k, sizeof(ch_spatial_ent*)));
+    ch_spatial_knn_ctx ctx = {.index = index, .point = point, .heap = index->heap, .k = k};
+    if (k > 0)
+        ch_spatial_knn_visit(&ctx, 0);
+    // heap sort, the furthest entity is moved to the end each time
+    for (size_t i = ctx.n; i-- > 1;) {
+        ch_spatial_knn tmp = ctx.heap[0];
+        ctx.heap[0] = ctx.heap[i];
+        ctx.heap[i] = tmp;
+        ch_spatial_heap_sift_down(ctx.heap, 0, i);
+    }
+    for (size_t i = 0; i < ctx.n; i++)
+        index->results[i] = ctx.heap[i].ent;
+    *results = index->results;
+    *n_results = ctx.n;
+    return CH_ERR_NONE;
+}
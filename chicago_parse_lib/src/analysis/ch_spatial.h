@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* A spatial index of the entities of a single state file (each map has its own coordinate space). The position of
+* each entity is taken from a vector field of its class (m_vecAbsOrigin by default), and entities which don't have
+* the field, have a non-finite position, or weren't fully restored are skipped. The index is a BVH over the positions
+* with a handful of entities in each leaf, so the queries only visit the parts of the map that are near the query.
+*
+* The index points into the save, so the save must outlive it.
+*/
+
+typedef struct ch_spatial_index ch_spatial_index;
+
+typedef struct ch_spatial_ent {
+    const ch_restored_entity* ent;
+    size_t ent_idx; // index in the entity table
+    float pos[3];
+} ch_spatial_ent;
+
+// origin_field is the name of a FIELD_VECTOR or FIELD_POSITION_VECTOR field, or NULL for m_vecAbsOrigin
+ch_err ch_spatial_index_new(const ch_state_file* sf, const char* origin_field, ch_spatial_index** index);
+void ch_spatial_index_free(ch_spatial_index* index);
+
+// all entities in the index
+void ch_spatial_get_ents(const ch_spatial_index* index, const ch_spatial_ent** ents, size_t* n_ents);
+
+/*
+* The results of the queries are valid until the next query on the same index. Box and sphere results are in no
+* particular order, nearest results are sorted by distance (closest first).
+*/
+ch_err ch_spatial_query_box(ch_spatial_index* index,
+                            const float mins[3],
+                            const float maxs[3],
+                            const ch_spatial_ent* const** results,
+                            size_t* n_results);
+ch_err ch_spatial_query_sphere(ch_spatial_index* index,
+                               const float center[3],
+                               float radius,
+                               const ch_spatial_ent* const** results,
+                               size_t* n_results);
+ch_err ch_spatial_query_nearest(ch_spatial_index* index,
+                                const float point[3],
+                                size_t k,
+                                const ch_spatial_ent* const** results,
+                                size_t* n_results);
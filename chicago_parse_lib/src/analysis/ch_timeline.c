@@ -0,0 +1,274 @@
+#include <math.h>
+
+#include "ch_timeline.h"
+#include "ch_save_internal.h"
+#include "custom_restore/ch_utl_vector.h"
+
+// see TICK_NEVER_THINK in the SDK
+#define CH_TICK_NEVER_THINK (-1)
+
+// the think fields of a datamap, NULL if the datamap doesn't have them
+typedef struct ch_timeline_dm_fields {
+    const ch_datamap* dm;
+    const ch_type_description* next_think;
+    const ch_type_description* think_funcs;
+} ch_timeline_dm_fields;
+
+// thinkfunc_t fields
+typedef struct ch_timeline_think_func_fields {
+    const ch_datamap* dm;
+    const ch_type_description *context, *next_think;
+} ch_timeline_think_func_fields;
+
+struct ch_timeline {
+    ch_arena* arena;
+    float tick_interval;
+    struct hashmap* dm_fields; // ch_timeline_dm_fields
+    ch_timeline_think_func_fields think_func_fields;
+    ch_timeline_entry* entries;
+    size_t n_entries;
+};
+
+static uint64_t ch_timeline_dm_fields_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_timeline_dm_fields* fields = item;
+    return hashmap_xxhash3(&fields->dm, sizeof fields->dm, seed0, seed1);
+}
+
+static int ch_timeline_dm_fields_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_timeline_dm_fields* fa = a;
+    const ch_timeline_dm_fields* fb = b;
+    return fa->dm < fb->dm ? -1 : fa->dm > fb->dm;
+}
+
+static ch_err ch_timeline_get_dm_fields(ch_timeline* tl, const ch_datamap* dm, const ch_timeline_dm_fields** out)
+{
+    ch_timeline_dm_fields fields = {.dm = dm};
+    const ch_timeline_dm_fields* existing = hashmap_get(tl->dm_fields, &fields);
+    if (existing) {
+        *out = existing;
+        return CH_ERR_NONE;
+    }
+    if (ch_find_field(dm, "m_nNextThinkTick", true, &fields.next_think) || fields.next_think->type != FIELD_TICK)
+        fields.next_think = NULL;
+    if (ch_find_field(dm, "m_aThinkFunctions", true, &fields.think_funcs) ||
+        fields.think_funcs->type != FIELD_CUSTOM || !fields.think_funcs->save_restore_ops)
+        fields.think_funcs = NULL;
+    if (!hashmap_set(tl->dm_fields, &fields) && hashmap_oom(tl->dm_fields))
+        return CH_ERR_OUT_OF_MEMORY;
+    *out = hashmap_get(tl->dm_fields, &fields);
+    return CH_ERR_NONE;
+}
+
+static bool ch_timeline_get_think_func_fields(ch_timeline* tl, const ch_datamap* dm)
+{
+    ch_timeline_think_func_fields* fields = &tl->think_func_fields;
+    if (fields->dm == dm)
+        return fields->next_think;
+    *fields = (ch_timeline_think_func_fields){.dm = dm};
+    if (ch_find_field(dm, "m_nNextThinkTick", true, &fields->next_think) || fields->next_think->type != FIELD_TICK)
+        fields->next_think = NULL;
+    if (ch_find_field(dm, "m_iszContext", true, &fields->context) || fields->context->type != FIELD_STRING)
+        fields->context = NULL;
+    return fields->next_think;
+}
+
+// if entries is NULL the entries are only counted
+static ch_err ch_timeline_collect_thinks(ch_timeline* tl,
+                                         const ch_block_entities* block,
+                                         ch_timeline_entry* entries,
+                                         size_t* n_entries)
+{
+    *n_entries = 0;
+    for (size_t i = 0; i < block->entity_table.n_elems; i++) {
+        const ch_restored_entity* ent = block->entities[i];
+        // skip entities which failed to restore partway through
+        if (!ent || !ent->class_info.dm || !ent->class_info.data)
+            continue;
+        const ch_timeline_dm_fields* fields;
+        CH_RET_IF_ERR(ch_timeline_get_dm_fields(tl, ent->class_info.dm, &fields));
+        if (fields->next_think) {
+            int32_t tick = CH_FIELD_AT(ent->class_info.data, fields->next_think, int32_t);
+            if (tick != CH_TICK_NEVER_THINK) {
+                if (entries) {
+                    entries[*n_entries] = (ch_timeline_entry){
+                        .type = CH_TIMELINE_THINK,
+                        .tick = tick,
+                        .time = tick * tl->tick_interval,
+                        .ent_idx = i,
+                    };
+                }
+                ++*n_entries;
+            }
+        }
+        if (!fields->think_funcs)
+            continue;
+        const ch_cr_utl_vector* vec = CH_FIELD_AT(ent->class_info.data, fields->think_funcs, const ch_cr_utl_vector*);
+        if (!vec || vec->field_type != FIELD_EMBEDDED || !ch_timeline_get_think_func_fields(tl, vec->embedded_map))
+            continue;
+        for (uint32_t j = 0; j < vec->n_elems; j++) {
+            const unsigned char* think_func = CH_UTL_VEC_ELEM_PTR(*vec, j);
+            int32_t tick = CH_FIELD_AT(think_func, tl->think_func_fields.next_think, int32_t);
+            if (tick == CH_TICK_NEVER_THINK)
+                continue;
+            if (entries) {
+                entries[*n_entries] = (ch_timeline_entry){
+                    .type = CH_TIMELINE_THINK,
+                    .tick = tick,
+                    .time = tick * tl->tick_interval,
+                    .ent_idx = i,
+                    .think_idx = j + 1,
+                    .think_context = tl->think_func_fields.context
+                                         ? CH_FIELD_AT(think_func, tl->think_func_fields.context, const char*)
+                                         : NULL,
+                };
+            }
+            ++*n_entries;
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_timeline_collect_events(ch_timeline* tl, const ch_block_event_queue* block, ch_timeline_entry* entries)
+{
+    const ch_restored_class_arr* events = &block->events;
+    if (events->n_elems == 0)
+        return CH_ERR_NONE;
+    const ch_type_description *td_fire_time, *td_target = NULL, *td_input = NULL;
+    CH_RET_IF_ERR(ch_find_field(events->dm, "m_flFireTime", true, &td_fire_time));
+    if (td_fire_time->type != FIELD_TIME && td_fire_time->type != FIELD_FLOAT)
+        return CH_ERR_BAD_FIELD_TYPE;
+    if (ch_find_field(events->dm, "m_iTarget", true, &td_target) || td_target->type != FIELD_STRING)
+        td_target = NULL;
+    if (ch_find_field(events->dm, "m_iTargetInput", true, &td_input) || td_input->type != FIELD_STRING)
+        td_input = NULL;
+    for (size_t i = 0; i < events->n_elems; i++) {
+        const unsigned char* event = CH_RCA_ELEM_DATA(*events, i);
+        float time = CH_FIELD_AT(event, td_fire_time, float);
+        entries[i] = (ch_timeline_entry){
+            .type = CH_TIMELINE_EVENT,
+            // the event is serviced on the first tick where the current time is >= the fire time
+            .tick = (int32_t)ceilf(time / tl->tick_interval - 0.01f),
+            .time = time,
+            .ent_idx = SIZE_MAX,
+            .event = event,
+            .target = td_target ? CH_FIELD_AT(event, td_target, const char*) : NULL,
+            .input = td_input ? CH_FIELD_AT(event, td_input, const char*) : NULL,
+        };
+    }
+    return CH_ERR_NONE;
+}
+
+static int ch_timeline_entry_compare(const void* a, const void* b)
+{
+    const ch_timeline_entry* ea = a;
+    const ch_timeline_entry* eb = b;
+    if (ea->tick != eb->tick)
+        return ea->tick < eb->tick ? -1 : 1;
+    if (ea->type != eb->type)
+        return ea->type < eb->type ? -1 : 1;
+    if (ea->type == CH_TIMELINE_THINK) {
+        if (ea->ent_idx != eb->ent_idx)
+            return ea->ent_idx < eb->ent_idx ? -1 : 1;
+        return ea->think_idx < eb->think_idx ? -1 : ea->think_idx > eb->think_idx;
+    }
+    if (ea->time != eb->time)
+        return ea->time < eb->time ? -1 : 1;
+    // the events are in one array in save order
+    return ea->event < eb->event ? -1 : ea->event > eb->event;
+}
+
+static ch_err ch_timeline_build(ch_timeline* tl, const ch_state_file* sf)
+{
+    tl->dm_fields = hashmap_new(sizeof(ch_timeline_dm_fields),
+                                64,
+                                0,
+                                0,
+                                ch_timeline_dm_fields_hash,
+                                ch_timeline_dm_fields_compare,
+                                NULL,
+                                NULL);
+    if (!tl->dm_fields)
+        return CH_ERR_OUT_OF_MEMORY;
+
+    const ch_block_entities* block_ents = ch_sf_get_block_entities(sf);
+    const ch_block_event_queue* block_events = ch_sf_get_block_event_queue(sf);
+    size_t n_thinks = 0;
+    size_t n_events = block_events ? block_events->events.n_elems : 0;
+    if (block_ents)
+        CH_RET_IF_ERR(ch_timeline_collect_thinks(tl, block_ents, NULL, &n_thinks));
+    tl->n_entries = n_thinks + n_events;
+    CH_CHECKED_ALLOC(tl->entries, ch_arena_alloc(tl->arena, sizeof(ch_timeline_entry) * tl->n_entries));
+    if (block_ents)
+        CH_RET_IF_ERR(ch_timeline_collect_thinks(tl, block_ents, tl->entries, &n_thinks));
+    if (block_events)
+        CH_RET_IF_ERR(ch_timeline_collect_events(tl, block_events, tl->entries + n_thinks));
+    qsort(tl->entries, tl->n_entries, sizeof(ch_timeline_entry), ch_timeline_entry_compare);
+    return CH_ERR_NONE;
+}
+
+ch_err ch_timeline_new(const ch_state_file* sf, float tick_interval, ch_timeline** timeline_out)
+{
+    assert(sf && timeline_out);
+    *timeline_out = NULL;
+    ch_arena* arena = ch_arena_new(1024 * 16);
+    if (!arena)
+        return CH_ERR_OUT_OF_MEMORY;
+    ch_timeline* tl = ch_arena_calloc(arena, sizeof *tl);
+    if (!tl) {
+        ch_arena_free(arena);
+        return CH_ERR_OUT_OF_MEMORY;
+    }
+    tl->arena = arena;
+    tl->tick_interval = tick_interval > 0 ? tick_interval : CH_TIMELINE_DEFAULT_TICK_INTERVAL;
+    ch_err err = ch_timeline_build(tl, sf);
+    if (err) {
+        ch_timeline_free(tl);
+        return err;
+    }
+    *timeline_out = tl;
+    return CH_ERR_NONE;
+}
+
+void ch_timeline_free(ch_timeline* timeline)
+{
+    if (!timeline)
+        return;
+    if (timeline->dm_fields)
+        hashmap_free(timeline->dm_fields);
+    ch_arena_free(timeline->arena);
+}
+
+void ch_timeline_get_all(const ch_timeline* timeline, const ch_timeline_entry** entries, size_t* n_entries)
+{
+    *entries = timeline->entries;
+    *n_entries = timeline->n_entries;
+}
+
+// index of the first entry with a tick >= the given tick
+static size_t ch_timeline_lower_bound(const ch_timeline* timeline, int64_t tick)
+{
+    size_t lo = 0, hi = timeline->n_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (timeline->entries[mid].tick < tick)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void ch_timeline_get_ticks(const ch_timeline* timeline,
+                           int32_t first_tick,
+                           int32_t n_ticks,
+                           const ch_timeline_entry** entries,
+                           size_t* n_entries)
+{
+    size_t begin = ch_timeline_lower_bound(timeline, first_tick);
+    size_t end = n_ticks > 0 ? ch_timeline_lower_bound(timeline, (int64_t)first_tick + n_ticks) : begin;
+    *entries = timeline->entries + begin;
+    *n_entries = end - begin;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* A time-ordered view of everything that's pending in a single state file: the events in the event queue and the
+* next think of each entity (both the main think function and the think contexts in m_aThinkFunctions).
+*
+* Saved times and ticks are relative to the moment the save was made (see CSave::WriteTime & CSave::WriteTick), so
+* tick 0 is the tick the save was made on. Fire times of events are converted to the first tick on which they would
+* be serviced using the given tick interval. On the same tick thinks come before events (the game runs the think
+* functions before servicing the event queue). Thinks are ordered by entity and events by their fire time, ties keep
+* the save order.
+*
+* The timeline points into the save, so the save must outlive it.
+*/
+
+#define CH_TIMELINE_DEFAULT_TICK_INTERVAL 0.015f
+
+typedef struct ch_timeline ch_timeline;
+
+typedef enum ch_timeline_entry_type {
+    CH_TIMELINE_THINK,
+    CH_TIMELINE_EVENT,
+} ch_timeline_entry_type;
+
+typedef struct ch_timeline_entry {
+    ch_timeline_entry_type type;
+    int32_t tick;
+    float time;
+    // think
+    size_t ent_idx;            // index in the entity table, SIZE_MAX for events
+    size_t think_idx;          // 0 for the main think function, i + 1 for m_aThinkFunctions[i]
+    const char* think_context; // NULL for the main think function
+    // event
+    const unsigned char* event; // EventQueuePrioritizedEvent_t (ch_block_event_queue.events.dm), NULL for thinks
+    const char* target;
+    const char* input;
+} ch_timeline_entry;
+
+// tick_interval <= 0 uses CH_TIMELINE_DEFAULT_TICK_INTERVAL
+ch_err ch_timeline_new(const ch_state_file* sf, float tick_interval, ch_timeline** timeline);
+void ch_timeline_free(ch_timeline* timeline);
+
+void ch_timeline_get_all(const ch_timeline* timeline, const ch_timeline_entry** entries, size_t* n_entries);
+
+// everything that happens on ticks [first_tick, first_tick + n_ticks), found with a binary search
+void ch_timeline_get_ticks(const ch_timeline* timeline,
+                           int32_t first_tick,
+                           int32_t n_ticks,
+                           const ch_timeline_entry** entries,
+                           size_t* n_entries);
@@ -23,7 +23,7 @@ ch_err ch_parse_block_event_queue_body(ch_parsed_save_ctx* ctx, ch_block_event_q
     block->events.n_elems = CH_FIELD_AT(block->queue.data, td_n_elems, int32_t);
     CH_CHECKED_ALLOC(block->events.data,
                      ch_arena_calloc(ctx->arena, block->events.dm->ch_size * block->events.n_elems));
-    // in game code this sorts the events by the fire time, I don't care much
+    // in game code this sorts the events by the fire time, see ch_timeline for a sorted view
     for (size_t i = 0; i < block->events.n_elems; i++)
         CH_RET_IF_ERR(ch_br_restore_fields(ctx, "PEvent", block->events.dm, CH_RCA_ELEM_DATA(block->events, i)));
 
@@ -10,22 +10,22 @@ typedef struct ch_byte_reader {
     const unsigned char *cur, *end;
 } ch_byte_reader;
 
-inline bool ch_br_overflowed(const ch_byte_reader* br)
+static inline bool ch_br_overflowed(const ch_byte_reader* br)
 {
     return br->cur > br->end;
 }
 
-inline void ch_br_set_overflowed(ch_byte_reader* br)
+static inline void ch_br_set_overflowed(ch_byte_reader* br)
 {
     br->end = br->cur - 1;
 }
 
-inline bool ch_br_could_skip(const ch_byte_reader* br, size_t n)
+static inline bool ch_br_could_skip(const ch_byte_reader* br, size_t n)
 {
     return !ch_br_overflowed(br) && br->cur + n <= br->end;
 }
 
-inline bool ch_br_skip(ch_byte_reader* br, size_t n)
+static inline bool ch_br_skip(ch_byte_reader* br, size_t n)
 {
     if (ch_br_could_skip(br, n))
         br->cur += n;
@@ -34,22 +34,22 @@ inline bool ch_br_skip(ch_byte_reader* br, size_t n)
     return ch_br_overflowed(br);
 }
 
-inline void ch_br_skip_unchecked(ch_byte_reader* br, size_t n)
+static inline void ch_br_skip_unchecked(ch_byte_reader* br, size_t n)
 {
     br->cur += n;
 }
 
-inline size_t ch_br_remaining(const ch_byte_reader* br)
+static inline size_t ch_br_remaining(const ch_byte_reader* br)
 {
     return ch_br_overflowed(br) ? 0 : (size_t)br->end - (size_t)br->cur;
 }
 
-inline size_t ch_br_strlen(const ch_byte_reader* br)
+static inline size_t ch_br_strlen(const ch_byte_reader* br)
 {
     return strnlen((const char*)br->cur, ch_br_remaining(br));
 }
 
-inline bool ch_br_read(ch_byte_reader* br, void* dest, size_t n)
+static inline bool ch_br_read(ch_byte_reader* br, void* dest, size_t n)
 {
     if (ch_br_could_skip(br, n)) {
         memcpy(dest, br->cur, n);
@@ -70,7 +70,7 @@ inline bool ch_br_read(ch_byte_reader* br, void* dest, size_t n)
 * br_chunk = ch_br_split_skip(&br, 666);
 * ch_parsed_this_crazy_next_chunk(br_chunk);
 */
-inline ch_byte_reader ch_br_split_skip(ch_byte_reader* br, size_t chunk_size)
+static inline ch_byte_reader ch_br_split_skip(ch_byte_reader* br, size_t chunk_size)
 {
     if (ch_br_could_skip(br, chunk_size)) {
         ch_byte_reader ret = {.cur = br->cur, .end = br->cur + chunk_size};
@@ -90,7 +90,7 @@ inline ch_byte_reader ch_br_split_skip(ch_byte_reader* br, size_t chunk_size)
 * ch_parse_this_crazy_next_chunk_with_context(&ctx);
 * ctx->br = br_after_chunk
 */
-inline ch_byte_reader ch_br_split_skip_swap(ch_byte_reader* br, size_t chunk_size)
+static inline ch_byte_reader ch_br_split_skip_swap(ch_byte_reader* br, size_t chunk_size)
 {
     if (ch_br_could_skip(br, chunk_size)) {
         ch_byte_reader ret = {.cur = br->cur + chunk_size, .end = br->end};
@@ -107,7 +107,7 @@ inline ch_byte_reader ch_br_split_skip_swap(ch_byte_reader* br, size_t chunk_siz
 * Creates & returns a byte reader at some position relative
 * to the given reader. The given reader is unchanged.
 */
-inline ch_byte_reader ch_br_jmp_rel(const ch_byte_reader* br, size_t jmp_size)
+static inline ch_byte_reader ch_br_jmp_rel(const ch_byte_reader* br, size_t jmp_size)
 {
     if (ch_br_could_skip(br, jmp_size)) {
         ch_byte_reader ret = {.cur = br->cur + jmp_size, .end = br->end};
@@ -120,7 +120,7 @@ inline ch_byte_reader ch_br_jmp_rel(const ch_byte_reader* br, size_t jmp_size)
 }
 
 #define CH_BR_DEFINE_PRIMITIVE_READ(func_name, ret_type) \
-    inline ret_type func_name(ch_byte_reader* br)        \
+    static inline ret_type func_name(ch_byte_reader* br) \
     {                                                    \
         if (ch_br_could_skip(br, sizeof(ret_type))) {    \
             ret_type tmp = *(ret_type*)br->cur;          \
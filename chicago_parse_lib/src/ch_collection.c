@@ -0,0 +1,343 @@
+#include "ch_save_internal.h"
+#include "custom_restore/registration/ch_reg.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define CH_DC_SECTION(hd, off, type) ((const type*)((const char*)(hd) + (hd)->off))
+
+static uint64_t ch_dc_hash(const char* name, size_t len, uint32_t seed)
+{
+    return hashmap_xxhash3(name, len, seed, 0);
+}
+
+static bool ch_dc_section_ok(const ch_dc_header* hd, uint32_t off, uint32_t count, size_t elem_size)
+{
+    return off % sizeof(uint32_t) == 0 && off >= sizeof *hd &&
+           (uint64_t)off + (uint64_t)count * elem_size <= hd->file_size;
+}
+
+uint32_t ch_collection_find(const ch_datamap_collection* collection, const char* name)
+{
+    const ch_dc_header* hd = collection->header;
+    size_t len = strlen(name);
+    uint32_t bucket = ch_dc_hash(name, len, CH_DC_MPH_SEED) % hd->n_mph_buckets;
+    uint32_t disp = CH_DC_SECTION(hd, mph_disps_off, uint32_t)[bucket];
+    uint32_t slot_idx = disp & CH_DC_MPH_DIRECT ? disp & ~CH_DC_MPH_DIRECT : ch_dc_hash(name, len, disp) % hd->n_names;
+    if (slot_idx >= hd->n_names)
+        return CH_DC_NULL;
+    const ch_dc_mph_slot* slot = &CH_DC_SECTION(hd, mph_slots_off, ch_dc_mph_slot)[slot_idx];
+    if (slot->name >= hd->strs_size || slot->dm >= hd->n_datamaps ||
+        strcmp(CH_DC_SECTION(hd, strs_off, char) + slot->name, name))
+        return CH_DC_NULL;
+    return slot->dm;
+}
+
+static const char* ch_dc_str(const ch_dc_header* hd, uint32_t off, bool allow_null, bool* ok)
+{
+    if (off == CH_DC_NULL && allow_null)
+        return NULL;
+    if (off >= hd->strs_size) {
+        *ok = false;
+        return NULL;
+    }
+    return CH_DC_SECTION(hd, strs_off, char) + off;
+}
+
+static const ch_custom_ops* ch_dc_bound_ops(const ch_datamap_collection* collection, uint32_t op_id)
+{
+    // ids from newer versions of chicago are treated like ops that aren't supported
+    return op_id < CH_OP_COUNT ? collection->registry.ops[op_id] : NULL;
+}
+
+// the number of bytes the field takes up in the restored class
+static uint64_t ch_dc_field_extent(const ch_dc_type_description* dc_td)
+{
+    if (dc_td->type == FIELD_CUSTOM)
+        return sizeof(void*);
+    if (ch_field_type_is_str((ch_field_type)dc_td->type))
+        return (uint64_t)sizeof(char*) * dc_td->n_elems;
+    if (dc_td->type == FIELD_EMBEDDED)
+        return (uint64_t)dc_td->total_size_bytes * dc_td->n_elems;
+    return dc_td->total_size_bytes;
+}
+
+/*
+* Datamaps are created on their first lookup and published with a compare & swap, so a collection can be shared
+* between threads without locking. If two threads create the same datamap at once, the one that loses the swap frees
+* its copy and uses the other one.
+*/
+static const ch_datamap* ch_dc_load_dm(const ch_datamap* const* slot)
+{
+#ifdef _MSC_VER
+    // volatile reads have acquire semantics with /volatile:ms, the default on x86 & x64
+    return *(const ch_datamap* const volatile*)slot;
+#else
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// returns whichever datamap ended up in the slot
+static const ch_datamap* ch_dc_publish_dm(const ch_datamap** slot, const ch_datamap* dm)
+{
+#ifdef _MSC_VER
+    const ch_datamap* old = _InterlockedCompareExchangePointer((void* volatile*)slot, (void*)dm, NULL);
+#else
+    const ch_datamap* old = NULL;
+    __atomic_compare_exchange_n(slot, &old, dm, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+    return old ? old : dm;
+}
+
+static void ch_dc_free_dm(const ch_datamap* dm)
+{
+    free((void*)dm->fields);
+    free((void*)dm);
+}
+
+static ch_err ch_collection_create_dm(const ch_datamap_collection* collection, uint32_t idx, const ch_datamap** dm_out);
+
+static ch_err ch_collection_fill_dm(const ch_datamap_collection* collection, uint32_t idx, ch_datamap* dm)
+{
+    const ch_dc_header* hd = collection->header;
+    const ch_dc_datamap* dc_dm = &CH_DC_SECTION(hd, dms_off, ch_dc_datamap)[idx];
+    if ((dc_dm->base_map != CH_DC_NULL && dc_dm->base_map >= idx) ||
+        (dc_dm->n_fields > 0 && (uint64_t)dc_dm->fields + dc_dm->n_fields > hd->n_tds))
+        return CH_ERR_COLLECTION_BAD_FILE;
+
+    bool ok = true;
+    dm->class_name = ch_dc_str(hd, dc_dm->class_name, false, &ok);
+    dm->module_name = ch_dc_str(hd, dc_dm->module_name, false, &ok);
+    dm->n_fields = dc_dm->n_fields;
+    dm->ch_size = dc_dm->ch_size;
+    if (dc_dm->base_map != CH_DC_NULL) {
+        CH_RET_IF_ERR(ch_collection_create_dm(collection, dc_dm->base_map, &dm->base_map));
+        // the base class is restored into the start of this class
+        if (dm->base_map->ch_size > dm->ch_size)
+            return CH_ERR_COLLECTION_BAD_FILE;
+    }
+
+    if (dc_dm->n_fields > 0) {
+        ch_type_description* tds;
+        CH_CHECKED_ALLOC(tds, calloc(dc_dm->n_fields, sizeof(ch_type_description)));
+        dm->fields = tds;
+        const ch_dc_type_description* dc_tds = CH_DC_SECTION(hd, tds_off, ch_dc_type_description) + dc_dm->fields;
+        for (uint32_t i = 0; i < dc_dm->n_fields; i++) {
+            const ch_dc_type_description* dc_td = &dc_tds[i];
+            ch_type_description* td = &tds[i];
+            // the restore functions write the whole extent of the field, so it must fit in the class
+            if (dc_td->type >= FIELD_TYPECOUNT || dc_td->ch_offset >= dc_dm->ch_size ||
+                dc_td->ch_offset + ch_dc_field_extent(dc_td) > dc_dm->ch_size ||
+                (dc_td->embedded_map != CH_DC_NULL && dc_td->embedded_map >= idx))
+                return CH_ERR_COLLECTION_BAD_FILE;
+            td->type = (ch_field_type)dc_td->type;
+            td->flags = dc_td->flags;
+            td->n_elems = dc_td->n_elems;
+            td->name = ch_dc_str(hd, dc_td->name, false, &ok);
+            td->external_name = ch_dc_str(hd, dc_td->external_name, true, &ok);
+            td->game_offset = dc_td->game_offset;
+            td->ch_offset = dc_td->ch_offset;
+            td->total_size_bytes = dc_td->total_size_bytes;
+            td->save_restore_ops = ch_dc_bound_ops(collection, dc_td->save_restore_ops);
+            if (dc_td->embedded_map != CH_DC_NULL) {
+                CH_RET_IF_ERR(ch_collection_create_dm(collection, dc_td->embedded_map, &td->embedded_map));
+                if (td->type == FIELD_EMBEDDED && td->embedded_map->ch_size > td->total_size_bytes)
+                    return CH_ERR_COLLECTION_BAD_FILE;
+            }
+        }
+    }
+    return ok ? CH_ERR_NONE : CH_ERR_COLLECTION_BAD_FILE;
+}
+
+/*
+* Creates the ch_datamap for the datamap at the given index, as well as its base & embedded maps. Those always come
+* before the datamap in the file, so this can't loop forever even if the file is garbage.
+*/
+static ch_err ch_collection_create_dm(const ch_datamap_collection* collection, uint32_t idx, const ch_datamap** dm_out)
+{
+    *dm_out = ch_dc_load_dm(&collection->dms[idx]);
+    if (*dm_out)
+        return CH_ERR_NONE;
+    ch_datamap* dm;
+    CH_CHECKED_ALLOC(dm, calloc(1, sizeof *dm));
+    ch_err err = ch_collection_fill_dm(collection, idx, dm);
+    if (err) {
+        ch_dc_free_dm(dm);
+        return err;
+    }
+    *dm_out = ch_dc_publish_dm(&collection->dms[idx], dm);
+    if (*dm_out != dm)
+        ch_dc_free_dm(dm);
+    return CH_ERR_NONE;
+}
+
+// binds the ops, that's just a few name lookups - the datamaps are created when they're first looked up
+static ch_err ch_collection_load(ch_datamap_collection* collection)
+{
+    CH_RET_IF_ERR(ch_register_all(collection, &collection->registry));
+    CH_CHECKED_ALLOC(collection->dms, calloc(collection->header->n_datamaps, sizeof(ch_datamap*)));
+    return CH_ERR_NONE;
+}
+
+ch_err ch_collection_open(const void* bytes, size_t n_bytes, ch_datamap_collection* collection)
+{
+    memset(collection, 0, sizeof *collection);
+    const ch_dc_header* hd = bytes;
+    if (n_bytes < sizeof *hd || (uintptr_t)bytes % sizeof(uint32_t))
+        return CH_ERR_COLLECTION_BAD_FILE;
+    if (strncmp(hd->magic, CH_COLLECTION_FILE_MAGIC, sizeof hd->magic))
+        return CH_ERR_COLLECTION_BAD_FILE;
+    if (hd->version != CH_DATAMAP_STRUCT_VERSION)
+        return CH_ERR_COLLECTION_BAD_VERSION;
+    if (hd->file_size > n_bytes || hd->n_datamaps == 0 || hd->n_names < hd->n_datamaps ||
+        hd->n_mph_buckets != CH_DC_MPH_N_BUCKETS(hd->n_names) || hd->strs_size == 0)
+        return CH_ERR_COLLECTION_BAD_FILE;
+    if (!ch_dc_section_ok(hd, hd->dms_off, hd->n_datamaps, sizeof(ch_dc_datamap)) ||
+        !ch_dc_section_ok(hd, hd->tds_off, hd->n_tds, sizeof(ch_dc_type_description)) ||
+        !ch_dc_section_ok(hd, hd->mph_disps_off, hd->n_mph_buckets, sizeof(uint32_t)) ||
+        !ch_dc_section_ok(hd, hd->mph_slots_off, hd->n_names, sizeof(ch_dc_mph_slot)) ||
+        !ch_dc_section_ok(hd, hd->strs_off, hd->strs_size, 1))
+        return CH_ERR_COLLECTION_BAD_FILE;
+    // every string offset in the string section is then null terminated
+    if (CH_DC_SECTION(hd, strs_off, char)[hd->strs_size - 1] != '\0')
+        return CH_ERR_COLLECTION_BAD_FILE;
+
+    collection->header = hd;
+    ch_err err = ch_collection_load(collection);
+    if (err)
+        ch_collection_free(collection);
+    return err;
+}
+
+void ch_collection_free(ch_datamap_collection* collection)
+{
+    if (collection->dms) {
+        for (uint32_t i = 0; i < collection->header->n_datamaps; i++)
+            if (collection->dms[i])
+                ch_dc_free_dm(collection->dms[i]);
+        free(collection->dms);
+    }
+    memset(collection, 0, sizeof *collection);
+}
+
+ch_err ch_collection_lookup(const ch_datamap_collection* collection, const char* name, const ch_datamap** dm)
+{
+    assert(collection->header && name && dm);
+    uint32_t idx = ch_collection_find(collection, name);
+    if (idx == CH_DC_NULL) {
+        *dm = NULL;
+        return CH_ERR_DATAMAP_NOT_FOUND;
+    }
+    return ch_collection_create_dm(collection, idx, dm);
+}
+
+ch_err ch_collection_get(const ch_datamap_collection* collection, uint32_t idx, const ch_datamap** dm)
+{
+    assert(collection->header && idx < collection->header->n_datamaps && dm);
+    return ch_collection_create_dm(collection, idx, dm);
+}
+
+/*
+* Hash & displace: the names are split into buckets, and the buckets are placed from biggest to smallest by trying
+* seeds until all names in the bucket land in free slots. Buckets with a single name are placed directly into
+* whatever slots are left. The output only depends on the names and their order.
+*
+* Equal names always land in the same bucket, so duplicates are found by comparing the names within each bucket
+* before any seeds are tried. A bucket usually takes a handful of seeds, the limit is only there so that a broken
+* hash can't make this spin for billions of them.
+*/
+#define CH_DC_MPH_MAX_SEEDS (1u << 20)
+
+ch_err ch_collection_build_mph(const char* const* names, uint32_t n_names, uint32_t* disps, uint32_t* slot_names)
+{
+    uint32_t n_buckets = CH_DC_MPH_N_BUCKETS(n_names);
+    ch_err err = CH_ERR_NONE;
+    uint32_t* bucket_sizes = calloc(n_buckets, sizeof(uint32_t));
+    uint32_t* bucket_starts = calloc(n_buckets + 1, sizeof(uint32_t));
+    uint32_t* bucket_names = malloc(sizeof(uint32_t) * (n_names + 1)); // names sorted by bucket
+    uint32_t* name_buckets = malloc(sizeof(uint32_t) * (n_names + 1));
+    uint32_t* try_slots = malloc(sizeof(uint32_t) * (n_names + 1));
+    if (!bucket_sizes || !bucket_starts || !bucket_names || !name_buckets || !try_slots) {
+        err = CH_ERR_OUT_OF_MEMORY;
+        goto end;
+    }
+
+    for (uint32_t i = 0; i < n_names; i++) {
+        name_buckets[i] = ch_dc_hash(names[i], strlen(names[i]), CH_DC_MPH_SEED) % n_buckets;
+        bucket_sizes[name_buckets[i]]++;
+    }
+    uint32_t max_bucket_size = 0;
+    for (uint32_t i = 0; i < n_buckets; i++) {
+        bucket_starts[i + 1] = bucket_starts[i] + bucket_sizes[i];
+        max_bucket_size = max(max_bucket_size, bucket_sizes[i]);
+        disps[i] = 0;
+    }
+    for (uint32_t i = 0; i < n_names; i++)
+        bucket_names[bucket_starts[name_buckets[i]]++] = i;
+    for (uint32_t i = 0; i < n_buckets; i++)
+        bucket_starts[i] -= bucket_sizes[i];
+
+    for (uint32_t bucket = 0; bucket < n_buckets; bucket++) {
+        const uint32_t* bucket_name_idxs = bucket_names + bucket_starts[bucket];
+        for (uint32_t j = 1; j < bucket_sizes[bucket]; j++) {
+            for (uint32_t k = 0; k < j; k++) {
+                if (!strcmp(names[bucket_name_idxs[j]], names[bucket_name_idxs[k]])) {
+                    err = CH_ERR_COLLECTION_DUPLICATE_NAME;
+                    goto end;
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < n_names; i++)
+        slot_names[i] = CH_DC_NULL;
+
+    // the buckets are tiny, so going over all of them for each size is cheaper than sorting them
+    for (uint32_t size = max_bucket_size; size >= 2; size--) {
+        for (uint32_t bucket = 0; bucket < n_buckets; bucket++) {
+            if (bucket_sizes[bucket] != size)
+                continue;
+            const uint32_t* bucket_name_idxs = bucket_names + bucket_starts[bucket];
+            uint32_t seed = 0;
+            for (;; seed++) {
+                if (seed == CH_DC_MPH_MAX_SEEDS) {
+                    err = CH_ERR_COLLECTION_MPH_FAILED;
+                    goto end;
+                }
+                uint32_t j = 0;
+                for (; j < size; j++) {
+                    const char* name = names[bucket_name_idxs[j]];
+                    try_slots[j] = ch_dc_hash(name, strlen(name), seed) % n_names;
+                    if (slot_names[try_slots[j]] != CH_DC_NULL)
+                        break;
+                    // mark the slot as taken for the rest of the names in the bucket
+                    slot_names[try_slots[j]] = bucket_name_idxs[j];
+                }
+                if (j == size)
+                    break;
+                while (j-- > 0)
+                    slot_names[try_slots[j]] = CH_DC_NULL;
+            }
+            disps[bucket] = seed;
+        }
+    }
+
+    uint32_t next_free_slot = 0;
+    for (uint32_t bucket = 0; bucket < n_buckets; bucket++) {
+        if (bucket_sizes[bucket] != 1)
+            continue;
+        while (slot_names[next_free_slot] != CH_DC_NULL)
+            next_free_slot++;
+        slot_names[next_free_slot] = bucket_names[bucket_starts[bucket]];
+        disps[bucket] = CH_DC_MPH_DIRECT | next_free_slot;
+    }
+
+end:
+    free(bucket_sizes);
+    free(bucket_starts);
+    free(bucket_names);
+    free(name_buckets);
+    free(try_slots);
+    return err;
+}
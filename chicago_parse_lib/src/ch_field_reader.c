@@ -262,3 +262,18 @@ size_t ch_field_type_byte_size(ch_field_type ft)
             return 0;
     }
 }
+
+bool ch_field_type_is_str(ch_field_type ft)
+{
+    switch (ft) {
+        case FIELD_STRING:
+        case FIELD_MODELNAME:
+        case FIELD_SOUNDNAME:
+        case FIELD_FUNCTION:
+        case FIELD_MODELINDEX:
+        case FIELD_MATERIALINDEX:
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,192 @@
+#include "ch_fingerprint.h"
+#include "ch_save_internal.h"
+
+static uint64_t ch_fingerprint_hash(const char* name, size_t len)
+{
+    return hashmap_xxhash3(name, len, 0, 0);
+}
+
+static void ch_fingerprint_positions(uint64_t hash, size_t n_bits, size_t positions[CH_FINGERPRINT_N_HASHES])
+{
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < CH_FINGERPRINT_N_HASHES; i++)
+        positions[i] = (size_t)(((uint64_t)h1 + (uint64_t)i * h2) % n_bits);
+}
+
+// calls cb for every string in the string section of the collection, returns the number of strings
+static size_t ch_fingerprint_for_each_name(const ch_datamap_collection* collection,
+                                           void (*cb)(const char* name, size_t len, void* udata),
+                                           void* udata)
+{
+    const ch_dc_header* hd = collection->header;
+    const char* strs = (const char*)hd + hd->strs_off;
+    size_t n = 0;
+    for (const char* s = strs; s < strs + hd->strs_size;) {
+        size_t len = strlen(s);
+        if (len > 0) {
+            if (cb)
+                cb(s, len, udata);
+            n++;
+        }
+        s += len + 1;
+    }
+    return n;
+}
+
+size_t ch_fingerprint_size(const ch_datamap_collection* collection)
+{
+    size_t n_bits = ch_fingerprint_for_each_name(collection, NULL, NULL) * CH_FINGERPRINT_BITS_PER_NAME;
+    return max(n_bits / 8, 8);
+}
+
+typedef struct ch_fingerprint_build_ctx {
+    unsigned char* fingerprint;
+    size_t n_bits;
+} ch_fingerprint_build_ctx;
+
+static void ch_fingerprint_add(const char* name, size_t len, void* udata)
+{
+    ch_fingerprint_build_ctx* ctx = udata;
+    size_t positions[CH_FINGERPRINT_N_HASHES];
+    ch_fingerprint_positions(ch_fingerprint_hash(name, len), ctx->n_bits, positions);
+    for (size_t i = 0; i < CH_FINGERPRINT_N_HASHES; i++)
+        ctx->fingerprint[positions[i] / 8] |= (unsigned char)(1 << (positions[i] % 8));
+}
+
+void ch_fingerprint_build(const ch_datamap_collection* collection, unsigned char* fingerprint, size_t n_bytes)
+{
+    assert(n_bytes > 0);
+    memset(fingerprint, 0, n_bytes);
+    ch_fingerprint_build_ctx ctx = {.fingerprint = fingerprint, .n_bits = n_bytes * 8};
+    ch_fingerprint_for_each_name(collection, ch_fingerprint_add, &ctx);
+}
+
+static int ch_u64_compare(const void* a, const void* b)
+{
+    uint64_t ua = *(const uint64_t*)a;
+    uint64_t ub = *(const uint64_t*)b;
+    return ua < ub ? -1 : ua > ub;
+}
+
+// appends the hashes of all symbols in the table, *hashes is grown as needed
+static ch_err ch_save_symbols_add_table(ch_byte_reader br, int32_t n_symbols, ch_save_symbols* symbols)
+{
+    if (n_symbols < 0)
+        return CH_ERR_BAD_SYMBOL_TABLE;
+    if (n_symbols == 0)
+        return CH_ERR_NONE;
+    uint64_t* new_hashes;
+    CH_CHECKED_ALLOC(new_hashes, realloc(symbols->hashes, sizeof(uint64_t) * (symbols->n_symbols + n_symbols)));
+    symbols->hashes = new_hashes;
+    for (int32_t i = 0; i < n_symbols && !ch_br_overflowed(&br); i++) {
+        size_t len = ch_br_strlen(&br);
+        if (len > 0)
+            symbols->hashes[symbols->n_symbols++] = ch_fingerprint_hash((const char*)br.cur, len);
+        ch_br_skip(&br, len + 1);
+    }
+    return ch_br_overflowed(&br) ? CH_ERR_BAD_SYMBOL_TABLE : CH_ERR_NONE;
+}
+
+// the state files either start right after the global fields or after an explicit count (see ch_parse_save_ctx)
+static bool ch_is_state_file_name(const ch_byte_reader* br)
+{
+    char name[260];
+    ch_byte_reader br_name = *br;
+    if (!ch_br_read(&br_name, name, sizeof name) || !memchr(name, '\0', sizeof name))
+        return false;
+    const char* ext = strrchr(name, '.');
+    return ext && (!strcmp(ext, ".hl1") || !strcmp(ext, ".hl2") || !strcmp(ext, ".hl3"));
+}
+
+static ch_err ch_save_symbols_read_impl(ch_byte_reader* br, ch_save_symbols* symbols)
+{
+    ch_tag tag;
+    ch_br_read(br, &tag, sizeof tag);
+    const ch_tag expected_tag = {.id = {'J', 'S', 'A', 'V'}, .version = 0x73};
+    if (memcmp(&tag, &expected_tag, sizeof expected_tag))
+        return CH_ERR_SAV_BAD_TAG;
+    int32_t global_fields_size_bytes = ch_br_read_32(br);
+    int32_t st_n_symbols = ch_br_read_32(br);
+    int32_t st_size_bytes = ch_br_read_32(br);
+    CH_RET_IF_BR_OVERFLOWED(br);
+    if (st_size_bytes > 0) {
+        ch_byte_reader br_st = ch_br_split_skip(br, st_size_bytes);
+        CH_RET_IF_BR_OVERFLOWED(br);
+        CH_RET_IF_ERR(ch_save_symbols_add_table(br_st, st_n_symbols, symbols));
+    }
+    ch_br_skip(br, global_fields_size_bytes);
+    CH_RET_IF_BR_OVERFLOWED(br);
+    if (!ch_is_state_file_name(br))
+        ch_br_skip(br, sizeof(int32_t));
+
+    // the first .hl1 file is the current map
+    while (ch_is_state_file_name(br)) {
+        char name[260];
+        ch_br_read(br, name, sizeof name);
+        int32_t sf_len_bytes = ch_br_read_32(br);
+        CH_RET_IF_BR_OVERFLOWED(br);
+        if (sf_len_bytes < 0)
+            return CH_ERR_BAD_STATE_FILE_LENGTH;
+        ch_byte_reader br_sf = ch_br_split_skip(br, sf_len_bytes);
+        CH_RET_IF_BR_OVERFLOWED(br);
+        if (strcmp(strrchr(name, '.'), ".hl1"))
+            continue;
+        ch_br_read(&br_sf, &tag, sizeof tag);
+        const ch_tag expected_hl1_tag = {.id = {'V', 'A', 'L', 'V'}, .version = 0x73};
+        if (memcmp(&tag, &expected_hl1_tag, sizeof expected_hl1_tag))
+            return CH_ERR_HL1_BAD_TAG;
+        int32_t hl1_st_size_bytes = ch_br_read_32(&br_sf);
+        int32_t hl1_st_n_symbols = ch_br_read_32(&br_sf);
+        ch_br_skip(&br_sf, sizeof(int32_t) * 2);
+        CH_RET_IF_BR_OVERFLOWED(&br_sf);
+        if (hl1_st_size_bytes > 0) {
+            ch_byte_reader br_st = ch_br_split_skip(&br_sf, hl1_st_size_bytes);
+            CH_RET_IF_BR_OVERFLOWED(&br_sf);
+            CH_RET_IF_ERR(ch_save_symbols_add_table(br_st, hl1_st_n_symbols, symbols));
+        }
+        break;
+    }
+    return CH_ERR_NONE;
+}
+
+ch_err ch_save_symbols_read(const void* bytes, size_t n_bytes, ch_save_symbols* symbols)
+{
+    memset(symbols, 0, sizeof *symbols);
+    ch_byte_reader br = {.cur = bytes, .end = (const unsigned char*)bytes + n_bytes};
+    ch_err err = ch_save_symbols_read_impl(&br, symbols);
+    if (err) {
+        ch_save_symbols_free(symbols);
+        return err;
+    }
+    // both tables have some of the same symbols
+    qsort(symbols->hashes, symbols->n_symbols, sizeof(uint64_t), ch_u64_compare);
+    size_t n_unique = 0;
+    for (size_t i = 0; i < symbols->n_symbols; i++)
+        if (n_unique == 0 || symbols->hashes[n_unique - 1] != symbols->hashes[i])
+            symbols->hashes[n_unique++] = symbols->hashes[i];
+    symbols->n_symbols = n_unique;
+    return CH_ERR_NONE;
+}
+
+void ch_save_symbols_free(ch_save_symbols* symbols)
+{
+    free(symbols->hashes);
+    memset(symbols, 0, sizeof *symbols);
+}
+
+float ch_fingerprint_score(const unsigned char* fingerprint, size_t n_bytes, const ch_save_symbols* symbols)
+{
+    if (n_bytes == 0 || symbols->n_symbols == 0)
+        return 0.f;
+    size_t n_found = 0;
+    for (size_t i = 0; i < symbols->n_symbols; i++) {
+        size_t positions[CH_FINGERPRINT_N_HASHES];
+        ch_fingerprint_positions(symbols->hashes[i], n_bytes * 8, positions);
+        size_t j = 0;
+        while (j < CH_FINGERPRINT_N_HASHES && (fingerprint[positions[j] / 8] & (1 << (positions[j] % 8))))
+            j++;
+        n_found += j == CH_FINGERPRINT_N_HASHES;
+    }
+    return (float)n_found / (float)symbols->n_symbols;
+}
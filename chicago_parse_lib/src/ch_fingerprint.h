@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* Figuring out which collection a save was made with before parsing it. The fingerprint of a collection is a bloom
+* filter of every name in it (class names, field names, etc. - everything in the string section of the file). The
+* symbol tables of a save have the names of every class & field that was written, so the collection that the save
+* was made with will have all of them, and collections for other games or versions will be missing some. The score
+* can't tell apart collections that have all of the symbols (e.g. two versions of a game where one only adds classes),
+* see ch_archive_detect_game for how those are picked.
+*
+* The symbols are taken from the .sav header and the first .hl1 state file (the symbol table of the current map),
+* nothing else in the save is parsed.
+*
+* Position i of name n is (lo32(h) + i * (hi32(h) | 1)) % n_bits with h = xxh64(n) (hashmap_xxhash3 with 0 seeds),
+* datamaps/files_to_archive.py builds the same filter.
+*/
+
+#define CH_FINGERPRINT_BITS_PER_NAME 16
+#define CH_FINGERPRINT_N_HASHES 6
+
+// size of the fingerprint for a collection in bytes
+size_t ch_fingerprint_size(const ch_datamap_collection* collection);
+// the fingerprint must be ch_fingerprint_size bytes
+void ch_fingerprint_build(const ch_datamap_collection* collection, unsigned char* fingerprint, size_t n_bytes);
+
+typedef struct ch_save_symbols {
+    uint64_t* hashes; // one per unique symbol
+    size_t n_symbols;
+} ch_save_symbols;
+
+ch_err ch_save_symbols_read(const void* bytes, size_t n_bytes, ch_save_symbols* symbols);
+void ch_save_symbols_free(ch_save_symbols* symbols);
+
+// the fraction of the symbols that are in the fingerprint, 1 for a match (or a false positive on every symbol)
+float ch_fingerprint_score(const unsigned char* fingerprint, size_t n_bytes, const ch_save_symbols* symbols);
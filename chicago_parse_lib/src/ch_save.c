@@ -85,6 +85,111 @@ bool ch_dm_inherts_from(const ch_datamap* dm, const char* base_name)
     return ch_dm_inherts_from(dm->base_map, base_name);
 }
 
+const ch_block_entities* ch_sf_get_block_entities(const ch_state_file* sf)
+{
+    if (sf->type != CH_SF_SAVE_DATA || !sf->data)
+        return NULL;
+    const ch_block* block = &((const ch_sf_save_data*)sf->data)->blocks[CH_BLOCK_ENTITIES];
+    if (!block->header_parsed || !block->data)
+        return NULL;
+    const ch_block_entities* block_ents = block->data;
+    return block_ents->entities ? block_ents : NULL;
+}
+
+const ch_block_event_queue* ch_sf_get_block_event_queue(const ch_state_file* sf)
+{
+    if (sf->type != CH_SF_SAVE_DATA || !sf->data)
+        return NULL;
+    const ch_block* block = &((const ch_sf_save_data*)sf->data)->blocks[CH_BLOCK_EVENT_QUEUE];
+    return block->body_parsed ? block->data : NULL;
+}
+
+typedef struct ch_flatten_ctx {
+    ch_arena* arena;
+    ch_flat_field* last;
+    ch_flat_field** first;
+    size_t* n_fields;
+    ch_flatten_flags flags;
+} ch_flatten_ctx;
+
+static ch_err ch_flatten_name(ch_arena* arena, char** name_out, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int name_len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    assert(name_len >= 0);
+    CH_CHECKED_ALLOC(*name_out, ch_arena_alloc(arena, name_len + 1));
+    va_start(args, fmt);
+    vsnprintf(*name_out, name_len + 1, fmt, args);
+    va_end(args);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_flatten_recursive(ch_flatten_ctx* ctx,
+                                   const ch_datamap* dm,
+                                   const char* prefix,
+                                   size_t base_offset)
+{
+    if (dm->base_map)
+        CH_RET_IF_ERR(ch_flatten_recursive(ctx, dm->base_map, prefix, base_offset));
+
+    for (size_t i = 0; i < dm->n_fields; i++) {
+        const ch_type_description* td = &dm->fields[i];
+        if (td->type == FIELD_VOID || td->type == FIELD_INPUT)
+            continue;
+        if (td->type == FIELD_CUSTOM && !(ctx->flags & CH_FLATTEN_INCLUDE_CUSTOM))
+            continue;
+
+        char* name;
+        CH_RET_IF_ERR(ch_flatten_name(ctx->arena, &name, "%s%s%s", prefix, *prefix ? "." : "", td->name));
+
+        if (td->type == FIELD_EMBEDDED) {
+            size_t n_elems = (ctx->flags & CH_FLATTEN_ALL_EMBEDDED_ELEMS) ? td->n_elems : 1;
+            for (size_t j = 0; j < n_elems; j++) {
+                char* elem_name = name;
+                if (n_elems > 1)
+                    CH_RET_IF_ERR(ch_flatten_name(ctx->arena, &elem_name, "%s[%zu]", name, j));
+                // the elements of embedded arrays are total_size_bytes apart (see ch_br_restore_recursive)
+                size_t elem_offset = base_offset + td->ch_offset + td->total_size_bytes * j;
+                CH_RET_IF_ERR(ch_flatten_recursive(ctx, td->embedded_map, elem_name, elem_offset));
+            }
+            continue;
+        }
+
+        ch_flat_field* field;
+        CH_CHECKED_ALLOC(field, ch_arena_alloc(ctx->arena, sizeof *field));
+        field->name = name;
+        field->td = td;
+        field->offset = base_offset + td->ch_offset;
+        field->next = NULL;
+        if (ctx->last)
+            ctx->last->next = field;
+        else
+            *ctx->first = field;
+        ctx->last = field;
+        ++*ctx->n_fields;
+    }
+    return CH_ERR_NONE;
+}
+
+ch_err ch_flatten_fields(ch_arena* arena,
+                         const ch_datamap* dm,
+                         ch_flatten_flags flags,
+                         ch_flat_field** first,
+                         size_t* n_fields)
+{
+    *first = NULL;
+    *n_fields = 0;
+    ch_flatten_ctx ctx = {
+        .arena = arena,
+        .first = first,
+        .n_fields = n_fields,
+        .flags = flags,
+    };
+    return ch_flatten_recursive(&ctx, dm, "", 0);
+}
+
 ch_err ch_find_field_log_if_dne(ch_parsed_save_ctx* ctx,
                                 const ch_datamap* dm,
                                 const char* field_name,
@@ -114,15 +219,10 @@ ch_err ch_find_field_log_if_dne(ch_parsed_save_ctx* ctx,
 ch_err ch_lookup_datamap(ch_parsed_save_ctx* ctx, const char* name, const ch_datamap** dm)
 {
     assert(name && dm);
-    ch_datamap_lookup_entry entry_in = {.name = name};
-    const ch_datamap_lookup_entry* entry_out = hashmap_get(ctx->info->datamap_collection->lookup, &entry_in);
-    if (!entry_out) {
+    ch_err err = ch_collection_lookup(ctx->info->datamap_collection, name, dm);
+    if (err == CH_ERR_DATAMAP_NOT_FOUND)
         CH_PARSER_LOG_ERR(ctx, "datamap '%s' not found in collection", name);
-        *dm = NULL;
-        return CH_ERR_DATAMAP_NOT_FOUND;
-    }
-    *dm = entry_out->datamap;
-    return CH_ERR_NONE;
+    return err;
 }
 
 ch_err ch_parse_save_ctx(ch_parsed_save_ctx* ctx)
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <string.h>
 
+#include "ch_portable.h"
 #include "SDK/datamap.h"
 #include "thirdparty/hashmap/hashmap.h"
 
@@ -57,7 +58,23 @@
                                           \
     /* dump errors */                     \
     GEN(CH_ERR_FILE_IO)                   \
-    GEN(CH_ERR_MSGPACK)
+    GEN(CH_ERR_MSGPACK)                   \
+                                          \
+    /* export errors */                   \
+    GEN(CH_ERR_SQLITE)                    \
+                                          \
+    /* save store errors */               \
+    GEN(CH_ERR_STORE_BAD_FILE)            \
+    GEN(CH_ERR_STORE_DATAMAP_MISMATCH)    \
+                                          \
+    /* query errors */                    \
+    GEN(CH_ERR_QUERY_SYNTAX)              \
+                                          \
+    /* collection errors */               \
+    GEN(CH_ERR_COLLECTION_BAD_FILE)       \
+    GEN(CH_ERR_COLLECTION_BAD_VERSION)    \
+    GEN(CH_ERR_COLLECTION_DUPLICATE_NAME) \
+    GEN(CH_ERR_COLLECTION_MPH_FAILED)
 
 typedef enum ch_err { CH_FOREACH_ERR(CH_GENERATE_ENUM) } ch_err;
 static const char* const ch_err_strs[] = {CH_FOREACH_ERR(CH_GENERATE_STRING)};
@@ -246,32 +263,47 @@ typedef struct ch_state_file {
     void* data; // one of the ch_sf_* structures depending on the type
 } ch_state_file;
 
-typedef struct ch_datamap_lookup_entry {
-    const char* name;
-    const ch_datamap* datamap;
-} ch_datamap_lookup_entry;
-
-static int ch_datamap_collection_name_compare(const void* a, const void* b, void* udata)
-{
-    (void)udata;
-    const ch_datamap_lookup_entry* ea = (const ch_datamap_lookup_entry*)a;
-    const ch_datamap_lookup_entry* eb = (const ch_datamap_lookup_entry*)b;
-    assert(ea->name && eb->name);
-    return strcmp(ea->name, eb->name);
-}
-
-static uint64_t ch_datamap_collection_name_hash(const void* key, uint64_t seed0, uint64_t seed1)
-{
-    assert(*(char**)key);
-    const ch_datamap_lookup_entry* e = (const ch_datamap_lookup_entry*)key;
-    return hashmap_xxhash3(e->name, strlen(e->name), seed0, seed1);
-}
+struct ch_arena;
 
+// the ops for each custom op id (see ch_dc_header), filled by ch_register_all
+typedef struct ch_custom_op_registry {
+    const ch_custom_ops* ops[CH_OP_COUNT];
+} ch_custom_op_registry;
+
+/*
+* A loaded collection file (see ch_dc_header). The file isn't modified so it can be mapped read-only, it must stay
+* alive for as long as the collection. Opening only checks the header & binds the ops, each datamap is created the
+* first time it's looked up (so a save only pays for the datamaps it uses). Created datamaps are never modified and
+* are published atomically, so one collection can be used from any number of threads at once, and any number of
+* collections can be loaded at the same time.
+*/
 typedef struct ch_datamap_collection {
-    // const char* name -> ch_datamap, see the hash & compare functions above
-    struct hashmap* lookup;
+    const ch_dc_header* header;
+    const ch_datamap** dms; // n_datamaps, NULL until the datamap is first looked up
+    ch_custom_op_registry registry;
 } ch_datamap_collection;
 
+// checks the header & the section bounds, CH_ERR_COLLECTION_BAD_FILE if they're bad
+ch_err ch_collection_open(const void* bytes, size_t n_bytes, ch_datamap_collection* collection);
+void ch_collection_free(ch_datamap_collection* collection);
+
+/*
+* CH_ERR_DATAMAP_NOT_FOUND if there's no datamap/linked name with that name, CH_ERR_COLLECTION_BAD_FILE if the datamap
+* (or one of its base/embedded maps) is bad.
+*/
+ch_err ch_collection_lookup(const ch_datamap_collection* collection, const char* name, const ch_datamap** dm);
+// the datamap at the given index in the file, creating it if needed (same errors as ch_collection_lookup)
+ch_err ch_collection_get(const ch_datamap_collection* collection, uint32_t idx, const ch_datamap** dm);
+// the index of the datamap in the file, or CH_DC_NULL (only needs the header, see ch_register_all)
+uint32_t ch_collection_find(const ch_datamap_collection* collection, const char* name);
+
+/*
+* For writing collections: builds the perfect hash of the names. disps must have CH_DC_MPH_N_BUCKETS(n_names)
+* elements, slot_names gets the index of the name that goes into each slot. Returns CH_ERR_COLLECTION_DUPLICATE_NAME
+* if a name appears more than once.
+*/
+ch_err ch_collection_build_mph(const char* const* names, uint32_t n_names, uint32_t* disps, uint32_t* slot_names);
+
 typedef struct ch_parse_info {
     const ch_datamap_collection* datamap_collection;
     void* bytes;
@@ -303,6 +335,11 @@ ch_err ch_find_field(const ch_datamap* dm,
 
 bool ch_dm_inherts_from(const ch_datamap* dm, const char* base_name);
 
+// returns NULL if the state file isn't a .hl1 file or if its entity block wasn't restored
+const ch_block_entities* ch_sf_get_block_entities(const ch_state_file* sf);
+// returns NULL if the state file isn't a .hl1 file or if its event queue block wasn't restored
+const ch_block_event_queue* ch_sf_get_block_event_queue(const ch_state_file* sf);
+
 ch_err ch_dump_sav_to_text(FILE* f, const ch_parsed_save_data* save_data, const char* indent_str, ch_dump_flags flags);
 
 #define CH_FIELD_AT_PTR(restored_data, td_ptr, c_type) ((c_type*)((restored_data) + (td_ptr)->ch_offset))
@@ -85,6 +85,32 @@ ch_err ch_parse_hl3(ch_parsed_save_ctx* ctx, ch_sf_entity_patch* sf);
 
 ch_err ch_lookup_datamap(ch_parsed_save_ctx* ctx, const char* name, const ch_datamap** dm);
 
+// a field of a restored class with all embedded fields expanded, see ch_flatten_fields
+typedef struct ch_flat_field {
+    const char* name; // e.g. "m_Collision.m_vecMins"
+    const ch_type_description* td;
+    size_t offset; // offset from the start of the restored class
+    struct ch_flat_field* next;
+} ch_flat_field;
+
+typedef enum ch_flatten_flags {
+    CH_FLATTEN_INCLUDE_CUSTOM = 1,
+    CH_FLATTEN_ALL_EMBEDDED_ELEMS = 2,
+} ch_flatten_flags;
+
+/*
+* Creates a list of all fields of the datamap in datamap order (base class fields first). Embedded fields are
+* replaced by the fields of their datamap. Only the first element of embedded arrays is used (same as the text
+* dump) unless CH_FLATTEN_ALL_EMBEDDED_ELEMS is set, then each element is included with its index in the name,
+* e.g. "m_Stacks[2].m_nStackSize". Custom fields are skipped unless CH_FLATTEN_INCLUDE_CUSTOM is set. The list is
+* allocated in the arena and may be empty.
+*/
+ch_err ch_flatten_fields(ch_arena* arena,
+                         const ch_datamap* dm,
+                         ch_flatten_flags flags,
+                         ch_flat_field** first,
+                         size_t* n_fields);
+
 ch_err ch_find_field_log_if_dne(ch_parsed_save_ctx* ctx,
                                 const ch_datamap* dm,
                                 const char* field_name,
@@ -8,3 +8,6 @@ typedef struct ch_cr_ent_output {
 } ch_cr_ent_output;
 
 ch_err ch_cr_ent_output_restore(ch_parsed_save_ctx* ctx, ch_cr_ent_output** data, const ch_type_description* td);
+
+// true if the field is a custom field which is restored as a ch_cr_ent_output
+bool ch_td_is_ent_output(const ch_type_description* td);
@@ -39,3 +39,28 @@ ch_err ch_cr_variant_restore(ch_parsed_save_ctx* ctx, ch_cr_variant** data)
 #pragma warning(pop)
     return err;
 }
+
+size_t ch_cr_variant_val_size(ch_field_type ft)
+{
+    ch_cr_variant* var = NULL;
+#pragma warning(push)
+#pragma warning(disable : 4061)
+    switch (ft) {
+        case FIELD_BOOLEAN:
+            return sizeof var->val_bool;
+        case FIELD_INTEGER:
+            return sizeof var->val_i32;
+        case FIELD_FLOAT:
+            return sizeof var->val_f32;
+        case FIELD_EHANDLE:
+            return sizeof var->val_ehandle;
+        case FIELD_COLOR32:
+            return sizeof var->val_rgba;
+        case FIELD_VECTOR:
+        case FIELD_POSITION_VECTOR:
+            return sizeof var->val_vec3f;
+        default:
+            return 0;
+    }
+#pragma warning(pop)
+}
@@ -18,3 +18,6 @@ typedef struct ch_cr_variant {
 } ch_cr_variant;
 
 ch_err ch_cr_variant_restore(ch_parsed_save_ctx* ctx, ch_cr_variant** data);
+
+// size of the union member used for the given type, 0 for strings (and void)
+size_t ch_cr_variant_val_size(ch_field_type ft);
@@ -1,6 +1,8 @@
 #include "ch_reg.h"
 #include "custom_restore/ch_activity.h"
 #include "dump/ch_dump_decl.h"
+#include "analysis/ch_compare.h"
+#include "store/ch_store_internal.h"
 
 static ch_err ch_cr_activity_dump_text(ch_dump_text* dump,
                                          const ch_type_description* td,
@@ -25,16 +27,18 @@ ch_err ch_reg_activity(ch_register_params* params)
         .text = ch_cr_activity_dump_text,
     };
 
-    static ch_custom_ops ops;
-    ops.dump_fns = &dump_fns;
-    ops.restore_fn = (ch_restore_custom)_ch_cr_activity_restore;
-    ops.user_data = NULL;
+    static const ch_custom_ops ops = {
+        .restore_fn = (ch_restore_custom)_ch_cr_activity_restore,
+        .user_data = NULL,
+        .dump_fns = &dump_fns,
+        .cmp_fns = &g_cmp_cr_activity_fns,
+        .store_fns = &g_store_cr_activity_fns,
+        .refs_fns = NULL,
+    };
     ch_register_info info = {
-        .builder = params->builder,
+        .registry = params->registry,
         .ops = &ops,
-        .ex_module_name = "server.dll",
-        .ex_class_name = "CAI_BaseNPC",
-        .ex_field_name = "m_IdealActivity",
+        .op_id = CH_OP_ACTIVITY,
     };
     CH_RET_IF_ERR(params->cb(&info));
 
@@ -1,6 +1,9 @@
 #include "ch_reg.h"
 #include "custom_restore/ch_ent_output.h"
 #include "dump/ch_dump_decl.h"
+#include "analysis/ch_compare.h"
+#include "store/ch_store_internal.h"
+#include "analysis/ch_ent_refs.h"
 
 static ch_err ch_cr_ent_output_dump_text(ch_dump_text* dump,
                                          const ch_type_description* td,
@@ -19,22 +22,30 @@ static ch_err _ch_cr_ent_output_restore(ch_parsed_save_ctx* ctx,
     return ch_cr_ent_output_restore(ctx, output, td);
 }
 
+bool ch_td_is_ent_output(const ch_type_description* td)
+{
+    return td->type == FIELD_CUSTOM && td->save_restore_ops &&
+           td->save_restore_ops->restore_fn == (ch_restore_custom)_ch_cr_ent_output_restore;
+}
+
 ch_err ch_reg_ent_output(ch_register_params* params)
 {
     const static ch_dump_custom_fns dump_fns = {
         .text = ch_cr_ent_output_dump_text,
     };
 
-    static ch_custom_ops ops;
-    ops.dump_fns = &dump_fns;
-    ops.restore_fn = (ch_restore_custom)_ch_cr_ent_output_restore;
-    ops.user_data = NULL;
+    static const ch_custom_ops ops = {
+        .restore_fn = (ch_restore_custom)_ch_cr_ent_output_restore,
+        .user_data = NULL,
+        .dump_fns = &dump_fns,
+        .cmp_fns = &g_cmp_cr_ent_output_fns,
+        .store_fns = &g_store_cr_ent_output_fns,
+        .refs_fns = &g_ent_refs_cr_ent_output_fns,
+    };
     ch_register_info info = {
-        .builder = params->builder,
+        .registry = params->registry,
         .ops = &ops,
-        .ex_module_name = "server.dll",
-        .ex_class_name = "CBaseEntity",
-        .ex_field_name = "m_OnUser1",
+        .op_id = CH_OP_ENT_OUTPUT,
     };
     CH_RET_IF_ERR(params->cb(&info));
 
@@ -1,6 +1,9 @@
 #include "ch_reg.h"
 #include "custom_restore/ch_utl_vector.h"
 #include "dump/ch_dump_decl.h"
+#include "analysis/ch_compare.h"
+#include "store/ch_store_internal.h"
+#include "analysis/ch_ent_refs.h"
 
 static ch_err ch_cr_utl_vector_dump_text(ch_dump_text* dump, const ch_type_description* td, const ch_cr_utl_vector* vec)
 {
@@ -17,47 +20,60 @@ static ch_err ch_cr_utl_vector_dump_text(ch_dump_text* dump, const ch_type_descr
         return ch_cr_utl_vector_restore(ctx, ft, dm, vec);                   \
     }
 
-// CH_DEFINE_CUSTOM_VECTOR_CB(FIELD_EMBEDDED);
 CH_DEFINE_CUSTOM_VECTOR_CB(FIELD_EHANDLE);
 
+/*
+* The ops are shared between all collections but the thinkfunc_t datamap isn't, so it can't be passed as the user
+* data. Look it up in the collection of the save that's being parsed instead.
+*/
+static ch_err _ch_cr_utl_vec_restore_think_funcs(ch_parsed_save_ctx* ctx,
+                                                 ch_cr_utl_vector** vec,
+                                                 const ch_type_description* td,
+                                                 void* user_data)
+{
+    (void)td;
+    (void)user_data;
+    CH_CHECKED_ALLOC(*vec, ch_arena_calloc(ctx->arena, sizeof **vec));
+    return ch_cr_utl_vector_restore_by_name_to(ctx, "thinkfunc_t", *vec);
+}
+
 ch_err ch_reg_utl_vec(ch_register_params* params)
 {
     const static ch_dump_custom_fns dump_fns = {
         .text = ch_cr_utl_vector_dump_text,
     };
 
-    // TODO fuck goddamit the userdata here will change from save to save, it'll have to live in the arena :/
-
     // m_aThinkFunctions are actually thinkcontextFuncs
-    /*ch_datamap_lookup_entry entry = {.name = "thinkfunc_t"};
-    const ch_datamap_lookup_entry* dm_entry = hashmap_get(params->collection->lookup, &entry);
-    if (dm_entry) {
-        static ch_custom_ops ops;
-        ops.dump_fns = &dump_fns;
-        ops.restore_fn = (ch_restore_custom)_ch_cr_utl_vec_restore_FIELD_EMBEDDED;
-        ops.user_data = (void*)dm_entry->datamap;
+    if (ch_collection_find(params->collection, "thinkfunc_t") != CH_DC_NULL) {
+        static const ch_custom_ops ops = {
+            .restore_fn = (ch_restore_custom)_ch_cr_utl_vec_restore_think_funcs,
+            .user_data = NULL,
+            .dump_fns = &dump_fns,
+            .cmp_fns = &g_cmp_cr_utl_vec_fns,
+            .store_fns = &g_store_cr_utl_vec_fns,
+            .refs_fns = &g_ent_refs_cr_utl_vec_fns,
+        };
         ch_register_info info = {
-            .builder = params->builder,
+            .registry = params->registry,
             .ops = &ops,
-            .ex_module_name = "server.dll",
-            .ex_class_name = "CBaseEntity",
-            .ex_field_name = "m_aThinkFunctions",
+            .op_id = CH_OP_THINK_FUNCS,
         };
         CH_RET_IF_ERR(params->cb(&info));
-    }*/
+    }
 
     {
-        // TODO yeah this prolly shouldn't be static to be reentrant
-        static ch_custom_ops ops;
-        ops.dump_fns = &dump_fns;
-        ops.restore_fn = (ch_restore_custom)_ch_cr_utl_vec_restore_FIELD_EHANDLE;
-        ops.user_data = NULL;
+        static const ch_custom_ops ops = {
+            .restore_fn = (ch_restore_custom)_ch_cr_utl_vec_restore_FIELD_EHANDLE,
+            .user_data = NULL,
+            .dump_fns = &dump_fns,
+            .cmp_fns = &g_cmp_cr_utl_vec_fns,
+            .store_fns = &g_store_cr_utl_vec_fns,
+            .refs_fns = &g_ent_refs_cr_utl_vec_fns,
+        };
         ch_register_info info = {
-            .builder = params->builder,
+            .registry = params->registry,
             .ops = &ops,
-            .ex_module_name = "server.dll",
-            .ex_class_name = "CSceneEntity",
-            .ex_field_name = "m_hActorList",
+            .op_id = CH_OP_EHANDLE_VECTOR,
         };
         CH_RET_IF_ERR(params->cb(&info));
     }
@@ -1,5 +1,8 @@
 #include "ch_reg.h"
 #include "dump/ch_dump_decl.h"
+#include "analysis/ch_compare.h"
+#include "store/ch_store_internal.h"
+#include "analysis/ch_ent_refs.h"
 #include "custom_restore/ch_variant.h"
 
 static ch_err ch_cr_ent_output_dump_text(ch_dump_text* dump, const ch_type_description* td, const ch_cr_variant* var)
@@ -24,16 +27,18 @@ ch_err ch_reg_variant(ch_register_params* params)
         .text = ch_cr_ent_output_dump_text,
     };
 
-    static ch_custom_ops ops;
-    ops.dump_fns = &dump_fns;
-    ops.restore_fn = (ch_restore_custom)_ch_cr_ent_output_restore;
-    ops.user_data = NULL;
+    static const ch_custom_ops ops = {
+        .restore_fn = (ch_restore_custom)_ch_cr_ent_output_restore,
+        .user_data = NULL,
+        .dump_fns = &dump_fns,
+        .cmp_fns = &g_cmp_cr_variant_fns,
+        .store_fns = &g_store_cr_variant_fns,
+        .refs_fns = &g_ent_refs_cr_variant_fns,
+    };
     ch_register_info info = {
-        .builder = params->builder,
+        .registry = params->registry,
         .ops = &ops,
-        .ex_module_name = "server.dll",
-        .ex_class_name = "CBaseEntityOutput",
-        .ex_field_name = "m_Value",
+        .op_id = CH_OP_VARIANT,
     };
     CH_RET_IF_ERR(params->cb(&info));
     return CH_ERR_NONE;
@@ -1,5 +1,5 @@
 #include <stdarg.h>
-#include "ch_dump.h"
+#include "ch_dump_decl.h"
 #include "ch_save_internal.h"
 
 ch_err ch_dump_text_printf(ch_dump_text* dump, const char* fmt, ...)
@@ -42,6 +42,51 @@ ch_err ch_dump_text_printf(ch_dump_text* dump, const char* fmt, ...)
     return ferror(dump->f) ? CH_ERR_FILE_IO : CH_ERR_NONE;
 }
 
+ch_err ch_dump_text_begin(ch_dump_text* dump, FILE* f, const char* indent_str, ch_dump_flags flags)
+{
+    size_t ind_len = strlen(indent_str);
+    assert(ind_len < 16); // what even is this indent string my dude
+    ind_len = min(ind_len, 16);
+
+    *dump = (ch_dump_text){
+        .f = f,
+        .indent_str_len = (uint8_t)ind_len,
+        .flags = flags,
+        .pending_nl = false,
+        .indent_lvl = 0,
+    };
+    dump->arena = ch_arena_new(0);
+    if (!dump->arena)
+        return CH_ERR_OUT_OF_MEMORY;
+
+    // init indent string buf
+    dump->indent_str_buf = ch_arena_alloc(dump->arena, CH_DUMP_TEXT_MAX_INDENT * ind_len + 1);
+    if (!dump->indent_str_buf)
+        return CH_ERR_OUT_OF_MEMORY;
+    for (size_t i = 0; i < CH_DUMP_TEXT_MAX_INDENT; i++)
+        sprintf(dump->indent_str_buf + i * ind_len, "%.*s", (int)ind_len, indent_str);
+    return CH_ERR_NONE;
+}
+
+ch_err ch_dump_text_end(ch_dump_text* dump, ch_err err)
+{
+    // error checking hell to make sure we free the arena
+    if (dump->first_error) {
+        if (!err)
+            err = ch_dump_text_printf(dump, "\n\nErrors during dumping:\n");
+        dump->indent_lvl++;
+        if (!err)
+            err = CH_DUMP_TEXT_CALL(g_dump_str_ll_fns, dump, dump->first_error, CH_DUMP_TEXT_STR_LL_NL_SEP);
+        if (!err)
+            err = ch_dump_text_printf(dump, "\n");
+        dump->indent_lvl--;
+    }
+    if (!err)
+        err = ch_dump_text_flush_nl(dump);
+    ch_arena_free(dump->arena);
+    return err;
+}
+
 ch_err ch_dump_text_flush_nl(ch_dump_text* dump)
 {
     if (dump->pending_nl) {
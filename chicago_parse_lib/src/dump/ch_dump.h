@@ -23,6 +23,13 @@ typedef struct ch_dump_text {
     ch_arena* arena;
 } ch_dump_text;
 
+/*
+* Sets up the dump, must always be followed by ch_dump_text_end() (even if this fails). The end function appends
+* any errors logged during dumping and returns the first error out of err and any errors that happened at the end.
+*/
+ch_err ch_dump_text_begin(ch_dump_text* dump, FILE* f, const char* indent_str, ch_dump_flags flags);
+ch_err ch_dump_text_end(ch_dump_text* dump, ch_err err);
+
 ch_err ch_dump_text_printf(ch_dump_text* dump, const char* fmt, ...);
 ch_err ch_dump_text_flush_nl(ch_dump_text* dump);
 ch_err ch_dump_text_log_err(ch_dump_text* dump, const char* fmt, ...);
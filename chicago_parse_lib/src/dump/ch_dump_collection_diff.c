@@ -0,0 +1,280 @@
+#include "ch_dump_decl.h"
+#include "analysis/ch_collection_diff.h"
+#include "thirdparty/msgpack/include/msgpack/fbuffer.h"
+
+static const char* const ch_col_diff_kind_strs[] = {
+    [CH_COL_DIFF_ADDED] = "added",
+    [CH_COL_DIFF_REMOVED] = "removed",
+    [CH_COL_DIFF_CHANGED] = "changed",
+};
+
+#define CH_GEN_CUSTOM_OP_NAME(id, module, class, field) #id,
+
+// the id of the ops in the collection's registry, NULL for fields without ops
+static const char* ch_col_diff_ops_string(const ch_datamap_collection* collection, const ch_custom_ops* ops)
+{
+    static const char* const op_names[CH_OP_COUNT] = {CH_FOR_EACH_CUSTOM_OP(CH_GEN_CUSTOM_OP_NAME)};
+    if (!ops)
+        return NULL;
+    for (int i = 0; i < CH_OP_COUNT; i++)
+        if (collection->registry.ops[i] == ops)
+            return op_names[i];
+    return "unknown";
+}
+
+static const char* ch_col_diff_dm_name(const ch_datamap* dm)
+{
+    return dm ? dm->class_name : NULL;
+}
+
+static ch_err ch_dump_col_diff_td_val_text(ch_dump_text* dump,
+                                           const ch_datamap_collection* collection,
+                                           const ch_type_description* td,
+                                           ch_col_diff_changes change)
+{
+    const char* str;
+    switch (change) {
+        case CH_COL_DIFF_TYPE:
+            return ch_dump_text_printf(dump, "%s", ch_field_type_string(td->type));
+        case CH_COL_DIFF_FLAGS:
+            return ch_dump_text_printf(dump, "0x%x", td->flags);
+        case CH_COL_DIFF_N_ELEMS:
+            return ch_dump_text_printf(dump, "%d", td->n_elems);
+        case CH_COL_DIFF_OFFSET:
+            return ch_dump_text_printf(dump, "%zu", td->game_offset);
+        case CH_COL_DIFF_SIZE:
+            return ch_dump_text_printf(dump, "%zu", td->total_size_bytes);
+        case CH_COL_DIFF_EXTERNAL_NAME:
+            str = td->external_name;
+            break;
+        case CH_COL_DIFF_CUSTOM_OPS:
+            str = ch_col_diff_ops_string(collection, td->save_restore_ops);
+            break;
+        case CH_COL_DIFF_EMBEDDED:
+            str = ch_col_diff_dm_name(td->embedded_map);
+            break;
+        default:
+            assert(0);
+            return CH_ERR_NONE;
+    }
+    return str ? ch_dump_text_printf(dump, "\"%s\"", str) : ch_dump_text_printf(dump, "<null>");
+}
+
+static ch_err ch_dump_col_diff_field_text(ch_dump_text* dump,
+                                          const ch_collection_diff* diff,
+                                          const ch_col_diff_field* field)
+{
+    const ch_type_description* td = field->td_a ? field->td_a : field->td_b;
+    if (field->kind != CH_COL_DIFF_CHANGED) {
+        const char* type_str = ch_field_type_string(td->type);
+        char sign = field->kind == CH_COL_DIFF_ADDED ? '+' : '-';
+        if (td->n_elems == 1)
+            return ch_dump_text_printf(dump, "%c %s %s @ %zu\n", sign, type_str, td->name, td->game_offset);
+        return ch_dump_text_printf(dump,
+                                   "%c %s[%d] %s @ %zu\n",
+                                   sign,
+                                   type_str,
+                                   td->n_elems,
+                                   td->name,
+                                   td->game_offset);
+    }
+    CH_RET_IF_ERR(ch_dump_text_printf(dump, "~ %s:", td->name));
+    const char* sep = " ";
+    for (int i = 0; i < CH_COL_DIFF_N_CHANGES; i++) {
+        ch_col_diff_changes change = 1 << i;
+        if (!(field->changes & change))
+            continue;
+        CH_RET_IF_ERR(ch_dump_text_printf(dump, "%s%s ", sep, ch_col_diff_change_string(change)));
+        sep = ", ";
+        CH_RET_IF_ERR(ch_dump_col_diff_td_val_text(dump, diff->a, field->td_a, change));
+        CH_RET_IF_ERR(ch_dump_text_printf(dump, " -> "));
+        CH_RET_IF_ERR(ch_dump_col_diff_td_val_text(dump, diff->b, field->td_b, change));
+    }
+    return ch_dump_text_printf(dump, "\n");
+}
+
+static ch_err ch_dump_collection_diff_text(ch_dump_text* dump, const ch_collection_diff* diff)
+{
+    CH_RET_IF_ERR(ch_dump_text_printf(dump,
+                                      "datamaps: %zu added, %zu removed, %zu changed, %zu unchanged\n\n",
+                                      diff->n_added,
+                                      diff->n_removed,
+                                      diff->n_changed,
+                                      diff->n_unchanged));
+
+    for (const ch_col_diff_datamap* dm = diff->datamaps; dm; dm = dm->next) {
+        const ch_datamap* any_dm = dm->dm_a ? dm->dm_a : dm->dm_b;
+        CH_RET_IF_ERR(ch_dump_text_printf(dump,
+                                          "%s (%s) %s%s\n",
+                                          any_dm->class_name,
+                                          any_dm->module_name,
+                                          ch_col_diff_kind_strs[dm->kind],
+                                          dm->kind == CH_COL_DIFF_CHANGED ? ":" : ""));
+        dump->indent_lvl++;
+        if (dm->changes & CH_COL_DIFF_MODULE)
+            CH_RET_IF_ERR(ch_dump_text_printf(dump,
+                                              "module \"%s\" -> \"%s\"\n",
+                                              dm->dm_a->module_name,
+                                              dm->dm_b->module_name));
+        if (dm->changes & CH_COL_DIFF_BASE) {
+            const char* base_a = ch_col_diff_dm_name(dm->dm_a->base_map);
+            const char* base_b = ch_col_diff_dm_name(dm->dm_b->base_map);
+            CH_RET_IF_ERR(
+                ch_dump_text_printf(dump, "base %s -> %s\n", base_a ? base_a : "<null>", base_b ? base_b : "<null>"));
+        }
+        for (const ch_col_diff_field* field = dm->fields; field; field = field->next)
+            CH_RET_IF_ERR(ch_dump_col_diff_field_text(dump, diff, field));
+        dump->indent_lvl--;
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_dump_mp_nullable_str(ch_dump_msgpack* dump, const char* str)
+{
+    if (str)
+        CH_DUMP_MP_STR_CHECKED(dump, str);
+    else
+        CH_DUMP_MP_CHECKED(dump, msgpack_pack_nil(&dump->pk));
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_dump_col_diff_changes_msgpack(ch_dump_msgpack* dump, ch_col_diff_changes changes)
+{
+    uint32_t n_changes = 0;
+    for (int i = 0; i < CH_COL_DIFF_N_CHANGES; i++)
+        n_changes += (changes >> i) & 1;
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_array(&dump->pk, n_changes));
+    for (int i = 0; i < CH_COL_DIFF_N_CHANGES; i++)
+        if (changes & (1 << i))
+            CH_DUMP_MP_STR_CHECKED(dump, ch_col_diff_change_string(1 << i));
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_dump_col_diff_td_msgpack(ch_dump_msgpack* dump,
+                                          const ch_datamap_collection* collection,
+                                          const ch_type_description* td)
+{
+    if (!td) {
+        CH_DUMP_MP_CHECKED(dump, msgpack_pack_nil(&dump->pk));
+        return CH_ERR_NONE;
+    }
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_map(&dump->pk, 8));
+    CH_DUMP_MP_STR_CHECKED(dump, "type");
+    CH_DUMP_MP_STR_CHECKED(dump, ch_field_type_string(td->type));
+    CH_DUMP_MP_STR_CHECKED(dump, "flags");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_unsigned_short(&dump->pk, td->flags));
+    CH_DUMP_MP_STR_CHECKED(dump, "n_elems");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_unsigned_short(&dump->pk, td->n_elems));
+    CH_DUMP_MP_STR_CHECKED(dump, "offset");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_uint64(&dump->pk, td->game_offset));
+    CH_DUMP_MP_STR_CHECKED(dump, "size");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_uint64(&dump->pk, td->total_size_bytes));
+    CH_DUMP_MP_STR_CHECKED(dump, "external_name");
+    CH_RET_IF_ERR(ch_dump_mp_nullable_str(dump, td->external_name));
+    CH_DUMP_MP_STR_CHECKED(dump, "custom_ops");
+    CH_RET_IF_ERR(ch_dump_mp_nullable_str(dump, ch_col_diff_ops_string(collection, td->save_restore_ops)));
+    CH_DUMP_MP_STR_CHECKED(dump, "embedded");
+    CH_RET_IF_ERR(ch_dump_mp_nullable_str(dump, ch_col_diff_dm_name(td->embedded_map)));
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_dump_col_diff_dm_msgpack(ch_dump_msgpack* dump, const ch_datamap* dm)
+{
+    if (!dm) {
+        CH_DUMP_MP_CHECKED(dump, msgpack_pack_nil(&dump->pk));
+        return CH_ERR_NONE;
+    }
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_map(&dump->pk, 3));
+    CH_DUMP_MP_STR_CHECKED(dump, "module");
+    CH_DUMP_MP_STR_CHECKED(dump, dm->module_name);
+    CH_DUMP_MP_STR_CHECKED(dump, "base");
+    CH_RET_IF_ERR(ch_dump_mp_nullable_str(dump, ch_col_diff_dm_name(dm->base_map)));
+    CH_DUMP_MP_STR_CHECKED(dump, "n_fields");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_uint64(&dump->pk, dm->n_fields));
+    return CH_ERR_NONE;
+}
+
+/*
+* {
+*   "n_added": int, "n_removed": int, "n_changed": int, "n_unchanged": int,
+*   "datamaps": [{
+*     "name": str, "kind": "added"|"removed"|"changed", "changes": [str],
+*     "a": datamap|nil, "b": datamap|nil,
+*     "fields": [{"name": str, "kind": str, "changes": [str], "a": field|nil, "b": field|nil}]
+*   }]
+* }
+* datamap: {"module": str, "base": str|nil, "n_fields": int}
+* field: {"type": str, "flags": int, "n_elems": int, "offset": int, "size": int, "external_name": str|nil,
+*         "custom_ops": str|nil, "embedded": str|nil}
+*
+* The changes are the names from ch_col_diff_change_string. Only changed datamaps have fields.
+*/
+static ch_err ch_dump_collection_diff_msgpack(ch_dump_msgpack* dump, const ch_collection_diff* diff)
+{
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_map(&dump->pk, 5));
+    CH_DUMP_MP_STR_CHECKED(dump, "n_added");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_uint64(&dump->pk, diff->n_added));
+    CH_DUMP_MP_STR_CHECKED(dump, "n_removed");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_uint64(&dump->pk, diff->n_removed));
+    CH_DUMP_MP_STR_CHECKED(dump, "n_changed");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_uint64(&dump->pk, diff->n_changed));
+    CH_DUMP_MP_STR_CHECKED(dump, "n_unchanged");
+    CH_DUMP_MP_CHECKED(dump, msgpack_pack_uint64(&dump->pk, diff->n_unchanged));
+    CH_DUMP_MP_STR_CHECKED(dump, "datamaps");
+    CH_DUMP_MP_CHECKED(dump,
+                       msgpack_pack_array(&dump->pk, (uint32_t)(diff->n_added + diff->n_removed + diff->n_changed)));
+
+    for (const ch_col_diff_datamap* dm = diff->datamaps; dm; dm = dm->next) {
+        CH_DUMP_MP_CHECKED(dump, msgpack_pack_map(&dump->pk, 6));
+        CH_DUMP_MP_STR_CHECKED(dump, "name");
+        CH_DUMP_MP_STR_CHECKED(dump, (dm->dm_a ? dm->dm_a : dm->dm_b)->class_name);
+        CH_DUMP_MP_STR_CHECKED(dump, "kind");
+        CH_DUMP_MP_STR_CHECKED(dump, ch_col_diff_kind_strs[dm->kind]);
+        CH_DUMP_MP_STR_CHECKED(dump, "changes");
+        CH_RET_IF_ERR(ch_dump_col_diff_changes_msgpack(dump, dm->changes));
+        CH_DUMP_MP_STR_CHECKED(dump, "a");
+        CH_RET_IF_ERR(ch_dump_col_diff_dm_msgpack(dump, dm->dm_a));
+        CH_DUMP_MP_STR_CHECKED(dump, "b");
+        CH_RET_IF_ERR(ch_dump_col_diff_dm_msgpack(dump, dm->dm_b));
+        CH_DUMP_MP_STR_CHECKED(dump, "fields");
+        CH_DUMP_MP_CHECKED(dump, msgpack_pack_array(&dump->pk, (uint32_t)dm->n_fields));
+        for (const ch_col_diff_field* field = dm->fields; field; field = field->next) {
+            CH_DUMP_MP_CHECKED(dump, msgpack_pack_map(&dump->pk, 5));
+            CH_DUMP_MP_STR_CHECKED(dump, "name");
+            CH_DUMP_MP_STR_CHECKED(dump, (field->td_a ? field->td_a : field->td_b)->name);
+            CH_DUMP_MP_STR_CHECKED(dump, "kind");
+            CH_DUMP_MP_STR_CHECKED(dump, ch_col_diff_kind_strs[field->kind]);
+            CH_DUMP_MP_STR_CHECKED(dump, "changes");
+            CH_RET_IF_ERR(ch_dump_col_diff_changes_msgpack(dump, field->changes));
+            CH_DUMP_MP_STR_CHECKED(dump, "a");
+            CH_RET_IF_ERR(ch_dump_col_diff_td_msgpack(dump, diff->a, field->td_a));
+            CH_DUMP_MP_STR_CHECKED(dump, "b");
+            CH_RET_IF_ERR(ch_dump_col_diff_td_msgpack(dump, diff->b, field->td_b));
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+const ch_dump_collection_diff_fns g_dump_collection_diff_fns = {
+    .text = ch_dump_collection_diff_text,
+    .msgpack = ch_dump_collection_diff_msgpack,
+};
+
+ch_err ch_dump_collection_diff_to_text(FILE* f, const ch_collection_diff* diff, const char* indent_str)
+{
+    ch_dump_text rdump;
+    ch_dump_text* dump = &rdump;
+    ch_err err = ch_dump_text_begin(dump, f, indent_str, 0);
+    if (!err)
+        err = ch_dump_text_printf(dump, "Collection diff generated by Chicago save parser.\n\n");
+    if (!err)
+        err = CH_DUMP_TEXT_CALL(g_dump_collection_diff_fns, dump, diff);
+    return ch_dump_text_end(dump, err);
+}
+
+ch_err ch_dump_collection_diff_to_msgpack(FILE* f, const ch_collection_diff* diff)
+{
+    ch_dump_msgpack dump = {.pk = {.data = f, .callback = msgpack_fbuffer_write}};
+    CH_RET_IF_ERR(CH_DUMP_MSGPACK_CALL(g_dump_collection_diff_fns, &dump, diff));
+    return ferror(f) ? CH_ERR_FILE_IO : CH_ERR_NONE;
+}
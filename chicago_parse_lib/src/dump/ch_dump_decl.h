@@ -6,6 +6,12 @@
 
 CH_DECLARE_DUMP_FNS_SINGLE(sav, g_dump_sav_fns, const ch_parsed_save_data* save_data);
 
+struct ch_save_diff;
+CH_DECLARE_DUMP_FNS_SINGLE(save_diff, g_dump_save_diff_fns, const struct ch_save_diff* diff);
+
+struct ch_collection_diff;
+CH_DECLARE_DUMP_FNS_SINGLE(collection_diff, g_dump_collection_diff_fns, const struct ch_collection_diff* diff);
+
 // misc stuff
 
 typedef enum ch_dump_text_str_ll_type {
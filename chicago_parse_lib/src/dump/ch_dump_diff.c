@@ -0,0 +1,93 @@
+#include "ch_dump_decl.h"
+#include "analysis/ch_diff.h"
+
+static ch_err ch_dump_diff_field_val_text(ch_dump_text* dump,
+                                          char side,
+                                          const ch_type_description* td,
+                                          const unsigned char* data)
+{
+    CH_RET_IF_ERR(ch_dump_text_printf(dump, "%c ", side));
+    if (!td)
+        return ch_dump_text_printf(dump, "<not present>\n");
+    if (td->type != FIELD_CUSTOM)
+        return ch_dump_field_val_text(dump, td->type, td->total_size_bytes, data, false);
+    const void* custom = *(const void* const*)data;
+    if (!custom)
+        return ch_dump_text_printf(dump, "<null>\n");
+    if (!td->save_restore_ops || !td->save_restore_ops->dump_fns)
+        return ch_dump_text_printf(dump, "(NOT IMPLEMENTED)\n");
+    return CH_DUMP_TEXT_CALL(*td->save_restore_ops->dump_fns, dump, td, custom);
+}
+
+static ch_err ch_dump_diff_field_text(ch_dump_text* dump, const ch_diff_field* field)
+{
+    const ch_type_description* td = field->td_a ? field->td_a : field->td_b;
+    if (td->n_elems == 1)
+        CH_RET_IF_ERR(ch_dump_text_printf(dump, "%s %s:\n", ch_field_type_string(td->type), field->name));
+    else
+        CH_RET_IF_ERR(
+            ch_dump_text_printf(dump, "%s[%d] %s:\n", ch_field_type_string(td->type), td->n_elems, field->name));
+    dump->indent_lvl++;
+    CH_RET_IF_ERR(ch_dump_diff_field_val_text(dump, '-', field->td_a, field->data_a));
+    CH_RET_IF_ERR(ch_dump_diff_field_val_text(dump, '+', field->td_b, field->data_b));
+    dump->indent_lvl--;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_dump_save_diff_text(ch_dump_text* dump, const ch_save_diff* diff)
+{
+    CH_RET_IF_ERR(ch_dump_text_printf(dump,
+                                      "entities: %zu added, %zu removed, %zu changed, %zu unchanged\n",
+                                      diff->n_added,
+                                      diff->n_removed,
+                                      diff->n_changed,
+                                      diff->n_unchanged));
+
+    static const char* const kind_strs[] = {
+        [CH_DIFF_ENT_ADDED] = "added",
+        [CH_DIFF_ENT_REMOVED] = "removed",
+        [CH_DIFF_ENT_CHANGED] = "changed",
+    };
+
+    const char* last_sf_name = NULL;
+    for (const ch_diff_entity* ent = diff->entities; ent; ent = ent->next) {
+        if (ent->sf_name != last_sf_name) {
+            if (last_sf_name)
+                dump->indent_lvl--;
+            CH_RET_IF_ERR(ch_dump_text_printf(dump, "\nstate file \"%s\":\n", ent->sf_name));
+            dump->indent_lvl++;
+            last_sf_name = ent->sf_name;
+        }
+        const ch_restored_entity* re = ent->ent_b ? ent->ent_b : ent->ent_a;
+        CH_RET_IF_ERR(ch_dump_text_printf(dump,
+                                          "[%zu] %s (%s) %s%s\n",
+                                          ent->ent_idx,
+                                          re->classname ? re->classname : "<null>",
+                                          re->class_info.dm ? re->class_info.dm->class_name : "<null>",
+                                          kind_strs[ent->kind],
+                                          ent->fields ? ":" : ""));
+        dump->indent_lvl++;
+        for (const ch_diff_field* field = ent->fields; field; field = field->next)
+            CH_RET_IF_ERR(ch_dump_diff_field_text(dump, field));
+        dump->indent_lvl--;
+    }
+    if (last_sf_name)
+        dump->indent_lvl--;
+    return CH_ERR_NONE;
+}
+
+const ch_dump_save_diff_fns g_dump_save_diff_fns = {
+    .text = ch_dump_save_diff_text,
+};
+
+ch_err ch_dump_save_diff_to_text(FILE* f, const ch_save_diff* diff, const char* indent_str)
+{
+    ch_dump_text rdump;
+    ch_dump_text* dump = &rdump;
+    ch_err err = ch_dump_text_begin(dump, f, indent_str, 0);
+    if (!err)
+        err = ch_dump_text_printf(dump, "Save diff generated by Chicago save parser.\n\n");
+    if (!err)
+        err = CH_DUMP_TEXT_CALL(g_dump_save_diff_fns, dump, diff);
+    return ch_dump_text_end(dump, err);
+}
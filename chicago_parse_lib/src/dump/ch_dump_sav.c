@@ -50,52 +50,12 @@ const ch_dump_sav_fns g_dump_sav_fns = {
 
 ch_err ch_dump_sav_to_text(FILE* f, const ch_parsed_save_data* save_data, const char* indent_str, ch_dump_flags flags)
 {
-    size_t ind_len = strlen(indent_str);
-    assert(ind_len < 16); // what even is this indent string my dude
-    ind_len = min(ind_len, 16);
-
-    ch_dump_text rdump = {
-        .f = f,
-        .indent_str_len = (uint8_t)ind_len,
-        .flags = flags,
-        .pending_nl = false,
-        .indent_lvl = 0,
-    };
-    rdump.arena = ch_arena_new(0);
-    if (!rdump.arena)
-        return CH_ERR_OUT_OF_MEMORY;
-
-    ch_err err = CH_ERR_NONE;
-
-    // init indent string buf
-    rdump.indent_str_buf = ch_arena_alloc(rdump.arena, CH_DUMP_TEXT_MAX_INDENT * ind_len + 1);
-    if (!rdump.indent_str_buf) {
-        err = CH_ERR_OUT_OF_MEMORY;
-    } else {
-        for (size_t i = 0; i < CH_DUMP_TEXT_MAX_INDENT; i++)
-            sprintf(rdump.indent_str_buf + i * ind_len, "%.*s", (int)ind_len, indent_str);
-    }
-
+    ch_dump_text rdump;
     ch_dump_text* dump = &rdump;
-
-    // error checking hell to make sure we free the arena
+    ch_err err = ch_dump_text_begin(dump, f, indent_str, flags);
     if (!err)
         err = ch_dump_text_printf(dump, "Save dump generated by Chicago save parser.\n\n");
     if (!err)
         err = CH_DUMP_TEXT_CALL(g_dump_sav_fns, dump, (void*)save_data);
-
-    if (dump->first_error) {
-        if (!err)
-            err = ch_dump_text_printf(dump, "\n\nErrors during dumping:\n");
-        dump->indent_lvl++;
-        if (!err)
-            err = CH_DUMP_TEXT_CALL(g_dump_str_ll_fns, dump, dump->first_error, CH_DUMP_TEXT_STR_LL_NL_SEP);
-        if (!err)
-            err = ch_dump_text_printf(dump, "\n");
-        dump->indent_lvl--;
-    }
-    if (!err)
-        err = ch_dump_text_flush_nl(dump);
-    ch_arena_free(dump->arena);
-    return err;
+    return ch_dump_text_end(dump, err);
 }
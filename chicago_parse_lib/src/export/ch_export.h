@@ -0,0 +1,94 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* Columnar export - all restored entities from one or more saves are grouped into one table per entity
+* datamap, and each table stores one typed array per field instead of one struct per entity. This is meant
+* for feeding save data into analytics tools without having to walk the restored classes one by one.
+*
+* The columns of a table are the fields of the datamap flattened in datamap order: base class fields come
+* first, and embedded fields are flattened with a dot (e.g. "m_Collision.m_vecMins"). Only the first element
+* of embedded arrays is exported (same as the text dump), and custom fields are not exported at all. Field
+* names are not guaranteed to be unique since the game's datamaps aren't. Each table also has a few implicit
+* columns which are prefixed with an '@' so they can't collide with any game fields:
+* - @save       (FIELD_INTEGER) - index of the save in the array given to the export function
+* - @state_file (FIELD_INTEGER) - index of the state file in the save
+* - @entity     (FIELD_INTEGER) - index of the entity in the entity table
+* - @classname  (FIELD_STRING)  - the name the entity was created with, e.g. "prop_physics"
+*
+* Saves which were parsed with different collections can produce several tables with the same name.
+*
+* Layout - all integers are little-endian, and each of the "padded" sections below is padded with zeros so
+* that the next section starts on an 8 byte boundary relative to the start of the file:
+*
+* ch_columnar_file_header
+* for each table:
+*     ch_columnar_table_header
+*     char name[name_len]                       - class name of the datamap (not null terminated), padded
+*     for each column:
+*         ch_columnar_column_header
+*         char name[name_len]                   - flattened field name (not null terminated), padded
+*         uint8_t presence[(n_rows + 7) / 8]    - bit (i % 8) of byte (i / 8) is set if row i has a value, padded
+*         if elem_size != 0:
+*             uint8_t values[n_rows][elem_size] - raw field data, all zeros if not present, padded
+*         else (string column):
+*             uint32_t offsets[n_rows * n_elems + 1]   - string j of row i is blob[offsets[k]:offsets[k + 1]]
+*                                                        where k = i * n_elems + j, padded
+*             char blob[offsets[n_rows * n_elems]]     - not null terminated, padded
+*
+* The save format doesn't say which fields were written, so a field counts as present if any of its bytes
+* are non-zero (or if any of its strings are non-null), same as CH_DF_IGNORE_ZERO_FIELDS.
+*/
+
+#define CH_COLUMNAR_MAGIC "chcolumn"
+#define CH_COLUMNAR_VERSION 1
+
+typedef struct ch_columnar_file_header {
+    char magic[8]; // CH_COLUMNAR_MAGIC, not null terminated
+    uint32_t version;
+    uint32_t n_saves;
+    uint32_t n_tables;
+    uint32_t _pad;
+} ch_columnar_file_header;
+
+typedef struct ch_columnar_table_header {
+    uint32_t name_len;
+    uint32_t n_rows;
+    uint32_t n_columns;
+    uint32_t _pad;
+} ch_columnar_table_header;
+
+typedef struct ch_columnar_column_header {
+    uint32_t name_len;
+    uint32_t field_type; // ch_field_type
+    uint32_t n_elems;
+    uint32_t elem_size; // size of one row in bytes, 0 for string columns
+} ch_columnar_column_header;
+
+ch_err ch_export_columnar(FILE* f, const ch_parsed_save_data* const* saves, size_t n_saves);
+
+#ifdef CH_HAVE_SQLITE
+
+/*
+* SQLite export - appends the saves to the database at db_path (which is created if it doesn't exist). This is
+* meant for bulk ingesting lots of saves, so everything is inserted in a single transaction with prepared
+* multi-row inserts. The schema is:
+*
+* saves       (save_id INTEGER PRIMARY KEY, name TEXT, n_state_files INTEGER, n_errors INTEGER)
+* state_files (save_id, state_file, name TEXT, type TEXT)
+* entities    (save_id, state_file, entity, classname TEXT, datamap TEXT)
+* fields      (save_id, state_file, entity, name TEXT, type TEXT, value)
+*
+* state_file is the index of the state file in the save, and entity is the index in the entity table. Only
+* present fields are inserted and they are flattened the same way as for the columnar export (see above).
+* Single element scalar fields are stored as INTEGER/REAL/TEXT, everything else (vectors, arrays, etc.) is
+* stored as a JSON array so that it can be picked apart with json_extract(). Character arrays are stored as
+* TEXT. save_names may be NULL.
+*/
+ch_err ch_export_sqlite(const char* db_path,
+                        const ch_parsed_save_data* const* saves,
+                        const char* const* save_names,
+                        size_t n_saves);
+
+#endif
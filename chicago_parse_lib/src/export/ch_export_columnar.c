@@ -0,0 +1,324 @@
+#include "ch_export_internal.h"
+
+typedef struct ch_columnar_row {
+    uint32_t save_idx;
+    uint32_t sf_idx;
+    uint32_t ent_idx;
+    const ch_restored_entity* ent;
+} ch_columnar_row;
+
+typedef struct ch_columnar_table {
+    const ch_datamap* dm;
+    size_t n_rows;
+    ch_columnar_row* rows;
+} ch_columnar_table;
+
+typedef enum ch_columnar_col_src {
+    CH_COL_SRC_FIELD,
+    CH_COL_SRC_SAVE_IDX,
+    CH_COL_SRC_SF_IDX,
+    CH_COL_SRC_ENT_IDX,
+    CH_COL_SRC_CLASSNAME,
+} ch_columnar_col_src;
+
+typedef struct ch_columnar_col {
+    const char* name;
+    ch_columnar_col_src src;
+    const ch_type_description* td; // only for CH_COL_SRC_FIELD
+    ch_field_type ft;
+    uint32_t n_elems;
+    uint32_t elem_size; // 0 for strings
+    size_t offset;      // offset of the field in the restored entity data
+    struct ch_columnar_col* next;
+} ch_columnar_col;
+
+typedef struct ch_columnar_writer {
+    FILE* f;
+    size_t pos;
+    ch_arena* arena;
+    ch_columnar_col* first_col;
+    ch_columnar_col* last_col;
+    uint32_t n_cols;
+} ch_columnar_writer;
+
+static const unsigned char ch_columnar_zeros[8];
+
+static ch_err ch_columnar_write(ch_columnar_writer* w, const void* data, size_t n)
+{
+    if (n > 0 && fwrite(data, n, 1, w->f) != 1)
+        return CH_ERR_FILE_IO;
+    w->pos += n;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_columnar_pad(ch_columnar_writer* w)
+{
+    return ch_columnar_write(w, ch_columnar_zeros, CH_ALIGN_TO(w->pos, 8) - w->pos);
+}
+
+static ch_err ch_columnar_add_col(ch_columnar_writer* w, const ch_columnar_col* col)
+{
+    ch_columnar_col* new_col;
+    CH_CHECKED_ALLOC(new_col, ch_arena_alloc(w->arena, sizeof *new_col));
+    *new_col = *col;
+    new_col->next = NULL;
+    if (w->last_col)
+        w->last_col->next = new_col;
+    else
+        w->first_col = new_col;
+    w->last_col = new_col;
+    w->n_cols++;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_columnar_add_field_cols(ch_columnar_writer* w, const ch_datamap* dm)
+{
+    ch_flat_field* first;
+    size_t n_fields;
+    CH_RET_IF_ERR(ch_flatten_fields(w->arena, dm, 0, &first, &n_fields));
+    for (const ch_flat_field* field = first; field; field = field->next) {
+        ch_columnar_col col = {
+            .name = field->name,
+            .src = CH_COL_SRC_FIELD,
+            .td = field->td,
+            .ft = field->td->type,
+            .n_elems = field->td->n_elems,
+            .elem_size = ch_field_type_is_str(field->td->type) ? 0 : (uint32_t)field->td->total_size_bytes,
+            .offset = field->offset,
+        };
+        CH_RET_IF_ERR(ch_columnar_add_col(w, &col));
+    }
+    return CH_ERR_NONE;
+}
+
+static const void* ch_columnar_row_val(const ch_columnar_col* col, const ch_columnar_row* row)
+{
+    switch (col->src) {
+        case CH_COL_SRC_FIELD:
+            return row->ent->class_info.data + col->offset;
+        case CH_COL_SRC_SAVE_IDX:
+            return &row->save_idx;
+        case CH_COL_SRC_SF_IDX:
+            return &row->sf_idx;
+        case CH_COL_SRC_ENT_IDX:
+            return &row->ent_idx;
+        case CH_COL_SRC_CLASSNAME:
+            return &row->ent->classname;
+        default:
+            assert(0);
+            return NULL;
+    }
+}
+
+static bool ch_columnar_val_present(const ch_columnar_col* col, const void* val)
+{
+    return col->src != CH_COL_SRC_FIELD || ch_export_field_present(col->td, val);
+}
+
+static ch_err ch_columnar_write_col(ch_columnar_writer* w, const ch_columnar_table* table, const ch_columnar_col* col)
+{
+    ch_columnar_column_header header = {
+        .name_len = (uint32_t)strlen(col->name),
+        .field_type = col->ft,
+        .n_elems = col->n_elems,
+        .elem_size = col->elem_size,
+    };
+    CH_RET_IF_ERR(ch_columnar_write(w, &header, sizeof header));
+    CH_RET_IF_ERR(ch_columnar_write(w, col->name, header.name_len));
+    CH_RET_IF_ERR(ch_columnar_pad(w));
+
+    // presence bitmap
+
+    size_t n_bitmap_bytes = (table->n_rows + 7) / 8;
+    uint8_t* bitmap = calloc(n_bitmap_bytes, 1);
+    if (!bitmap && n_bitmap_bytes > 0)
+        return CH_ERR_OUT_OF_MEMORY;
+    for (size_t i = 0; i < table->n_rows; i++)
+        if (ch_columnar_val_present(col, ch_columnar_row_val(col, &table->rows[i])))
+            bitmap[i / 8] |= (uint8_t)(1 << (i % 8));
+    ch_err err = ch_columnar_write(w, bitmap, n_bitmap_bytes);
+    free(bitmap);
+    CH_RET_IF_ERR(err);
+    CH_RET_IF_ERR(ch_columnar_pad(w));
+
+    // values
+
+    if (col->elem_size != 0) {
+        for (size_t i = 0; i < table->n_rows; i++)
+            CH_RET_IF_ERR(ch_columnar_write(w, ch_columnar_row_val(col, &table->rows[i]), col->elem_size));
+        return ch_columnar_pad(w);
+    }
+
+    uint32_t str_off = 0;
+    CH_RET_IF_ERR(ch_columnar_write(w, &str_off, sizeof str_off));
+    for (size_t i = 0; i < table->n_rows; i++) {
+        const char* const* strs = ch_columnar_row_val(col, &table->rows[i]);
+        for (uint32_t j = 0; j < col->n_elems; j++) {
+            str_off += strs[j] ? (uint32_t)strlen(strs[j]) : 0;
+            CH_RET_IF_ERR(ch_columnar_write(w, &str_off, sizeof str_off));
+        }
+    }
+    CH_RET_IF_ERR(ch_columnar_pad(w));
+    for (size_t i = 0; i < table->n_rows; i++) {
+        const char* const* strs = ch_columnar_row_val(col, &table->rows[i]);
+        for (uint32_t j = 0; j < col->n_elems; j++)
+            if (strs[j])
+                CH_RET_IF_ERR(ch_columnar_write(w, strs[j], strlen(strs[j])));
+    }
+    return ch_columnar_pad(w);
+}
+
+static ch_err ch_columnar_write_table(ch_columnar_writer* w, const ch_columnar_table* table)
+{
+    w->first_col = w->last_col = NULL;
+    w->n_cols = 0;
+
+#define CH_IMPLICIT_COL(col_name, col_src, col_ft, col_size) \
+    {.name = col_name, .src = col_src, .ft = col_ft, .n_elems = 1, .elem_size = col_size}
+
+    const ch_columnar_col implicit_cols[] = {
+        CH_IMPLICIT_COL("@save", CH_COL_SRC_SAVE_IDX, FIELD_INTEGER, sizeof(uint32_t)),
+        CH_IMPLICIT_COL("@state_file", CH_COL_SRC_SF_IDX, FIELD_INTEGER, sizeof(uint32_t)),
+        CH_IMPLICIT_COL("@entity", CH_COL_SRC_ENT_IDX, FIELD_INTEGER, sizeof(uint32_t)),
+        CH_IMPLICIT_COL("@classname", CH_COL_SRC_CLASSNAME, FIELD_STRING, 0),
+    };
+
+#undef CH_IMPLICIT_COL
+
+    for (size_t i = 0; i < CH_ARRAYSIZE(implicit_cols); i++)
+        CH_RET_IF_ERR(ch_columnar_add_col(w, &implicit_cols[i]));
+    CH_RET_IF_ERR(ch_columnar_add_field_cols(w, table->dm));
+
+    ch_columnar_table_header header = {
+        .name_len = (uint32_t)strlen(table->dm->class_name),
+        .n_rows = (uint32_t)table->n_rows,
+        .n_columns = w->n_cols,
+    };
+    CH_RET_IF_ERR(ch_columnar_write(w, &header, sizeof header));
+    CH_RET_IF_ERR(ch_columnar_write(w, table->dm->class_name, header.name_len));
+    CH_RET_IF_ERR(ch_columnar_pad(w));
+
+    for (const ch_columnar_col* col = w->first_col; col; col = col->next)
+        CH_RET_IF_ERR(ch_columnar_write_col(w, table, col));
+    return CH_ERR_NONE;
+}
+
+static int ch_columnar_table_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_columnar_table* ta = a;
+    const ch_columnar_table* tb = b;
+    return ta->dm < tb->dm ? -1 : ta->dm > tb->dm;
+}
+
+static uint64_t ch_columnar_table_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_columnar_table* t = item;
+    return hashmap_xxhash3(&t->dm, sizeof t->dm, seed0, seed1);
+}
+
+static int ch_columnar_table_sort_compare(const void* a, const void* b)
+{
+    const ch_columnar_table* ta = *(const ch_columnar_table* const*)a;
+    const ch_columnar_table* tb = *(const ch_columnar_table* const*)b;
+    int cmp = strcmp(ta->dm->class_name, tb->dm->class_name);
+    return cmp ? cmp : (ta->dm < tb->dm ? -1 : ta->dm > tb->dm);
+}
+
+#define CH_COLUMNAR_FOR_EACH_ENTITY(saves, n_saves, i, j, k, ent)                                          \
+    for (size_t i = 0; i < (n_saves); i++)                                                                 \
+        for (size_t j = 0; j < (saves)[i]->n_state_files; j++)                                             \
+            for (const ch_block_entities* _block = ch_sf_get_block_entities(&(saves)[i]->state_files[j]); \
+                 _block;                                                                                   \
+                 _block = NULL)                                                                            \
+                for (size_t k = 0; k < _block->entity_table.n_elems; k++)                                  \
+                    for (const ch_restored_entity* ent = _block->entities[k]; ent && ent->class_info.data; \
+                         ent = NULL)
+
+static ch_err ch_export_columnar_tables(ch_columnar_writer* w,
+                                        struct hashmap* tables,
+                                        const ch_parsed_save_data* const* saves,
+                                        size_t n_saves)
+{
+    // count rows per table
+
+    CH_COLUMNAR_FOR_EACH_ENTITY(saves, n_saves, i, j, k, ent)
+    {
+        ch_columnar_table key = {.dm = ent->class_info.dm};
+        const ch_columnar_table* existing = hashmap_get(tables, &key);
+        if (existing)
+            key = *existing;
+        key.n_rows++;
+        if (!hashmap_set(tables, &key) && hashmap_oom(tables))
+            return CH_ERR_OUT_OF_MEMORY;
+    }
+
+    // allocate rows & sort the tables by name so that the output doesn't depend on the hashmap order
+
+    size_t n_tables = hashmap_count(tables);
+    ch_columnar_table** sorted;
+    CH_CHECKED_ALLOC(sorted, ch_arena_alloc(w->arena, sizeof(*sorted) * n_tables));
+    size_t iter = 0, n_sorted = 0;
+    void* item;
+    while (hashmap_iter(tables, &iter, &item)) {
+        ch_columnar_table* table = item;
+        CH_CHECKED_ALLOC(table->rows, ch_arena_alloc(w->arena, sizeof(ch_columnar_row) * table->n_rows));
+        table->n_rows = 0;
+        sorted[n_sorted++] = table;
+    }
+    qsort(sorted, n_tables, sizeof *sorted, ch_columnar_table_sort_compare);
+
+    CH_COLUMNAR_FOR_EACH_ENTITY(saves, n_saves, i, j, k, ent)
+    {
+        ch_columnar_table key = {.dm = ent->class_info.dm};
+        ch_columnar_table* table = (ch_columnar_table*)hashmap_get(tables, &key);
+        assert(table);
+        table->rows[table->n_rows++] = (ch_columnar_row){
+            .save_idx = (uint32_t)i,
+            .sf_idx = (uint32_t)j,
+            .ent_idx = (uint32_t)k,
+            .ent = ent,
+        };
+    }
+
+    // write everything
+
+    ch_columnar_file_header header = {
+        .version = CH_COLUMNAR_VERSION,
+        .n_saves = (uint32_t)n_saves,
+        .n_tables = (uint32_t)n_tables,
+    };
+    memcpy(header.magic, CH_COLUMNAR_MAGIC, sizeof header.magic);
+    CH_RET_IF_ERR(ch_columnar_write(w, &header, sizeof header));
+
+    for (size_t i = 0; i < n_tables; i++)
+        CH_RET_IF_ERR(ch_columnar_write_table(w, sorted[i]));
+    return CH_ERR_NONE;
+}
+
+ch_err ch_export_columnar(FILE* f, const ch_parsed_save_data* const* saves, size_t n_saves)
+{
+    ch_columnar_writer w = {.f = f};
+    w.arena = ch_arena_new(1024 * 64);
+    if (!w.arena)
+        return CH_ERR_OUT_OF_MEMORY;
+
+    ch_err err = CH_ERR_NONE;
+    struct hashmap* tables = hashmap_new(sizeof(ch_columnar_table),
+                                         256,
+                                         0,
+                                         0,
+                                         ch_columnar_table_hash,
+                                         ch_columnar_table_compare,
+                                         NULL,
+                                         NULL);
+    if (!tables)
+        err = CH_ERR_OUT_OF_MEMORY;
+    if (!err)
+        err = ch_export_columnar_tables(&w, tables, saves, n_saves);
+
+    if (tables)
+        hashmap_free(tables);
+    ch_arena_free(w.arena);
+    return err;
+}
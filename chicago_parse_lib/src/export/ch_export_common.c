@@ -0,0 +1,15 @@
+#include "ch_export_internal.h"
+
+bool ch_export_field_present(const ch_type_description* td, const unsigned char* field_ptr)
+{
+    if (ch_field_type_is_str(td->type)) {
+        for (size_t i = 0; i < td->n_elems; i++)
+            if (((const char* const*)field_ptr)[i])
+                return true;
+        return false;
+    }
+    for (const unsigned char* m = field_ptr; m < field_ptr + td->total_size_bytes; m++)
+        if (*m)
+            return true;
+    return false;
+}
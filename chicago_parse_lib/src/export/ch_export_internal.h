@@ -0,0 +1,7 @@
+#pragma once
+
+#include "ch_export.h"
+#include "ch_save_internal.h"
+
+// the save doesn't say which fields were written - treat fields with any non-zero bytes as present
+bool ch_export_field_present(const ch_type_description* td, const unsigned char* field_ptr);
@@ -0,0 +1,554 @@
+#ifdef CH_HAVE_SQLITE
+
+#include <stdarg.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "sqlite3.h"
+
+#include "ch_export_internal.h"
+
+/*
+* Binding values for every row and stepping each insert on its own is slow, even inside of a transaction. Rows
+* are instead buffered and inserted with a single statement which has CH_SQLITE_BATCH_ROWS rows worth of
+* parameters. Older versions of SQLite have a default limit of 999 parameters per statement.
+*/
+#define CH_SQLITE_BATCH_ROWS 128
+#define CH_SQLITE_MAX_COLS 6
+static_assert(CH_SQLITE_BATCH_ROWS * CH_SQLITE_MAX_COLS <= 999);
+
+typedef enum ch_sqlite_val_type {
+    CH_SQLITE_VAL_NULL,
+    CH_SQLITE_VAL_INT,
+    CH_SQLITE_VAL_REAL,
+    CH_SQLITE_VAL_TEXT,         // points to a string which outlives the batch
+    CH_SQLITE_VAL_SCRATCH_TEXT, // offset into the batch's scratch buffer
+} ch_sqlite_val_type;
+
+typedef struct ch_sqlite_val {
+    ch_sqlite_val_type type;
+    int text_len;
+    union {
+        int64_t i;
+        double d;
+        const char* text;
+        size_t scratch_off;
+    };
+} ch_sqlite_val;
+
+typedef struct ch_sqlite_batch {
+    sqlite3_stmt* stmt_batch; // inserts CH_SQLITE_BATCH_ROWS rows at once
+    sqlite3_stmt* stmt_single;
+    int n_cols;
+    int n_rows;
+    ch_sqlite_val vals[CH_SQLITE_BATCH_ROWS * CH_SQLITE_MAX_COLS];
+    // storage for generated text (e.g. json arrays), cleared after each flush
+    char* scratch;
+    size_t scratch_len;
+    size_t scratch_cap;
+} ch_sqlite_batch;
+
+typedef struct ch_sqlite_flat_dm {
+    const ch_datamap* dm;
+    ch_flat_field* fields;
+} ch_sqlite_flat_dm;
+
+typedef struct ch_sqlite_export_ctx {
+    sqlite3* db;
+    sqlite3_stmt* stmt_save;
+    ch_sqlite_batch* batch_sfs;
+    ch_sqlite_batch* batch_ents;
+    ch_sqlite_batch* batch_fields;
+    ch_arena* arena;
+    struct hashmap* flat_dms; // ch_sqlite_flat_dm
+} ch_sqlite_export_ctx;
+
+static const char* const ch_sqlite_schema =
+    "CREATE TABLE IF NOT EXISTS saves ("
+    "save_id INTEGER PRIMARY KEY, name TEXT, n_state_files INTEGER, n_errors INTEGER);"
+    "CREATE TABLE IF NOT EXISTS state_files ("
+    "save_id INTEGER NOT NULL, state_file INTEGER NOT NULL, name TEXT, type TEXT, "
+    "PRIMARY KEY (save_id, state_file)) WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS entities ("
+    "save_id INTEGER NOT NULL, state_file INTEGER NOT NULL, entity INTEGER NOT NULL, classname TEXT, datamap TEXT, "
+    "PRIMARY KEY (save_id, state_file, entity)) WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS fields ("
+    "save_id INTEGER NOT NULL, state_file INTEGER NOT NULL, entity INTEGER NOT NULL, name TEXT NOT NULL, type TEXT, "
+    "value);";
+
+// created after the inserts, updating the index for every row is much slower than building it at the end
+static const char* const ch_sqlite_indices =
+    "CREATE INDEX IF NOT EXISTS fields_by_entity ON fields (save_id, state_file, entity);"
+    "CREATE INDEX IF NOT EXISTS fields_by_name ON fields (name);"
+    "CREATE INDEX IF NOT EXISTS entities_by_classname ON entities (classname);";
+
+static ch_err ch_sqlite_exec(sqlite3* db, const char* sql)
+{
+    return sqlite3_exec(db, sql, NULL, NULL, NULL) == SQLITE_OK ? CH_ERR_NONE : CH_ERR_SQLITE;
+}
+
+static ch_err ch_sqlite_prepare_insert(sqlite3* db,
+                                       const char* table,
+                                       int n_cols,
+                                       int n_rows,
+                                       sqlite3_stmt** stmt)
+{
+    // INSERT INTO table VALUES (?,?,?),(?,?,?),...
+    size_t row_len = 2 + 2 * (size_t)n_cols;
+    size_t sql_len = strlen("INSERT INTO  VALUES ") + strlen(table) + row_len * n_rows;
+    char* sql = malloc(sql_len + 1);
+    if (!sql)
+        return CH_ERR_OUT_OF_MEMORY;
+    char* p = sql + sprintf(sql, "INSERT INTO %s VALUES ", table);
+    for (int i = 0; i < n_rows; i++) {
+        *p++ = i == 0 ? '(' : ',';
+        if (i > 0)
+            *p++ = '(';
+        for (int j = 0; j < n_cols; j++) {
+            *p++ = '?';
+            *p++ = j == n_cols - 1 ? ')' : ',';
+        }
+    }
+    *p = '\0';
+    assert((size_t)(p - sql) <= sql_len);
+    int rc = sqlite3_prepare_v2(db, sql, (int)(p - sql), stmt, NULL);
+    free(sql);
+    return rc == SQLITE_OK ? CH_ERR_NONE : CH_ERR_SQLITE;
+}
+
+static ch_err ch_sqlite_batch_new(sqlite3* db, const char* table, int n_cols, ch_sqlite_batch** batch)
+{
+    assert(n_cols <= CH_SQLITE_MAX_COLS);
+    CH_CHECKED_ALLOC(*batch, calloc(1, sizeof **batch));
+    (**batch).n_cols = n_cols;
+    CH_RET_IF_ERR(ch_sqlite_prepare_insert(db, table, n_cols, CH_SQLITE_BATCH_ROWS, &(**batch).stmt_batch));
+    return ch_sqlite_prepare_insert(db, table, n_cols, 1, &(**batch).stmt_single);
+}
+
+static void ch_sqlite_batch_free(ch_sqlite_batch* batch)
+{
+    if (!batch)
+        return;
+    sqlite3_finalize(batch->stmt_batch);
+    sqlite3_finalize(batch->stmt_single);
+    free(batch->scratch);
+    free(batch);
+}
+
+static ch_err ch_sqlite_bind_row(ch_sqlite_batch* batch, sqlite3_stmt* stmt, int stmt_row, int batch_row)
+{
+    for (int i = 0; i < batch->n_cols; i++) {
+        const ch_sqlite_val* val = &batch->vals[batch_row * batch->n_cols + i];
+        int idx = stmt_row * batch->n_cols + i + 1;
+        int rc;
+        switch (val->type) {
+            case CH_SQLITE_VAL_INT:
+                rc = sqlite3_bind_int64(stmt, idx, val->i);
+                break;
+            case CH_SQLITE_VAL_REAL:
+                rc = sqlite3_bind_double(stmt, idx, val->d);
+                break;
+            case CH_SQLITE_VAL_TEXT:
+                rc = sqlite3_bind_text(stmt, idx, val->text, val->text_len, SQLITE_STATIC);
+                break;
+            case CH_SQLITE_VAL_SCRATCH_TEXT:
+                rc = sqlite3_bind_text(stmt, idx, batch->scratch + val->scratch_off, val->text_len, SQLITE_STATIC);
+                break;
+            case CH_SQLITE_VAL_NULL:
+            default:
+                rc = sqlite3_bind_null(stmt, idx);
+                break;
+        }
+        if (rc != SQLITE_OK)
+            return CH_ERR_SQLITE;
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_sqlite_step(sqlite3_stmt* stmt)
+{
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE ? CH_ERR_NONE : CH_ERR_SQLITE;
+}
+
+static ch_err ch_sqlite_batch_flush(ch_sqlite_batch* batch)
+{
+    if (batch->n_rows == CH_SQLITE_BATCH_ROWS) {
+        for (int i = 0; i < batch->n_rows; i++)
+            CH_RET_IF_ERR(ch_sqlite_bind_row(batch, batch->stmt_batch, i, i));
+        CH_RET_IF_ERR(ch_sqlite_step(batch->stmt_batch));
+    } else {
+        for (int i = 0; i < batch->n_rows; i++) {
+            CH_RET_IF_ERR(ch_sqlite_bind_row(batch, batch->stmt_single, 0, i));
+            CH_RET_IF_ERR(ch_sqlite_step(batch->stmt_single));
+        }
+    }
+    batch->n_rows = 0;
+    batch->scratch_len = 0;
+    return CH_ERR_NONE;
+}
+
+static inline ch_sqlite_val* ch_sqlite_batch_cur_row(ch_sqlite_batch* batch)
+{
+    return &batch->vals[batch->n_rows * batch->n_cols];
+}
+
+static ch_err ch_sqlite_batch_end_row(ch_sqlite_batch* batch)
+{
+    if (++batch->n_rows == CH_SQLITE_BATCH_ROWS)
+        return ch_sqlite_batch_flush(batch);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_sqlite_scratch_printf(ch_sqlite_batch* batch, const char* fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    int len = vsnprintf(NULL, 0, fmt, va);
+    va_end(va);
+    assert(len >= 0);
+    if (batch->scratch_len + len + 1 > batch->scratch_cap) {
+        size_t new_cap = max(batch->scratch_cap * 2, batch->scratch_len + len + 1);
+        new_cap = max(new_cap, 4096);
+        CH_CHECKED_ALLOC(batch->scratch, realloc(batch->scratch, new_cap));
+        batch->scratch_cap = new_cap;
+    }
+    va_start(va, fmt);
+    vsnprintf(batch->scratch + batch->scratch_len, len + 1, fmt, va);
+    va_end(va);
+    batch->scratch_len += len;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_sqlite_scratch_json_str(ch_sqlite_batch* batch, const char* str)
+{
+    if (!str)
+        return ch_sqlite_scratch_printf(batch, "null");
+    CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "\""));
+    for (const char* c = str; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "\\%c", *c));
+        else if ((unsigned char)*c < 0x20)
+            CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "\\u%04x", (unsigned char)*c));
+        else
+            CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "%c", *c));
+    }
+    return ch_sqlite_scratch_printf(batch, "\"");
+}
+
+static inline ch_sqlite_val ch_sqlite_int(int64_t i)
+{
+    return (ch_sqlite_val){.type = CH_SQLITE_VAL_INT, .i = i};
+}
+
+static inline ch_sqlite_val ch_sqlite_text(const char* text)
+{
+    if (!text)
+        return (ch_sqlite_val){.type = CH_SQLITE_VAL_NULL};
+    return (ch_sqlite_val){.type = CH_SQLITE_VAL_TEXT, .text = text, .text_len = (int)strlen(text)};
+}
+
+// converts a field to a single value, or a json array of values if the field has more than one component
+static ch_err ch_sqlite_field_val(ch_sqlite_batch* batch,
+                                  const ch_type_description* td,
+                                  const unsigned char* field_ptr,
+                                  ch_sqlite_val* val)
+{
+    if (ch_field_type_is_str(td->type)) {
+        const char* const* strs = (const char* const*)field_ptr;
+        if (td->n_elems == 1) {
+            *val = ch_sqlite_text(strs[0]);
+            return CH_ERR_NONE;
+        }
+        size_t start = batch->scratch_len;
+        for (size_t i = 0; i < td->n_elems; i++) {
+            CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, i == 0 ? "[" : ","));
+            CH_RET_IF_ERR(ch_sqlite_scratch_json_str(batch, strs[i]));
+        }
+        CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "]"));
+        *val = (ch_sqlite_val){
+            .type = CH_SQLITE_VAL_SCRATCH_TEXT,
+            .scratch_off = start,
+            .text_len = (int)(batch->scratch_len - start),
+        };
+        return CH_ERR_NONE;
+    }
+
+    size_t elem_size;
+    switch (td->type) {
+        case FIELD_CHARACTER:
+            if (td->total_size_bytes > 1) {
+                // char arrays are almost always strings
+                *val = (ch_sqlite_val){
+                    .type = CH_SQLITE_VAL_TEXT,
+                    .text = (const char*)field_ptr,
+                    .text_len = (int)strnlen((const char*)field_ptr, td->total_size_bytes),
+                };
+                return CH_ERR_NONE;
+            }
+            elem_size = 1;
+            break;
+        case FIELD_BOOLEAN:
+            elem_size = 1;
+            break;
+        case FIELD_SHORT:
+            elem_size = sizeof(int16_t);
+            break;
+        default:
+            elem_size = sizeof(int32_t);
+            break;
+    }
+
+    bool is_float;
+    switch (td->type) {
+        case FIELD_FLOAT:
+        case FIELD_VECTOR:
+        case FIELD_QUATERNION:
+        case FIELD_POSITION_VECTOR:
+        case FIELD_TIME:
+        case FIELD_VMATRIX:
+        case FIELD_VMATRIX_WORLDSPACE:
+        case FIELD_MATRIX3X4_WORLDSPACE:
+        case FIELD_INTERVAL:
+        case FIELD_VECTOR2D:
+            is_float = true;
+            break;
+        default:
+            is_float = false;
+            break;
+    }
+
+    size_t n_vals = td->total_size_bytes / elem_size;
+    size_t start = batch->scratch_len;
+
+    for (size_t i = 0; i < n_vals; i++) {
+        const unsigned char* p = field_ptr + i * elem_size;
+        ch_sqlite_val elem_val;
+        if (is_float) {
+            float f;
+            memcpy(&f, p, sizeof f);
+            elem_val = (ch_sqlite_val){.type = isfinite(f) ? CH_SQLITE_VAL_REAL : CH_SQLITE_VAL_NULL, .d = f};
+        } else if (elem_size == 1) {
+            elem_val = ch_sqlite_int(*(const int8_t*)p);
+        } else if (elem_size == sizeof(int16_t)) {
+            int16_t i16;
+            memcpy(&i16, p, sizeof i16);
+            elem_val = ch_sqlite_int(i16);
+        } else if (td->type == FIELD_COLOR32) {
+            uint32_t u32;
+            memcpy(&u32, p, sizeof u32);
+            elem_val = ch_sqlite_int(u32);
+        } else {
+            int32_t i32;
+            memcpy(&i32, p, sizeof i32);
+            elem_val = ch_sqlite_int(i32);
+        }
+
+        if (n_vals == 1) {
+            *val = elem_val;
+            return CH_ERR_NONE;
+        }
+
+        CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, i == 0 ? "[" : ","));
+        switch (elem_val.type) {
+            case CH_SQLITE_VAL_REAL:
+                CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "%.9g", elem_val.d));
+                break;
+            case CH_SQLITE_VAL_INT:
+                CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "%" PRId64, elem_val.i));
+                break;
+            default:
+                CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "null"));
+                break;
+        }
+    }
+    CH_RET_IF_ERR(ch_sqlite_scratch_printf(batch, "]"));
+    *val = (ch_sqlite_val){
+        .type = CH_SQLITE_VAL_SCRATCH_TEXT,
+        .scratch_off = start,
+        .text_len = (int)(batch->scratch_len - start),
+    };
+    return CH_ERR_NONE;
+}
+
+static int ch_sqlite_flat_dm_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_sqlite_flat_dm* fa = a;
+    const ch_sqlite_flat_dm* fb = b;
+    return fa->dm < fb->dm ? -1 : fa->dm > fb->dm;
+}
+
+static uint64_t ch_sqlite_flat_dm_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_sqlite_flat_dm* f = item;
+    return hashmap_xxhash3(&f->dm, sizeof f->dm, seed0, seed1);
+}
+
+static ch_err ch_sqlite_get_flat_fields(ch_sqlite_export_ctx* ctx,
+                                        const ch_datamap* dm,
+                                        const ch_flat_field** fields)
+{
+    ch_sqlite_flat_dm entry = {.dm = dm};
+    const ch_sqlite_flat_dm* existing = hashmap_get(ctx->flat_dms, &entry);
+    if (existing) {
+        *fields = existing->fields;
+        return CH_ERR_NONE;
+    }
+    size_t n_fields;
+    CH_RET_IF_ERR(ch_flatten_fields(ctx->arena, dm, 0, &entry.fields, &n_fields));
+    if (!hashmap_set(ctx->flat_dms, &entry) && hashmap_oom(ctx->flat_dms))
+        return CH_ERR_OUT_OF_MEMORY;
+    *fields = entry.fields;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_sqlite_export_entities(ch_sqlite_export_ctx* ctx,
+                                        int64_t save_id,
+                                        size_t sf_idx,
+                                        const ch_block_entities* block)
+{
+    for (size_t i = 0; i < block->entity_table.n_elems; i++) {
+        const ch_restored_entity* ent = block->entities[i];
+        if (!ent || !ent->class_info.data)
+            continue;
+
+        ch_sqlite_val* row = ch_sqlite_batch_cur_row(ctx->batch_ents);
+        row[0] = ch_sqlite_int(save_id);
+        row[1] = ch_sqlite_int((int64_t)sf_idx);
+        row[2] = ch_sqlite_int((int64_t)i);
+        row[3] = ch_sqlite_text(ent->classname);
+        row[4] = ch_sqlite_text(ent->class_info.dm->class_name);
+        CH_RET_IF_ERR(ch_sqlite_batch_end_row(ctx->batch_ents));
+
+        const ch_flat_field* fields;
+        CH_RET_IF_ERR(ch_sqlite_get_flat_fields(ctx, ent->class_info.dm, &fields));
+
+        for (const ch_flat_field* field = fields; field; field = field->next) {
+            const unsigned char* field_ptr = ent->class_info.data + field->offset;
+            if (!ch_export_field_present(field->td, field_ptr))
+                continue;
+            row = ch_sqlite_batch_cur_row(ctx->batch_fields);
+            row[0] = ch_sqlite_int(save_id);
+            row[1] = ch_sqlite_int((int64_t)sf_idx);
+            row[2] = ch_sqlite_int((int64_t)i);
+            row[3] = ch_sqlite_text(field->name);
+            row[4] = ch_sqlite_text(ch_field_type_string(field->td->type));
+            CH_RET_IF_ERR(ch_sqlite_field_val(ctx->batch_fields, field->td, field_ptr, &row[5]));
+            CH_RET_IF_ERR(ch_sqlite_batch_end_row(ctx->batch_fields));
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_sqlite_export_save(ch_sqlite_export_ctx* ctx, const ch_parsed_save_data* save, const char* name)
+{
+    int64_t n_errors = 0;
+    for (const ch_str_ll* err_ll = save->errors_ll; err_ll; err_ll = err_ll->next)
+        n_errors++;
+
+    sqlite3_stmt* stmt = ctx->stmt_save;
+    if (name ? sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC) : sqlite3_bind_null(stmt, 1))
+        return CH_ERR_SQLITE;
+    if (sqlite3_bind_int64(stmt, 2, (int64_t)save->n_state_files) || sqlite3_bind_int64(stmt, 3, n_errors))
+        return CH_ERR_SQLITE;
+    CH_RET_IF_ERR(ch_sqlite_step(stmt));
+    int64_t save_id = sqlite3_last_insert_rowid(ctx->db);
+
+    for (size_t i = 0; i < save->n_state_files; i++) {
+        const ch_state_file* sf = &save->state_files[i];
+        ch_sqlite_val* row = ch_sqlite_batch_cur_row(ctx->batch_sfs);
+        row[0] = ch_sqlite_int(save_id);
+        row[1] = ch_sqlite_int((int64_t)i);
+        row[2] = (ch_sqlite_val){
+            .type = CH_SQLITE_VAL_TEXT,
+            .text = sf->name,
+            .text_len = (int)strnlen(sf->name, sizeof sf->name),
+        };
+        row[3] = ch_sqlite_text(ch_sf_type_strs[sf->type]);
+        CH_RET_IF_ERR(ch_sqlite_batch_end_row(ctx->batch_sfs));
+
+        const ch_block_entities* block = ch_sf_get_block_entities(sf);
+        if (block)
+            CH_RET_IF_ERR(ch_sqlite_export_entities(ctx, save_id, i, block));
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_sqlite_export_all(ch_sqlite_export_ctx* ctx,
+                                   const ch_parsed_save_data* const* saves,
+                                   const char* const* save_names,
+                                   size_t n_saves)
+{
+    // the database is only written to by us - a crash mid-export is fine as long as the file is not corrupted
+    CH_RET_IF_ERR(ch_sqlite_exec(ctx->db, "PRAGMA synchronous = OFF; PRAGMA temp_store = MEMORY;"));
+    CH_RET_IF_ERR(ch_sqlite_exec(ctx->db, ch_sqlite_schema));
+
+    if (sqlite3_prepare_v2(ctx->db,
+                           "INSERT INTO saves (name, n_state_files, n_errors) VALUES (?, ?, ?)",
+                           -1,
+                           &ctx->stmt_save,
+                           NULL) != SQLITE_OK)
+        return CH_ERR_SQLITE;
+    CH_RET_IF_ERR(ch_sqlite_batch_new(ctx->db, "state_files", 4, &ctx->batch_sfs));
+    CH_RET_IF_ERR(ch_sqlite_batch_new(ctx->db, "entities", 5, &ctx->batch_ents));
+    CH_RET_IF_ERR(ch_sqlite_batch_new(ctx->db, "fields", 6, &ctx->batch_fields));
+
+    CH_RET_IF_ERR(ch_sqlite_exec(ctx->db, "BEGIN"));
+    ch_err err = CH_ERR_NONE;
+    for (size_t i = 0; i < n_saves && !err; i++)
+        err = ch_sqlite_export_save(ctx, saves[i], save_names ? save_names[i] : NULL);
+    if (!err)
+        err = ch_sqlite_batch_flush(ctx->batch_sfs);
+    if (!err)
+        err = ch_sqlite_batch_flush(ctx->batch_ents);
+    if (!err)
+        err = ch_sqlite_batch_flush(ctx->batch_fields);
+    if (!err)
+        err = ch_sqlite_exec(ctx->db, "COMMIT");
+    if (err) {
+        ch_sqlite_exec(ctx->db, "ROLLBACK");
+        return err;
+    }
+    return ch_sqlite_exec(ctx->db, ch_sqlite_indices);
+}
+
+ch_err ch_export_sqlite(const char* db_path,
+                        const ch_parsed_save_data* const* saves,
+                        const char* const* save_names,
+                        size_t n_saves)
+{
+    ch_sqlite_export_ctx ctx = {0};
+    ch_err err = CH_ERR_NONE;
+
+    if (sqlite3_open_v2(db_path, &ctx.db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+        err = CH_ERR_SQLITE;
+    if (!err) {
+        ctx.arena = ch_arena_new(1024 * 64);
+        ctx.flat_dms = hashmap_new(sizeof(ch_sqlite_flat_dm),
+                                   256,
+                                   0,
+                                   0,
+                                   ch_sqlite_flat_dm_hash,
+                                   ch_sqlite_flat_dm_compare,
+                                   NULL,
+                                   NULL);
+        if (!ctx.arena || !ctx.flat_dms)
+            err = CH_ERR_OUT_OF_MEMORY;
+    }
+    if (!err)
+        err = ch_sqlite_export_all(&ctx, saves, save_names, n_saves);
+
+    sqlite3_finalize(ctx.stmt_save);
+    ch_sqlite_batch_free(ctx.batch_sfs);
+    ch_sqlite_batch_free(ctx.batch_ents);
+    ch_sqlite_batch_free(ctx.batch_fields);
+    if (ctx.flat_dms)
+        hashmap_free(ctx.flat_dms);
+    ch_arena_free(ctx.arena);
+    sqlite3_close(ctx.db);
+    return err;
+}
+
+#endif
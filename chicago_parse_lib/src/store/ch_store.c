@@ -0,0 +1,1024 @@
+#include "ch_store_internal.h"
+
+#define CH_STORE_MAGIC "chstore"
+#define CH_STORE_VERSION 1
+
+typedef struct ch_store_file_header {
+    char magic[8]; // CH_STORE_MAGIC, null terminated
+    uint32_t version;
+    uint32_t ptr_size;
+    uint32_t n_records;
+    uint32_t n_datamaps;
+    uint32_t n_saves;
+    uint32_t _pad;
+    uint64_t blob_size;
+    uint64_t n_record_refs;
+    uint64_t record_ref_bytes;
+} ch_store_file_header;
+
+// followed by the (not null terminated) name in the file
+typedef struct ch_store_file_dm {
+    uint32_t name_len;
+    uint32_t ch_size;
+    uint64_t layout_hash;
+} ch_store_file_dm;
+
+// a string or custom field in a restored class
+typedef struct ch_store_ptr_slot {
+    size_t offset;
+    const ch_type_description* td;
+} ch_store_ptr_slot;
+
+typedef struct ch_store_dm_layout {
+    const ch_datamap* dm;
+    uint32_t dm_id; // 0 if the datamap hasn't been added to the store yet
+    uint64_t layout_hash;
+    const ch_store_ptr_slot* slots; // sorted by offset
+    size_t n_slots;
+} ch_store_dm_layout;
+
+typedef struct ch_store_dm {
+    const char* name;
+    uint32_t ch_size;
+    uint64_t layout_hash;
+} ch_store_dm;
+
+typedef struct ch_store_dm_key {
+    const char* name;
+    uint64_t layout_hash;
+    uint32_t dm_id;
+} ch_store_dm_key;
+
+typedef struct ch_store_record_entry {
+    uint64_t hash;
+    uint32_t id; // 0 for the record currently being looked up
+} ch_store_record_entry;
+
+struct ch_save_store {
+    ch_arena* arena;
+
+    // records are back to back in the blob, record i (starting at 1) is blob[offsets[i - 1]:offsets[i]]
+    ch_store_buf blob;
+    ch_store_buf offsets; // uint64_t
+    uint32_t n_records;
+    struct hashmap* records; // ch_store_record_entry
+    const unsigned char* lookup_data;
+    size_t lookup_size;
+    size_t n_record_refs;
+    size_t record_ref_bytes;
+
+    ch_store_buf dms;           // ch_store_dm, datamap i (starting at 1) is at index i - 1
+    struct hashmap* dm_keys;    // ch_store_dm_key
+    struct hashmap* dm_layouts; // ch_store_dm_layout
+
+    // datamaps from the last collection used for rehydrating, by datamap ID
+    const ch_datamap_collection* resolved_collection;
+    ch_store_buf resolved_dms; // const ch_datamap*
+
+    ch_store_buf saves; // uint32_t manifest record IDs
+};
+
+/*
+* generic helpers
+*/
+
+static ch_err ch_store_buf_reserve(ch_store_buf* buf, size_t n)
+{
+    if (buf->size + n <= buf->cap)
+        return CH_ERR_NONE;
+    size_t new_cap = max(buf->cap * 2, 256);
+    while (new_cap < buf->size + n)
+        new_cap *= 2;
+    unsigned char* new_data = realloc(buf->data, new_cap);
+    if (!new_data)
+        return CH_ERR_OUT_OF_MEMORY;
+    buf->data = new_data;
+    buf->cap = new_cap;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_buf_append(ch_store_buf* buf, const void* data, size_t n)
+{
+    CH_RET_IF_ERR(ch_store_buf_reserve(buf, n));
+    if (n > 0)
+        memcpy(buf->data + buf->size, data, n);
+    buf->size += n;
+    return CH_ERR_NONE;
+}
+
+#define CH_STORE_BUF_ELEM(buf, type, i) (((type*)(buf).data)[i])
+#define CH_STORE_BUF_COUNT(buf, type) ((buf).size / sizeof(type))
+
+static void ch_store_buf_free(ch_store_buf* buf)
+{
+    free(buf->data);
+    *buf = (ch_store_buf){0};
+}
+
+/*
+* records
+*/
+
+static void ch_store_get_record_unchecked(const ch_save_store* store,
+                                          uint32_t id,
+                                          const unsigned char** data,
+                                          size_t* size)
+{
+    assert(id > 0 && id <= store->n_records);
+    uint64_t start = CH_STORE_BUF_ELEM(store->offsets, uint64_t, id - 1);
+    uint64_t end = CH_STORE_BUF_ELEM(store->offsets, uint64_t, id);
+    *data = store->blob.data + start;
+    *size = (size_t)(end - start);
+}
+
+static ch_err ch_store_get_record(const ch_save_store* store, uint32_t id, const unsigned char** data, size_t* size)
+{
+    if (id == 0 || id > store->n_records)
+        return CH_ERR_STORE_BAD_FILE;
+    ch_store_get_record_unchecked(store, id, data, size);
+    return CH_ERR_NONE;
+}
+
+static uint64_t ch_store_record_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    (void)seed0;
+    (void)seed1;
+    return ((const ch_store_record_entry*)item)->hash;
+}
+
+static int ch_store_record_compare(const void* a, const void* b, void* udata)
+{
+    const ch_save_store* store = udata;
+    const ch_store_record_entry* entries[] = {a, b};
+    const unsigned char* data[2];
+    size_t size[2];
+    for (int i = 0; i < 2; i++) {
+        if (entries[i]->id == 0) {
+            data[i] = store->lookup_data;
+            size[i] = store->lookup_size;
+        } else {
+            ch_store_get_record_unchecked(store, entries[i]->id, &data[i], &size[i]);
+        }
+    }
+    if (size[0] != size[1])
+        return size[0] < size[1] ? -1 : 1;
+    // empty records have no data pointer
+    return size[0] ? memcmp(data[0], data[1], size[0]) : 0;
+}
+
+static ch_err ch_store_insert_record(ch_save_store* store, uint64_t hash, const void* data, size_t size, uint32_t* id)
+{
+    if (store->n_records == UINT32_MAX)
+        return CH_ERR_OUT_OF_MEMORY;
+    CH_RET_IF_ERR(ch_store_buf_append(&store->blob, data, size));
+    uint64_t end = store->blob.size;
+    CH_RET_IF_ERR(ch_store_buf_append(&store->offsets, &end, sizeof end));
+    *id = ++store->n_records;
+    ch_store_record_entry entry = {.hash = hash, .id = *id};
+    if (!hashmap_set(store->records, &entry) && hashmap_oom(store->records))
+        return CH_ERR_OUT_OF_MEMORY;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_add_record(ch_save_store* store, const void* data, size_t size, uint32_t* id)
+{
+    store->n_record_refs++;
+    store->record_ref_bytes += size;
+    ch_store_record_entry lookup = {.hash = hashmap_xxhash3(data, size, 0, 0), .id = 0};
+    store->lookup_data = data;
+    store->lookup_size = size;
+    const ch_store_record_entry* existing = hashmap_get(store->records, &lookup);
+    store->lookup_data = NULL;
+    if (existing) {
+        *id = existing->id;
+        return CH_ERR_NONE;
+    }
+    return ch_store_insert_record(store, lookup.hash, data, size, id);
+}
+
+/*
+* datamaps
+*/
+
+static uint64_t ch_store_dm_layout_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_store_dm_layout* layout = item;
+    return hashmap_xxhash3(&layout->dm, sizeof layout->dm, seed0, seed1);
+}
+
+static int ch_store_dm_layout_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_store_dm_layout* la = a;
+    const ch_store_dm_layout* lb = b;
+    return la->dm < lb->dm ? -1 : la->dm > lb->dm;
+}
+
+static uint64_t ch_store_dm_key_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_store_dm_key* key = item;
+    return hashmap_xxhash3(key->name, strlen(key->name), seed0 ^ key->layout_hash, seed1);
+}
+
+static int ch_store_dm_key_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_store_dm_key* ka = a;
+    const ch_store_dm_key* kb = b;
+    if (ka->layout_hash != kb->layout_hash)
+        return ka->layout_hash < kb->layout_hash ? -1 : 1;
+    return strcmp(ka->name, kb->name);
+}
+
+typedef struct ch_store_layout_ctx {
+    ch_store_buf slots; // ch_store_ptr_slot
+    uint64_t hash;
+    size_t class_size;
+} ch_store_layout_ctx;
+
+static ch_err ch_store_add_slot(ch_store_layout_ctx* ctx, size_t offset, const ch_type_description* td)
+{
+    if (offset + sizeof(void*) > ctx->class_size)
+        return CH_ERR_NONE;
+    ch_store_ptr_slot slot = {.offset = offset, .td = td};
+    return ch_store_buf_append(&ctx->slots, &slot, sizeof slot);
+}
+
+// same iteration as ch_br_restore_fields so that all strings & custom fields in the restored class are found
+static ch_err ch_store_walk_layout(ch_store_layout_ctx* ctx, const ch_datamap* dm, size_t base_offset)
+{
+    if (dm->base_map)
+        CH_RET_IF_ERR(ch_store_walk_layout(ctx, dm->base_map, base_offset));
+    for (size_t i = 0; i < dm->n_fields; i++) {
+        const ch_type_description* td = &dm->fields[i];
+        if (td->type == FIELD_VOID || td->type == FIELD_INPUT)
+            continue;
+        size_t offset = base_offset + td->ch_offset;
+        struct {
+            uint32_t type, n_elems;
+            uint64_t offset, total_size_bytes;
+        } field_info = {td->type, td->n_elems, offset, td->total_size_bytes};
+        ctx->hash = hashmap_xxhash3(td->name, strlen(td->name), ctx->hash, 0);
+        ctx->hash = hashmap_xxhash3(&field_info, sizeof field_info, ctx->hash, 0);
+
+        if (td->type == FIELD_EMBEDDED) {
+            for (size_t j = 0; j < td->n_elems; j++) {
+                size_t elem_offset = offset + td->total_size_bytes * j;
+                if (elem_offset + td->embedded_map->ch_size > ctx->class_size)
+                    break;
+                CH_RET_IF_ERR(ch_store_walk_layout(ctx, td->embedded_map, elem_offset));
+            }
+        } else if (td->type == FIELD_CUSTOM) {
+            CH_RET_IF_ERR(ch_store_add_slot(ctx, offset, td));
+        } else if (ch_field_type_is_str(td->type)) {
+            for (size_t j = 0; j < td->n_elems; j++)
+                CH_RET_IF_ERR(ch_store_add_slot(ctx, offset + sizeof(char*) * j, td));
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+static int ch_store_slot_compare(const void* a, const void* b)
+{
+    const ch_store_ptr_slot* sa = a;
+    const ch_store_ptr_slot* sb = b;
+    return sa->offset < sb->offset ? -1 : sa->offset > sb->offset;
+}
+
+static ch_err ch_store_get_dm_layout(ch_save_store* store, const ch_datamap* dm, ch_store_dm_layout** layout_out)
+{
+    ch_store_dm_layout layout = {.dm = dm};
+    ch_store_dm_layout* existing = (ch_store_dm_layout*)hashmap_get(store->dm_layouts, &layout);
+    if (existing) {
+        *layout_out = existing;
+        return CH_ERR_NONE;
+    }
+
+    ch_store_layout_ctx ctx = {.class_size = dm->ch_size};
+    ch_err err = ch_store_walk_layout(&ctx, dm, 0);
+    size_t n_slots = CH_STORE_BUF_COUNT(ctx.slots, ch_store_ptr_slot);
+    ch_store_ptr_slot* slots = NULL;
+    if (!err)
+        slots = ch_arena_alloc(store->arena, sizeof(ch_store_ptr_slot) * n_slots);
+    if (!err && !slots)
+        err = CH_ERR_OUT_OF_MEMORY;
+    if (!err) {
+        // the game's datamaps sometimes have the same field twice
+        if (n_slots > 0)
+            qsort(ctx.slots.data, n_slots, sizeof(ch_store_ptr_slot), ch_store_slot_compare);
+        for (size_t i = 0; i < n_slots; i++) {
+            const ch_store_ptr_slot* slot = &CH_STORE_BUF_ELEM(ctx.slots, ch_store_ptr_slot, i);
+            if (layout.n_slots == 0 || slots[layout.n_slots - 1].offset + sizeof(void*) <= slot->offset)
+                slots[layout.n_slots++] = *slot;
+        }
+    }
+    ch_store_buf_free(&ctx.slots);
+    CH_RET_IF_ERR(err);
+
+    layout.slots = slots;
+    layout.layout_hash = hashmap_xxhash3(&dm->ch_size, sizeof dm->ch_size, ctx.hash, 0);
+    if (!hashmap_set(store->dm_layouts, &layout) && hashmap_oom(store->dm_layouts))
+        return CH_ERR_OUT_OF_MEMORY;
+    *layout_out = (ch_store_dm_layout*)hashmap_get(store->dm_layouts, &layout);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_add_dm(ch_save_store* store, const ch_store_dm* dm, uint32_t* dm_id)
+{
+    CH_RET_IF_ERR(ch_store_buf_append(&store->dms, dm, sizeof *dm));
+    *dm_id = (uint32_t)CH_STORE_BUF_COUNT(store->dms, ch_store_dm);
+    ch_store_dm_key key = {.name = dm->name, .layout_hash = dm->layout_hash, .dm_id = *dm_id};
+    if (!hashmap_set(store->dm_keys, &key) && hashmap_oom(store->dm_keys))
+        return CH_ERR_OUT_OF_MEMORY;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_get_dm_id(ch_save_store* store, const ch_datamap* dm, uint32_t* dm_id)
+{
+    ch_store_dm_layout* layout;
+    CH_RET_IF_ERR(ch_store_get_dm_layout(store, dm, &layout));
+    if (layout->dm_id == 0) {
+        ch_store_dm_key key = {.name = dm->class_name, .layout_hash = layout->layout_hash};
+        const ch_store_dm_key* existing = hashmap_get(store->dm_keys, &key);
+        if (existing) {
+            layout->dm_id = existing->dm_id;
+        } else {
+            size_t name_len = strlen(dm->class_name);
+            char* name;
+            CH_CHECKED_ALLOC(name, ch_arena_alloc(store->arena, name_len + 1));
+            memcpy(name, dm->class_name, name_len + 1);
+            ch_store_dm new_dm = {.name = name, .ch_size = (uint32_t)dm->ch_size, .layout_hash = layout->layout_hash};
+            CH_RET_IF_ERR(ch_store_add_dm(store, &new_dm, &layout->dm_id));
+        }
+    }
+    *dm_id = layout->dm_id;
+    return CH_ERR_NONE;
+}
+
+/*
+* writer
+*/
+
+ch_err ch_store_write_bytes(ch_store_writer* w, const void* data, size_t n)
+{
+    return ch_store_buf_append(&w->buf, data, n);
+}
+
+ch_err ch_store_write_u32(ch_store_writer* w, uint32_t val)
+{
+    return ch_store_write_bytes(w, &val, sizeof val);
+}
+
+static ch_err ch_store_add_str(ch_save_store* store, const char* str, uint32_t* id)
+{
+    if (!str) {
+        *id = 0;
+        return CH_ERR_NONE;
+    }
+    return ch_store_add_record(store, str, strlen(str), id);
+}
+
+ch_err ch_store_write_str(ch_store_writer* w, const char* str)
+{
+    uint32_t id;
+    CH_RET_IF_ERR(ch_store_add_str(w->store, str, &id));
+    return ch_store_write_u32(w, id);
+}
+
+ch_err ch_store_write_dm(ch_store_writer* w, const ch_datamap* dm)
+{
+    uint32_t dm_id = 0;
+    if (dm)
+        CH_RET_IF_ERR(ch_store_get_dm_id(w->store, dm, &dm_id));
+    return ch_store_write_u32(w, dm_id);
+}
+
+ch_err ch_store_write_class(ch_store_writer* w, const ch_datamap* dm, const unsigned char* data)
+{
+    ch_store_dm_layout* layout;
+    CH_RET_IF_ERR(ch_store_get_dm_layout(w->store, dm, &layout));
+
+    size_t size_pos = w->buf.size;
+    CH_RET_IF_ERR(ch_store_write_u32(w, 0));
+    size_t class_pos = w->buf.size;
+    CH_RET_IF_ERR(ch_store_write_bytes(w, data, dm->ch_size));
+
+    for (size_t i = 0; i < layout->n_slots; i++) {
+        const ch_store_ptr_slot* slot = &layout->slots[i];
+        const void* ptr = *(const void* const*)(data + slot->offset);
+        uint32_t val = 0;
+        if (slot->td->type == FIELD_CUSTOM) {
+            const ch_custom_ops* ops = slot->td->save_restore_ops;
+            if (ptr && ops && ops->store_fns) {
+                val = (uint32_t)(w->buf.size - class_pos);
+                CH_RET_IF_ERR(ops->store_fns->write(w, slot->td, ptr));
+            }
+        } else {
+            CH_RET_IF_ERR(ch_store_add_str(w->store, ptr, &val));
+        }
+        unsigned char* slot_ptr = w->buf.data + class_pos + slot->offset;
+        memset(slot_ptr, 0, sizeof(void*));
+        memcpy(slot_ptr, &val, sizeof val);
+    }
+
+    uint32_t size = (uint32_t)(w->buf.size - class_pos);
+    memcpy(w->buf.data + size_pos, &size, sizeof size);
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_writer_finish(ch_store_writer* w, uint32_t* id)
+{
+    ch_err err = ch_store_add_record(w->store, w->buf.data, w->buf.size, id);
+    w->buf.size = 0;
+    return err;
+}
+
+/*
+* reader
+*/
+
+ch_err ch_store_read_bytes(ch_store_reader* r, void* data, size_t n)
+{
+    if (n > r->size - r->pos)
+        return CH_ERR_READER_OVERFLOWED;
+    memcpy(data, r->data + r->pos, n);
+    r->pos += n;
+    return CH_ERR_NONE;
+}
+
+ch_err ch_store_read_u32(ch_store_reader* r, uint32_t* val)
+{
+    return ch_store_read_bytes(r, val, sizeof *val);
+}
+
+static ch_err ch_store_get_str(ch_store_reader* r, uint32_t id, char** str)
+{
+    *str = NULL;
+    if (id == 0)
+        return CH_ERR_NONE;
+    const unsigned char* data;
+    size_t size;
+    CH_RET_IF_ERR(ch_store_get_record(r->store, id, &data, &size));
+    CH_CHECKED_ALLOC(*str, ch_arena_alloc(r->arena, size + 1));
+    memcpy(*str, data, size);
+    (*str)[size] = '\0';
+    return CH_ERR_NONE;
+}
+
+ch_err ch_store_read_str(ch_store_reader* r, char** str)
+{
+    uint32_t id;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &id));
+    return ch_store_get_str(r, id, str);
+}
+
+static ch_err ch_store_resolve_dm(ch_store_reader* r, uint32_t dm_id, const ch_datamap** dm)
+{
+    ch_save_store* store = r->store;
+    size_t n_dms = CH_STORE_BUF_COUNT(store->dms, ch_store_dm);
+    if (dm_id == 0 || dm_id > n_dms)
+        return CH_ERR_STORE_BAD_FILE;
+
+    if (store->resolved_collection != r->collection || store->resolved_dms.size != n_dms * sizeof(ch_datamap*)) {
+        store->resolved_dms.size = 0;
+        CH_RET_IF_ERR(ch_store_buf_reserve(&store->resolved_dms, n_dms * sizeof(ch_datamap*)));
+        memset(store->resolved_dms.data, 0, n_dms * sizeof(ch_datamap*));
+        store->resolved_dms.size = n_dms * sizeof(ch_datamap*);
+        store->resolved_collection = r->collection;
+    }
+    const ch_datamap** resolved = &CH_STORE_BUF_ELEM(store->resolved_dms, const ch_datamap*, dm_id - 1);
+    if (!*resolved) {
+        const ch_store_dm* store_dm = &CH_STORE_BUF_ELEM(store->dms, ch_store_dm, dm_id - 1);
+        const ch_datamap* collection_dm;
+        CH_RET_IF_ERR(ch_collection_lookup(r->collection, store_dm->name, &collection_dm));
+        ch_store_dm_layout* layout;
+        CH_RET_IF_ERR(ch_store_get_dm_layout(store, collection_dm, &layout));
+        if (layout->layout_hash != store_dm->layout_hash)
+            return CH_ERR_STORE_DATAMAP_MISMATCH;
+        *resolved = collection_dm;
+    }
+    *dm = *resolved;
+    return CH_ERR_NONE;
+}
+
+ch_err ch_store_read_dm(ch_store_reader* r, const ch_datamap** dm)
+{
+    uint32_t dm_id;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &dm_id));
+    *dm = NULL;
+    return dm_id == 0 ? CH_ERR_NONE : ch_store_resolve_dm(r, dm_id, dm);
+}
+
+ch_err ch_store_read_class(ch_store_reader* r, const ch_datamap* dm, unsigned char** data)
+{
+    ch_store_dm_layout* layout;
+    CH_RET_IF_ERR(ch_store_get_dm_layout(r->store, dm, &layout));
+
+    uint32_t size;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &size));
+    if (size > r->size - r->pos || size < dm->ch_size)
+        return CH_ERR_READER_OVERFLOWED;
+    ch_store_reader class_reader = *r;
+    class_reader.data = r->data + r->pos;
+    class_reader.size = size;
+    class_reader.pos = 0;
+    r->pos += size;
+
+    CH_CHECKED_ALLOC(*data, ch_arena_alloc(r->arena, dm->ch_size));
+    memcpy(*data, class_reader.data, dm->ch_size);
+
+    for (size_t i = 0; i < layout->n_slots; i++) {
+        const ch_store_ptr_slot* slot = &layout->slots[i];
+        uint32_t val;
+        memcpy(&val, *data + slot->offset, sizeof val);
+        void** slot_ptr = (void**)(*data + slot->offset);
+        *slot_ptr = NULL;
+        if (slot->td->type != FIELD_CUSTOM) {
+            CH_RET_IF_ERR(ch_store_get_str(r, val, (char**)slot_ptr));
+            continue;
+        }
+        const ch_custom_ops* ops = slot->td->save_restore_ops;
+        if (val == 0 || !ops || !ops->store_fns)
+            continue;
+        if (val >= size)
+            return CH_ERR_READER_OVERFLOWED;
+        class_reader.pos = val;
+        CH_RET_IF_ERR(ops->store_fns->read(&class_reader, slot->td, slot_ptr));
+    }
+    return CH_ERR_NONE;
+}
+
+static void ch_store_reader_init_record(ch_store_reader* r, const unsigned char* data, size_t size)
+{
+    r->data = data;
+    r->size = size;
+    r->pos = 0;
+}
+
+/*
+* saves
+*/
+
+// a restored class in its own record: u32 datamap ID (0 if NULL), u32 record ID
+static ch_err ch_store_write_class_ref(ch_store_writer* w, const ch_restored_class* rc)
+{
+    if (!rc->dm || !rc->data)
+        return ch_store_write_u32(w, 0);
+    ch_store_writer class_w = {.store = w->store};
+    uint32_t id;
+    ch_err err = ch_store_write_class(&class_w, rc->dm, rc->data);
+    if (!err)
+        err = ch_store_writer_finish(&class_w, &id);
+    ch_store_buf_free(&class_w.buf);
+    CH_RET_IF_ERR(err);
+    CH_RET_IF_ERR(ch_store_write_dm(w, rc->dm));
+    return ch_store_write_u32(w, id);
+}
+
+static ch_err ch_store_read_class_ref(ch_store_reader* r, ch_restored_class* rc)
+{
+    *rc = (ch_restored_class){0};
+    CH_RET_IF_ERR(ch_store_read_dm(r, &rc->dm));
+    if (!rc->dm)
+        return CH_ERR_NONE;
+    uint32_t id;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &id));
+    ch_store_reader class_r = *r;
+    const unsigned char* data;
+    size_t size;
+    CH_RET_IF_ERR(ch_store_get_record(r->store, id, &data, &size));
+    ch_store_reader_init_record(&class_r, data, size);
+    return ch_store_read_class(&class_r, rc->dm, &rc->data);
+}
+
+// an array of restored classes in its own record: u32 datamap ID (0 if NULL), u32 n_elems, u32 record ID
+static ch_err ch_store_write_class_arr_ref(ch_store_writer* w, const ch_restored_class_arr* rca)
+{
+    if (!rca->dm)
+        return ch_store_write_u32(w, 0);
+    ch_store_writer arr_w = {.store = w->store};
+    uint32_t id;
+    ch_err err = CH_ERR_NONE;
+    for (size_t i = 0; i < rca->n_elems && !err; i++)
+        err = ch_store_write_class(&arr_w, rca->dm, CH_RCA_ELEM_DATA(*rca, i));
+    if (!err)
+        err = ch_store_writer_finish(&arr_w, &id);
+    ch_store_buf_free(&arr_w.buf);
+    CH_RET_IF_ERR(err);
+    CH_RET_IF_ERR(ch_store_write_dm(w, rca->dm));
+    CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)rca->n_elems));
+    return ch_store_write_u32(w, id);
+}
+
+static ch_err ch_store_read_class_arr_ref(ch_store_reader* r, ch_restored_class_arr* rca)
+{
+    *rca = (ch_restored_class_arr){0};
+    CH_RET_IF_ERR(ch_store_read_dm(r, &rca->dm));
+    if (!rca->dm)
+        return CH_ERR_NONE;
+    uint32_t n_elems, id;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &n_elems));
+    CH_RET_IF_ERR(ch_store_read_u32(r, &id));
+    ch_store_reader arr_r = *r;
+    const unsigned char* data;
+    size_t size;
+    CH_RET_IF_ERR(ch_store_get_record(r->store, id, &data, &size));
+    ch_store_reader_init_record(&arr_r, data, size);
+    // each class is prefixed with its size
+    if (n_elems > size / sizeof(uint32_t))
+        return CH_ERR_READER_OVERFLOWED;
+
+    rca->n_elems = n_elems;
+    CH_CHECKED_ALLOC(rca->data, ch_arena_alloc(r->arena, CH_RCA_DATA_SIZE(*rca)));
+    for (size_t i = 0; i < n_elems; i++) {
+        unsigned char* elem;
+        CH_RET_IF_ERR(ch_store_read_class(&arr_r, rca->dm, &elem));
+        memcpy(CH_RCA_ELEM_DATA(*rca, i), elem, rca->dm->ch_size);
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_write_hl1(ch_store_writer* w, const ch_sf_save_data* sf)
+{
+    CH_RET_IF_ERR(ch_store_write_bytes(w, &sf->tag, sizeof sf->tag));
+    CH_RET_IF_ERR(ch_store_write_class_ref(w, &sf->save_header));
+    CH_RET_IF_ERR(ch_store_write_class_arr_ref(w, &sf->adjacent_levels));
+    CH_RET_IF_ERR(ch_store_write_class_arr_ref(w, &sf->light_styles));
+    CH_RET_IF_ERR(ch_store_write_u32(w, sf->block_headers ? 1 : 0));
+    if (sf->block_headers)
+        CH_RET_IF_ERR(g_store_cr_utl_vec_fns.write(w, NULL, sf->block_headers));
+    for (size_t i = 0; i < CH_BLOCK_COUNT; i++)
+        CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)sf->blocks[i].vec_idx));
+
+    const ch_block* block = &sf->blocks[CH_BLOCK_ENTITIES];
+    const ch_block_entities* ents = block->header_parsed ? block->data : NULL;
+    if (!ents || !ents->entities)
+        return ch_store_write_u32(w, 0);
+    CH_RET_IF_ERR(ch_store_write_u32(w, 1));
+    CH_RET_IF_ERR(ch_store_write_class_arr_ref(w, &ents->entity_table));
+    for (size_t i = 0; i < ents->entity_table.n_elems; i++) {
+        const ch_restored_entity* ent = ents->entities[i];
+        CH_RET_IF_ERR(ch_store_write_u32(w, ent ? 1 : 0));
+        if (ent) {
+            CH_RET_IF_ERR(ch_store_write_str(w, ent->classname));
+            CH_RET_IF_ERR(ch_store_write_class_ref(w, &ent->class_info));
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_read_hl1(ch_store_reader* r, ch_sf_save_data** sf_out)
+{
+    ch_sf_save_data* sf;
+    CH_CHECKED_ALLOC(sf, ch_arena_calloc(r->arena, sizeof *sf));
+    *sf_out = sf;
+    CH_RET_IF_ERR(ch_store_read_bytes(r, &sf->tag, sizeof sf->tag));
+    CH_RET_IF_ERR(ch_store_read_class_ref(r, &sf->save_header));
+    CH_RET_IF_ERR(ch_store_read_class_arr_ref(r, &sf->adjacent_levels));
+    CH_RET_IF_ERR(ch_store_read_class_arr_ref(r, &sf->light_styles));
+    uint32_t has_block_headers;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &has_block_headers));
+    if (has_block_headers)
+        CH_RET_IF_ERR(g_store_cr_utl_vec_fns.read(r, NULL, (void**)&sf->block_headers));
+    for (size_t i = 0; i < CH_BLOCK_COUNT; i++) {
+        uint32_t vec_idx;
+        CH_RET_IF_ERR(ch_store_read_u32(r, &vec_idx));
+        sf->blocks[i].vec_idx = (int16_t)vec_idx;
+    }
+
+    uint32_t has_ents;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &has_ents));
+    if (!has_ents)
+        return CH_ERR_NONE;
+    ch_block_entities* ents;
+    CH_CHECKED_ALLOC(ents, ch_arena_calloc(r->arena, sizeof *ents));
+    CH_RET_IF_ERR(ch_store_read_class_arr_ref(r, &ents->entity_table));
+    CH_CHECKED_ALLOC(ents->entities,
+                     ch_arena_calloc(r->arena, sizeof(ch_restored_entity*) * ents->entity_table.n_elems));
+    for (size_t i = 0; i < ents->entity_table.n_elems; i++) {
+        uint32_t present;
+        CH_RET_IF_ERR(ch_store_read_u32(r, &present));
+        if (!present)
+            continue;
+        ch_restored_entity* ent;
+        CH_CHECKED_ALLOC(ent, ch_arena_calloc(r->arena, sizeof *ent));
+        CH_RET_IF_ERR(ch_store_read_str(r, (char**)&ent->classname));
+        CH_RET_IF_ERR(ch_store_read_class_ref(r, &ent->class_info));
+        ents->entities[i] = ent;
+    }
+    sf->blocks[CH_BLOCK_ENTITIES].header_parsed = true;
+    sf->blocks[CH_BLOCK_ENTITIES].body_parsed = true;
+    sf->blocks[CH_BLOCK_ENTITIES].data = ents;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_write_manifest(ch_store_writer* w, const ch_parsed_save_data* save_data)
+{
+    CH_RET_IF_ERR(ch_store_write_bytes(w, &save_data->tag, sizeof save_data->tag));
+    CH_RET_IF_ERR(ch_store_write_class_ref(w, &save_data->game_header));
+    CH_RET_IF_ERR(ch_store_write_class_ref(w, &save_data->global_state));
+
+    uint32_t n_errors = 0;
+    for (const ch_str_ll* ll = save_data->errors_ll; ll; ll = ll->next)
+        n_errors++;
+    CH_RET_IF_ERR(ch_store_write_u32(w, n_errors));
+    for (const ch_str_ll* ll = save_data->errors_ll; ll; ll = ll->next)
+        CH_RET_IF_ERR(ch_store_write_str(w, ll->str));
+
+    CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)save_data->n_state_files));
+    for (size_t i = 0; i < save_data->n_state_files; i++) {
+        const ch_state_file* sf = &save_data->state_files[i];
+        uint32_t name_id;
+        CH_RET_IF_ERR(ch_store_add_record(w->store, sf->name, strnlen(sf->name, sizeof sf->name), &name_id));
+        CH_RET_IF_ERR(ch_store_write_u32(w, name_id));
+        ch_state_file_type type = sf->data ? sf->type : CH_SF_INVALID;
+        CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)type));
+        switch (type) {
+            case CH_SF_SAVE_DATA:
+                CH_RET_IF_ERR(ch_store_write_hl1(w, sf->data));
+                break;
+            case CH_SF_ADJACENT_CLIENT_STATE: {
+                const ch_sf_adjacent_client_state* hl2 = sf->data;
+                CH_RET_IF_ERR(ch_store_write_bytes(w, &hl2->tag, sizeof hl2->tag));
+                break;
+            }
+            case CH_SF_ENTITY_PATCH: {
+                const ch_sf_entity_patch* hl3 = sf->data;
+                CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)hl3->n_patched_ents));
+                CH_RET_IF_ERR(ch_store_write_bytes(w, hl3->patched_ents, sizeof(int32_t) * hl3->n_patched_ents));
+                break;
+            }
+            case CH_SF_INVALID:
+            default:
+                break;
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_read_manifest(ch_store_reader* r, ch_parsed_save_data* save_data)
+{
+    CH_RET_IF_ERR(ch_store_read_bytes(r, &save_data->tag, sizeof save_data->tag));
+    CH_RET_IF_ERR(ch_store_read_class_ref(r, &save_data->game_header));
+    CH_RET_IF_ERR(ch_store_read_class_ref(r, &save_data->global_state));
+
+    uint32_t n_errors;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &n_errors));
+    ch_str_ll* last_error = NULL;
+    for (uint32_t i = 0; i < n_errors; i++) {
+        ch_str_ll* ll;
+        CH_CHECKED_ALLOC(ll, ch_arena_calloc(r->arena, sizeof *ll));
+        CH_RET_IF_ERR(ch_store_read_str(r, &ll->str));
+        if (last_error)
+            last_error->next = ll;
+        else
+            save_data->errors_ll = ll;
+        last_error = ll;
+    }
+
+    uint32_t n_state_files;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &n_state_files));
+    if (n_state_files > r->size - r->pos)
+        return CH_ERR_READER_OVERFLOWED;
+    CH_CHECKED_ALLOC(save_data->state_files, ch_arena_calloc(r->arena, sizeof(ch_state_file) * n_state_files));
+    save_data->n_state_files = n_state_files;
+    for (size_t i = 0; i < n_state_files; i++) {
+        ch_state_file* sf = &save_data->state_files[i];
+        uint32_t name_id, type;
+        CH_RET_IF_ERR(ch_store_read_u32(r, &name_id));
+        CH_RET_IF_ERR(ch_store_read_u32(r, &type));
+        const unsigned char* name;
+        size_t name_len;
+        CH_RET_IF_ERR(ch_store_get_record(r->store, name_id, &name, &name_len));
+        memcpy(sf->name, name, min(name_len, sizeof(sf->name) - 1));
+        sf->type = (ch_state_file_type)type;
+        switch (sf->type) {
+            case CH_SF_SAVE_DATA:
+                CH_RET_IF_ERR(ch_store_read_hl1(r, (ch_sf_save_data**)&sf->data));
+                break;
+            case CH_SF_ADJACENT_CLIENT_STATE: {
+                ch_sf_adjacent_client_state* hl2;
+                CH_CHECKED_ALLOC(hl2, ch_arena_calloc(r->arena, sizeof *hl2));
+                CH_RET_IF_ERR(ch_store_read_bytes(r, &hl2->tag, sizeof hl2->tag));
+                sf->data = hl2;
+                break;
+            }
+            case CH_SF_ENTITY_PATCH: {
+                ch_sf_entity_patch* hl3;
+                CH_CHECKED_ALLOC(hl3, ch_arena_calloc(r->arena, sizeof *hl3));
+                uint32_t n_patched_ents;
+                CH_RET_IF_ERR(ch_store_read_u32(r, &n_patched_ents));
+                if (n_patched_ents > (r->size - r->pos) / sizeof(int32_t))
+                    return CH_ERR_READER_OVERFLOWED;
+                hl3->n_patched_ents = (int32_t)n_patched_ents;
+                CH_CHECKED_ALLOC(hl3->patched_ents, ch_arena_alloc(r->arena, sizeof(int32_t) * n_patched_ents));
+                CH_RET_IF_ERR(ch_store_read_bytes(r, hl3->patched_ents, sizeof(int32_t) * n_patched_ents));
+                sf->data = hl3;
+                break;
+            }
+            case CH_SF_INVALID:
+                break;
+            default:
+                return CH_ERR_STORE_BAD_FILE;
+        }
+    }
+    return CH_ERR_NONE;
+}
+
+/*
+* public API
+*/
+
+ch_save_store* ch_save_store_new(void)
+{
+    ch_arena* arena = ch_arena_new(1024 * 16);
+    if (!arena)
+        return NULL;
+    ch_save_store* store = ch_arena_calloc(arena, sizeof *store);
+    if (!store) {
+        ch_arena_free(arena);
+        return NULL;
+    }
+    store->arena = arena;
+    uint64_t zero = 0;
+    store->records = hashmap_new(sizeof(ch_store_record_entry),
+                                 1024,
+                                 0,
+                                 0,
+                                 ch_store_record_hash,
+                                 ch_store_record_compare,
+                                 NULL,
+                                 store);
+    store->dm_keys =
+        hashmap_new(sizeof(ch_store_dm_key), 256, 0, 0, ch_store_dm_key_hash, ch_store_dm_key_compare, NULL, NULL);
+    store->dm_layouts = hashmap_new(sizeof(ch_store_dm_layout),
+                                    256,
+                                    0,
+                                    0,
+                                    ch_store_dm_layout_hash,
+                                    ch_store_dm_layout_compare,
+                                    NULL,
+                                    NULL);
+    if (!store->records || !store->dm_keys || !store->dm_layouts ||
+        ch_store_buf_append(&store->offsets, &zero, sizeof zero)) {
+        ch_save_store_free(store);
+        return NULL;
+    }
+    return store;
+}
+
+void ch_save_store_free(ch_save_store* store)
+{
+    if (!store)
+        return;
+    hashmap_free(store->records);
+    hashmap_free(store->dm_keys);
+    hashmap_free(store->dm_layouts);
+    ch_store_buf_free(&store->blob);
+    ch_store_buf_free(&store->offsets);
+    ch_store_buf_free(&store->dms);
+    ch_store_buf_free(&store->resolved_dms);
+    ch_store_buf_free(&store->saves);
+    ch_arena_free(store->arena);
+}
+
+ch_err ch_save_store_add(ch_save_store* store, const ch_parsed_save_data* save_data, uint32_t* save_id)
+{
+    ch_store_writer w = {.store = store};
+    uint32_t manifest_id;
+    ch_err err = ch_store_write_manifest(&w, save_data);
+    if (!err)
+        err = ch_store_writer_finish(&w, &manifest_id);
+    ch_store_buf_free(&w.buf);
+    CH_RET_IF_ERR(err);
+    if (save_id)
+        *save_id = (uint32_t)CH_STORE_BUF_COUNT(store->saves, uint32_t);
+    return ch_store_buf_append(&store->saves, &manifest_id, sizeof manifest_id);
+}
+
+ch_err ch_save_store_rehydrate(ch_save_store* store,
+                               uint32_t save_id,
+                               const ch_datamap_collection* collection,
+                               ch_parsed_save_data* save_data)
+{
+    assert(store && collection && save_data);
+    if (save_id >= CH_STORE_BUF_COUNT(store->saves, uint32_t))
+        return CH_ERR_STORE_BAD_FILE;
+    const unsigned char* data;
+    size_t size;
+    CH_RET_IF_ERR(ch_store_get_record(store, CH_STORE_BUF_ELEM(store->saves, uint32_t, save_id), &data, &size));
+    ch_store_reader r = {
+        .store = store,
+        .arena = save_data->_arena,
+        .collection = collection,
+    };
+    ch_store_reader_init_record(&r, data, size);
+    return ch_store_read_manifest(&r, save_data);
+}
+
+void ch_save_store_get_stats(const ch_save_store* store, ch_save_store_stats* stats)
+{
+    *stats = (ch_save_store_stats){
+        .n_saves = CH_STORE_BUF_COUNT(store->saves, uint32_t),
+        .n_records = store->n_records,
+        .n_datamaps = CH_STORE_BUF_COUNT(store->dms, ch_store_dm),
+        .n_record_refs = store->n_record_refs,
+        .record_bytes = store->blob.size,
+        .record_ref_bytes = store->record_ref_bytes,
+    };
+}
+
+ch_err ch_save_store_write(const ch_save_store* store, FILE* f)
+{
+    ch_store_file_header header = {
+        .magic = CH_STORE_MAGIC,
+        .version = CH_STORE_VERSION,
+        .ptr_size = sizeof(void*),
+        .n_records = store->n_records,
+        .n_datamaps = (uint32_t)CH_STORE_BUF_COUNT(store->dms, ch_store_dm),
+        .n_saves = (uint32_t)CH_STORE_BUF_COUNT(store->saves, uint32_t),
+        .blob_size = store->blob.size,
+        .n_record_refs = store->n_record_refs,
+        .record_ref_bytes = store->record_ref_bytes,
+    };
+    if (fwrite(&header, sizeof header, 1, f) != 1)
+        return CH_ERR_FILE_IO;
+    for (uint32_t i = 0; i < header.n_datamaps; i++) {
+        const ch_store_dm* dm = &CH_STORE_BUF_ELEM(store->dms, ch_store_dm, i);
+        ch_store_file_dm file_dm = {
+            .name_len = (uint32_t)strlen(dm->name),
+            .ch_size = dm->ch_size,
+            .layout_hash = dm->layout_hash,
+        };
+        if (fwrite(&file_dm, sizeof file_dm, 1, f) != 1 || fwrite(dm->name, 1, file_dm.name_len, f) != file_dm.name_len)
+            return CH_ERR_FILE_IO;
+    }
+    if (fwrite(store->offsets.data, 1, store->offsets.size, f) != store->offsets.size ||
+        fwrite(store->blob.data, 1, store->blob.size, f) != store->blob.size ||
+        fwrite(store->saves.data, 1, store->saves.size, f) != store->saves.size)
+        return CH_ERR_FILE_IO;
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_fread(FILE* f, ch_store_buf* buf, size_t n)
+{
+    CH_RET_IF_ERR(ch_store_buf_reserve(buf, n));
+    if (n > 0 && fread(buf->data + buf->size, 1, n, f) != n)
+        return ferror(f) ? CH_ERR_FILE_IO : CH_ERR_STORE_BAD_FILE;
+    buf->size += n;
+    return CH_ERR_NONE;
+}
+
+ch_err ch_save_store_read(ch_save_store* store, FILE* f)
+{
+    assert(store->n_records == 0 && store->dms.size == 0 && store->saves.size == 0);
+    ch_store_file_header header;
+    if (fread(&header, sizeof header, 1, f) != 1)
+        return ferror(f) ? CH_ERR_FILE_IO : CH_ERR_STORE_BAD_FILE;
+    if (memcmp(header.magic, CH_STORE_MAGIC, sizeof header.magic) || header.version != CH_STORE_VERSION ||
+        header.ptr_size != sizeof(void*))
+        return CH_ERR_STORE_BAD_FILE;
+
+    for (uint32_t i = 0; i < header.n_datamaps; i++) {
+        ch_store_file_dm file_dm;
+        if (fread(&file_dm, sizeof file_dm, 1, f) != 1)
+            return ferror(f) ? CH_ERR_FILE_IO : CH_ERR_STORE_BAD_FILE;
+        char* name;
+        CH_CHECKED_ALLOC(name, ch_arena_alloc(store->arena, (size_t)file_dm.name_len + 1));
+        if (fread(name, 1, file_dm.name_len, f) != file_dm.name_len)
+            return ferror(f) ? CH_ERR_FILE_IO : CH_ERR_STORE_BAD_FILE;
+        name[file_dm.name_len] = '\0';
+        ch_store_dm dm = {.name = name, .ch_size = file_dm.ch_size, .layout_hash = file_dm.layout_hash};
+        uint32_t dm_id;
+        CH_RET_IF_ERR(ch_store_add_dm(store, &dm, &dm_id));
+    }
+
+    // the first offset (0) is already in the store
+    store->offsets.size = 0;
+    CH_RET_IF_ERR(ch_store_fread(f, &store->offsets, sizeof(uint64_t) * ((size_t)header.n_records + 1)));
+    CH_RET_IF_ERR(ch_store_fread(f, &store->blob, header.blob_size));
+    CH_RET_IF_ERR(ch_store_fread(f, &store->saves, sizeof(uint32_t) * header.n_saves));
+
+    for (uint32_t i = 0; i < header.n_records; i++) {
+        uint64_t start = CH_STORE_BUF_ELEM(store->offsets, uint64_t, i);
+        uint64_t end = CH_STORE_BUF_ELEM(store->offsets, uint64_t, i + 1);
+        if (start > end || end > header.blob_size)
+            return CH_ERR_STORE_BAD_FILE;
+    }
+    if (CH_STORE_BUF_ELEM(store->offsets, uint64_t, 0) != 0 ||
+        CH_STORE_BUF_ELEM(store->offsets, uint64_t, header.n_records) != header.blob_size)
+        return CH_ERR_STORE_BAD_FILE;
+
+    store->n_records = header.n_records;
+    for (uint32_t id = 1; id <= header.n_records; id++) {
+        const unsigned char* data;
+        size_t size;
+        ch_store_get_record_unchecked(store, id, &data, &size);
+        ch_store_record_entry entry = {.hash = hashmap_xxhash3(data, size, 0, 0), .id = id};
+        if (!hashmap_set(store->records, &entry) && hashmap_oom(store->records))
+            return CH_ERR_OUT_OF_MEMORY;
+    }
+    store->n_record_refs = (size_t)header.n_record_refs;
+    store->record_ref_bytes = (size_t)header.record_ref_bytes;
+    return CH_ERR_NONE;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ch_save.h"
+
+/*
+* A content-addressed store for lots of parsed saves. Saves are split up into records which are deduplicated by
+* their contents, so e.g. an entity that is byte-identical between two saves (after following its strings & custom
+* fields) is only stored once. There are a few kinds of records:
+* - strings (without the null terminator)
+* - restored classes: the raw class bytes where strings are replaced by string record IDs, and custom fields by an
+*   offset to their serialized value which follows the class in the same record (see ch_store_internal.h)
+* - arrays of restored classes (entity tables, adjacent levels, light styles)
+* - manifests: one per save, these reference all other records that make up the save
+*
+* Any save in the store can be rehydrated back into a ch_parsed_save_data. Only the following parts of a save are
+* kept, everything else is dropped when adding a save to the store:
+* - the save tag, game header, global state & parse errors
+* - the state file names & types
+* - for .hl1 files: the tag, save header, adjacent levels, light styles, block headers, and the entities block
+*   (entity table & entity classes, NPC & speaker info is not kept)
+* - for .hl2 files: the tag
+* - for .hl3 files: the patched entities
+* Custom fields which don't have store_fns in their ch_custom_ops are rehydrated as NULL.
+*
+* Restored classes depend on the layout of the datamaps in the collection that the save was parsed with. The
+* store keeps track of the name & a hash of the layout of each datamap, and the collection given when rehydrating
+* must have the same layout for all used datamaps, otherwise CH_ERR_STORE_DATAMAP_MISMATCH is returned. Store
+* files are not portable between 32 & 64 bit builds. Datamap layouts are cached by pointer, so the collections used
+* with a store must outlive it.
+*
+* The store is not thread safe.
+*/
+
+typedef struct ch_save_store ch_save_store;
+
+typedef struct ch_save_store_stats {
+    size_t n_saves;
+    size_t n_records;
+    size_t n_datamaps;
+    size_t n_record_refs;    // number of records that were added to the store (including duplicates)
+    size_t record_bytes;     // size of all unique records
+    size_t record_ref_bytes; // size of all records that were added to the store (including duplicates)
+} ch_save_store_stats;
+
+ch_save_store* ch_save_store_new(void);
+void ch_save_store_free(ch_save_store* store);
+
+// save_id is optional, IDs are given out sequentially starting at 0
+ch_err ch_save_store_add(ch_save_store* store, const ch_parsed_save_data* save_data, uint32_t* save_id);
+
+// save_data must be freshly made with ch_parsed_save_new()
+ch_err ch_save_store_rehydrate(ch_save_store* store,
+                               uint32_t save_id,
+                               const ch_datamap_collection* collection,
+                               ch_parsed_save_data* save_data);
+
+void ch_save_store_get_stats(const ch_save_store* store, ch_save_store_stats* stats);
+
+// the store must be empty when reading from a file, and should be freed if reading fails
+ch_err ch_save_store_write(const ch_save_store* store, FILE* f);
+ch_err ch_save_store_read(ch_save_store* store, FILE* f);
@@ -0,0 +1,168 @@
+#include "ch_store_internal.h"
+#include "custom_restore/ch_utl_vector.h"
+#include "custom_restore/ch_ent_output.h"
+#include "custom_restore/ch_variant.h"
+#include "custom_restore/ch_activity.h"
+
+// td may be NULL for utl vectors that aren't fields (e.g. block headers)
+static ch_err ch_store_utl_vec_write(ch_store_writer* w, const ch_type_description* td, const void* restored_field)
+{
+    (void)td;
+    const ch_cr_utl_vector* vec = restored_field;
+    CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)vec->field_type));
+    CH_RET_IF_ERR(ch_store_write_u32(w, vec->n_elems));
+    CH_RET_IF_ERR(ch_store_write_dm(w, vec->embedded_map));
+    if (vec->embedded_map) {
+        for (uint32_t i = 0; i < vec->n_elems; i++)
+            CH_RET_IF_ERR(ch_store_write_class(w, vec->embedded_map, CH_UTL_VEC_ELEM_PTR(*vec, i)));
+    } else if (ch_field_type_is_str(vec->field_type)) {
+        for (uint32_t i = 0; i < vec->n_elems; i++)
+            CH_RET_IF_ERR(ch_store_write_str(w, *(const char* const*)CH_UTL_VEC_ELEM_PTR(*vec, i)));
+    } else {
+        CH_RET_IF_ERR(ch_store_write_bytes(w, vec->elems, vec->elem_size * vec->n_elems));
+    }
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_utl_vec_read(ch_store_reader* r, const ch_type_description* td, void** restored_field)
+{
+    (void)td;
+    ch_cr_utl_vector* vec;
+    CH_CHECKED_ALLOC(vec, ch_arena_calloc(r->arena, sizeof *vec));
+    *restored_field = vec;
+    uint32_t field_type;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &field_type));
+    CH_RET_IF_ERR(ch_store_read_u32(r, &vec->n_elems));
+    CH_RET_IF_ERR(ch_store_read_dm(r, &vec->embedded_map));
+    if (field_type >= FIELD_TYPECOUNT)
+        return CH_ERR_STORE_BAD_FILE;
+    vec->field_type = (ch_field_type)field_type;
+    if (!vec->embedded_map &&
+        (vec->field_type == FIELD_VOID || vec->field_type == FIELD_EMBEDDED || vec->field_type == FIELD_CUSTOM))
+        return CH_ERR_STORE_BAD_FILE;
+    vec->elem_size = vec->embedded_map ? vec->embedded_map->ch_size : ch_field_type_byte_size(vec->field_type);
+    // classes are prefixed with their size & strings are written as IDs
+    size_t min_elem_size =
+        vec->embedded_map || ch_field_type_is_str(vec->field_type) ? sizeof(uint32_t) : vec->elem_size;
+    if (min_elem_size == 0 || vec->n_elems > (r->size - r->pos) / min_elem_size)
+        return CH_ERR_READER_OVERFLOWED;
+    CH_CHECKED_ALLOC(vec->elems, ch_arena_calloc(r->arena, vec->elem_size * vec->n_elems));
+
+    if (vec->embedded_map) {
+        for (uint32_t i = 0; i < vec->n_elems; i++) {
+            unsigned char* elem;
+            CH_RET_IF_ERR(ch_store_read_class(r, vec->embedded_map, &elem));
+            memcpy(CH_UTL_VEC_ELEM_PTR(*vec, i), elem, vec->elem_size);
+        }
+    } else if (ch_field_type_is_str(vec->field_type)) {
+        for (uint32_t i = 0; i < vec->n_elems; i++)
+            CH_RET_IF_ERR(ch_store_read_str(r, (char**)CH_UTL_VEC_ELEM_PTR(*vec, i)));
+    } else {
+        CH_RET_IF_ERR(ch_store_read_bytes(r, vec->elems, vec->elem_size * vec->n_elems));
+    }
+    return CH_ERR_NONE;
+}
+
+const ch_store_custom_fns g_store_cr_utl_vec_fns = {
+    .write = ch_store_utl_vec_write,
+    .read = ch_store_utl_vec_read,
+};
+
+static ch_err ch_store_ent_output_write(ch_store_writer* w, const ch_type_description* td, const void* restored_field)
+{
+    (void)td;
+    const ch_cr_ent_output* eo = restored_field;
+    CH_RET_IF_ERR(ch_store_write_dm(w, eo->ent_output_val.dm));
+    if (eo->ent_output_val.dm)
+        CH_RET_IF_ERR(ch_store_write_class(w, eo->ent_output_val.dm, eo->ent_output_val.data));
+    CH_RET_IF_ERR(ch_store_write_dm(w, eo->actions.dm));
+    if (!eo->actions.dm)
+        return CH_ERR_NONE;
+    CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)eo->actions.n_elems));
+    for (size_t i = 0; i < eo->actions.n_elems; i++)
+        CH_RET_IF_ERR(ch_store_write_class(w, eo->actions.dm, CH_RCA_ELEM_DATA(eo->actions, i)));
+    return CH_ERR_NONE;
+}
+
+static ch_err ch_store_ent_output_read(ch_store_reader* r, const ch_type_description* td, void** restored_field)
+{
+    (void)td;
+    ch_cr_ent_output* eo;
+    CH_CHECKED_ALLOC(eo, ch_arena_calloc(r->arena, sizeof *eo));
+    *restored_field = eo;
+    CH_RET_IF_ERR(ch_store_read_dm(r, &eo->ent_output_val.dm));
+    if (eo->ent_output_val.dm)
+        CH_RET_IF_ERR(ch_store_read_class(r, eo->ent_output_val.dm, &eo->ent_output_val.data));
+    CH_RET_IF_ERR(ch_store_read_dm(r, &eo->actions.dm));
+    if (!eo->actions.dm)
+        return CH_ERR_NONE;
+    uint32_t n_actions;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &n_actions));
+    if (n_actions > (r->size - r->pos) / sizeof(uint32_t))
+        return CH_ERR_READER_OVERFLOWED;
+    eo->actions.n_elems = n_actions;
+    CH_CHECKED_ALLOC(eo->actions.data, ch_arena_calloc(r->arena, CH_RCA_DATA_SIZE(eo->actions)));
+    for (size_t i = 0; i < n_actions; i++) {
+        unsigned char* action;
+        CH_RET_IF_ERR(ch_store_read_class(r, eo->actions.dm, &action));
+        memcpy(CH_RCA_ELEM_DATA(eo->actions, i), action, eo->actions.dm->ch_size);
+    }
+    return CH_ERR_NONE;
+}
+
+const ch_store_custom_fns g_store_cr_ent_output_fns = {
+    .write = ch_store_ent_output_write,
+    .read = ch_store_ent_output_read,
+};
+
+static ch_err ch_store_variant_write(ch_store_writer* w, const ch_type_description* td, const void* restored_field)
+{
+    (void)td;
+    const ch_cr_variant* var = restored_field;
+    CH_RET_IF_ERR(ch_store_write_u32(w, (uint32_t)var->ft));
+    if (var->ft == FIELD_STRING)
+        return ch_store_write_str(w, var->val_str);
+    return ch_store_write_bytes(w, &var->val_bool, ch_cr_variant_val_size(var->ft));
+}
+
+static ch_err ch_store_variant_read(ch_store_reader* r, const ch_type_description* td, void** restored_field)
+{
+    (void)td;
+    ch_cr_variant* var;
+    CH_CHECKED_ALLOC(var, ch_arena_calloc(r->arena, sizeof *var));
+    *restored_field = var;
+    uint32_t ft;
+    CH_RET_IF_ERR(ch_store_read_u32(r, &ft));
+    var->ft = (ch_field_type)ft;
+    if (var->ft == FIELD_STRING)
+        return ch_store_read_str(r, &var->val_str);
+    return ch_store_read_bytes(r, &var->val_bool, ch_cr_variant_val_size(var->ft));
+}
+
+const ch_store_custom_fns g_store_cr_variant_fns = {
+    .write = ch_store_variant_write,
+    .read = ch_store_variant_read,
+};
+
+static ch_err ch_store_activity_write(ch_store_writer* w, const ch_type_description* td, const void* restored_field)
+{
+    (void)td;
+    const ch_cr_activity* act = restored_field;
+    CH_RET_IF_ERR(ch_store_write_bytes(w, &act->index, sizeof act->index));
+    return ch_store_write_str(w, act->name);
+}
+
+static ch_err ch_store_activity_read(ch_store_reader* r, const ch_type_description* td, void** restored_field)
+{
+    (void)td;
+    ch_cr_activity* act;
+    CH_CHECKED_ALLOC(act, ch_arena_calloc(r->arena, sizeof *act));
+    *restored_field = act;
+    CH_RET_IF_ERR(ch_store_read_bytes(r, &act->index, sizeof act->index));
+    return ch_store_read_str(r, &act->name);
+}
+
+const ch_store_custom_fns g_store_cr_activity_fns = {
+    .write = ch_store_activity_write,
+    .read = ch_store_activity_read,
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ch_store.h"
+#include "ch_save_internal.h"
+
+/*
+* Records are written with a ch_store_writer and read back with a ch_store_reader. All values are written in native
+* byte order, and references to other records/datamaps are u32 IDs where 0 means NULL.
+*
+* An inline restored class is written as:
+* uint32_t size                - size of everything below
+* unsigned char class[ch_size] - the restored class bytes, string & custom fields are replaced with a u32 (the rest
+*                                of the pointer is zeroed): a string record ID, or the offset of the serialized
+*                                custom field from the start of the class
+* serialized custom fields     - written with the store_fns of the custom field
+*/
+
+typedef struct ch_store_buf {
+    unsigned char* data;
+    size_t size;
+    size_t cap;
+} ch_store_buf;
+
+typedef struct ch_store_writer {
+    ch_save_store* store;
+    ch_store_buf buf;
+} ch_store_writer;
+
+typedef struct ch_store_reader {
+    ch_save_store* store;
+    ch_arena* arena; // of the save being rehydrated
+    const ch_datamap_collection* collection;
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+} ch_store_reader;
+
+ch_err ch_store_write_bytes(ch_store_writer* w, const void* data, size_t n);
+ch_err ch_store_write_u32(ch_store_writer* w, uint32_t val);
+ch_err ch_store_write_str(ch_store_writer* w, const char* str);
+ch_err ch_store_write_dm(ch_store_writer* w, const ch_datamap* dm);
+ch_err ch_store_write_class(ch_store_writer* w, const ch_datamap* dm, const unsigned char* data);
+
+ch_err ch_store_read_bytes(ch_store_reader* r, void* data, size_t n);
+ch_err ch_store_read_u32(ch_store_reader* r, uint32_t* val);
+ch_err ch_store_read_str(ch_store_reader* r, char** str);
+ch_err ch_store_read_dm(ch_store_reader* r, const ch_datamap** dm);
+// the class is allocated in the reader's arena
+ch_err ch_store_read_class(ch_store_reader* r, const ch_datamap* dm, unsigned char** data);
+
+typedef struct ch_store_custom_fns {
+    ch_err (*write)(ch_store_writer* w, const ch_type_description* td, const void* restored_field);
+    // allocate the restored field in the reader's arena
+    ch_err (*read)(ch_store_reader* r, const ch_type_description* td, void** restored_field);
+} ch_store_custom_fns;
+
+extern const ch_store_custom_fns g_store_cr_utl_vec_fns, g_store_cr_ent_output_fns, g_store_cr_variant_fns,
+    g_store_cr_activity_fns;
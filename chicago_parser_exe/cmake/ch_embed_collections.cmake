@@ -0,0 +1,25 @@
+# Generates a C file with the given collection files as arrays (see ch_embedded_collections.h).
+# Usage: cmake -DCH_COLLECTION_FILES="a.chic;b.chic" -DCH_OUTPUT_FILE=out.c -P ch_embed_collections.cmake
+#
+# MSVC doesn't support #embed yet, so the bytes are written out as an initializer list. Collection files don't
+# have any pointers in them and already have their lookup table, so nothing has to be done to them when loading.
+
+string(REPEAT "[0-9a-f]" 64 CH_LINE_REGEX)
+
+set(CH_OUT "// generated by ch_embed_collections.cmake, don't edit\n\n#include \"ch_embedded_collections.h\"\n\n")
+set(CH_ENTRIES "")
+set(CH_IDX 0)
+foreach(CH_FILE IN LISTS CH_COLLECTION_FILES)
+	get_filename_component(CH_NAME "${CH_FILE}" NAME_WE)
+	file(READ "${CH_FILE}" CH_HEX HEX)
+	string(REGEX REPLACE "(${CH_LINE_REGEX})" "\\1\n" CH_HEX "${CH_HEX}")
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," CH_HEX "${CH_HEX}")
+	string(APPEND CH_OUT "// ${CH_FILE}\n_Alignas(8) static const unsigned char ch_embedded_${CH_IDX}[] = {\n${CH_HEX}\n};\n\n")
+	string(APPEND CH_ENTRIES "    {\"${CH_NAME}\", ch_embedded_${CH_IDX}, sizeof ch_embedded_${CH_IDX}},\n")
+	math(EXPR CH_IDX "${CH_IDX} + 1")
+endforeach()
+
+string(APPEND CH_OUT "const ch_embedded_collection ch_embedded_collections[] = {\n${CH_ENTRIES}};\n\n")
+string(APPEND CH_OUT "const size_t ch_n_embedded_collections = ${CH_IDX};\n")
+
+file(WRITE "${CH_OUTPUT_FILE}" "${CH_OUT}")
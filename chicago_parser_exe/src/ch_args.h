@@ -5,8 +5,13 @@ typedef enum ch_log_level {
     CH_LL_ERROR,
 } ch_log_level;
 
+#ifdef _MSC_VER
 #define _CH_PRAGMA_PUSH(x) __pragma(warning(push)) __pragma(warning(disable : x))
 #define _CH_PRAGMA_POP __pragma(warning(pop))
+#else
+#define _CH_PRAGMA_PUSH(x)
+#define _CH_PRAGMA_POP
+#endif
 
 #define CH_LOG_INFO(ctx, ...)               \
     do {                                    \
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+* Collections that were compiled into the executable with -DCH_EMBED_COLLECTIONS="a.chic;b.chic" (the array is
+* generated by cmake/ch_embed_collections.cmake). The bytes can be given to ch_collection_open directly, the name is
+* the file name without the extension.
+*
+* Only declared when CH_HAVE_EMBEDDED_COLLECTIONS is defined.
+*/
+
+#ifdef CH_HAVE_EMBEDDED_COLLECTIONS
+
+typedef struct ch_embedded_collection {
+    const char* name;
+    const unsigned char* bytes;
+    size_t n_bytes;
+} ch_embedded_collection;
+
+extern const ch_embedded_collection ch_embedded_collections[];
+extern const size_t ch_n_embedded_collections;
+
+#endif
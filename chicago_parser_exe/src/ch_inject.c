@@ -1,3 +1,5 @@
+#ifdef _WIN32
+
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <PathCch.h>
@@ -10,6 +12,7 @@
 #include <stdlib.h>
 
 #include "ch_recv.h"
+#include "ch_transport.h"
 
 #pragma comment(lib, "Pathcch.lib")
 
@@ -22,6 +25,7 @@ typedef struct ch_recv_ctx {
     HANDLE wait_event;
     LPVOID remote_thread_alloc;
     const ch_datamap_collection_info* collection_save_info;
+    const char* record_path;
 } ch_recv_ctx;
 
 // print the fmt followed by the winapi_error
@@ -289,77 +293,53 @@ BOOL ch_await_connect(ch_recv_ctx* ctx)
     return TRUE;
 }
 
-// client has connected, process requests
-BOOL ch_recv_loop(ch_recv_ctx* ctx)
+typedef struct ch_pipe_transport {
+    ch_transport base;
+    ch_recv_ctx* ctx;
+    OVERLAPPED overlapped;
+} ch_pipe_transport;
+
+/*
+* This is a bit wacky and I'm honestly still lost in the sauce about what exactly GetOverlappedResult does. I *think*
+* it returns what ReadFile *would* return if it were synchronous, but only once the async ReadFile has completed. So
+* we try the read, and if it is pending then we wait for it to finish with WaitForSingleObject, then check
+* GetOverlappedResult.
+*
+* In case the buffer needs to be expanded, we will do multiple calls to read & each one will continue reading where
+* the previous one left off. I'm *pretty sure* that it's the overlapped structure that keeps track of where to read
+* next, but we don't need to reset the structure in order to start reading at the beginning of the next message (I
+* couldn't find any mention of this in the docs). Also, ReadFile and GetOverlappedResult functions will reset the
+* wait_event to non-signalled so we don't have to worry about that.
+*/
+static ch_transport_result ch_pipe_recv_msg(ch_transport* tp, struct ch_process_msg_ctx* process_ctx)
 {
-    BOOL have_read_result = FALSE;
-    BOOL read_success = FALSE;
-    DWORD read_n_bytes = 0;
-    DWORD n_loops_without_success = 0;
-    OVERLAPPED overlapped = {.hEvent = ctx->wait_event};
-
-    enum ch_recv_state {
-        CH_RS_RUNNING,
-        CH_RS_ERROR,
-        CH_RS_DONE,
-    } state = CH_RS_RUNNING;
-
-    struct ch_process_msg_ctx* process_ctx = ch_msg_ctx_alloc(ctx->log_level, CH_PIPE_INIT_BUF_SIZE, ctx->collection_save_info);
-
-    if (!process_ctx) {
-        CH_LOG_ERROR(ctx, "Out of memory (ch_recv_loop malloc).");
-        state = CH_RS_ERROR;
-    }
-
-    /*
-    * This loop is a bit wacky and I'm honestly still lost in the sauce about what exactly
-    * GetOverlappedResult does. I *think* it returns what ReadFile *would* return if it were
-    * synchronous, but only once the async ReadFile has completed. So we try the read, and
-    * if it is pending then we wait for it to finish with WaitForSingleObject, then check
-    * GetOverlappedResult.
-    * 
-    * In case the buffer needs to be expanded, we will do multiple calls to read & each one
-    * will continue reading where the previous one left off. I'm *pretty sure* that it's the
-    * overlapped structure that keeps track of where to read next, but we don't need to reset
-    * the structure in order to start reading at the beginning of the next message (I couldn't
-    * find any mention of this in the docs). Also, ReadFile and GetOverlappedResult functions
-    * will reset the wait_event to non-signalled so we don't have to worry about that.
-    */
-    while (state == CH_RS_RUNNING) {
-
-        if (!have_read_result)
-            read_success = ReadFile(ctx->pipe,
-                                    ch_msg_ctx_buf(process_ctx),
-                                    ch_msg_ctx_buf_capacity(process_ctx),
-                                    &read_n_bytes,
-                                    &overlapped);
-        have_read_result = FALSE;
+    ch_pipe_transport* pt = (ch_pipe_transport*)tp;
+    ch_recv_ctx* ctx = pt->ctx;
+
+    for (int n_loops_without_success = 0; n_loops_without_success <= 10; n_loops_without_success++) {
+        DWORD read_n_bytes = 0;
+        BOOL read_success = ReadFile(ctx->pipe,
+                                     ch_msg_ctx_buf(process_ctx),
+                                     ch_msg_ctx_buf_capacity(process_ctx),
+                                     &read_n_bytes,
+                                     &pt->overlapped);
+
+        if (!read_success && GetLastError() == ERROR_IO_PENDING) {
+            // not an error - wait for async read to complete, no timeout necessary
+            if (WaitForSingleObject(ctx->wait_event, INFINITE) != WAIT_OBJECT_0) {
+                ch_log_sys_err(ctx, GetLastError(), "WaitForSingleObject failed:");
+                return CH_TRANSPORT_ERROR;
+            }
+            read_success = GetOverlappedResult(ctx->pipe, &pt->overlapped, &read_n_bytes, FALSE);
+        }
 
         if (read_success) {
-            n_loops_without_success = 0;
             ch_msg_ctx_buf_consumed(process_ctx, read_n_bytes);
-            if (!ch_msg_ctx_process(process_ctx))
-                state = CH_RS_DONE;
-            continue;
-        } else if (n_loops_without_success++ > 10) {
-            CH_LOG_ERROR(ctx, "recv loop has failed too many times, something fishy is going on");
-            state = CH_RS_ERROR;
-            break;
+            return CH_TRANSPORT_OK;
         }
 
         DWORD err = GetLastError();
         switch (err) {
-            case ERROR_IO_PENDING:
-                // not an error - wait for async read to complete, no timeout necessary
-                DWORD wait_result = WaitForSingleObject(ctx->wait_event, INFINITE);
-                if (wait_result == WAIT_OBJECT_0) {
-                    read_success = GetOverlappedResult(ctx->pipe, &overlapped, &read_n_bytes, FALSE);
-                    have_read_result = TRUE;
-                } else {
-                    ch_log_sys_err(ctx, GetLastError(), "WaitForSingleObject failed:");
-                    state = CH_RS_ERROR;
-                }
-                break;
             case ERROR_MORE_DATA:
                 /*
                 * Not an error - the message is just bigger than our buffer. Note that
@@ -368,23 +348,34 @@ BOOL ch_recv_loop(ch_recv_ctx* ctx)
                 */
                 ch_msg_ctx_buf_consumed(process_ctx, ch_msg_ctx_buf_capacity(process_ctx));
                 if (!ch_msg_ctx_buf_expand(process_ctx)) {
-                    CH_LOG_ERROR(ctx, "Out of memory (ch_recv_loop realloc).");
-                    state = CH_RS_ERROR;
+                    CH_LOG_ERROR(ctx, "Out of memory (ch_pipe_recv_msg realloc).");
+                    return CH_TRANSPORT_ERROR;
                 }
                 break;
             case ERROR_BROKEN_PIPE:
-                CH_LOG_ERROR(ctx, "Payload disconnected before sending goodbye message.");
-                state = CH_RS_ERROR;
-                break;
+                return CH_TRANSPORT_CLOSED;
             default:
-                ch_log_sys_err(ctx, GetLastError(), "ReadFile (or GetOverlappedResult) failed:");
-                state = CH_RS_ERROR;
-                break;
+                ch_log_sys_err(ctx, err, "ReadFile (or GetOverlappedResult) failed:");
+                return CH_TRANSPORT_ERROR;
         }
     }
-    ch_msg_ctx_free(process_ctx);
-    assert(state == CH_RS_ERROR || state == CH_RS_DONE);
-    return state == CH_RS_DONE;
+    CH_LOG_ERROR(ctx, "recv loop has failed too many times, something fishy is going on");
+    return CH_TRANSPORT_ERROR;
+}
+
+// client has connected, process requests
+BOOL ch_recv_loop(ch_recv_ctx* ctx)
+{
+    ch_pipe_transport pt = {
+        .base = {.recv_msg = ch_pipe_recv_msg, .log_level = ctx->log_level},
+        .ctx = ctx,
+        .overlapped = {.hEvent = ctx->wait_event},
+    };
+    return ch_transport_recv_session(&pt.base,
+                                     ctx->collection_save_info,
+                                     CH_PIPE_INIT_BUF_SIZE,
+                                     ctx->record_path,
+                                     NULL);
 }
 
 #define CH_RUN_IF_OK(x) \
@@ -393,7 +384,9 @@ BOOL ch_recv_loop(ch_recv_ctx* ctx)
             ok = x;     \
     }
 
-void ch_do_inject_and_recv_maps(const ch_datamap_collection_info* collection_save_info, ch_log_level log_level)
+bool ch_do_inject_and_recv_maps(const ch_datamap_collection_info* collection_save_info,
+                                ch_log_level log_level,
+                                const char* record_path)
 {
     ch_recv_ctx rctx = {
         .log_level = log_level,
@@ -402,6 +395,7 @@ void ch_do_inject_and_recv_maps(const ch_datamap_collection_info* collection_sav
         .wait_event = NULL,
         .remote_thread_alloc = NULL,
         .collection_save_info = collection_save_info,
+        .record_path = record_path,
     };
     ch_recv_ctx* ctx = &rctx;
 
@@ -438,4 +432,7 @@ void ch_do_inject_and_recv_maps(const ch_datamap_collection_info* collection_sav
         CloseHandle(ctx->pipe);
     if (ctx->wait_event)
         CloseHandle(ctx->wait_event);
+    return ok;
 }
+
+#endif
@@ -10,28 +10,24 @@
 
 #include "ch_save.h"
 #include "ch_archive.h"
-#include "ch_arena.h" // just for ch_align_to
-
-typedef struct ch_mp_unpacked_ll {
-    msgpack_unpacked unp;
-    struct ch_mp_unpacked_ll* next;
-    char _pad[4];
-} ch_mp_unpacked_ll;
+#include "ch_arena.h"
 
 typedef struct ch_process_msg_ctx {
     bool got_hello;
     bool got_linked_names;
     char _pad[2];
     ch_log_level log_level;
+    // the CH_MSGPACK_FORMAT_VERSION of the payload, sent with HELLO
+    uint32_t payload_version;
 
     /*
-    * We use a single unpacker and unpack each message into a single unpacked structure.
-    * If the datamap is one that we've already receieved (e.g. we were sent a CHL2_Player
-    * map and then a CBaseEntity map later), then we reuse the unpacked object. Otherwise,
-    * we keep the object alive in this linked list.
+    * We use a single unpacker and unpack each message into a single unpacked structure. Everything
+    * that's kept from a message is copied into the arena, so the unpacked object is freed as soon
+    * as the message is processed.
     */
     msgpack_unpacker mp_unpacker;
-    ch_mp_unpacked_ll* unpacked_ll;
+    msgpack_unpacked unp;
+    ch_arena* arena;
     // how much we'll expand the msgpack buffer on next fail
     size_t buf_expand_size;
     // total length of current message over IPC, only used for debugging
@@ -39,11 +35,13 @@ typedef struct ch_process_msg_ctx {
 
     /*
     * We'll store datamap names to the corresponding datamap object for all datamaps. When
-    * we get a new datamap we'll store the map itself as well as any new base/embedded sorted_maps.
+    * we get a new datamap we'll store the map itself as well as any new base/embedded maps.
     * If we get a datamap that we already have, then we'll verify that it's equal to the
-    * one we got before.
+    * one we got before. The stored datamaps reference their base/embedded maps by name.
     */
     struct hashmap* dm_hashmap;
+    // ch_dm_offset_entry, batched datamaps reference the maps that were sent before them by module offset
+    struct hashmap* dm_offset_hashmap;
     msgpack_object_map linked_names;
 
     const ch_datamap_collection_info* collection_save_info;
@@ -56,11 +54,22 @@ typedef struct ch_hashmap_entry {
     // values
 
     msgpack_object o;
-    // these are used later when writing to file
+    // the number of maps in the tree of base/embedded maps (including this one), used for sorting
     size_t n_dependencies;
+    // used later when writing to file
     size_t offset;
 } ch_hashmap_entry;
 
+typedef struct ch_dm_offset_entry {
+    // key
+    msgpack_object_str module;
+    uint64_t module_off;
+
+    // values
+    msgpack_object_str name;
+    size_t n_dependencies;
+} ch_dm_offset_entry;
+
 static uint64_t ch_hashmap_entry_hash(const void* key, uint64_t seed0, uint64_t seed1)
 {
     const ch_hashmap_entry* entry = key;
@@ -86,6 +95,22 @@ static int ch_hashmap_entry_compare(const void* a, const void* b, void* udata)
     return ch_cmp_mp_str(((const ch_hashmap_entry*)a)->name, ((const ch_hashmap_entry*)b)->name);
 }
 
+static uint64_t ch_dm_offset_entry_hash(const void* key, uint64_t seed0, uint64_t seed1)
+{
+    const ch_dm_offset_entry* entry = key;
+    return hashmap_xxhash3(entry->module.ptr, entry->module.size, seed0 ^ entry->module_off, seed1);
+}
+
+static int ch_dm_offset_entry_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_dm_offset_entry* ea = a;
+    const ch_dm_offset_entry* eb = b;
+    if (ea->module_off != eb->module_off)
+        return ea->module_off < eb->module_off ? -1 : 1;
+    return ch_cmp_mp_str(ea->module, eb->module);
+}
+
 ch_process_msg_ctx* ch_msg_ctx_alloc(ch_log_level log_level,
                                      size_t init_chunk_size,
                                      const ch_datamap_collection_info* collection_save_info)
@@ -95,8 +120,9 @@ ch_process_msg_ctx* ch_msg_ctx_alloc(ch_log_level log_level,
         return NULL;
     ctx->log_level = log_level;
     ctx->collection_save_info = collection_save_info;
-    ctx->unpacked_ll = calloc(1, sizeof(ch_mp_unpacked_ll));
-    if (!ctx->unpacked_ll)
+    msgpack_unpacked_init(&ctx->unp);
+    ctx->arena = ch_arena_new(1024 * 64);
+    if (!ctx->arena)
         goto failed;
     if (!msgpack_unpacker_init(&ctx->mp_unpacker, init_chunk_size))
         goto failed;
@@ -104,6 +130,16 @@ ch_process_msg_ctx* ch_msg_ctx_alloc(ch_log_level log_level,
         hashmap_new(sizeof(ch_hashmap_entry), 256, 0, 0, ch_hashmap_entry_hash, ch_hashmap_entry_compare, NULL, NULL);
     if (!ctx->dm_hashmap)
         goto failed;
+    ctx->dm_offset_hashmap = hashmap_new(sizeof(ch_dm_offset_entry),
+                                         256,
+                                         0,
+                                         0,
+                                         ch_dm_offset_entry_hash,
+                                         ch_dm_offset_entry_compare,
+                                         NULL,
+                                         NULL);
+    if (!ctx->dm_offset_hashmap)
+        goto failed;
     ctx->buf_expand_size = init_chunk_size;
     return ctx;
 failed:
@@ -117,12 +153,10 @@ void ch_msg_ctx_free(ch_process_msg_ctx* ctx)
         return;
     if (ctx->dm_hashmap)
         hashmap_free(ctx->dm_hashmap);
-    while (ctx->unpacked_ll) {
-        ch_mp_unpacked_ll* cur = ctx->unpacked_ll;
-        ctx->unpacked_ll = ctx->unpacked_ll->next;
-        msgpack_unpacked_destroy(&cur->unp);
-        free(cur);
-    }
+    if (ctx->dm_offset_hashmap)
+        hashmap_free(ctx->dm_offset_hashmap);
+    msgpack_unpacked_destroy(&ctx->unp);
+    ch_arena_free(ctx->arena);
     msgpack_unpacker_destroy(&ctx->mp_unpacker);
     free(ctx);
 }
@@ -151,6 +185,12 @@ void ch_msg_ctx_buf_consumed(ch_process_msg_ctx* ctx, size_t n)
     ctx->msg_len += n;
 }
 
+const char* ch_msg_ctx_pending(ch_process_msg_ctx* ctx, size_t* n_bytes)
+{
+    *n_bytes = ctx->mp_unpacker.used - ctx->mp_unpacker.off;
+    return ctx->mp_unpacker.buffer + ctx->mp_unpacker.off;
+}
+
 typedef enum ch_process_result {
     // all is well
     CH_PROCESS_OK,
@@ -160,21 +200,15 @@ typedef enum ch_process_result {
     CH_PROCESS_ERROR,
     // caller reports error
     CH_PROCESS_OUT_OF_MEMORY,
-    CH_PROCESS_BAD_FORMAT,
 } ch_process_result;
 
-#define CH_CHECK_FORMAT(cond)             \
-    do {                                  \
-        if (!(cond)) {                    \
-            assert(0);                    \
-            return CH_PROCESS_BAD_FORMAT; \
-        }                                 \
-    } while (0)
-
-#define CH_CHECK_STR_FORMAT(mp_str_obj, comp_str)                                                   \
-    do {                                                                                            \
-        CH_CHECK_FORMAT((mp_str_obj).type == MSGPACK_OBJECT_STR);                                   \
-        CH_CHECK_FORMAT(!strncmp((mp_str_obj).via.str.ptr, comp_str, ((mp_str_obj).via.str).size)); \
+// the message (or collection) is malformed, expects a ctx in scope
+#define CH_CHECK_FORMAT(cond)                                                   \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            CH_LOG_ERROR(ctx, "Unexpected msgpack format, expected %s.", #cond); \
+            return CH_PROCESS_ERROR;                                            \
+        }                                                                       \
     } while (0)
 
 // schema stuff that's used for verifying the receieved format
@@ -183,13 +217,14 @@ typedef struct ch_kv_pair {
     const char* key_name;
     const uint8_t allowed_types[2];
     uint8_t n_allowed;
-    uint8_t _pad;
+    uint8_t key_len;
 } ch_kv_pair;
 
 // clang-format off
-#define CH_KV_SINGLE(name, msgpack_type) {.key_name = CH_KEY_NAME(name), .allowed_types = {msgpack_type}, .n_allowed = 1}
-#define CH_KV_EITHER(name, msgpack_type1, msgpack_type2) {.key_name = CH_KEY_NAME(name), .allowed_types = {msgpack_type1, msgpack_type2}, .n_allowed = 2}
-#define CH_KV_WILD(name) {.key_name = CH_KEY_NAME(name), .n_allowed = 0}
+#define CH_KV_KEY(name) .key_name = CH_KEY_NAME(name), .key_len = sizeof(CH_KEY_NAME(name)) - 1
+#define CH_KV_SINGLE(name, msgpack_type) {CH_KV_KEY(name), .allowed_types = {msgpack_type}, .n_allowed = 1}
+#define CH_KV_EITHER(name, msgpack_type1, msgpack_type2) {CH_KV_KEY(name), .allowed_types = {msgpack_type1, msgpack_type2}, .n_allowed = 2}
+#define CH_KV_WILD(name) {CH_KV_KEY(name), .n_allowed = 0}
 // clang-format on
 
 typedef struct ch_kv_schema {
@@ -211,13 +246,14 @@ typedef struct ch_kv_schema {
             return res;               \
     } while (0)
 
-ch_process_result ch_check_kv_schema(msgpack_object o, ch_kv_schema schema)
+static ch_process_result ch_check_kv_schema(ch_process_msg_ctx* ctx, msgpack_object o, ch_kv_schema schema)
 {
     CH_CHECK_FORMAT(o.type == MSGPACK_OBJECT_MAP);
     CH_CHECK_FORMAT(o.via.map.size == schema.n_kv_pairs);
     const msgpack_object_kv* kv = o.via.map.ptr;
     for (size_t i = 0; i < schema.n_kv_pairs; i++) {
-        CH_CHECK_STR_FORMAT(kv[i].key, schema.kv_pairs[i].key_name);
+        CH_CHECK_FORMAT(kv[i].key.type == MSGPACK_OBJECT_STR && kv[i].key.via.str.size == schema.kv_pairs[i].key_len);
+        CH_CHECK_FORMAT(!memcmp(kv[i].key.via.str.ptr, schema.kv_pairs[i].key_name, schema.kv_pairs[i].key_len));
         if (schema.kv_pairs[i].n_allowed) {
             bool any = false;
             for (size_t j = 0; j < schema.kv_pairs[i].n_allowed; j++)
@@ -228,89 +264,90 @@ ch_process_result ch_check_kv_schema(msgpack_object o, ch_kv_schema schema)
     return CH_PROCESS_OK;
 }
 
-// visit this datamap and base/embedded sorted_maps
-static ch_process_result ch_recurse_visit_datamaps(const msgpack_object o,
-                                                   ch_process_result (*cb)(const msgpack_object* o, void* user_data),
-                                                   void* user_data)
-{
-    if (o.type == MSGPACK_OBJECT_NIL)
-        return CH_PROCESS_OK;
-    CH_CHECK(cb(&o, user_data));
-    CH_CHECK(ch_recurse_visit_datamaps(o.via.map.ptr[CH_DM_BASE].val, cb, user_data));
-    msgpack_object_array fields = o.via.map.ptr[CH_DM_FIELDS].val.via.array;
-    for (size_t i = 0; i < fields.size; i++)
-        CH_CHECK(ch_recurse_visit_datamaps(fields.ptr[i].via.map.ptr[CH_TD_EMBEDDED].val, cb, user_data));
-    return CH_PROCESS_OK;
-}
-
-static ch_process_result ch_check_dm_schema_cb(const msgpack_object* o, void* user_data)
+/*
+* Old payloads send base & embedded maps as nested datamaps, and new ones send their module offset (see
+* CH_MSG_DATAMAPS). Collections written as CH_DC_STRUCT_MSGPACK only have their names (see
+* ch_change_datamap_references_to_strings).
+*/
+#define CH_DM_SCHEMA_PAIRS(ref_type)                                 \
+    CH_KV_SINGLE(CH_DM_NAME, MSGPACK_OBJECT_STR),                    \
+    CH_KV_SINGLE(CH_DM_MODULE, MSGPACK_OBJECT_STR),                  \
+    CH_KV_SINGLE(CH_DM_MODULE_OFF, MSGPACK_OBJECT_POSITIVE_INTEGER), \
+    CH_KV_EITHER(CH_DM_BASE, ref_type, MSGPACK_OBJECT_NIL),          \
+    CH_KV_SINGLE(CH_DM_FIELDS, MSGPACK_OBJECT_ARRAY)
+
+#define CH_TD_SCHEMA_PAIRS(ref_type)                                                      \
+    CH_KV_SINGLE(CH_TD_NAME, MSGPACK_OBJECT_STR),                                         \
+    CH_KV_SINGLE(CH_TD_TYPE, MSGPACK_OBJECT_POSITIVE_INTEGER),                            \
+    CH_KV_SINGLE(CH_TD_FLAGS, MSGPACK_OBJECT_POSITIVE_INTEGER),                           \
+    CH_KV_EITHER(CH_TD_EXTERNAL_NAME, MSGPACK_OBJECT_STR, MSGPACK_OBJECT_NIL),            \
+    CH_KV_SINGLE(CH_TD_OFF, MSGPACK_OBJECT_POSITIVE_INTEGER),                             \
+    CH_KV_SINGLE(CH_TD_NUM_ELEMS, MSGPACK_OBJECT_POSITIVE_INTEGER),                       \
+    CH_KV_SINGLE(CH_TD_TOTAL_SIZE, MSGPACK_OBJECT_POSITIVE_INTEGER),                      \
+    CH_KV_EITHER(CH_TD_RESTORE_OPS, MSGPACK_OBJECT_POSITIVE_INTEGER, MSGPACK_OBJECT_NIL), \
+    CH_KV_EITHER(CH_TD_INPUT_FUNC, MSGPACK_OBJECT_POSITIVE_INTEGER, MSGPACK_OBJECT_NIL),  \
+    CH_KV_EITHER(CH_TD_EMBEDDED, ref_type, MSGPACK_OBJECT_NIL),                           \
+    CH_KV_SINGLE(CH_TD_OVERRIDE_COUNT, MSGPACK_OBJECT_POSITIVE_INTEGER),                  \
+    CH_KV_SINGLE(CH_TD_TOL, MSGPACK_OBJECT_FLOAT32)
+
+CH_DEFINE_KV_SCHEMA(ch_dm_kv_schema, CH_DM_SCHEMA_PAIRS(MSGPACK_OBJECT_MAP));
+CH_DEFINE_KV_SCHEMA(ch_dm_td_schema, CH_TD_SCHEMA_PAIRS(MSGPACK_OBJECT_MAP));
+CH_DEFINE_KV_SCHEMA(ch_stored_dm_kv_schema, CH_DM_SCHEMA_PAIRS(MSGPACK_OBJECT_STR));
+CH_DEFINE_KV_SCHEMA(ch_stored_dm_td_schema, CH_TD_SCHEMA_PAIRS(MSGPACK_OBJECT_STR));
+CH_DEFINE_KV_SCHEMA(ch_batched_dm_kv_schema, CH_DM_SCHEMA_PAIRS(MSGPACK_OBJECT_POSITIVE_INTEGER));
+CH_DEFINE_KV_SCHEMA(ch_batched_dm_td_schema, CH_TD_SCHEMA_PAIRS(MSGPACK_OBJECT_POSITIVE_INTEGER));
+
+static ch_process_result ch_check_dm_schema(ch_process_msg_ctx* ctx, const msgpack_object* o, bool refs_are_names)
 {
-    (void)user_data;
-    CH_DEFINE_KV_SCHEMA(dm_kv_schema,
-                        CH_KV_SINGLE(CH_DM_NAME, MSGPACK_OBJECT_STR),
-                        CH_KV_SINGLE(CH_DM_MODULE, MSGPACK_OBJECT_STR),
-                        CH_KV_SINGLE(CH_DM_MODULE_OFF, MSGPACK_OBJECT_POSITIVE_INTEGER),
-                        CH_KV_EITHER(CH_DM_BASE, MSGPACK_OBJECT_MAP, MSGPACK_OBJECT_NIL),
-                        CH_KV_SINGLE(CH_DM_FIELDS, MSGPACK_OBJECT_ARRAY));
-    CH_CHECK(ch_check_kv_schema(*o, dm_kv_schema));
+    CH_CHECK(ch_check_kv_schema(ctx, *o, refs_are_names ? ch_stored_dm_kv_schema : ch_dm_kv_schema));
 
     msgpack_object_array fields = o->via.map.ptr[CH_DM_FIELDS].val.via.array;
 
-    for (size_t i = 0; i < fields.size; i++) {
-        CH_DEFINE_KV_SCHEMA(dm_td_schema,
-                            CH_KV_SINGLE(CH_TD_NAME, MSGPACK_OBJECT_STR),
-                            CH_KV_SINGLE(CH_TD_TYPE, MSGPACK_OBJECT_POSITIVE_INTEGER),
-                            CH_KV_SINGLE(CH_TD_FLAGS, MSGPACK_OBJECT_POSITIVE_INTEGER),
-                            CH_KV_EITHER(CH_TD_EXTERNAL_NAME, MSGPACK_OBJECT_STR, MSGPACK_OBJECT_NIL),
-                            CH_KV_SINGLE(CH_TD_OFF, MSGPACK_OBJECT_POSITIVE_INTEGER),
-                            CH_KV_SINGLE(CH_TD_NUM_ELEMS, MSGPACK_OBJECT_POSITIVE_INTEGER),
-                            CH_KV_SINGLE(CH_TD_TOTAL_SIZE, MSGPACK_OBJECT_POSITIVE_INTEGER),
-                            CH_KV_EITHER(CH_TD_RESTORE_OPS, MSGPACK_OBJECT_POSITIVE_INTEGER, MSGPACK_OBJECT_NIL),
-                            CH_KV_EITHER(CH_TD_INPUT_FUNC, MSGPACK_OBJECT_POSITIVE_INTEGER, MSGPACK_OBJECT_NIL),
-                            CH_KV_EITHER(CH_TD_EMBEDDED, MSGPACK_OBJECT_MAP, MSGPACK_OBJECT_NIL),
-                            CH_KV_SINGLE(CH_TD_OVERRIDE_COUNT, MSGPACK_OBJECT_POSITIVE_INTEGER),
-                            CH_KV_SINGLE(CH_TD_TOL, MSGPACK_OBJECT_FLOAT32));
-        CH_CHECK(ch_check_kv_schema(fields.ptr[i], dm_td_schema));
-    }
+    for (size_t i = 0; i < fields.size; i++)
+        CH_CHECK(ch_check_kv_schema(ctx, fields.ptr[i], refs_are_names ? ch_stored_dm_td_schema : ch_dm_td_schema));
     return CH_PROCESS_OK;
 }
 
-typedef struct ch_verify_and_hash_dm_cb_udata {
-    ch_process_msg_ctx* ctx;
-    bool* save_unpacked;
-} ch_verify_and_hash_dm_cb_udata;
-
-// add the datamap into the hashmap if it's new, compare with an existing one if it's not
-static ch_process_result ch_verify_and_hash_dm_cb(const msgpack_object* o, void* user_data)
+// deep copy of a message object into the arena so that the message can be freed
+static ch_process_result ch_copy_mp_object(ch_process_msg_ctx* ctx, msgpack_object* dst, msgpack_object src)
 {
-    ch_verify_and_hash_dm_cb_udata* udata = (ch_verify_and_hash_dm_cb_udata*)user_data;
-    msgpack_object_map dm = o->via.map;
-    ch_hashmap_entry entry = {.name = dm.ptr[CH_DM_NAME].val.via.str, .o = *o};
-    uint64_t hash = ch_hashmap_entry_hash(&entry, 0, 0);
-    const ch_hashmap_entry* existing = hashmap_get_with_hash(udata->ctx->dm_hashmap, &entry, hash);
-
-    if (!existing) {
-        hashmap_set_with_hash(udata->ctx->dm_hashmap, &entry, hash);
-        if (hashmap_oom(udata->ctx->dm_hashmap))
-            return CH_PROCESS_OUT_OF_MEMORY;
-        *udata->save_unpacked = true;
-        return CH_PROCESS_OK;
+    *dst = src;
+    switch (src.type) {
+        case MSGPACK_OBJECT_STR: {
+            char* str = ch_arena_alloc(ctx->arena, src.via.str.size);
+            if (!str)
+                return CH_PROCESS_OUT_OF_MEMORY;
+            memcpy(str, src.via.str.ptr, src.via.str.size);
+            dst->via.str.ptr = str;
+            return CH_PROCESS_OK;
+        }
+        case MSGPACK_OBJECT_ARRAY: {
+            msgpack_object* arr = ch_arena_alloc(ctx->arena, sizeof(msgpack_object) * src.via.array.size);
+            if (!arr)
+                return CH_PROCESS_OUT_OF_MEMORY;
+            for (uint32_t i = 0; i < src.via.array.size; i++)
+                CH_CHECK(ch_copy_mp_object(ctx, &arr[i], src.via.array.ptr[i]));
+            dst->via.array.ptr = arr;
+            return CH_PROCESS_OK;
+        }
+        case MSGPACK_OBJECT_MAP: {
+            msgpack_object_kv* kv = ch_arena_alloc(ctx->arena, sizeof(msgpack_object_kv) * src.via.map.size);
+            if (!kv)
+                return CH_PROCESS_OUT_OF_MEMORY;
+            for (uint32_t i = 0; i < src.via.map.size; i++) {
+                CH_CHECK(ch_copy_mp_object(ctx, &kv[i].key, src.via.map.ptr[i].key));
+                CH_CHECK(ch_copy_mp_object(ctx, &kv[i].val, src.via.map.ptr[i].val));
+            }
+            dst->via.map.ptr = kv;
+            return CH_PROCESS_OK;
+        }
+        case MSGPACK_OBJECT_BIN:
+        case MSGPACK_OBJECT_EXT:
+            CH_LOG_ERROR(ctx, "Unexpected msgpack object type %d.", src.type);
+            return CH_PROCESS_ERROR;
+        default:
+            return CH_PROCESS_OK;
     }
-    // I was originally going to do a deep comparison of all of the fields, but I can just compare the datamap pointers :)
-    msgpack_object_map dm2 = existing->o.via.map;
-    if (msgpack_object_equal(dm.ptr[CH_DM_MODULE].val, dm2.ptr[CH_DM_MODULE].val) &&
-        msgpack_object_equal(dm.ptr[CH_DM_MODULE_OFF].val, dm2.ptr[CH_DM_MODULE_OFF].val))
-        return CH_PROCESS_OK;
-
-    msgpack_object_str name = dm.ptr[CH_DM_NAME].val.via.str;
-    msgpack_object_str mod_name = dm.ptr[CH_DM_MODULE].val.via.str;
-    CH_LOG_ERROR(udata->ctx,
-                 "Two datamaps found with the same name '%.*s' in %.*s, but different type descriptions!",
-                 name.size,
-                 name.ptr,
-                 mod_name.size,
-                 mod_name.ptr);
-    return CH_PROCESS_ERROR;
 }
 
 static ch_process_result ch_verify_linked_names(ch_process_msg_ctx* ctx, msgpack_object_map linked_names)
@@ -354,24 +391,18 @@ static ch_process_result ch_verify_linked_names(ch_process_msg_ctx* ctx, msgpack
     return CH_PROCESS_OK;
 }
 
-static ch_process_result ch_count_maps_cb(const msgpack_object* o, void* user_data)
-{
-    (void)o;
-    ++*(uint32_t*)user_data;
-    return CH_PROCESS_OK;
-}
-
-static int ch_cmp_datamaps(const ch_hashmap_entry** a, const ch_hashmap_entry** b)
+static int ch_cmp_datamaps(const void* a, const void* b)
 {
-    int cmp =
-        ch_cmp_mp_str((**a).o.via.map.ptr[CH_DM_MODULE].val.via.str, (**b).o.via.map.ptr[CH_DM_MODULE].val.via.str);
-    if (cmp)
-        return cmp;
-    if ((**a).n_dependencies < (**b).n_dependencies)
+    const ch_hashmap_entry* ea = *(const ch_hashmap_entry* const*)a;
+    const ch_hashmap_entry* eb = *(const ch_hashmap_entry* const*)b;
+    if (ea->n_dependencies < eb->n_dependencies)
         return -1;
-    if ((**a).n_dependencies > (**b).n_dependencies)
+    if (ea->n_dependencies > eb->n_dependencies)
         return 1;
-    return ch_cmp_mp_str((**a).o.via.map.ptr[CH_DM_NAME].val.via.str, (**b).o.via.map.ptr[CH_DM_NAME].val.via.str);
+    int cmp = ch_cmp_mp_str(ea->o.via.map.ptr[CH_DM_MODULE].val.via.str, eb->o.via.map.ptr[CH_DM_MODULE].val.via.str);
+    if (cmp)
+        return cmp;
+    return ch_cmp_mp_str(ea->o.via.map.ptr[CH_DM_NAME].val.via.str, eb->o.via.map.ptr[CH_DM_NAME].val.via.str);
 }
 
 // change the msgpack objects which reference base/embedded sorted_maps to just strings
@@ -389,9 +420,146 @@ static void ch_change_datamap_references_to_strings(msgpack_object_map dm)
     }
 }
 
+// finds the map with the same name as a received one, errors if it's a different map
+static ch_process_result ch_find_received_dm(ch_process_msg_ctx* ctx,
+                                             msgpack_object_map dm,
+                                             uint64_t hash,
+                                             const ch_hashmap_entry** existing)
+{
+    ch_hashmap_entry entry_lookup = {.name = dm.ptr[CH_DM_NAME].val.via.str};
+    *existing = hashmap_get_with_hash(ctx->dm_hashmap, &entry_lookup, hash);
+    if (!*existing)
+        return CH_PROCESS_OK;
+    // I was originally going to do a deep comparison of all of the fields, but I can just compare the datamap
+    // pointers :)
+    msgpack_object_map dm2 = (*existing)->o.via.map;
+    if (msgpack_object_equal(dm.ptr[CH_DM_MODULE].val, dm2.ptr[CH_DM_MODULE].val) &&
+        msgpack_object_equal(dm.ptr[CH_DM_MODULE_OFF].val, dm2.ptr[CH_DM_MODULE_OFF].val))
+        return CH_PROCESS_OK;
+    msgpack_object_str mod_name = dm.ptr[CH_DM_MODULE].val.via.str;
+    CH_LOG_ERROR(ctx,
+                 "Two datamaps found with the same name '%.*s' in %.*s, but different type descriptions!",
+                 entry_lookup.name.size,
+                 entry_lookup.name.ptr,
+                 mod_name.size,
+                 mod_name.ptr);
+    return CH_PROCESS_ERROR;
+}
+
+// copies a new map whose references are names into the arena and adds it
+static ch_process_result ch_store_received_dm(ch_process_msg_ctx* ctx,
+                                              msgpack_object o,
+                                              uint64_t hash,
+                                              size_t n_dependencies)
+{
+    ch_hashmap_entry entry = {.n_dependencies = n_dependencies};
+    CH_CHECK(ch_copy_mp_object(ctx, &entry.o, o));
+    msgpack_object_kv* dm_kv = entry.o.via.map.ptr;
+    entry.name = dm_kv[CH_DM_NAME].val.via.str;
+    hashmap_set_with_hash(ctx->dm_hashmap, &entry, hash);
+    if (hashmap_oom(ctx->dm_hashmap))
+        return CH_PROCESS_OUT_OF_MEMORY;
+    ch_dm_offset_entry offset_entry = {
+        .module = dm_kv[CH_DM_MODULE].val.via.str,
+        .module_off = dm_kv[CH_DM_MODULE_OFF].val.via.u64,
+        .name = entry.name,
+        .n_dependencies = n_dependencies,
+    };
+    hashmap_set(ctx->dm_offset_hashmap, &offset_entry);
+    if (hashmap_oom(ctx->dm_offset_hashmap))
+        return CH_PROCESS_OUT_OF_MEMORY;
+    return CH_PROCESS_OK;
+}
+
+/*
+* CH_MSG_DATAMAP messages have the whole tree of base & embedded maps. Maps that we already have are only compared
+* with the existing one, so each map is only checked & walked the first time it's received. The base & embedded maps
+* of a new map are added before it, and then it's copied into the arena with the references changed to names.
+*/
+static ch_process_result ch_add_received_dm(ch_process_msg_ctx* ctx, msgpack_object o, size_t* n_dependencies)
+{
+    CH_CHECK(ch_check_kv_schema(ctx, o, ch_dm_kv_schema));
+    msgpack_object_map dm = o.via.map;
+    ch_hashmap_entry entry_lookup = {.name = dm.ptr[CH_DM_NAME].val.via.str};
+    uint64_t hash = ch_hashmap_entry_hash(&entry_lookup, 0, 0);
+    const ch_hashmap_entry* existing;
+    CH_CHECK(ch_find_received_dm(ctx, dm, hash, &existing));
+    if (existing) {
+        *n_dependencies = existing->n_dependencies;
+        return CH_PROCESS_OK;
+    }
+
+    *n_dependencies = 1;
+    size_t n_ref_dependencies;
+    if (dm.ptr[CH_DM_BASE].val.type == MSGPACK_OBJECT_MAP) {
+        CH_CHECK(ch_add_received_dm(ctx, dm.ptr[CH_DM_BASE].val, &n_ref_dependencies));
+        *n_dependencies += n_ref_dependencies;
+    }
+    msgpack_object_array fields = dm.ptr[CH_DM_FIELDS].val.via.array;
+    for (size_t i = 0; i < fields.size; i++) {
+        CH_CHECK(ch_check_kv_schema(ctx, fields.ptr[i], ch_dm_td_schema));
+        msgpack_object embedded = fields.ptr[i].via.map.ptr[CH_TD_EMBEDDED].val;
+        if (embedded.type == MSGPACK_OBJECT_MAP) {
+            CH_CHECK(ch_add_received_dm(ctx, embedded, &n_ref_dependencies));
+            *n_dependencies += n_ref_dependencies;
+        }
+    }
+    ch_change_datamap_references_to_strings(dm);
+    return ch_store_received_dm(ctx, o, hash, *n_dependencies);
+}
+
+// changes the module offset that a batched map uses to reference another map to the name of that map
+static ch_process_result ch_resolve_batched_dm_ref(ch_process_msg_ctx* ctx,
+                                                   msgpack_object_map dm,
+                                                   msgpack_object* ref,
+                                                   size_t* n_dependencies)
+{
+    if (ref->type == MSGPACK_OBJECT_NIL)
+        return CH_PROCESS_OK;
+    ch_dm_offset_entry entry_lookup = {.module = dm.ptr[CH_DM_MODULE].val.via.str, .module_off = ref->via.u64};
+    const ch_dm_offset_entry* entry = hashmap_get(ctx->dm_offset_hashmap, &entry_lookup);
+    if (!entry) {
+        msgpack_object_str name = dm.ptr[CH_DM_NAME].val.via.str;
+        CH_LOG_ERROR(ctx,
+                     "Datamap '%.*s' references the datamap at %.*s+0x%llx which wasn't sent before it.",
+                     name.size,
+                     name.ptr,
+                     entry_lookup.module.size,
+                     entry_lookup.module.ptr,
+                     (unsigned long long)entry_lookup.module_off);
+        return CH_PROCESS_ERROR;
+    }
+    *ref = (msgpack_object){.type = MSGPACK_OBJECT_STR, .via.str = entry->name};
+    *n_dependencies += entry->n_dependencies;
+    return CH_PROCESS_OK;
+}
+
+// a map from a CH_MSG_DATAMAPS message, all the maps it references were sent before it
+static ch_process_result ch_add_batched_dm(ch_process_msg_ctx* ctx, msgpack_object o)
+{
+    CH_CHECK(ch_check_kv_schema(ctx, o, ch_batched_dm_kv_schema));
+    msgpack_object_map dm = o.via.map;
+    ch_hashmap_entry entry_lookup = {.name = dm.ptr[CH_DM_NAME].val.via.str};
+    uint64_t hash = ch_hashmap_entry_hash(&entry_lookup, 0, 0);
+    const ch_hashmap_entry* existing;
+    CH_CHECK(ch_find_received_dm(ctx, dm, hash, &existing));
+    if (existing)
+        return CH_PROCESS_OK;
+
+    size_t n_dependencies = 1;
+    CH_CHECK(ch_resolve_batched_dm_ref(ctx, dm, &dm.ptr[CH_DM_BASE].val, &n_dependencies));
+    msgpack_object_array fields = dm.ptr[CH_DM_FIELDS].val.via.array;
+    for (size_t i = 0; i < fields.size; i++) {
+        CH_CHECK(ch_check_kv_schema(ctx, fields.ptr[i], ch_batched_dm_td_schema));
+        msgpack_object* embedded = &fields.ptr[i].via.map.ptr[CH_TD_EMBEDDED].val;
+        CH_CHECK(ch_resolve_batched_dm_ref(ctx, dm, embedded, &n_dependencies));
+    }
+    return ch_store_received_dm(ctx, o, hash, n_dependencies);
+}
+
 static ch_process_result ch_msgpack_write_collection(ch_process_msg_ctx* ctx,
                                                      msgpack_packer* pk,
-                                                     const ch_hashmap_entry** sorted_maps,
+                                                     ch_hashmap_entry* const* sorted_maps,
                                                      size_t n_sorted_maps,
                                                      const ch_datamap_collection_info* collection_save_info)
 {
@@ -444,15 +612,167 @@ static ch_process_result ch_add_strings_to_map(struct hashmap* str_map,
     return CH_PROCESS_OK;
 }
 
-static size_t ch_get_entry_offset(struct hashmap* map, msgpack_object mp_str)
+static uint32_t ch_get_entry_offset(struct hashmap* map, msgpack_object mp_str)
 {
     if (mp_str.type == MSGPACK_OBJECT_NIL)
-        return CH_REL_OFF_NULL;
+        return CH_DC_NULL;
     assert(mp_str.type == MSGPACK_OBJECT_STR);
     ch_hashmap_entry entry_in = {.name = mp_str.via.str};
     const ch_hashmap_entry* entry_out = hashmap_get(map, &entry_in);
     assert(entry_out);
-    return entry_out->offset;
+    return (uint32_t)entry_out->offset;
+}
+
+static inline msgpack_object_str ch_mp_str_from(const char* str)
+{
+    return (msgpack_object_str){.ptr = str, .size = (uint32_t)strlen(str)};
+}
+
+/*
+* Finds the game ops of the example field of each custom op id (see CH_FOR_EACH_CUSTOM_OP), UINT64_MAX if the game
+* doesn't have the field. The ids are what's written to the collection instead of the game ops.
+*/
+static ch_process_result ch_find_custom_op_game_ops(ch_process_msg_ctx* ctx, uint64_t game_ops[CH_OP_COUNT])
+{
+#define CH_GEN_CUSTOM_OP_FIELD(id, module, class, field) {module, class, field},
+    static const char* const op_fields[CH_OP_COUNT][3] = {CH_FOR_EACH_CUSTOM_OP(CH_GEN_CUSTOM_OP_FIELD)};
+#undef CH_GEN_CUSTOM_OP_FIELD
+
+    for (size_t i = 0; i < CH_OP_COUNT; i++) {
+        game_ops[i] = UINT64_MAX;
+        ch_hashmap_entry entry_lookup = {.name = ch_mp_str_from(op_fields[i][1])};
+        const ch_hashmap_entry* entry = hashmap_get(ctx->dm_hashmap, &entry_lookup);
+        if (!entry)
+            continue;
+        msgpack_object_kv* dm_kv = entry->o.via.map.ptr;
+        if (ch_cmp_mp_str(dm_kv[CH_DM_MODULE].val.via.str, ch_mp_str_from(op_fields[i][0])))
+            continue;
+        msgpack_object_array fields = dm_kv[CH_DM_FIELDS].val.via.array;
+        for (size_t j = 0; j < fields.size; j++) {
+            msgpack_object_kv* td_kv = fields.ptr[j].via.map.ptr;
+            if (td_kv[CH_TD_RESTORE_OPS].val.type != MSGPACK_OBJECT_NIL &&
+                !ch_cmp_mp_str(td_kv[CH_TD_NAME].val.via.str, ch_mp_str_from(op_fields[i][2]))) {
+                game_ops[i] = td_kv[CH_TD_RESTORE_OPS].val.via.u64;
+                break;
+            }
+        }
+        for (size_t j = 0; j < i; j++) {
+            if (game_ops[i] != UINT64_MAX && game_ops[j] == game_ops[i]) {
+                CH_LOG_ERROR(ctx,
+                             "Fields '%s::%s' and '%s::%s' have the same save/restore ops but different custom op ids.",
+                             op_fields[j][1],
+                             op_fields[j][2],
+                             op_fields[i][1],
+                             op_fields[i][2]);
+                return CH_PROCESS_ERROR;
+            }
+        }
+    }
+    return CH_PROCESS_OK;
+}
+
+// CH_DC_NULL if the field doesn't have ops or if they aren't any of the custom op ids
+static uint32_t ch_get_custom_op_id(const uint64_t game_ops[CH_OP_COUNT], msgpack_object mp_ops)
+{
+    if (mp_ops.type == MSGPACK_OBJECT_NIL)
+        return CH_DC_NULL;
+    for (uint32_t i = 0; i < CH_OP_COUNT; i++)
+        if (game_ops[i] == mp_ops.via.u64)
+            return i;
+    return CH_DC_NULL;
+}
+
+// fields which the analysis code reads from most entities, see ch_layout_fields
+static const char* const ch_hot_field_names[] = {
+    "m_iName",
+    "m_vecAbsOrigin",
+    "m_hOwnerEntity",
+    "m_nNextThinkTick",
+    "m_aThinkFunctions",
+};
+
+typedef struct ch_field_layout {
+    ch_dc_type_description* td;
+    uint32_t size;
+    uint32_t seq_size; // the size when all embedded maps have a sequential layout, for the report
+    uint32_t align;
+    bool hot;
+} ch_field_layout;
+
+typedef struct ch_dm_layout {
+    uint32_t align;
+    uint32_t seq_size; // ch_size if the fields were placed in order
+} ch_dm_layout;
+
+/*
+* The size & alignment of the field in the restored class. Embedded maps come before the datamap so their layout is
+* already known, and for them total_size_bytes is changed to the size of one restored element.
+*/
+static void ch_get_field_layout(ch_dc_type_description* td,
+                                const char* name,
+                                const ch_dc_datamap* ch_dms,
+                                const ch_dm_layout* dm_layouts,
+                                ch_field_layout* layout)
+{
+    *layout = (ch_field_layout){.td = td, .size = td->total_size_bytes, .align = 1};
+    switch (td->type) {
+        case FIELD_CUSTOM:
+            layout->size = sizeof(void*);
+            layout->align = sizeof(void*);
+            break;
+        case FIELD_EMBEDDED:
+            td->total_size_bytes = ch_dms[td->embedded_map].ch_size;
+            layout->size = td->total_size_bytes * td->n_elems;
+            layout->seq_size = dm_layouts[td->embedded_map].seq_size * td->n_elems;
+            layout->align = dm_layouts[td->embedded_map].align;
+            break;
+        case FIELD_VOID:
+            break;
+        default:
+            if (ch_field_type_is_str(td->type)) {
+                layout->size = sizeof(char*) * td->n_elems;
+                layout->align = sizeof(char*);
+            } else if (td->type < FIELD_TYPECOUNT) {
+                // vectors & matrices are aligned like their components
+                uint32_t elem_size = (uint32_t)ch_field_type_byte_size(td->type);
+                layout->align = min(elem_size & (0 - elem_size), sizeof(void*));
+            }
+            break;
+    }
+    // every field gets at least one byte so that offsets are unique and less than ch_size
+    layout->size = (uint32_t)CH_ALIGN_TO(max(layout->size, 1), layout->align);
+    if (td->type != FIELD_EMBEDDED)
+        layout->seq_size = layout->size;
+    for (size_t i = 0; i < ARRAYSIZE(ch_hot_field_names) && !layout->hot; i++)
+        layout->hot = !strcmp(ch_hot_field_names[i], name);
+}
+
+static int ch_cmp_field_layouts(const void* a, const void* b)
+{
+    const ch_field_layout* fa = a;
+    const ch_field_layout* fb = b;
+    if (fa->hot != fb->hot)
+        return fa->hot ? -1 : 1;
+    if (fa->align != fb->align)
+        return fa->align > fb->align ? -1 : 1;
+    // qsort isn't stable, keep the declaration order otherwise
+    return fa->td < fb->td ? -1 : fa->td > fb->td;
+}
+
+/*
+* Assigns the ch_offset of the fields of one datamap, starting after the base class, and returns the end offset.
+* Sorting by alignment means that there's no padding between the fields since each size is a multiple of the
+* alignment. Hot fields are placed first so that they tend to share the first cache line(s) of the class.
+*/
+static uint32_t ch_layout_fields(ch_field_layout* fields, uint32_t n_fields, uint32_t offset)
+{
+    qsort(fields, n_fields, sizeof *fields, ch_cmp_field_layouts);
+    for (uint32_t i = 0; i < n_fields; i++) {
+        offset = (uint32_t)CH_ALIGN_TO(offset, fields[i].align);
+        fields[i].td->ch_offset = offset;
+        offset += fields[i].size;
+    }
+    return offset;
 }
 
 static ch_process_result ch_create_naked_packed_collection(ch_process_msg_ctx* ctx,
@@ -462,6 +782,11 @@ static ch_process_result ch_create_naked_packed_collection(ch_process_msg_ctx* c
 {
 
     ch_process_result result = CH_PROCESS_OK;
+    const char** mph_names = NULL;
+    uint32_t* mph_name_dms = NULL;
+    uint32_t* mph_slot_names = NULL;
+    ch_dm_layout* dm_layouts = NULL;
+    ch_field_layout* field_layouts = NULL;
 
     // msgpack str -> offset from string_buf
     struct hashmap* hm_unique_strs = hashmap_new(sizeof(ch_hashmap_entry),
@@ -504,142 +829,182 @@ static ch_process_result ch_create_naked_packed_collection(ch_process_msg_ctx* c
             goto end;
     }
 
-    collection_out->len = sizeof(ch_datamap_collection_header) + sizeof(ch_datamap_collection) +
-                          n_sorted_maps * sizeof(ch_datamap) + total_typedescs_to_write * sizeof(ch_type_description) +
-                          string_alloc_size + sizeof(ch_linked_name) * ctx->linked_names.size;
+    size_t n_names = n_sorted_maps + ctx->linked_names.size;
+    size_t n_mph_buckets = CH_DC_MPH_N_BUCKETS(n_names);
+
+    // all sections are a multiple of 4 bytes except for the strings, so put them last
+    size_t dms_off = sizeof(ch_dc_header);
+    size_t tds_off = dms_off + n_sorted_maps * sizeof(ch_dc_datamap);
+    size_t mph_disps_off = tds_off + total_typedescs_to_write * sizeof(ch_dc_type_description);
+    size_t mph_slots_off = mph_disps_off + n_mph_buckets * sizeof(uint32_t);
+    size_t strs_off = mph_slots_off + n_names * sizeof(ch_dc_mph_slot);
+    collection_out->len = strs_off + string_alloc_size;
+    if (collection_out->len >= CH_DC_NULL) {
+        CH_LOG_ERROR(ctx, "Collection is too big (%zu bytes).", collection_out->len);
+        result = CH_PROCESS_ERROR;
+        goto end;
+    }
 
     collection_out->arr = calloc(1, collection_out->len);
-    if (!collection_out->arr) {
+    mph_names = malloc(sizeof(const char*) * n_names);
+    mph_name_dms = malloc(sizeof(uint32_t) * n_names);
+    mph_slot_names = malloc(sizeof(uint32_t) * n_names);
+    dm_layouts = malloc(sizeof(ch_dm_layout) * n_sorted_maps);
+    field_layouts = malloc(sizeof(ch_field_layout) * max(total_typedescs_to_write, 1));
+    if (!collection_out->arr || !mph_names || !mph_name_dms || !mph_slot_names || !dm_layouts || !field_layouts) {
         result = CH_PROCESS_OUT_OF_MEMORY;
         goto end;
     }
 
-    ch_datamap_collection_header* ch_head = (ch_datamap_collection_header*)collection_out->arr;
-    ch_datamap_collection* ch_col = (ch_datamap_collection*)(ch_head + 1);
-    ch_datamap* ch_dms = (ch_datamap*)(ch_col + 1);
-    ch_type_description* ch_tds = (ch_type_description*)(ch_dms + n_sorted_maps);
-    char* string_buf = (char*)(ch_tds + total_typedescs_to_write);
-    ch_linked_name* ch_linked_names = (ch_linked_name*)(string_buf + string_alloc_size);
-
-    // fill collection
-    ch_col->lookup = NULL;
+    ch_dc_header* ch_head = (ch_dc_header*)collection_out->arr;
+    ch_dc_datamap* ch_dms = (ch_dc_datamap*)(collection_out->arr + dms_off);
+    ch_dc_type_description* ch_tds = (ch_dc_type_description*)(collection_out->arr + tds_off);
+    uint32_t* ch_mph_disps = (uint32_t*)(collection_out->arr + mph_disps_off);
+    ch_dc_mph_slot* ch_mph_slots = (ch_dc_mph_slot*)(collection_out->arr + mph_slots_off);
+    char* string_buf = collection_out->arr + strs_off;
 
     // fill strings
-    ch_hashmap_entry* entry = NULL;
+    void* item;
     size_t bucket = 0;
-    while (hashmap_iter(hm_unique_strs, &bucket, &entry))
+    while (hashmap_iter(hm_unique_strs, &bucket, &item)) {
+        const ch_hashmap_entry* entry = item;
         memcpy(string_buf + entry->offset, entry->name.ptr, entry->name.size);
+    }
 
 #ifndef NDEBUG
     // check that string section is filled (at most one '\0' char between consecutive strings)
-    for (const char* s = string_buf; s < (char*)ch_linked_names - 2; s++)
-        assert(*(uint16_t*)s != 0);
+    for (const char* s = string_buf; s < string_buf + string_alloc_size - 2; s++)
+        assert(s[0] || s[1]);
 #endif
 
+    uint64_t game_ops[CH_OP_COUNT];
+    result = ch_find_custom_op_game_ops(ctx, game_ops);
+    if (result)
+        goto end;
+
     // fill maps & type descriptions
-    ch_datamap* ch_dm = ch_dms;
-    ch_type_description* ch_td = ch_tds;
+    ch_dc_datamap* ch_dm = ch_dms;
+    ch_dc_type_description* ch_td = ch_tds;
     for (size_t i = 0; i < n_sorted_maps; i++) {
         msgpack_object_map mp_dm = sorted_maps[i]->o.via.map;
         msgpack_object_array mp_tds = mp_dm.ptr[CH_DM_FIELDS].val.via.array;
         ch_change_datamap_references_to_strings(mp_dm);
-        ch_dm->base_map_rel_off = ch_get_entry_offset(ctx->dm_hashmap, mp_dm.ptr[CH_DM_BASE].val);
-        ch_dm->class_name_rel_off = ch_get_entry_offset(hm_unique_strs, mp_dm.ptr[CH_DM_NAME].val);
-        ch_dm->module_name_rel_off = ch_get_entry_offset(hm_unique_strs, mp_dm.ptr[CH_DM_MODULE].val);
-        ch_dm->fields_rel_off = (size_t)(ch_td - ch_tds);
+        ch_dm->base_map = ch_get_entry_offset(ctx->dm_hashmap, mp_dm.ptr[CH_DM_BASE].val);
+        ch_dm->class_name = ch_get_entry_offset(hm_unique_strs, mp_dm.ptr[CH_DM_NAME].val);
+        ch_dm->module_name = ch_get_entry_offset(hm_unique_strs, mp_dm.ptr[CH_DM_MODULE].val);
+        ch_dm->fields = (uint32_t)(ch_td - ch_tds);
         // packed offset will be relative to class start
         // maps are sorted by dependency order, so base dm will be processed first (if it exists)
-        size_t ch_off = 0;
-        if (ch_dm->base_map_rel_off != CH_REL_OFF_NULL)
-            ch_off = ch_dms[ch_dm->base_map_rel_off].ch_size;
-        size_t n_ch_dm_tds = 0;
+        uint32_t ch_off = 0;
+        ch_dm_layout* dm_layout = &dm_layouts[i];
+        *dm_layout = (ch_dm_layout){.align = 1};
+        if (ch_dm->base_map != CH_DC_NULL) {
+            assert(ch_dm->base_map < i);
+            ch_off = ch_dms[ch_dm->base_map].ch_size;
+            *dm_layout = dm_layouts[ch_dm->base_map];
+        }
+        uint32_t n_ch_dm_tds = 0;
         for (size_t j = 0; j < mp_tds.size; j++) {
             msgpack_object_kv* td_kv = mp_tds.ptr[j].via.map.ptr;
             if (!(td_kv[CH_TD_FLAGS].val.via.u64 & FTYPEDESC_SAVE))
                 continue;
-            n_ch_dm_tds++;
-            ch_td->type = td_kv[CH_TD_TYPE].val.via.u64;
-            ch_td->name_rel_off = ch_get_entry_offset(hm_unique_strs, td_kv[CH_TD_NAME].val);
-            ch_td->external_name_rel_off = ch_get_entry_offset(hm_unique_strs, td_kv[CH_TD_EXTERNAL_NAME].val);
-            ch_td->game_offset = (size_t)td_kv[CH_TD_OFF].val.via.u64;
-            ch_td->ch_offset = ch_off;
-            ch_td->total_size_bytes = (size_t)td_kv[CH_TD_TOTAL_SIZE].val.via.u64;
-            ch_td->flags = (unsigned short)td_kv[CH_TD_FLAGS].val.via.u64;
-            ch_td->n_elems = (unsigned short)td_kv[CH_TD_NUM_ELEMS].val.via.u64;
-            if (td_kv[CH_TD_RESTORE_OPS].val.type == MSGPACK_OBJECT_NIL)
-                ch_td->save_restore_ops_rel_off = CH_REL_OFF_NULL;
-            else
-                ch_td->save_restore_ops_rel_off = (size_t)td_kv[CH_TD_RESTORE_OPS].val.via.u64;
-            ch_td->embedded_map_rel_off = ch_get_entry_offset(ctx->dm_hashmap, td_kv[CH_TD_EMBEDDED].val);
-            if (ch_td->type == FIELD_CUSTOM)
-                ch_off += sizeof(void*);
-            else
-                ch_off += CH_ALIGN_TO(ch_td->total_size_bytes, min(sizeof(void*), ch_td->total_size_bytes));
+            ch_td->type = (uint16_t)td_kv[CH_TD_TYPE].val.via.u64;
+            ch_td->name = ch_get_entry_offset(hm_unique_strs, td_kv[CH_TD_NAME].val);
+            ch_td->external_name = ch_get_entry_offset(hm_unique_strs, td_kv[CH_TD_EXTERNAL_NAME].val);
+            ch_td->game_offset = (uint32_t)td_kv[CH_TD_OFF].val.via.u64;
+            ch_td->total_size_bytes = (uint32_t)td_kv[CH_TD_TOTAL_SIZE].val.via.u64;
+            ch_td->flags = (uint16_t)td_kv[CH_TD_FLAGS].val.via.u64;
+            ch_td->n_elems = (uint16_t)td_kv[CH_TD_NUM_ELEMS].val.via.u64;
+            ch_td->save_restore_ops = ch_get_custom_op_id(game_ops, td_kv[CH_TD_RESTORE_OPS].val);
+            ch_td->embedded_map = ch_get_entry_offset(ctx->dm_hashmap, td_kv[CH_TD_EMBEDDED].val);
+            assert(ch_td->embedded_map == CH_DC_NULL || ch_td->embedded_map < i);
+            ch_field_layout* field_layout = &field_layouts[n_ch_dm_tds++];
+            ch_get_field_layout(ch_td, string_buf + ch_td->name, ch_dms, dm_layouts, field_layout);
+            field_layout->hot &= ctx->collection_save_info->hot_fields_first;
+            dm_layout->align = max(dm_layout->align, field_layout->align);
+            dm_layout->seq_size = (uint32_t)CH_ALIGN_TO(dm_layout->seq_size, field_layout->align);
+            dm_layout->seq_size += field_layout->seq_size;
             ch_td++;
         }
+        ch_off = ch_layout_fields(field_layouts, n_ch_dm_tds, ch_off);
         ch_dm->n_fields = n_ch_dm_tds;
-        if (n_ch_dm_tds == 0)
-            ch_dm->fields_rel_off = CH_REL_OFF_NULL;
-        ch_dm->ch_size = CH_ALIGN_TO(ch_off, sizeof(void*));
+        ch_dm->ch_size = (uint32_t)CH_ALIGN_TO(ch_off, dm_layout->align);
+        dm_layout->seq_size = (uint32_t)CH_ALIGN_TO(dm_layout->seq_size, dm_layout->align);
+        mph_names[i] = string_buf + ch_dm->class_name;
+        mph_name_dms[i] = (uint32_t)i;
         ch_dm++;
     }
 
-    // fill linked names
+    // linked names are only in the perfect hash
     for (uint32_t i = 0; i < ctx->linked_names.size; i++) {
-        ch_linked_names[i].linked_name_rel_off = ch_get_entry_offset(hm_unique_strs, ctx->linked_names.ptr[i].key);
-        ch_linked_names[i].dm_rel_off = ch_get_entry_offset(ctx->dm_hashmap, ctx->linked_names.ptr[i].val);
+        mph_names[n_sorted_maps + i] = string_buf + ch_get_entry_offset(hm_unique_strs, ctx->linked_names.ptr[i].key);
+        mph_name_dms[n_sorted_maps + i] = ch_get_entry_offset(ctx->dm_hashmap, ctx->linked_names.ptr[i].val);
+    }
+    ch_err err = ch_collection_build_mph(mph_names, (uint32_t)n_names, ch_mph_disps, mph_slot_names);
+    if (err) {
+        CH_LOG_ERROR(ctx, "Failed to build the datamap name lookup: %s.", ch_err_strs[err]);
+        result = err == CH_ERR_OUT_OF_MEMORY ? CH_PROCESS_OUT_OF_MEMORY : CH_PROCESS_ERROR;
+        goto end;
+    }
+    for (size_t i = 0; i < n_names; i++) {
+        ch_mph_slots[i].name = (uint32_t)(mph_names[mph_slot_names[i]] - string_buf);
+        ch_mph_slots[i].dm = mph_name_dms[mph_slot_names[i]];
     }
 
+    // the report is the difference from placing every field in declaration order
+    unsigned long long total_saved = 0;
+    for (size_t i = 0; i < n_sorted_maps; i++) {
+        if (dm_layouts[i].seq_size <= ch_dms[i].ch_size)
+            continue;
+        uint32_t saved = dm_layouts[i].seq_size - ch_dms[i].ch_size;
+        total_saved += saved;
+        CH_LOG_INFO(ctx,
+                    "Layout of '%s': %u -> %u bytes (saved %u).\n",
+                    string_buf + ch_dms[i].class_name,
+                    dm_layouts[i].seq_size,
+                    ch_dms[i].ch_size,
+                    saved);
+    }
+    CH_LOG_INFO(ctx, "Field layout saved %llu bytes in total (one instance of each datamap).\n", total_saved);
+
     // consistency checks, check that the expected amount of data was written
     assert((size_t)(ch_dm - ch_dms) == n_sorted_maps);
     assert((size_t)(ch_td - ch_tds) == total_typedescs_to_write);
     assert((void*)ch_dm == (void*)ch_tds);
-    assert((void*)ch_td == (void*)string_buf);
+    assert((void*)ch_td == (void*)ch_mph_disps);
 
     // fill header
-    ch_head->n_datamaps = n_sorted_maps;
-    ch_head->n_linked_names = ctx->linked_names.size;
-    ch_head->dms_rel_off = (size_t)ch_dms - (size_t)collection_out->arr;
-    ch_head->tds_rel_off = (size_t)ch_tds - (size_t)collection_out->arr;
-    ch_head->strs_rel_off = (size_t)string_buf - (size_t)collection_out->arr;
-    ch_head->lnks_rel_off = (size_t)ch_linked_names - (size_t)collection_out->arr;
-    ch_head->version = CH_DATAMAP_STRUCT_VERSION;
     strncpy(ch_head->magic, CH_COLLECTION_FILE_MAGIC, sizeof ch_head->magic);
+    ch_head->version = CH_DATAMAP_STRUCT_VERSION;
+    ch_head->file_size = (uint32_t)collection_out->len;
+    ch_head->n_datamaps = (uint32_t)n_sorted_maps;
+    ch_head->n_tds = (uint32_t)total_typedescs_to_write;
+    ch_head->n_names = (uint32_t)n_names;
+    ch_head->n_mph_buckets = (uint32_t)n_mph_buckets;
+    ch_head->strs_size = (uint32_t)string_alloc_size;
+    ch_head->dms_off = (uint32_t)dms_off;
+    ch_head->tds_off = (uint32_t)tds_off;
+    ch_head->mph_disps_off = (uint32_t)mph_disps_off;
+    ch_head->mph_slots_off = (uint32_t)mph_slots_off;
+    ch_head->strs_off = (uint32_t)strs_off;
 
 end:
+    if (result != CH_PROCESS_OK)
+        ch_free_array(collection_out);
+    free(mph_names);
+    free(mph_name_dms);
+    free(mph_slot_names);
+    free(dm_layouts);
+    free(field_layouts);
     hashmap_free(hm_unique_strs);
     return result;
 }
 
-static ch_process_result ch_write_all_to_file(ch_process_msg_ctx* ctx)
+// writes the datamaps in the format given by the collection info, the dependencies of each map must come before it
+static ch_process_result ch_write_sorted_maps(ch_process_msg_ctx* ctx,
+                                              ch_hashmap_entry** sorted_maps,
+                                              size_t n_datamaps)
 {
-    // TODO add checks here to see if we receieved any data
-    size_t n_datamaps = hashmap_count(ctx->dm_hashmap);
-    if (n_datamaps == 0) {
-        CH_LOG_ERROR(ctx, "Writing to file without any sent datamaps, stopping.");
-        return CH_PROCESS_ERROR;
-    }
-
-    ch_hashmap_entry** sorted_maps = malloc(n_datamaps * sizeof(ch_hashmap_entry*));
-
-    if (!sorted_maps)
-        return CH_PROCESS_OUT_OF_MEMORY;
-
-    size_t map_idx = 0;
-    size_t it = 0;
-    while (hashmap_iter(ctx->dm_hashmap, &it, &sorted_maps[map_idx])) {
-        sorted_maps[map_idx]->n_dependencies = 0;
-        ch_recurse_visit_datamaps(sorted_maps[map_idx]->o, ch_count_maps_cb, &sorted_maps[map_idx]->n_dependencies);
-        sorted_maps[map_idx]->offset = map_idx++;
-    }
-
-    /*
-    * Sort by the number of base/embedded sorted_maps each map has and then by name. This guarantees that all the
-    * dependencies of each map are before it in the list. The only exception would be if there was some circular
-    * dependencies but that would very much go against how datamaps function.
-    */
-    qsort(sorted_maps, n_datamaps, sizeof *sorted_maps, ch_cmp_datamaps);
-
     ch_process_result result = CH_PROCESS_OK;
 
     switch (ctx->collection_save_info->output_type) {
@@ -650,8 +1015,7 @@ static ch_process_result ch_write_all_to_file(ch_process_msg_ctx* ctx)
                              "Failed to write to file '%s', (errno=%d)",
                              ctx->collection_save_info->output_file_path,
                              errno);
-                result = CH_PROCESS_ERROR;
-                goto end;
+                return CH_PROCESS_ERROR;
             }
             CH_LOG_INFO(ctx,
                         "Writing %zu datamaps to '%s'.\n",
@@ -675,8 +1039,8 @@ static ch_process_result ch_write_all_to_file(ch_process_msg_ctx* ctx)
                              "Failed to write to file '%s', (errno=%d)",
                              ctx->collection_save_info->output_file_path,
                              errno);
-                result = CH_PROCESS_ERROR;
-                goto end;
+                ch_free_array(&collection);
+                return CH_PROCESS_ERROR;
             }
             CH_LOG_INFO(ctx,
                         "Writing %zu datamaps to '%s'.\n",
@@ -695,19 +1059,183 @@ static ch_process_result ch_write_all_to_file(ch_process_msg_ctx* ctx)
         default:
             assert(0);
     }
+    return result;
+}
 
-end:
+static ch_process_result ch_write_all_to_file(ch_process_msg_ctx* ctx)
+{
+    // TODO add checks here to see if we receieved any data
+    size_t n_datamaps = hashmap_count(ctx->dm_hashmap);
+    if (n_datamaps == 0) {
+        CH_LOG_ERROR(ctx, "Writing to file without any sent datamaps, stopping.");
+        return CH_PROCESS_ERROR;
+    }
+
+    ch_hashmap_entry** sorted_maps = malloc(n_datamaps * sizeof(ch_hashmap_entry*));
+
+    if (!sorted_maps)
+        return CH_PROCESS_OUT_OF_MEMORY;
+
+    size_t map_idx = 0;
+    size_t it = 0;
+    void* item;
+    while (hashmap_iter(ctx->dm_hashmap, &it, &item)) {
+        sorted_maps[map_idx] = item;
+        sorted_maps[map_idx]->offset = map_idx;
+        map_idx++;
+    }
+
+    /*
+    * Sort by the number of base/embedded sorted_maps each map has and then by module & name. This guarantees that all
+    * the dependencies of each map are before it in the list (even across modules), which the collection format
+    * relies on. The only exception would be if there was some circular
+    * dependencies but that would very much go against how datamaps function.
+    */
+    qsort(sorted_maps, n_datamaps, sizeof *sorted_maps, ch_cmp_datamaps);
+
+    ch_process_result result = ch_write_sorted_maps(ctx, sorted_maps, n_datamaps);
     free(sorted_maps);
     return result;
 }
 
+// the base or embedded map must already be in the hashmap, i.e. it came earlier in the file
+static ch_process_result ch_check_stored_dm_ref(ch_process_msg_ctx* ctx, msgpack_object_str name, msgpack_object ref)
+{
+    if (ref.type == MSGPACK_OBJECT_NIL)
+        return CH_PROCESS_OK;
+    ch_hashmap_entry entry_lookup = {.name = ref.via.str};
+    if (hashmap_get(ctx->dm_hashmap, &entry_lookup))
+        return CH_PROCESS_OK;
+    CH_LOG_ERROR(ctx,
+                 "Datamap '%.*s' references '%.*s' which doesn't come before it.",
+                 name.size,
+                 name.ptr,
+                 ref.via.str.size,
+                 ref.via.str.ptr);
+    return CH_PROCESS_ERROR;
+}
+
+/*
+* The version is checked before the rest of the header since the other keys are allowed to change between versions.
+* Collections from before CH_MSGPACK_MIN_FORMAT_VERSION called the version key chicago_format_version.
+*/
+static ch_process_result ch_check_msgpack_collection_version(ch_process_msg_ctx* ctx, msgpack_object o)
+{
+    static const char old_version_key[] = "chicago_format_version";
+    CH_CHECK_FORMAT(o.type == MSGPACK_OBJECT_MAP);
+    for (uint32_t i = 0; i < o.via.map.size; i++) {
+        const msgpack_object_kv* kv = &o.via.map.ptr[i];
+        if (kv->key.type != MSGPACK_OBJECT_STR)
+            continue;
+        msgpack_object_str key = kv->key.via.str;
+        if (ch_cmp_mp_str(key, ch_mp_str_from(CH_HEADER_VERSION_key)) &&
+            ch_cmp_mp_str(key, ch_mp_str_from(old_version_key)))
+            continue;
+        CH_CHECK_FORMAT(kv->val.type == MSGPACK_OBJECT_POSITIVE_INTEGER);
+        if (kv->val.via.u64 < CH_MSGPACK_MIN_FORMAT_VERSION || kv->val.via.u64 > CH_MSGPACK_FORMAT_VERSION) {
+            CH_LOG_ERROR(ctx,
+                         "Collection has format version %llu, expected %d to %d.",
+                         (unsigned long long)kv->val.via.u64,
+                         CH_MSGPACK_MIN_FORMAT_VERSION,
+                         CH_MSGPACK_FORMAT_VERSION);
+            return CH_PROCESS_ERROR;
+        }
+        return CH_PROCESS_OK;
+    }
+    CH_LOG_ERROR(ctx, "Collection doesn't have a format version.");
+    return CH_PROCESS_ERROR;
+}
+
+/*
+* Collections written with CH_DC_STRUCT_MSGPACK have the datamaps in the same order that ch_write_all_to_file sorts
+* them in, so each datamap is checked & hashed as it's read and the file order is used as is.
+*/
+static ch_process_result ch_process_msgpack_collection(ch_process_msg_ctx* ctx, msgpack_object o)
+{
+    CH_DEFINE_KV_SCHEMA(header_kv_schema,
+                        CH_KV_SINGLE(CH_HEADER_VERSION, MSGPACK_OBJECT_POSITIVE_INTEGER),
+                        CH_KV_SINGLE(CH_HEADER_GAME_NAME, MSGPACK_OBJECT_STR),
+                        CH_KV_SINGLE(CH_HEADER_GAME_VERSION, MSGPACK_OBJECT_STR),
+                        CH_KV_SINGLE(CH_HEADER_DATAMAPS, MSGPACK_OBJECT_ARRAY),
+                        CH_KV_SINGLE(CH_HEADER_LINKED_NAMES, MSGPACK_OBJECT_MAP));
+    CH_CHECK(ch_check_msgpack_collection_version(ctx, o));
+    // the collection file format hasn't changed since the oldest supported version
+    CH_CHECK(ch_check_kv_schema(ctx, o, header_kv_schema));
+
+    const msgpack_object_kv* kv = o.via.map.ptr;
+    msgpack_object_array dms = kv[CH_HEADER_DATAMAPS].val.via.array;
+    if (dms.size == 0) {
+        CH_LOG_ERROR(ctx, "Collection doesn't have any datamaps.");
+        return CH_PROCESS_ERROR;
+    }
+
+    for (uint32_t i = 0; i < dms.size; i++) {
+        CH_CHECK_FORMAT(dms.ptr[i].type == MSGPACK_OBJECT_MAP);
+        CH_CHECK(ch_check_dm_schema(ctx, &dms.ptr[i], true));
+        msgpack_object_map dm = dms.ptr[i].via.map;
+        msgpack_object_str name = dm.ptr[CH_DM_NAME].val.via.str;
+        CH_CHECK(ch_check_stored_dm_ref(ctx, name, dm.ptr[CH_DM_BASE].val));
+        msgpack_object_array fields = dm.ptr[CH_DM_FIELDS].val.via.array;
+        for (uint32_t j = 0; j < fields.size; j++)
+            CH_CHECK(ch_check_stored_dm_ref(ctx, name, fields.ptr[j].via.map.ptr[CH_TD_EMBEDDED].val));
+
+        ch_hashmap_entry entry = {.name = name, .o = dms.ptr[i], .offset = i};
+        if (hashmap_set(ctx->dm_hashmap, &entry)) {
+            CH_LOG_ERROR(ctx, "Collection has more than one datamap called '%.*s'.", name.size, name.ptr);
+            return CH_PROCESS_ERROR;
+        }
+        if (hashmap_oom(ctx->dm_hashmap))
+            return CH_PROCESS_OUT_OF_MEMORY;
+    }
+    if (kv[CH_HEADER_LINKED_NAMES].val.via.map.size > 0)
+        CH_CHECK(ch_verify_linked_names(ctx, kv[CH_HEADER_LINKED_NAMES].val.via.map));
+
+    // the hashmap doesn't move its entries once it's done growing
+    ch_hashmap_entry** sorted_maps = malloc(dms.size * sizeof(ch_hashmap_entry*));
+    if (!sorted_maps)
+        return CH_PROCESS_OUT_OF_MEMORY;
+    for (uint32_t i = 0; i < dms.size; i++) {
+        ch_hashmap_entry entry_lookup = {.name = dms.ptr[i].via.map.ptr[CH_DM_NAME].val.via.str};
+        sorted_maps[i] = (ch_hashmap_entry*)hashmap_get(ctx->dm_hashmap, &entry_lookup);
+    }
+    ch_process_result result = ch_write_sorted_maps(ctx, sorted_maps, dms.size);
+    free(sorted_maps);
+    return result;
+}
+
+bool ch_convert_msgpack_collection(const void* bytes,
+                                   size_t n_bytes,
+                                   const ch_datamap_collection_info* collection_save_info,
+                                   ch_log_level log_level)
+{
+    ch_process_msg_ctx* ctx = ch_msg_ctx_alloc(log_level, MSGPACK_UNPACKER_INIT_BUFFER_SIZE, collection_save_info);
+    if (!ctx)
+        return false;
+    // strings aren't copied so the objects point into the file
+    msgpack_unpacked unp;
+    msgpack_unpacked_init(&unp);
+    size_t off = 0;
+    ch_process_result result;
+    if (msgpack_unpack_next(&unp, bytes, n_bytes, &off) != MSGPACK_UNPACK_SUCCESS || off != n_bytes) {
+        CH_LOG_ERROR(ctx, "Collection isn't a single msgpack object.");
+        result = CH_PROCESS_ERROR;
+    } else {
+        result = ch_process_msgpack_collection(ctx, unp.data);
+        if (result == CH_PROCESS_OUT_OF_MEMORY)
+            CH_LOG_ERROR(ctx, "Out of memory.");
+    }
+    msgpack_unpacked_destroy(&unp);
+    ch_msg_ctx_free(ctx);
+    return result == CH_PROCESS_OK;
+}
+
 // process the msgpack object sent by the payload
-static ch_process_result ch_process_message_pack_msg(ch_process_msg_ctx* ctx, msgpack_object o, bool* save_unpacked)
+static ch_process_result ch_process_message_pack_msg(ch_process_msg_ctx* ctx, msgpack_object o)
 {
     CH_DEFINE_KV_SCHEMA(msg_kv_schema,
                         CH_KV_SINGLE(CH_IPC_TYPE, MSGPACK_OBJECT_POSITIVE_INTEGER),
                         CH_KV_WILD(CH_IPC_DATA));
-    CH_CHECK(ch_check_kv_schema(o, msg_kv_schema));
+    CH_CHECK(ch_check_kv_schema(ctx, o, msg_kv_schema));
 
     const msgpack_object_kv* kv = o.via.map.ptr;
 
@@ -719,8 +1247,22 @@ static ch_process_result ch_process_message_pack_msg(ch_process_msg_ctx* ctx, ms
     }
     switch (msg_type) {
         case CH_MSG_HELLO:
-            CH_CHECK_FORMAT(msg_data.type == MSGPACK_OBJECT_NIL);
-            CH_LOG_INFO(ctx, "Got HELLO message from payload.\n");
+            // payloads from before CH_MSGPACK_FORMAT_VERSION 5 don't send their version
+            CH_CHECK_FORMAT(msg_data.type == MSGPACK_OBJECT_NIL || msg_data.type == MSGPACK_OBJECT_POSITIVE_INTEGER);
+            if (msg_data.type == MSGPACK_OBJECT_NIL)
+                ctx->payload_version = 4;
+            else
+                ctx->payload_version = (uint32_t)min(msg_data.via.u64, UINT32_MAX);
+            if (ctx->payload_version < CH_MSGPACK_MIN_FORMAT_VERSION ||
+                ctx->payload_version > CH_MSGPACK_FORMAT_VERSION) {
+                CH_LOG_ERROR(ctx,
+                             "Payload uses format version %u, expected %d to %d.",
+                             ctx->payload_version,
+                             CH_MSGPACK_MIN_FORMAT_VERSION,
+                             CH_MSGPACK_FORMAT_VERSION);
+                return CH_PROCESS_ERROR;
+            }
+            CH_LOG_INFO(ctx, "Got HELLO message from payload (format version %u).\n", ctx->payload_version);
             ctx->got_hello = true;
             return CH_PROCESS_OK;
         case CH_MSG_GOODBYE:
@@ -735,12 +1277,12 @@ static ch_process_result ch_process_message_pack_msg(ch_process_msg_ctx* ctx, ms
         case CH_MSG_LOG_ERROR:
             CH_CHECK_FORMAT(msg_data.type == MSGPACK_OBJECT_STR);
             CH_LOG_LEVEL(CH_LL_ERROR, ctx, "[payload ERROR] %.*s\n", msg_data.via.str.size, msg_data.via.str.ptr);
-            return CH_PROCESS_FINISHED;
+            // the payload exits right after sending an error
+            return CH_PROCESS_ERROR;
         case CH_MSG_DATAMAP:
             CH_CHECK_FORMAT(msg_data.type == MSGPACK_OBJECT_MAP);
-            CH_CHECK(ch_recurse_visit_datamaps(msg_data, ch_check_dm_schema_cb, NULL));
-            ch_verify_and_hash_dm_cb_udata udata = {.ctx = ctx, .save_unpacked = save_unpacked};
-            CH_CHECK(ch_recurse_visit_datamaps(msg_data, ch_verify_and_hash_dm_cb, &udata));
+            size_t n_dependencies;
+            CH_CHECK(ch_add_received_dm(ctx, msg_data, &n_dependencies));
             CH_LOG_INFO(ctx,
                         "Received datamap %.*s from %.*s.\n",
                         msg_data.via.map.ptr[CH_DM_NAME].val.via.str.size,
@@ -748,64 +1290,58 @@ static ch_process_result ch_process_message_pack_msg(ch_process_msg_ctx* ctx, ms
                         msg_data.via.map.ptr[CH_DM_MODULE].val.via.str.size,
                         msg_data.via.map.ptr[CH_DM_MODULE].val.via.str.ptr);
             return CH_PROCESS_OK;
+        case CH_MSG_DATAMAPS:
+            CH_CHECK_FORMAT(ctx->payload_version >= 5 && msg_data.type == MSGPACK_OBJECT_ARRAY);
+            for (uint32_t i = 0; i < msg_data.via.array.size; i++)
+                CH_CHECK(ch_add_batched_dm(ctx, msg_data.via.array.ptr[i]));
+            CH_LOG_INFO(ctx, "Received %u datamaps.\n", msg_data.via.array.size);
+            return CH_PROCESS_OK;
         case CH_MSG_LINKED_NAME:
             CH_CHECK_FORMAT(msg_data.type == MSGPACK_OBJECT_MAP);
-            CH_LOG_INFO(ctx, "Received %u linked names\n", msg_data.via.map.size);
+            CH_LOG_INFO(ctx, "Received %u linked names.\n", msg_data.via.map.size);
+            CH_CHECK(ch_copy_mp_object(ctx, &msg_data, msg_data));
             CH_CHECK(ch_verify_linked_names(ctx, msg_data.via.map));
-            *save_unpacked = true;
             return CH_PROCESS_OK;
         default:
-            return CH_PROCESS_BAD_FORMAT;
+            CH_LOG_ERROR(ctx, "Received a message with unknown type %d.", msg_type);
+            return CH_PROCESS_ERROR;
     }
 }
 
 // unpack the buffered data into msgpack
-bool ch_msg_ctx_process(ch_process_msg_ctx* ctx)
+ch_msg_process_result ch_msg_ctx_process(ch_process_msg_ctx* ctx)
 {
-    msgpack_unpack_return ret = msgpack_unpacker_next(&ctx->mp_unpacker, &ctx->unpacked_ll->unp);
+    msgpack_unpack_return ret = msgpack_unpacker_next(&ctx->mp_unpacker, &ctx->unp);
     if (ret != MSGPACK_UNPACK_SUCCESS) {
         CH_LOG_ERROR(ctx, "msgpack_unpack failed with return %d.", ret);
-        return false;
+        return CH_MSG_PROCESS_ERROR;
     }
 
 #if 0
     CH_LOG_INFO(ctx, "[exe] recv msg (%zu bytes) ", ctx->msg_len);
-    msgpack_object_print(stdout, ctx->unpacked_ll->unp.data);
+    msgpack_object_print(stdout, ctx->unp.data);
     fprintf(stdout, "\n");
 #endif
 
-    bool save_unpacked = false;
+    ch_process_result result = ch_process_message_pack_msg(ctx, ctx->unp.data);
+    // everything we need from the message has been copied
+    msgpack_unpacked_destroy(&ctx->unp);
 
-    switch (ch_process_message_pack_msg(ctx, ctx->unpacked_ll->unp.data, &save_unpacked)) {
+    switch (result) {
         case CH_PROCESS_OK:
             break;
         case CH_PROCESS_FINISHED:
+            return CH_MSG_PROCESS_FINISHED;
         case CH_PROCESS_ERROR:
-            return false;
-        case CH_PROCESS_BAD_FORMAT:
-            CH_LOG_ERROR(ctx, "Received wrong msgpack format from payload.");
-            return false;
+            return CH_MSG_PROCESS_ERROR;
         case CH_PROCESS_OUT_OF_MEMORY:
             CH_LOG_ERROR(ctx, "Out of memory while processing message from payload.");
-            return false;
+            return CH_MSG_PROCESS_ERROR;
         default:
             assert(0);
-            return false;
-    }
-
-    // save the unpacked object if had a new datamap by adding it the the linked list, otherwise reuse it
-    if (save_unpacked) {
-        ch_mp_unpacked_ll* head = calloc(1, sizeof(ch_mp_unpacked_ll));
-        if (!head) {
-            CH_LOG_ERROR(ctx, "Out of memory.");
-            return false;
-        }
-        head->next = ctx->unpacked_ll;
-        ctx->unpacked_ll = head;
-    } else {
-        msgpack_unpacked_destroy(&ctx->unpacked_ll->unp);
+            return CH_MSG_PROCESS_ERROR;
     }
 
     ctx->msg_len = 0;
-    return true;
+    return CH_MSG_PROCESS_OK;
 }
@@ -18,6 +18,8 @@ typedef struct ch_datamap_collection_info {
     const char* game_name;
     const char* game_version;
     ch_datamap_collection_type output_type;
+    // put the fields that chicago reads the most at the start of each class (only for CH_DC_STRUCT_NAKED)
+    bool hot_fields_first;
 } ch_datamap_collection_info;
 
 struct ch_process_msg_ctx;
@@ -33,9 +35,35 @@ char* ch_msg_ctx_buf(struct ch_process_msg_ctx* ctx);
 size_t ch_msg_ctx_buf_capacity(struct ch_process_msg_ctx* ctx);
 bool ch_msg_ctx_buf_expand(struct ch_process_msg_ctx* ctx);
 void ch_msg_ctx_buf_consumed(struct ch_process_msg_ctx* ctx, size_t n);
+// the bytes that have been received but not processed yet, i.e. the message that will be processed next
+const char* ch_msg_ctx_pending(struct ch_process_msg_ctx* ctx, size_t* n_bytes);
 
-// process data in the internal buffers, return true if we're expecting more messages
-bool ch_msg_ctx_process(struct ch_process_msg_ctx* ctx);
+typedef enum ch_msg_process_result {
+    // expecting more messages
+    CH_MSG_PROCESS_OK,
+    // got goodbye and the collection was written
+    CH_MSG_PROCESS_FINISHED,
+    // the message was malformed or couldn't be processed (the reason has already been logged)
+    CH_MSG_PROCESS_ERROR,
+} ch_msg_process_result;
 
-// do everything - inject the dll into a source game, receive datamaps, and write to file
-void ch_do_inject_and_recv_maps(const ch_datamap_collection_info* collection_save_info, ch_log_level log_level);
+// process the next message in the internal buffers
+ch_msg_process_result ch_msg_ctx_process(struct ch_process_msg_ctx* ctx);
+
+/*
+* Converts a collection that was written with CH_DC_STRUCT_MSGPACK to the output type of the collection info without
+* the game, e.g. to regenerate naked collections with different layout options. The game name & version of the info
+* are only used for msgpack output. Returns true if the output file was written.
+*/
+bool ch_convert_msgpack_collection(const void* bytes,
+                                   size_t n_bytes,
+                                   const ch_datamap_collection_info* collection_save_info,
+                                   ch_log_level log_level);
+
+#ifdef _WIN32
+// do everything - inject the dll into a source game, receive datamaps, and write to file (and record the session to
+// record_path if it isn't NULL, see ch_transport.h)
+bool ch_do_inject_and_recv_maps(const ch_datamap_collection_info* collection_save_info,
+                                ch_log_level log_level,
+                                const char* record_path);
+#endif
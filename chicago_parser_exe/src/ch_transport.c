@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ch_transport.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+static uint32_t ch_read_frame_len(const unsigned char bytes[4])
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+// makes sure the process ctx has room for the whole message so that it can be received in one go
+static bool ch_transport_reserve(ch_transport* tp, struct ch_process_msg_ctx* process_ctx, uint32_t msg_len)
+{
+    if (msg_len > CH_IPC_MAX_MSG_SIZE) {
+        CH_LOG_ERROR(tp, "Received a message of %u bytes, the stream is probably corrupt.", msg_len);
+        return false;
+    }
+    while (ch_msg_ctx_buf_capacity(process_ctx) < msg_len) {
+        if (!ch_msg_ctx_buf_expand(process_ctx)) {
+            CH_LOG_ERROR(tp, "Out of memory (ch_transport_reserve).");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ch_record_msg(FILE* f, const char* msg, size_t msg_len)
+{
+    unsigned char len_bytes[4] = {
+        (unsigned char)msg_len,
+        (unsigned char)(msg_len >> 8),
+        (unsigned char)(msg_len >> 16),
+        (unsigned char)(msg_len >> 24),
+    };
+    return fwrite(len_bytes, sizeof len_bytes, 1, f) == 1 && fwrite(msg, 1, msg_len, f) == msg_len;
+}
+
+bool ch_transport_recv_session(ch_transport* tp,
+                               const ch_datamap_collection_info* collection_save_info,
+                               size_t init_chunk_size,
+                               const char* record_path,
+                               ch_transport_stats* stats)
+{
+    ch_transport_stats tmp_stats;
+    if (!stats)
+        stats = &tmp_stats;
+    memset(stats, 0, sizeof *stats);
+
+    struct ch_process_msg_ctx* process_ctx = ch_msg_ctx_alloc(tp->log_level, init_chunk_size, collection_save_info);
+    if (!process_ctx) {
+        CH_LOG_ERROR(tp, "Out of memory (ch_msg_ctx_alloc).");
+        return false;
+    }
+
+    FILE* record_file = NULL;
+    bool success = true;
+    if (record_path) {
+        record_file = fopen(record_path, "wb");
+        if (!record_file || fwrite(CH_IPC_STREAM_MAGIC, sizeof CH_IPC_STREAM_MAGIC, 1, record_file) != 1) {
+            CH_LOG_ERROR(tp, "Failed to create recording '%s'.", record_path);
+            success = false;
+        }
+    }
+
+    while (success) {
+        ch_transport_result res = tp->recv_msg(tp, process_ctx);
+        if (res == CH_TRANSPORT_CLOSED)
+            CH_LOG_ERROR(tp, "Payload disconnected before sending goodbye message.");
+        if (res != CH_TRANSPORT_OK) {
+            success = false;
+            break;
+        }
+        size_t msg_len;
+        const char* msg = ch_msg_ctx_pending(process_ctx, &msg_len);
+        stats->n_msgs++;
+        stats->n_bytes += msg_len;
+        if (record_file && !ch_record_msg(record_file, msg, msg_len)) {
+            CH_LOG_ERROR(tp, "Failed to write to recording '%s'.", record_path);
+            success = false;
+            break;
+        }
+        ch_msg_process_result process_res = ch_msg_ctx_process(process_ctx);
+        if (process_res == CH_MSG_PROCESS_ERROR)
+            success = false;
+        if (process_res != CH_MSG_PROCESS_OK)
+            break;
+    }
+
+    if (record_file && fclose(record_file) && success) {
+        CH_LOG_ERROR(tp, "Failed to write to recording '%s'.", record_path);
+        success = false;
+    }
+    ch_msg_ctx_free(process_ctx);
+    return success;
+}
+
+void ch_transport_close(ch_transport* tp)
+{
+    if (tp && tp->close)
+        tp->close(tp);
+}
+
+typedef struct ch_replay_transport {
+    ch_transport base;
+    const unsigned char* bytes;
+    size_t n_bytes;
+    size_t off;
+} ch_replay_transport;
+
+static ch_transport_result ch_replay_recv_msg(ch_transport* tp, struct ch_process_msg_ctx* process_ctx)
+{
+    ch_replay_transport* rt = (ch_replay_transport*)tp;
+    size_t remaining = rt->n_bytes - rt->off;
+    if (remaining == 0)
+        return CH_TRANSPORT_CLOSED;
+    if (remaining < 4) {
+        CH_LOG_ERROR(tp, "Recording ends in the middle of a message.");
+        return CH_TRANSPORT_ERROR;
+    }
+    uint32_t msg_len = ch_read_frame_len(rt->bytes + rt->off);
+    if (!ch_transport_reserve(tp, process_ctx, msg_len))
+        return CH_TRANSPORT_ERROR;
+    if (remaining - 4 < msg_len) {
+        CH_LOG_ERROR(tp, "Recording ends in the middle of a message.");
+        return CH_TRANSPORT_ERROR;
+    }
+    memcpy(ch_msg_ctx_buf(process_ctx), rt->bytes + rt->off + 4, msg_len);
+    ch_msg_ctx_buf_consumed(process_ctx, msg_len);
+    rt->off += 4 + msg_len;
+    return CH_TRANSPORT_OK;
+}
+
+static void ch_replay_close(ch_transport* tp)
+{
+    free(tp);
+}
+
+ch_transport* ch_replay_transport_open(const void* bytes, size_t n_bytes, ch_log_level log_level)
+{
+    ch_replay_transport* rt = calloc(1, sizeof *rt);
+    if (!rt)
+        return NULL;
+    rt->base = (ch_transport){
+        .recv_msg = ch_replay_recv_msg,
+        .close = ch_replay_close,
+        .log_level = log_level,
+    };
+    if (n_bytes < sizeof CH_IPC_STREAM_MAGIC || memcmp(bytes, CH_IPC_STREAM_MAGIC, sizeof CH_IPC_STREAM_MAGIC)) {
+        CH_LOG_ERROR(&rt->base, "Not a chicago IPC recording.");
+        free(rt);
+        return NULL;
+    }
+    rt->bytes = bytes;
+    rt->n_bytes = n_bytes;
+    rt->off = sizeof CH_IPC_STREAM_MAGIC;
+    return &rt->base;
+}
+
+#ifndef _WIN32
+
+typedef struct ch_socket_transport {
+    ch_transport base;
+    int listen_fd;
+    int conn_fd;
+    // set once the socket file has been created by bind so that close can remove it
+    bool bound;
+    char socket_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+} ch_socket_transport;
+
+// removes the file at path if it's a socket, returns false if there's something else there
+static bool ch_unlink_socket_file(const char* path)
+{
+    struct stat st;
+    if (lstat(path, &st))
+        return true;
+    if (!S_ISSOCK(st.st_mode))
+        return false;
+    unlink(path);
+    return true;
+}
+
+// reads exactly n bytes unless the other end closes the connection first, returns the number of bytes read
+static size_t ch_socket_read(ch_socket_transport* st, void* buf, size_t n, bool* failed)
+{
+    size_t n_read = 0;
+    while (n_read < n) {
+        ssize_t ret = recv(st->conn_fd, (char*)buf + n_read, n - n_read, 0);
+        if (ret == 0)
+            break;
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            CH_LOG_ERROR(&st->base, "recv failed: %s", strerror(errno));
+            *failed = true;
+            break;
+        }
+        n_read += (size_t)ret;
+    }
+    return n_read;
+}
+
+static ch_transport_result ch_socket_recv_msg(ch_transport* tp, struct ch_process_msg_ctx* process_ctx)
+{
+    ch_socket_transport* st = (ch_socket_transport*)tp;
+    bool failed = false;
+    unsigned char len_bytes[4];
+    size_t n_read = ch_socket_read(st, len_bytes, sizeof len_bytes, &failed);
+    if (failed)
+        return CH_TRANSPORT_ERROR;
+    if (n_read == 0)
+        return CH_TRANSPORT_CLOSED;
+    if (n_read < sizeof len_bytes) {
+        CH_LOG_ERROR(tp, "Connection closed in the middle of a message.");
+        return CH_TRANSPORT_ERROR;
+    }
+    uint32_t msg_len = ch_read_frame_len(len_bytes);
+    if (!ch_transport_reserve(tp, process_ctx, msg_len))
+        return CH_TRANSPORT_ERROR;
+    n_read = ch_socket_read(st, ch_msg_ctx_buf(process_ctx), msg_len, &failed);
+    if (failed)
+        return CH_TRANSPORT_ERROR;
+    if (n_read < msg_len) {
+        CH_LOG_ERROR(tp, "Connection closed in the middle of a message.");
+        return CH_TRANSPORT_ERROR;
+    }
+    ch_msg_ctx_buf_consumed(process_ctx, msg_len);
+    return CH_TRANSPORT_OK;
+}
+
+static void ch_socket_close(ch_transport* tp)
+{
+    ch_socket_transport* st = (ch_socket_transport*)tp;
+    if (st->conn_fd >= 0)
+        close(st->conn_fd);
+    if (st->listen_fd >= 0)
+        close(st->listen_fd);
+    if (st->bound)
+        ch_unlink_socket_file(st->socket_path);
+    free(st);
+}
+
+ch_transport* ch_unix_socket_transport_open(const char* socket_path, ch_log_level log_level)
+{
+    ch_socket_transport* st = calloc(1, sizeof *st);
+    if (!st)
+        return NULL;
+    st->base = (ch_transport){
+        .recv_msg = ch_socket_recv_msg,
+        .close = ch_socket_close,
+        .log_level = log_level,
+    };
+    st->conn_fd = -1;
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof addr.sun_path) {
+        CH_LOG_ERROR(&st->base, "Socket path '%s' is too long.", socket_path);
+        st->listen_fd = -1;
+        ch_socket_close(&st->base);
+        return NULL;
+    }
+    strcpy(addr.sun_path, socket_path);
+    strcpy(st->socket_path, socket_path);
+
+    const char* failed_func = NULL;
+    st->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (st->listen_fd < 0) {
+        failed_func = "socket";
+    } else if (!ch_unlink_socket_file(socket_path)) {
+        // a socket file left behind by a previous run would make bind fail, but anything else is left alone
+        CH_LOG_ERROR(&st->base, "'%s' already exists and isn't a socket.", socket_path);
+        ch_socket_close(&st->base);
+        return NULL;
+    } else if (bind(st->listen_fd, (struct sockaddr*)&addr, sizeof addr)) {
+        failed_func = "bind";
+    } else {
+        st->bound = true;
+        if (listen(st->listen_fd, 1))
+            failed_func = "listen";
+    }
+    if (!failed_func) {
+        CH_LOG_INFO(&st->base, "Waiting for a connection on '%s'.\n", socket_path);
+        st->conn_fd = accept(st->listen_fd, NULL, NULL);
+        if (st->conn_fd < 0)
+            failed_func = "accept";
+    }
+    if (failed_func) {
+        CH_LOG_ERROR(&st->base, "%s failed: %s", failed_func, strerror(errno));
+        ch_socket_close(&st->base);
+        return NULL;
+    }
+
+    bool failed = false;
+    char magic[sizeof CH_IPC_STREAM_MAGIC];
+    if (ch_socket_read(st, magic, sizeof magic, &failed) != sizeof magic ||
+        memcmp(magic, CH_IPC_STREAM_MAGIC, sizeof magic)) {
+        if (!failed)
+            CH_LOG_ERROR(&st->base, "The other end of '%s' isn't sending a chicago IPC stream.", socket_path);
+        ch_socket_close(&st->base);
+        return NULL;
+    }
+    return &st->base;
+}
+
+#endif
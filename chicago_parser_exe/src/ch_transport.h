@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ch_recv.h"
+
+/*
+* Where the messages from the payload come from. The message processing (ch_msg_ctx_*) doesn't care, so it can be
+* driven by the named pipe of an injection session (windows only, see ch_inject.c), by a Unix socket, or by a
+* recording of an earlier session.
+*
+* The stream transports (the Unix socket & recordings) use the same framing: the stream starts with
+* CH_IPC_STREAM_MAGIC and each message is a little-endian uint32 length followed by the msgpack bytes of the message.
+* This means that a recording can be replayed from the file or sent over the socket as is, e.g. with socat.
+*/
+
+#define CH_IPC_STREAM_MAGIC "chicago_ipc"
+// a sanity check for the length of a frame, no message comes anywhere close to this
+#define CH_IPC_MAX_MSG_SIZE (1024 * 1024 * 64)
+#define CH_IPC_MAX_RECORDING_SIZE (1024 * 1024 * 512)
+
+typedef enum ch_transport_result {
+    CH_TRANSPORT_OK,
+    // the other end closed the connection, no partial message was received
+    CH_TRANSPORT_CLOSED,
+    // the error has already been logged
+    CH_TRANSPORT_ERROR,
+} ch_transport_result;
+
+typedef struct ch_transport {
+    // receives the next whole message into the buffer of the process ctx (see ch_msg_ctx_buf)
+    ch_transport_result (*recv_msg)(struct ch_transport* tp, struct ch_process_msg_ctx* process_ctx);
+    // NULL if the transport isn't owned by whoever is receiving from it
+    void (*close)(struct ch_transport* tp);
+    ch_log_level log_level;
+} ch_transport;
+
+typedef struct ch_transport_stats {
+    size_t n_msgs;
+    size_t n_bytes; // without the framing
+} ch_transport_stats;
+
+/*
+* Receives & processes messages until the payload says goodbye (or something goes wrong). If record_path isn't NULL
+* the received messages are also written to it as a framed stream. stats can be NULL. Returns false if the session
+* was cut short by an error in the transport, the recording, or one of the messages (including errors sent by the
+* payload).
+*/
+bool ch_transport_recv_session(ch_transport* tp,
+                               const ch_datamap_collection_info* collection_save_info,
+                               size_t init_chunk_size,
+                               const char* record_path,
+                               ch_transport_stats* stats);
+
+// replays a recorded session from memory, the bytes must outlive the transport
+ch_transport* ch_replay_transport_open(const void* bytes, size_t n_bytes, ch_log_level log_level);
+
+#ifndef _WIN32
+// waits for a single connection on a new Unix socket at socket_path, the socket file is removed when the transport
+// is closed (an existing file at socket_path is only replaced if it's a socket)
+ch_transport* ch_unix_socket_transport_open(const char* socket_path, ch_log_level log_level);
+#endif
+
+void ch_transport_close(ch_transport* tp);
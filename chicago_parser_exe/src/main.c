@@ -1,60 +1,1269 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
+#include <time.h>
+
 #include "ch_recv.h"
+#include "ch_transport.h"
 #include "ch_save.h"
 #include "ch_archive.h"
-#include "custom_restore/registration/ch_reg.h"
+#include "analysis/ch_query.h"
+#include "analysis/ch_collection_diff.h"
+#include "analysis/ch_diff.h"
+#include "analysis/ch_spatial.h"
+#include "analysis/ch_ent_refs.h"
+#include "analysis/ch_io_graph.h"
+#include "analysis/ch_timeline.h"
+#include "export/ch_export.h"
+#include "store/ch_store.h"
+#include "ch_embedded_collections.h"
+#include "ch_pattern_scan.h"
+#include "ch_memmem.h"
 
-int main(void)
+static void ch_print_query_matches(const ch_query_match* matches, size_t n_matches)
 {
-    ch_datamap_collection_info collection_save_info = {
-        .output_file_path = "datamaps.chic",
-        .game_name = "Portal 1",
-        .game_version = "5135",
-        .output_type = CH_DC_STRUCT_NAKED,
-    };
-    (void)collection_save_info;
-
-    // ch_do_inject_and_recv_maps(&collection_save_info, CH_LL_INFO);
-    // return;
-
-    ch_byte_array ba_col;
-    ch_archive_result res = ch_load_file("datamaps.chic", &ba_col, CH_COLLECTION_FILE_MAX_SIZE);
-    assert(res == CH_ARCH_OK);
-    ch_datamap_collection_header* header;
-    res = ch_verify_and_fixup_collection_pointers(ba_col, &header);
-    assert(res == CH_ARCH_OK);
-    ch_datamap_collection col;
-    res = ch_create_collection_lookup(header, &col);
-    assert(res == CH_ARCH_OK);
-    res = ch_register_all(header, &col);
-    assert(res == CH_ERR_NONE);
+    for (size_t i = 0; i < n_matches; i++) {
+        const ch_restored_entity* ent = matches[i].ent;
+        printf("%s [%zu] %s (%s)\n",
+               matches[i].sf->name,
+               matches[i].ent_idx,
+               ent->classname ? ent->classname : "<null>",
+               ent->class_info.dm->class_name);
+    }
+    printf("%zu match%s\n", n_matches, n_matches == 1 ? "" : "es");
+}
 
+/*
+* chicago query <save file> [query]...
+* Runs each query on the save, or reads queries from stdin (one per line) if none are given.
+*/
+static int ch_query_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    if (argc < 1) {
+        fprintf(stderr, "usage: chicago query <save file> [query]...\n");
+        return 1;
+    }
+    ch_byte_array ba_save;
+    if (ch_load_file(argv[0], &ba_save, CH_SAVE_FILE_MAX_SIZE) != CH_ARCH_OK) {
+        fprintf(stderr, "Failed to load '%s'\n", argv[0]);
+        return 1;
+    }
     ch_parsed_save_data* save_data = ch_parsed_save_new();
     assert(save_data);
+    ch_parse_info info = {
+        .datamap_collection = col,
+        .bytes = ba_save.arr,
+        .n_bytes = ba_save.len,
+    };
+    ch_err err = ch_parse_save_bytes(save_data, &info);
+    ch_query_ctx* ctx = NULL;
+    if (!err)
+        err = ch_query_ctx_new(save_data, &ctx);
+    if (err) {
+        fprintf(stderr, "Parsing failed with error: %s\n", ch_err_strs[err]);
+    } else {
+        const ch_query_match* matches;
+        size_t n_matches;
+        if (argc > 1) {
+            for (int i = 1; i < argc && !err; i++) {
+                err = ch_query_run(ctx, argv[i], &matches, &n_matches);
+                if (!err)
+                    ch_print_query_matches(matches, n_matches);
+            }
+            if (err)
+                fprintf(stderr, "Query failed with error: %s\n", ch_err_strs[err]);
+        } else {
+            char line[1024];
+            while (fgets(line, sizeof line, stdin)) {
+                line[strcspn(line, "\r\n")] = '\0';
+                ch_err query_err = ch_query_run(ctx, line, &matches, &n_matches);
+                if (query_err)
+                    fprintf(stderr, "Query failed with error: %s\n", ch_err_strs[query_err]);
+                else
+                    ch_print_query_matches(matches, n_matches);
+            }
+        }
+    }
+    ch_query_ctx_free(ctx);
+    ch_parsed_save_free(save_data);
+    free(ba_save.arr);
+    return err ? 1 : 0;
+}
+
+/*
+* chicago <save file> [<output file>]
+* Parses the save and dumps it as text (to test.txt by default).
+*/
+static int ch_dump_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    if (argc < 1 || argc > 2) {
+        fprintf(stderr, "usage: chicago <save file> [<output file>]\n");
+        return 1;
+    }
     ch_byte_array ba_save;
-    ch_load_file("G:/Games/portal/Portal Source/portal/SAVE/quick.sav", &ba_save, CH_SAVE_FILE_MAX_SIZE);
+    if (ch_load_file(argv[0], &ba_save, CH_SAVE_FILE_MAX_SIZE) != CH_ARCH_OK) {
+        fprintf(stderr, "Failed to load '%s'\n", argv[0]);
+        return 1;
+    }
+    ch_parsed_save_data* save_data = ch_parsed_save_new();
+    assert(save_data);
     ch_parse_info info = {
-        .datamap_collection = &col,
+        .datamap_collection = col,
         .bytes = ba_save.arr,
         .n_bytes = ba_save.len,
     };
     ch_err err = ch_parse_save_bytes(save_data, &info);
+    bool ok = !err;
     if (err)
-        printf("Parsing failed with error: %s\n", ch_err_strs[err]);
+        fprintf(stderr, "Parsing failed with error: %s\n", ch_err_strs[err]);
     else
         printf("Test result: %.4s\n", save_data->tag.id);
 
-    FILE* f = fopen("test.txt", "w");
-    err = ch_dump_sav_to_text(f, save_data, "  ", 0);
-    assert(!err);
-    fclose(f);
+    // a partially parsed save is still dumped
+    const char* out_path = argc > 1 ? argv[1] : "test.txt";
+    FILE* f = fopen(out_path, "w");
+    if (f) {
+        err = ch_dump_sav_to_text(f, save_data, "  ", 0);
+        fclose(f);
+        if (err) {
+            fprintf(stderr, "Dumping failed with error: %s\n", ch_err_strs[err]);
+            ok = false;
+        }
+    } else {
+        fprintf(stderr, "Failed to open '%s'\n", out_path);
+        ok = false;
+    }
     ch_parsed_save_free(save_data);
-
-    hashmap_free(col.lookup);
-    free(ba_col.arr);
     free(ba_save.arr);
+    return ok ? 0 : 1;
+}
+
+// the save's bytes are kept around since the parsed data can point into them
+typedef struct ch_loaded_save {
+    ch_byte_array bytes;
+    ch_parsed_save_data* data;
+} ch_loaded_save;
+
+static void ch_loaded_save_free(ch_loaded_save* save)
+{
+    if (save->data)
+        ch_parsed_save_free(save->data);
+    free(save->bytes.arr);
+    memset(save, 0, sizeof *save);
+}
+
+// loads & parses the save, prints why if either fails
+static bool ch_load_save(const ch_datamap_collection* col, const char* path, ch_loaded_save* save)
+{
+    memset(save, 0, sizeof *save);
+    if (ch_load_file(path, &save->bytes, CH_SAVE_FILE_MAX_SIZE) != CH_ARCH_OK) {
+        fprintf(stderr, "Failed to load '%s'\n", path);
+        return false;
+    }
+    save->data = ch_parsed_save_new();
+    assert(save->data);
+    ch_parse_info info = {
+        .datamap_collection = col,
+        .bytes = save->bytes.arr,
+        .n_bytes = save->bytes.len,
+    };
+    ch_err err = ch_parse_save_bytes(save->data, &info);
+    if (err) {
+        fprintf(stderr, "Parsing '%s' failed with error: %s\n", path, ch_err_strs[err]);
+        ch_loaded_save_free(save);
+        return false;
+    }
+    return true;
+}
+
+/*
+* chicago export [--sqlite] <output file> <save file>...
+* Exports the entities of all saves into a single columnar file, or appends them to an SQLite database (see
+* ch_export.h).
+*/
+static int ch_export_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    bool sqlite = argc >= 1 && !strcmp(argv[0], "--sqlite");
+    if (sqlite) {
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: chicago export [--sqlite] <output file> <save file>...\n");
+        return 1;
+    }
+#ifndef CH_HAVE_SQLITE
+    if (sqlite) {
+        fprintf(stderr, "chicago was built without the SQLite export\n");
+        return 1;
+    }
+#endif
+    const char* out_path = argv[0];
+    size_t n_saves = (size_t)argc - 1;
+    ch_loaded_save* saves = calloc(n_saves, sizeof *saves);
+    const ch_parsed_save_data** save_datas = calloc(n_saves, sizeof *save_datas);
+    assert(saves && save_datas);
+    bool ok = true;
+    for (size_t i = 0; i < n_saves && ok; i++) {
+        ok = ch_load_save(col, argv[i + 1], &saves[i]);
+        save_datas[i] = saves[i].data;
+    }
+    if (ok) {
+        ch_err err;
+#ifdef CH_HAVE_SQLITE
+        if (sqlite) {
+            // the save file paths are the names
+            err = ch_export_sqlite(out_path, save_datas, (const char* const*)(argv + 1), n_saves);
+        } else
+#endif
+        {
+            FILE* f = fopen(out_path, "wb");
+            err = f ? ch_export_columnar(f, save_datas, n_saves) : CH_ERR_FILE_IO;
+            if (f && fclose(f) && !err)
+                err = CH_ERR_FILE_IO;
+        }
+        if (err) {
+            fprintf(stderr, "Export failed with error: %s\n", ch_err_strs[err]);
+            ok = false;
+        } else {
+            printf("Exported %zu save%s to '%s'\n", n_saves, n_saves == 1 ? "" : "s", out_path);
+        }
+    }
+    for (size_t i = 0; i < n_saves; i++)
+        ch_loaded_save_free(&saves[i]);
+    free(saves);
+    free(save_datas);
+    return ok ? 0 : 1;
+}
+
+/*
+* chicago diff <save a> <save b> [<output file>]
+* Prints the entities that were added, removed or changed between two saves (to stdout by default).
+*/
+static int ch_diff_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: chicago diff <save a> <save b> [<output file>]\n");
+        return 1;
+    }
+    ch_loaded_save a = {0}, b = {0};
+    if (!ch_load_save(col, argv[0], &a) || !ch_load_save(col, argv[1], &b)) {
+        ch_loaded_save_free(&a);
+        return 1;
+    }
+    ch_save_diff* diff = NULL;
+    ch_err err = ch_diff_saves(a.data, b.data, &diff);
+    if (!err) {
+        FILE* f = argc > 2 ? fopen(argv[2], "w") : stdout;
+        err = f ? ch_dump_save_diff_to_text(f, diff, "  ") : CH_ERR_FILE_IO;
+        if (f && f != stdout && fclose(f) && !err)
+            err = CH_ERR_FILE_IO;
+    }
+    if (err)
+        fprintf(stderr, "Diff failed with error: %s\n", ch_err_strs[err]);
+    ch_save_diff_free(diff);
+    ch_loaded_save_free(&a);
+    ch_loaded_save_free(&b);
+    return err ? 1 : 0;
+}
+
+// reads the store file into the empty store, a file that doesn't exist is fine if must_exist is false
+static bool ch_read_store_file(ch_save_store* store, const char* path, bool must_exist)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        if (must_exist)
+            fprintf(stderr, "Failed to open '%s'\n", path);
+        return !must_exist;
+    }
+    ch_err err = ch_save_store_read(store, f);
+    fclose(f);
+    if (err)
+        fprintf(stderr, "Failed to read the store '%s': %s\n", path, ch_err_strs[err]);
+    return !err;
+}
+
+/*
+* chicago store add <store file> <save file>...
+* chicago store stats <store file>
+* chicago store extract <store file> <save id> <output file>
+* Adds saves to a deduplicated store file (which is created if it doesn't exist), prints how much space the
+* deduplication saves, or rehydrates a save from the store and dumps it as text.
+*/
+static int ch_store_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    bool add = argc >= 3 && !strcmp(argv[0], "add");
+    bool stats = argc == 2 && !strcmp(argv[0], "stats");
+    bool extract = argc == 4 && !strcmp(argv[0], "extract");
+    if (!add && !stats && !extract) {
+        fprintf(stderr,
+                "usage: chicago store add <store file> <save file>...\n"
+                "       chicago store stats <store file>\n"
+                "       chicago store extract <store file> <save id> <output file>\n");
+        return 1;
+    }
+    const char* store_path = argv[1];
+    ch_save_store* store = ch_save_store_new();
+    assert(store);
+    bool ok = ch_read_store_file(store, store_path, !add);
+    ch_err err = CH_ERR_NONE;
+
+    if (ok && add) {
+        for (int i = 2; i < argc && !err; i++) {
+            ch_loaded_save save;
+            if (!ch_load_save(col, argv[i], &save)) {
+                ok = false;
+                break;
+            }
+            uint32_t save_id;
+            err = ch_save_store_add(store, save.data, &save_id);
+            if (!err)
+                printf("%s: save %u\n", argv[i], save_id);
+            ch_loaded_save_free(&save);
+        }
+        if (ok && !err) {
+            FILE* f = fopen(store_path, "wb");
+            err = f ? ch_save_store_write(store, f) : CH_ERR_FILE_IO;
+            if (f && fclose(f) && !err)
+                err = CH_ERR_FILE_IO;
+        }
+    }
+
+    if (ok && !err && (add || stats)) {
+        ch_save_store_stats st;
+        ch_save_store_get_stats(store, &st);
+        printf("%zu saves, %zu datamaps, %zu unique records (%zu bytes) out of %zu (%zu bytes)\n",
+               st.n_saves,
+               st.n_datamaps,
+               st.n_records,
+               st.record_bytes,
+               st.n_record_refs,
+               st.record_ref_bytes);
+    }
+
+    if (ok && extract) {
+        ch_parsed_save_data* save_data = ch_parsed_save_new();
+        assert(save_data);
+        err = ch_save_store_rehydrate(store, (uint32_t)strtoul(argv[2], NULL, 10), col, save_data);
+        if (!err) {
+            FILE* f = fopen(argv[3], "w");
+            err = f ? ch_dump_sav_to_text(f, save_data, "  ", 0) : CH_ERR_FILE_IO;
+            if (f && fclose(f) && !err)
+                err = CH_ERR_FILE_IO;
+        }
+        ch_parsed_save_free(save_data);
+    }
+
+    if (err)
+        fprintf(stderr, "Store failed with error: %s\n", ch_err_strs[err]);
+    ch_save_store_free(store);
+    return ok && !err ? 0 : 1;
+}
+
+// removes [--state-file <name>] from the end of the args
+static void ch_parse_state_file_arg(int* argc, char** argv, const char** sf_name)
+{
+    *sf_name = NULL;
+    if (*argc >= 2 && !strcmp(argv[*argc - 2], "--state-file")) {
+        *sf_name = argv[*argc - 1];
+        *argc -= 2;
+    }
+}
+
+// the state file with the given name, or the first one with entities (the current map) if name is NULL
+static const ch_state_file* ch_find_state_file(const ch_parsed_save_data* save_data, const char* name)
+{
+    for (size_t i = 0; i < save_data->n_state_files; i++) {
+        const ch_state_file* sf = &save_data->state_files[i];
+        if (name ? !strcmp(sf->name, name) : !!ch_sf_get_block_entities(sf))
+            return sf;
+    }
+    if (name)
+        fprintf(stderr, "The save has no state file called '%s'\n", name);
+    else
+        fprintf(stderr, "The save has no state files with entities\n");
+    return NULL;
+}
+
+static void ch_print_entity(size_t ent_idx, const ch_restored_entity* ent)
+{
+    printf("[%zu] %s (%s)",
+           ent_idx,
+           ent && ent->classname ? ent->classname : "<null>",
+           ent && ent->class_info.dm ? ent->class_info.dm->class_name : "not restored");
+}
+
+static bool ch_parse_floats(char** args, float* out, int n)
+{
+    for (int i = 0; i < n; i++) {
+        char* end;
+        out[i] = strtof(args[i], &end);
+        if (end == args[i] || *end)
+            return false;
+    }
+    return true;
+}
+
+/*
+* chicago spatial <save file> box <x0> <y0> <z0> <x1> <y1> <z1> [--state-file <name>]
+* chicago spatial <save file> sphere <x> <y> <z> <radius> [--state-file <name>]
+* chicago spatial <save file> nearest <x> <y> <z> <k> [--state-file <name>]
+* Finds the entities by their origin in the current map (or the given state file).
+*/
+static int ch_spatial_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    const char* sf_name;
+    ch_parse_state_file_arg(&argc, argv, &sf_name);
+    float args[6];
+    bool box = argc == 8 && !strcmp(argv[1], "box") && ch_parse_floats(argv + 2, args, 6);
+    bool sphere = argc == 6 && !strcmp(argv[1], "sphere") && ch_parse_floats(argv + 2, args, 4) && args[3] >= 0;
+    bool nearest = argc == 6 && !strcmp(argv[1], "nearest") && ch_parse_floats(argv + 2, args, 3) && atoi(argv[5]) > 0;
+    if (!box && !sphere && !nearest) {
+        fprintf(stderr,
+                "usage: chicago spatial <save file> box <x0> <y0> <z0> <x1> <y1> <z1> [--state-file <name>]\n"
+                "       chicago spatial <save file> sphere <x> <y> <z> <radius> [--state-file <name>]\n"
+                "       chicago spatial <save file> nearest <x> <y> <z> <k> [--state-file <name>]\n");
+        return 1;
+    }
+    ch_loaded_save save;
+    if (!ch_load_save(col, argv[0], &save))
+        return 1;
+    const ch_state_file* sf = ch_find_state_file(save.data, sf_name);
+    ch_spatial_index* index = NULL;
+    ch_err err = sf ? ch_spatial_index_new(sf, NULL, &index) : CH_ERR_NONE;
+    if (sf && !err) {
+        const ch_spatial_ent* const* results;
+        size_t n_results;
+        if (box)
+            err = ch_spatial_query_box(index, args, args + 3, &results, &n_results);
+        else if (sphere)
+            err = ch_spatial_query_sphere(index, args, args[3], &results, &n_results);
+        else
+            err = ch_spatial_query_nearest(index, args, (size_t)atoi(argv[5]), &results, &n_results);
+        for (size_t i = 0; !err && i < n_results; i++) {
+            ch_print_entity(results[i]->ent_idx, results[i]->ent);
+            printf(" at [%g, %g, %g]\n", results[i]->pos[0], results[i]->pos[1], results[i]->pos[2]);
+        }
+        if (!err)
+            printf("%zu match%s\n", n_results, n_results == 1 ? "" : "es");
+    }
+    if (err)
+        fprintf(stderr, "Spatial query failed with error: %s\n", ch_err_strs[err]);
+    ch_spatial_index_free(index);
+    ch_loaded_save_free(&save);
+    return sf && !err ? 0 : 1;
+}
+
+static void ch_print_ent_refs(const ch_ent_ref* refs, size_t n_refs)
+{
+    for (size_t i = 0; i < n_refs; i++) {
+        printf("  ");
+        ch_print_entity(refs[i].from_idx, refs[i].from);
+        printf(" %s -> ", refs[i].field_name);
+        ch_print_entity(refs[i].to_idx, refs[i].to);
+        printf("\n");
+    }
+}
+
+/*
+* chicago refs <save file> [<entity index>] [--state-file <name>]
+* Prints the EHANDLE references between the entities of the current map (or the given state file), or only the ones
+* from & to the given entity.
+*/
+static int ch_refs_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    const char* sf_name;
+    ch_parse_state_file_arg(&argc, argv, &sf_name);
+    char* end = NULL;
+    size_t ent_idx = argc == 2 ? strtoul(argv[1], &end, 10) : SIZE_MAX;
+    if ((argc != 1 && argc != 2) || (end && (end == argv[1] || *end))) {
+        fprintf(stderr, "usage: chicago refs <save file> [<entity index>] [--state-file <name>]\n");
+        return 1;
+    }
+    ch_loaded_save save;
+    if (!ch_load_save(col, argv[0], &save))
+        return 1;
+    const ch_state_file* sf = ch_find_state_file(save.data, sf_name);
+    ch_ent_refs* refs = NULL;
+    ch_err err = sf ? ch_ent_refs_new(sf, &refs) : CH_ERR_NONE;
+    if (sf && !err) {
+        const ch_block_entities* block = ch_sf_get_block_entities(sf);
+        size_t n_ents = block ? block->entity_table.n_elems : 0;
+        const ch_ent_ref* ent_refs;
+        size_t n_ent_refs;
+        if (ent_idx == SIZE_MAX) {
+            printf("%zu reference%s:\n", ch_ent_refs_count(refs), ch_ent_refs_count(refs) == 1 ? "" : "s");
+            for (size_t i = 0; i < n_ents; i++) {
+                ch_ent_refs_get_outgoing(refs, i, &ent_refs, &n_ent_refs);
+                ch_print_ent_refs(ent_refs, n_ent_refs);
+            }
+        } else if (ent_idx < n_ents) {
+            ch_ent_refs_get_outgoing(refs, ent_idx, &ent_refs, &n_ent_refs);
+            printf("%zu outgoing:\n", n_ent_refs);
+            ch_print_ent_refs(ent_refs, n_ent_refs);
+            ch_ent_refs_get_incoming(refs, ent_idx, &ent_refs, &n_ent_refs);
+            printf("%zu incoming:\n", n_ent_refs);
+            ch_print_ent_refs(ent_refs, n_ent_refs);
+        } else {
+            fprintf(stderr, "The state file only has %zu entities\n", n_ents);
+            sf = NULL;
+        }
+    }
+    if (err)
+        fprintf(stderr, "Resolving the references failed with error: %s\n", ch_err_strs[err]);
+    ch_ent_refs_free(refs);
+    ch_loaded_save_free(&save);
+    return sf && !err ? 0 : 1;
+}
+
+static void ch_print_io_edge(const ch_block_entities* block, const ch_io_edge* edge)
+{
+    ch_print_entity(edge->from_idx, block->entities[edge->from_idx]);
+    printf(" %s -> %s, %s, \"%s\", delay %g, times %d:",
+           edge->output_name,
+           edge->target ? edge->target : "",
+           edge->input ? edge->input : "",
+           edge->parameter ? edge->parameter : "",
+           edge->delay,
+           edge->times_to_fire);
+    if (edge->n_targets == 0)
+        printf(" unresolved");
+    for (size_t i = 0; i < edge->n_targets; i++) {
+        printf(i == 0 ? " " : ", ");
+        ch_print_entity(edge->target_idxs[i], block->entities[edge->target_idxs[i]]);
+    }
+    printf("\n");
+}
+
+/*
+* chicago io <save file> <entity index> [<output name> [<max depth>]] [--state-file <name>]
+* Prints the outputs & inputs of an entity in the current map (or the given state file). With an output name (* for
+* all outputs) prints everything that fires when that output fires instead, up to max depth outputs deep.
+*/
+static int ch_io_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    const char* sf_name;
+    ch_parse_state_file_arg(&argc, argv, &sf_name);
+    char* end = NULL;
+    size_t ent_idx = argc >= 2 ? strtoul(argv[1], &end, 10) : 0;
+    bool bad_args = !end || end == argv[1] || *end;
+    size_t max_depth = SIZE_MAX;
+    if (argc == 4) {
+        max_depth = strtoul(argv[3], &end, 10);
+        bad_args |= end == argv[3] || *end;
+    }
+    if (argc < 2 || argc > 4 || bad_args) {
+        fprintf(stderr,
+                "usage: chicago io <save file> <entity index> [<output name> [<max depth>]] [--state-file <name>]\n");
+        return 1;
+    }
+    ch_loaded_save save;
+    if (!ch_load_save(col, argv[0], &save))
+        return 1;
+    const ch_state_file* sf = ch_find_state_file(save.data, sf_name);
+    ch_io_graph* graph = NULL;
+    ch_err err = sf ? ch_io_graph_new(sf, &graph) : CH_ERR_NONE;
+    if (sf && !err) {
+        const ch_block_entities* block = ch_sf_get_block_entities(sf);
+        size_t n_ents = block ? block->entity_table.n_elems : 0;
+        if (ent_idx >= n_ents) {
+            fprintf(stderr, "The state file only has %zu entities\n", n_ents);
+            sf = NULL;
+        } else if (argc == 2) {
+            const ch_io_edge* outputs;
+            size_t n_outputs;
+            ch_io_graph_get_outputs(graph, ent_idx, &outputs, &n_outputs);
+            printf("%zu output%s:\n", n_outputs, n_outputs == 1 ? "" : "s");
+            for (size_t i = 0; i < n_outputs; i++) {
+                printf("  ");
+                ch_print_io_edge(block, &outputs[i]);
+            }
+            const ch_io_edge* const* inputs;
+            size_t n_inputs;
+            ch_io_graph_get_inputs(graph, ent_idx, &inputs, &n_inputs);
+            printf("%zu input%s:\n", n_inputs, n_inputs == 1 ? "" : "s");
+            for (size_t i = 0; i < n_inputs; i++) {
+                printf("  ");
+                ch_print_io_edge(block, inputs[i]);
+            }
+        } else {
+            const ch_io_step* steps;
+            size_t n_steps;
+            err = ch_io_graph_traverse(graph,
+                                       ent_idx,
+                                       strcmp(argv[2], "*") ? argv[2] : NULL,
+                                       max_depth,
+                                       &steps,
+                                       &n_steps);
+            for (size_t i = 0; !err && i < n_steps; i++) {
+                printf("%*s+%gs ", (int)(2 * steps[i].depth), "", steps[i].delay);
+                ch_print_io_edge(block, steps[i].edge);
+            }
+            if (!err)
+                printf("%zu action%s\n", n_steps, n_steps == 1 ? "" : "s");
+        }
+    }
+    if (err)
+        fprintf(stderr, "Building the I/O graph failed with error: %s\n", ch_err_strs[err]);
+    ch_io_graph_free(graph);
+    ch_loaded_save_free(&save);
+    return sf && !err ? 0 : 1;
+}
+
+/*
+* chicago timeline <save file> [<first tick> <n ticks>] [--state-file <name>]
+* Prints the pending thinks & events of the current map (or the given state file) in the order they would happen,
+* optionally only the ones on ticks [first tick, first tick + n ticks).
+*/
+static int ch_timeline_cmd(const ch_datamap_collection* col, int argc, char** argv)
+{
+    const char* sf_name;
+    ch_parse_state_file_arg(&argc, argv, &sf_name);
+    int32_t ticks[2] = {0};
+    bool bad_args = argc != 1 && argc != 3;
+    for (int i = 0; !bad_args && i < argc - 1; i++) {
+        char* end;
+        ticks[i] = (int32_t)strtol(argv[i + 1], &end, 10);
+        bad_args = end == argv[i + 1] || *end || (i == 1 && ticks[i] < 0);
+    }
+    if (bad_args) {
+        fprintf(stderr, "usage: chicago timeline <save file> [<first tick> <n ticks>] [--state-file <name>]\n");
+        return 1;
+    }
+    ch_loaded_save save;
+    if (!ch_load_save(col, argv[0], &save))
+        return 1;
+    const ch_state_file* sf = ch_find_state_file(save.data, sf_name);
+    ch_timeline* timeline = NULL;
+    ch_err err = sf ? ch_timeline_new(sf, 0, &timeline) : CH_ERR_NONE;
+    if (sf && !err) {
+        const ch_block_entities* block = ch_sf_get_block_entities(sf);
+        const ch_timeline_entry* entries;
+        size_t n_entries;
+        if (argc == 3)
+            ch_timeline_get_ticks(timeline, ticks[0], ticks[1], &entries, &n_entries);
+        else
+            ch_timeline_get_all(timeline, &entries, &n_entries);
+        for (size_t i = 0; i < n_entries; i++) {
+            const ch_timeline_entry* entry = &entries[i];
+            printf("tick %d (%gs) ", entry->tick, entry->time);
+            if (entry->type == CH_TIMELINE_THINK) {
+                printf("think ");
+                ch_print_entity(entry->ent_idx, block->entities[entry->ent_idx]);
+                if (entry->think_context)
+                    printf(" context '%s'", entry->think_context);
+            } else {
+                printf("event %s, %s", entry->target ? entry->target : "", entry->input ? entry->input : "");
+            }
+            printf("\n");
+        }
+        printf("%zu entr%s\n", n_entries, n_entries == 1 ? "y" : "ies");
+    }
+    if (err)
+        fprintf(stderr, "Building the timeline failed with error: %s\n", ch_err_strs[err]);
+    ch_timeline_free(timeline);
+    ch_loaded_save_free(&save);
+    return sf && !err ? 0 : 1;
+}
+
+/*
+* chicago archive list <archive>
+* chicago archive add <archive> <game name> <game version> <collection file>
+* chicago archive detect <archive> <save file>
+*/
+static int ch_archive_cmd(int argc, char** argv)
+{
+    if (argc >= 2 && !strcmp(argv[0], "list")) {
+        const void* data;
+        size_t len;
+        const ch_archive_entry* entries;
+        uint32_t n_entries;
+        ch_archive_result res = ch_map_file(argv[1], &data, &len, CH_ARCHIVE_FILE_MAX_SIZE);
+        if (res == CH_ARCH_OK)
+            res = ch_archive_get_index(data, len, &entries, &n_entries);
+        if (res != CH_ARCH_OK) {
+            fprintf(stderr, "Failed to read archive '%s' (%d)\n", argv[1], res);
+            ch_unmap_file(data, len);
+            return 1;
+        }
+        for (uint32_t i = 0; i < n_entries; i++) {
+            printf("%s %s: %u -> %u bytes\n",
+                   entries[i].game.name,
+                   entries[i].game.version,
+                   entries[i].size,
+                   entries[i].compressed_size);
+        }
+        ch_unmap_file(data, len);
+        return 0;
+    }
+    if (argc >= 5 && !strcmp(argv[0], "add")) {
+        ch_game_info game = {0};
+        if (strlen(argv[2]) >= sizeof game.name || strlen(argv[3]) >= sizeof game.version) {
+            fprintf(stderr, "Game name and version must be shorter than %d characters\n", CH_MAX_GAME_NAME_SIZE);
+            return 1;
+        }
+        strcpy(game.name, argv[2]);
+        strcpy(game.version, argv[3]);
+        ch_byte_array ba_col;
+        ch_archive_result res = ch_load_file(argv[4], &ba_col, CH_COLLECTION_FILE_MAX_SIZE);
+        if (res == CH_ARCH_OK) {
+            res = ch_add_to_ch_archive(argv[1], &game, ba_col);
+            ch_free_array(&ba_col);
+        }
+        if (res != CH_ARCH_OK) {
+            fprintf(stderr, "Failed to add '%s' to '%s' (%d)\n", argv[4], argv[1], res);
+            return 1;
+        }
+        return 0;
+    }
+    if (argc >= 3 && !strcmp(argv[0], "detect")) {
+        const void* data;
+        size_t len;
+        ch_byte_array ba_save;
+        ch_archive_result res = ch_map_file(argv[1], &data, &len, CH_ARCHIVE_FILE_MAX_SIZE);
+        if (res != CH_ARCH_OK) {
+            fprintf(stderr, "Failed to read archive '%s' (%d)\n", argv[1], res);
+            return 1;
+        }
+        res = ch_load_file(argv[2], &ba_save, CH_SAVE_FILE_MAX_SIZE);
+        const ch_archive_entry* entry = NULL;
+        float score = 0.f;
+        uint32_t n_best = 0;
+        ch_game_info game = {0};
+        if (res == CH_ARCH_OK) {
+            res = ch_archive_detect_game(data, len, ba_save.arr, ba_save.len, &entry, &score, &n_best);
+            ch_free_array(&ba_save);
+        }
+        if (res == CH_ARCH_OK)
+            game = entry->game;
+        ch_unmap_file(data, len);
+        if (res != CH_ARCH_OK) {
+            fprintf(stderr, "Failed to detect the game of '%s' (%d)\n", argv[2], res);
+            return 1;
+        }
+        if (n_best > 1) {
+            fprintf(stderr,
+                    "Ambiguous match: %u collections have %.1f%% of the symbols, picked the smallest one\n",
+                    n_best,
+                    score * 100.f);
+        }
+        printf("%s %s (%.1f%% of symbols found)\n", game.name, game.version, score * 100.f);
+        return 0;
+    }
+    fprintf(stderr,
+            "usage: chicago archive list <archive>\n"
+            "       chicago archive add <archive> <game name> <game version> <collection file>\n"
+            "       chicago archive detect <archive> <save file>\n");
+    return 1;
+}
+
+/*
+* chicago convert <msgpack collection> <output file> [--no-hot-fields]
+* Converts a collection written as CH_DC_STRUCT_MSGPACK to a naked collection without running the game.
+*/
+static int ch_convert_cmd(int argc, char** argv)
+{
+    if (argc < 2 || (argc > 2 && strcmp(argv[2], "--no-hot-fields"))) {
+        fprintf(stderr, "usage: chicago convert <msgpack collection> <output file> [--no-hot-fields]\n");
+        return 1;
+    }
+    const void* data;
+    size_t len;
+    if (ch_map_file(argv[0], &data, &len, CH_COLLECTION_FILE_MAX_SIZE) != CH_ARCH_OK) {
+        fprintf(stderr, "Failed to read '%s'\n", argv[0]);
+        return 1;
+    }
+    ch_datamap_collection_info info = {
+        .output_file_path = argv[1],
+        .output_type = CH_DC_STRUCT_NAKED,
+        .hot_fields_first = argc == 2,
+    };
+    bool success = ch_convert_msgpack_collection(data, len, &info, CH_LL_INFO);
+    ch_unmap_file(data, len);
+    return success ? 0 : 1;
+}
+
+/*
+* chicago collection-diff <collection a> <collection b> [--msgpack <output file>]
+* Prints the differences between two .chic collections, or writes them as msgpack.
+*/
+static int ch_collection_diff_cmd(int argc, char** argv)
+{
+    if (argc != 2 && (argc != 4 || strcmp(argv[2], "--msgpack"))) {
+        fprintf(stderr, "usage: chicago collection-diff <collection a> <collection b> [--msgpack <output file>]\n");
+        return 1;
+    }
+    const void* data[2] = {0};
+    size_t len[2] = {0};
+    ch_datamap_collection cols[2];
+    bool opened[2] = {0};
+    ch_err err = CH_ERR_NONE;
+    for (int i = 0; i < 2 && !err; i++) {
+        if (ch_map_file(argv[i], &data[i], &len[i], CH_COLLECTION_FILE_MAX_SIZE) != CH_ARCH_OK)
+            err = CH_ERR_COLLECTION_BAD_FILE;
+        else
+            err = ch_collection_open(data[i], len[i], &cols[i]);
+        if (err)
+            fprintf(stderr, "Failed to open '%s': %s\n", argv[i], ch_err_strs[err]);
+        else
+            opened[i] = true;
+    }
+    ch_collection_diff* diff = NULL;
+    if (!err) {
+        err = ch_diff_collections(&cols[0], &cols[1], &diff);
+        if (!err && argc == 4) {
+            FILE* f = fopen(argv[3], "wb");
+            err = f ? ch_dump_collection_diff_to_msgpack(f, diff) : CH_ERR_FILE_IO;
+            if (f)
+                fclose(f);
+        } else if (!err) {
+            err = ch_dump_collection_diff_to_text(stdout, diff, "  ");
+        }
+        if (err)
+            fprintf(stderr, "Diff failed with error: %s\n", ch_err_strs[err]);
+    }
+    ch_collection_diff_free(diff);
+    for (int i = 0; i < 2; i++) {
+        if (opened[i])
+            ch_collection_free(&cols[i]);
+        ch_unmap_file(data[i], len[i]);
+    }
+    return err ? 1 : 0;
+}
+
+static double ch_seconds_since(const struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+* chicago replay <recording> <output file> [--repeat <n>]
+* Builds a collection from a recorded payload session (see ch_transport.h) without the game. The recording is read
+* into memory first, so the times are only for processing the messages & writing the collection.
+*/
+static int ch_replay_cmd(const ch_datamap_collection_info* save_info, int argc, char** argv)
+{
+    int n_runs = 1;
+    if (argc == 4 && !strcmp(argv[2], "--repeat"))
+        n_runs = atoi(argv[3]);
+    if ((argc != 2 && argc != 4) || n_runs < 1) {
+        fprintf(stderr, "usage: chicago replay <recording> <output file> [--repeat <n>]\n");
+        return 1;
+    }
+    const void* data;
+    size_t len;
+    if (ch_map_file(argv[0], &data, &len, CH_IPC_MAX_RECORDING_SIZE) != CH_ARCH_OK) {
+        fprintf(stderr, "Failed to read '%s'\n", argv[0]);
+        return 1;
+    }
+    ch_datamap_collection_info info = *save_info;
+    info.output_file_path = argv[1];
+    double best = 0.0;
+    bool success = true;
+    for (int i = 0; i < n_runs && success; i++) {
+        // only log everything on the first run, printing would dominate the rest
+        ch_transport* tp = ch_replay_transport_open(data, len, i == 0 ? CH_LL_INFO : CH_LL_ERROR);
+        if (!tp) {
+            success = false;
+            break;
+        }
+        ch_transport_stats stats;
+        struct timespec start;
+        timespec_get(&start, TIME_UTC);
+        success = ch_transport_recv_session(tp, &info, CH_PIPE_INIT_BUF_SIZE, NULL, &stats);
+        double secs = ch_seconds_since(&start);
+        ch_transport_close(tp);
+        if (success) {
+            printf("run %d: %zu messages (%zu bytes) in %.2fms, %.1f MB/s\n",
+                   i + 1,
+                   stats.n_msgs,
+                   stats.n_bytes,
+                   secs * 1e3,
+                   stats.n_bytes / secs / (1024 * 1024));
+            best = i == 0 ? secs : min(best, secs);
+        }
+    }
+    if (success && n_runs > 1)
+        printf("best of %d runs: %.2fms\n", n_runs, best * 1e3);
+    ch_unmap_file(data, len);
+    return success ? 0 : 1;
+}
+
+static uint32_t ch_bench_rand(uint32_t* state)
+{
+    // xorshift32, the benchmark should be the same on every run
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// mostly the common x86 bytes that the scanner avoids as anchors, so the prefilter gets a realistic workout
+static unsigned char ch_bench_code_byte(uint32_t* state)
+{
+    uint32_t r = ch_bench_rand(state);
+    if (r % 8 < 5)
+        return ch_scan_common_bytes[(r >> 8) % (r >> 20 & 1 ? 16 : sizeof ch_scan_common_bytes)];
+    return (unsigned char)(r >> 8);
+}
+
+static bool ch_bench_count_cb(size_t pattern_idx, size_t off, void* user_data)
+{
+    (void)pattern_idx;
+    (void)off;
+    (*(size_t*)user_data)++;
+    return false;
+}
+
+/*
+* chicago bench-scan [<MB>]
+* Compares the pattern scanner against testing every pattern at every byte on a synthetic .text-like buffer, with
+* patterns like the payload's (a quarter of the bytes are wildcards) planted in it. The edge cases are checked by the
+* ch_test_pattern_scan test.
+*/
+static int ch_bench_scan_cmd(int argc, char** argv)
+{
+    size_t n_mb = argc >= 1 ? strtoul(argv[0], NULL, 10) : 16;
+    if (argc > 1 || n_mb == 0) {
+        fprintf(stderr, "usage: chicago bench-scan [<MB>]\n");
+        return 1;
+    }
+    size_t len = n_mb * 1024 * 1024;
+    unsigned char* buf = malloc(len);
+    if (!buf) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    uint32_t state = 0x63686963;
+    for (size_t i = 0; i < len; i++)
+        buf[i] = ch_bench_code_byte(&state);
+
+    enum { PATTERN_LEN = 32 };
+    static unsigned char scratch[CH_SCAN_MAX_PATTERNS][PATTERN_LEN + PATTERN_LEN / 8];
+    ch_pattern patterns[CH_SCAN_MAX_PATTERNS];
+    for (size_t p = 0; p < CH_SCAN_MAX_PATTERNS; p++) {
+        patterns[p] = (ch_pattern){.bytes = scratch[p], .wildmask = scratch[p] + PATTERN_LEN, .len = PATTERN_LEN};
+        unsigned char* planted = buf + ch_bench_rand(&state) % (len - PATTERN_LEN);
+        for (size_t i = 0; i < PATTERN_LEN; i++) {
+            patterns[p].bytes[i] = ch_bench_code_byte(&state);
+            if (ch_bench_rand(&state) % 4 == 0)
+                patterns[p].wildmask[i / 8] |= 1 << (i & 7);
+            else
+                planted[i] = patterns[p].bytes[i];
+        }
+    }
+
+    size_t n_pattern_counts[] = {1, 3, CH_SCAN_MAX_PATTERNS};
+    for (size_t c = 0; c < ARRAYSIZE(n_pattern_counts); c++) {
+        size_t n_patterns = n_pattern_counts[c];
+        struct timespec start;
+        timespec_get(&start, TIME_UTC);
+        size_t n_naive_matches = 0;
+        for (size_t off = 0; off < len; off++)
+            for (size_t p = 0; p < n_patterns; p++)
+                if (patterns[p].len <= len - off && ch_pattern_match_at(buf + off, &patterns[p]))
+                    n_naive_matches++;
+        double naive_secs = ch_seconds_since(&start);
+
+        timespec_get(&start, TIME_UTC);
+        ch_pattern_scanner scanner;
+        if (!ch_pattern_scanner_init(&scanner, patterns, n_patterns)) {
+            fprintf(stderr, "Too many patterns\n");
+            free(buf);
+            return 1;
+        }
+        size_t n_matches = 0;
+        ch_pattern_scan(&scanner, buf, len, ch_bench_count_cb, &n_matches);
+        double secs = ch_seconds_since(&start);
+
+        printf("%2zu patterns: naive %7.1f MB/s, scanner %7.1f MB/s (%.1fx), %zu matches%s\n",
+               n_patterns,
+               n_mb / naive_secs,
+               n_mb / secs,
+               naive_secs / secs,
+               n_matches,
+               n_matches == n_naive_matches ? "" : " (MISMATCH)");
+        if (n_matches != n_naive_matches) {
+            free(buf);
+            return 1;
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+/*
+* chicago bench-memmem [<MB>]
+* Compares ch_memmem_find against a memcmp at every byte on a synthetic .rdata-like buffer (strings & pointers), looking
+* for the same kind of needles as the payload. The edge cases are checked by the ch_test_memmem test.
+*/
+static int ch_bench_memmem_cmd(int argc, char** argv)
+{
+    size_t n_mb = argc >= 1 ? strtoul(argv[0], NULL, 10) : 16;
+    if (argc > 1 || n_mb == 0) {
+        fprintf(stderr, "usage: chicago bench-memmem [<MB>]\n");
+        return 1;
+    }
+    size_t len = n_mb * 1024 * 1024;
+    unsigned char* buf = malloc(len);
+    if (!buf) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    uint32_t state = 0x72646174;
+    const char letters[] = "eeettaaoinnsshrdlcumwfgypbvkjxqz    ";
+    for (size_t i = 0; i < len;) {
+        uint32_t r = ch_bench_rand(&state);
+        if (r % 4 == 0) {
+            // a pointer into the module
+            for (size_t j = 0; j < 4 && i < len; j++, i++)
+                buf[i] = j < 2 ? (unsigned char)(r >> (8 * (j + 1))) : (j == 2 ? 0x5A : 0x10);
+        } else {
+            size_t str_len = 4 + (r >> 8) % 40;
+            for (size_t j = 0; j < str_len && i < len; j++, i++)
+                buf[i] = letters[ch_bench_rand(&state) % (sizeof letters - 1)];
+            if (i < len)
+                buf[i++] = '\0';
+        }
+    }
+
+    // the needles of ch_find_ent_factory, the strings are searched for with their null terminators
+    const char cvar_name[] = "dumpentityfactories";
+    const char cvar_desc[] = "Lists all entity factory names.";
+    uint32_t ptr = 0x105A3C20;
+    struct {
+        const char* name;
+        const void* needle;
+        size_t needle_len;
+    } needles[] = {
+        {"cvar name", cvar_name, sizeof cvar_name},
+        {"cvar description", cvar_desc, sizeof cvar_desc},
+        {"pointer", &ptr, sizeof ptr},
+    };
+    for (size_t i = 0; i < ARRAYSIZE(needles); i++)
+        memcpy(buf + ch_bench_rand(&state) % (len - needles[i].needle_len), needles[i].needle, needles[i].needle_len);
+
+    for (size_t i = 0; i < ARRAYSIZE(needles); i++) {
+        struct timespec start;
+        timespec_get(&start, TIME_UTC);
+        size_t n_naive_matches = 0;
+        for (size_t off = 0; off + needles[i].needle_len <= len; off++)
+            if (!memcmp(buf + off, needles[i].needle, needles[i].needle_len))
+                n_naive_matches++;
+        double naive_secs = ch_seconds_since(&start);
+
+        timespec_get(&start, TIME_UTC);
+        size_t n_matches = 0;
+        ch_memmem_iter it = ch_memmem_iter_init(buf, len, needles[i].needle, needles[i].needle_len);
+        size_t off;
+        while (ch_memmem_next(&it, &off))
+            n_matches++;
+        double secs = ch_seconds_since(&start);
+
+        printf("%-16s naive %7.1f MB/s, memmem %7.1f MB/s (%.1fx), %zu matches%s\n",
+               needles[i].name,
+               n_mb / naive_secs,
+               n_mb / secs,
+               naive_secs / secs,
+               n_matches,
+               n_matches == n_naive_matches ? "" : " (MISMATCH)");
+        if (n_matches != n_naive_matches) {
+            free(buf);
+            return 1;
+        }
+    }
+    free(buf);
     return 0;
 }
+
+// parses [--record <file>] at the end of argv
+static bool ch_parse_record_arg(int argc, char** argv, const char** record_path)
+{
+    *record_path = NULL;
+    if (argc == 0)
+        return true;
+    if (argc != 2 || strcmp(argv[0], "--record"))
+        return false;
+    *record_path = argv[1];
+    return true;
+}
+
+#ifdef _WIN32
+/*
+* chicago inject [--record <file>]
+* Injects the payload into a running game and writes the collection, optionally recording the session for replay.
+*/
+static int ch_inject_cmd(const ch_datamap_collection_info* save_info, int argc, char** argv)
+{
+    const char* record_path;
+    if (!ch_parse_record_arg(argc, argv, &record_path)) {
+        fprintf(stderr, "usage: chicago inject [--record <file>]\n");
+        return 1;
+    }
+    return ch_do_inject_and_recv_maps(save_info, CH_LL_INFO, record_path) ? 0 : 1;
+}
+#else
+/*
+* chicago listen <socket path> [--record <file>]
+* Receives a session over a Unix socket (e.g. a recording sent with socat) and writes the collection.
+*/
+static int ch_listen_cmd(const ch_datamap_collection_info* save_info, int argc, char** argv)
+{
+    const char* record_path;
+    if (argc < 1 || !ch_parse_record_arg(argc - 1, argv + 1, &record_path)) {
+        fprintf(stderr, "usage: chicago listen <socket path> [--record <file>]\n");
+        return 1;
+    }
+    ch_transport* tp = ch_unix_socket_transport_open(argv[0], CH_LL_INFO);
+    if (!tp)
+        return 1;
+    bool success = ch_transport_recv_session(tp, save_info, CH_PIPE_INIT_BUF_SIZE, record_path, NULL);
+    ch_transport_close(tp);
+    return success ? 0 : 1;
+}
+#endif
+
+// where the bytes of the opened collection came from, they must outlive the collection
+typedef struct ch_collection_source {
+    const void* data; // NULL for embedded collections
+    size_t len;
+    bool is_mapped; // otherwise allocated
+} ch_collection_source;
+
+static void ch_collection_source_free(ch_collection_source* src)
+{
+    if (src->is_mapped)
+        ch_unmap_file(src->data, src->len);
+    else
+        free((void*)src->data);
+    memset(src, 0, sizeof *src);
+}
+
+// gets the collection for the game out of the archive (through the per-user cache) and opens it
+static ch_err ch_open_archived_collection(const char* game_name,
+                                          const char* game_version,
+                                          ch_datamap_collection* col,
+                                          ch_collection_source* src)
+{
+    const void* archive;
+    size_t archive_len;
+    const ch_archive_entry* entries;
+    uint32_t n_entries;
+    if (ch_map_file("datamap_collections.cha", &archive, &archive_len, CH_ARCHIVE_FILE_MAX_SIZE) != CH_ARCH_OK)
+        return CH_ERR_COLLECTION_BAD_FILE;
+    ch_archive_result res = ch_archive_get_index(archive, archive_len, &entries, &n_entries);
+    const ch_archive_entry* entry = ch_archive_find(entries, n_entries, game_name, game_version);
+    ch_err err = CH_ERR_COLLECTION_BAD_FILE;
+    // if the cached file doesn't open it's extracted again once, the collection in the archive is the last word
+    for (int attempt = 0; attempt < 2 && res == CH_ARCH_OK && entry && err; attempt++) {
+        res = ch_archive_get_cached(archive,
+                                    archive_len,
+                                    entry,
+                                    NULL,
+                                    attempt > 0,
+                                    &src->data,
+                                    &src->len,
+                                    &src->is_mapped);
+        if (res != CH_ARCH_OK)
+            break;
+        err = ch_collection_open(src->data, src->len, col);
+        bool from_cache = src->is_mapped;
+        if (err)
+            ch_collection_source_free(src);
+        if (!from_cache)
+            break;
+    }
+    ch_unmap_file(archive, archive_len);
+    return err;
+}
+
+/*
+* Uses the first collection compiled into the executable if there are any, otherwise maps datamaps.chic, otherwise
+* gets the collection for the game out of datamap_collections.cha (through the per-user cache).
+*/
+static ch_err ch_open_collection(const char* game_name,
+                                 const char* game_version,
+                                 ch_datamap_collection* col,
+                                 ch_collection_source* src)
+{
+    memset(src, 0, sizeof *src);
+#ifdef CH_HAVE_EMBEDDED_COLLECTIONS
+    if (ch_n_embedded_collections > 0)
+        return ch_collection_open(ch_embedded_collections[0].bytes, ch_embedded_collections[0].n_bytes, col);
+#endif
+    if (ch_map_file("datamaps.chic", &src->data, &src->len, CH_COLLECTION_FILE_MAX_SIZE) != CH_ARCH_OK)
+        return ch_open_archived_collection(game_name, game_version, col, src);
+    src->is_mapped = true;
+    ch_err err = ch_collection_open(src->data, src->len, col);
+    if (err)
+        ch_collection_source_free(src);
+    return err;
+}
+
+int main(int argc, char** argv)
+{
+    ch_datamap_collection_info collection_save_info = {
+        .output_file_path = "datamaps.chic",
+        .game_name = "Portal 1",
+        .game_version = "5135",
+        .output_type = CH_DC_STRUCT_NAKED,
+        .hot_fields_first = true,
+    };
+#ifdef _WIN32
+    if (argc >= 2 && !strcmp(argv[1], "inject"))
+        return ch_inject_cmd(&collection_save_info, argc - 2, argv + 2);
+#else
+    if (argc >= 2 && !strcmp(argv[1], "listen"))
+        return ch_listen_cmd(&collection_save_info, argc - 2, argv + 2);
+#endif
+    if (argc >= 2 && !strcmp(argv[1], "replay"))
+        return ch_replay_cmd(&collection_save_info, argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "bench-scan"))
+        return ch_bench_scan_cmd(argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "bench-memmem"))
+        return ch_bench_memmem_cmd(argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "archive"))
+        return ch_archive_cmd(argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "convert"))
+        return ch_convert_cmd(argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "collection-diff"))
+        return ch_collection_diff_cmd(argc - 2, argv + 2);
+
+    ch_collection_source col_src;
+    ch_datamap_collection col;
+    ch_err col_err =
+        ch_open_collection(collection_save_info.game_name, collection_save_info.game_version, &col, &col_src);
+    if (col_err) {
+        fprintf(stderr, "Failed to open the datamap collection: %s\n", ch_err_strs[col_err]);
+        return 1;
+    }
+
+    int ret;
+    if (argc >= 2 && !strcmp(argv[1], "query"))
+        ret = ch_query_cmd(&col, argc - 2, argv + 2);
+    else if (argc >= 2 && !strcmp(argv[1], "export"))
+        ret = ch_export_cmd(&col, argc - 2, argv + 2);
+    else if (argc >= 2 && !strcmp(argv[1], "diff"))
+        ret = ch_diff_cmd(&col, argc - 2, argv + 2);
+    else if (argc >= 2 && !strcmp(argv[1], "store"))
+        ret = ch_store_cmd(&col, argc - 2, argv + 2);
+    else if (argc >= 2 && !strcmp(argv[1], "spatial"))
+        ret = ch_spatial_cmd(&col, argc - 2, argv + 2);
+    else if (argc >= 2 && !strcmp(argv[1], "refs"))
+        ret = ch_refs_cmd(&col, argc - 2, argv + 2);
+    else if (argc >= 2 && !strcmp(argv[1], "io"))
+        ret = ch_io_cmd(&col, argc - 2, argv + 2);
+    else if (argc >= 2 && !strcmp(argv[1], "timeline"))
+        ret = ch_timeline_cmd(&col, argc - 2, argv + 2);
+    else
+        ret = ch_dump_cmd(&col, argc - 1, argv + 1);
+    ch_collection_free(&col);
+    ch_collection_source_free(&col_src);
+    return ret;
+}
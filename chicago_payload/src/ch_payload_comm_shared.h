@@ -1,7 +1,15 @@
 #pragma once
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#else
+// the exe's message processing doesn't need windows (see ch_transport.h)
+#include <stddef.h>
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(a) (sizeof(a) / sizeof(*(a)))
+#endif
+#endif
 
 #include <stdbool.h>
 
@@ -47,16 +55,21 @@ typedef enum ch_comm_msg_type {
     CH_MSG_LOG_ERROR,
     // we're done and all was successful
     CH_MSG_GOODBYE,
+    // a batch of datamaps which reference other maps by module offset (since CH_MSGPACK_FORMAT_VERSION 5)
+    CH_MSG_DATAMAPS,
 } ch_comm_msg_type;
 
+#ifdef _WIN32
 bool ch_get_required_modules(DWORD proc_id, BYTE* base_addresses[CH_MOD_COUNT]);
+#endif
 
 /*
 * All msgpack data sent from the payload is meant to be somewhat human readable
 * if you were to print it out or debug it. It has the following format:
 * {CH_MSG_TYPE: ch_comm_msg_type, CH_MSG_DATA: ...}
 * 
-* - For hello & goodbye, data is null.
+* - For hello, data is the CH_MSGPACK_FORMAT_VERSION of the payload (null before version 5).
+* - For goodbye, data is null.
 * - For logging, data is a string.
 * - For linked names, data is a key/value dict of associated name -> class name.
 * 
@@ -83,11 +96,17 @@ bool ch_get_required_modules(DWORD proc_id, BYTE* base_addresses[CH_MOD_COUNT]);
 *   CH_MSG_TD_TOL:            float,
 * }
 * 
-* Each datamap is sent in full (all of the embedded & base maps are sent as well).
-* The exe then verifies that datamaps are distinct, then saves the base/embedded
-* in order to verify that all datamaps are distinct. When the datamaps are saved
-* to disk, CH_MSG_DM_BASE & CH_MSG_TD_EMBEDDED fields are instead strings
-* which uniquely reference a datamap that came before.
+* Before version 5, each datamap was sent in its own CH_MSG_DATAMAP message in full
+* (all of the embedded & base maps are sent as well), so common maps like the
+* CBaseEntity tree were sent & checked thousands of times. Now the payload sends
+* each datamap once: the data of CH_MSG_DATAMAPS is a list of datamaps where
+* CH_MSG_DM_BASE & CH_MSG_TD_EMBEDDED are int|nil, the module offset of a datamap
+* in the same module which was sent before (in this message or an earlier one).
+* Many datamaps are batched into each message to avoid a pipe write per datamap.
+*
+* The exe verifies that datamaps with the same name are the same map. When the
+* datamaps are saved to disk, CH_MSG_DM_BASE & CH_MSG_TD_EMBEDDED fields are
+* instead strings which uniquely reference a datamap that came before.
 */
 
 #define CH_MSGPACK_KEYS_BEGIN(group_name) enum { _ch_##group_name##_group_start = __COUNTER__ }
@@ -103,7 +122,9 @@ bool ch_get_required_modules(DWORD proc_id, BYTE* base_addresses[CH_MOD_COUNT]);
 #define CH_KEY_GROUP_COUNT(group_name) _ch_##group_name##_group_end
 
 // update if any changes are made :)
-#define CH_MSGPACK_FORMAT_VERSION 4
+#define CH_MSGPACK_FORMAT_VERSION 5
+// the oldest payload & collection file version the exe can still read
+#define CH_MSGPACK_MIN_FORMAT_VERSION 4
 
 CH_MSGPACK_KEYS_BEGIN(KEYS_IPC_HEADER);
 CH_DEFINE_MSGPACK_KEY(KEYS_IPC_HEADER, CH_IPC_TYPE, "msg_type");
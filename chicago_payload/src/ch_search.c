@@ -114,12 +114,7 @@ void ch_parse_pattern_str(const char* str, ch_pattern* out, unsigned char* scrat
 
 bool ch_pattern_match(ch_ptr mem, ch_mod_sec mod_sec_text, ch_pattern pattern)
 {
-    if (!ch_ptr_in_sec(mem, mod_sec_text, pattern.len))
-        return false;
-    for (size_t i = 0; i < pattern.len; i++)
-        if (pattern.bytes[i] != mem[i] && !(pattern.wildmask[i / 8] & (1 << (i & 7))))
-            return false;
-    return true;
+    return ch_ptr_in_sec(mem, mod_sec_text, pattern.len) && ch_pattern_match_at(mem, &pattern);
 }
 
 int ch_pattern_multi_match(ch_ptr mem, ch_mod_sec mod_sec_text, ch_pattern* patterns, size_t n_patterns)
@@ -138,25 +133,14 @@ int ch_pattern_multi_search(ch_ptr* found_mem,
 {
     if (found_mem)
         *found_mem = NULL;
-    for (ch_ptr mem = mod_sec_text.start; mem < mod_sec_text.start + mod_sec_text.len; mem++) {
-        int i = ch_pattern_multi_match(mem, mod_sec_text, patterns, n_patterns);
-        if (i != CH_MULTI_PATTERN_NOT_FOUND) {
-            if (ensure_unique && mem + 1 < mod_sec_text.start + mod_sec_text.len) {
-                ch_mod_sec dummy_sec = {
-                    .start = mem + 1,
-                    .len = CH_PTR_DIFF(mod_sec_text.start + mod_sec_text.len, mem + 1),
-                };
-                if (ch_pattern_multi_search(NULL, dummy_sec, patterns, n_patterns, false) !=
-                    CH_MULTI_PATTERN_NOT_FOUND) {
-                    return CH_MULTI_PATTERN_DUP;
-                }
-            }
-            if (found_mem)
-                *found_mem = mem;
-            return i;
-        }
-    }
-    return CH_MULTI_PATTERN_NOT_FOUND;
+    ch_pattern_scanner scanner;
+    if (!ch_pattern_scanner_init(&scanner, patterns, n_patterns))
+        return CH_MULTI_PATTERN_TOO_MANY;
+    size_t off;
+    int i = ch_pattern_scan_first(&scanner, mod_sec_text.start, mod_sec_text.len, ensure_unique, &off);
+    if (i >= 0 && found_mem)
+        *found_mem = mod_sec_text.start + off;
+    return i;
 }
 
 void ch_get_module_info(ch_send_ctx* ctx, ch_search_ctx* sc)
@@ -236,10 +220,12 @@ void ch_find_static_inits(ch_send_ctx* ctx, ch_search_ctx* sc)
         ch_ptr mem;
         int search_idx = ch_pattern_multi_search(&mem, sec_text, patterns, ARRAYSIZE(patterns), true);
         if (search_idx < 0) {
-            CH_PAYLOAD_LOG_ERR(ctx,
-                               "failed to find static init caller in %s%s",
-                               mod_name,
-                               search_idx == CH_MULTI_PATTERN_NOT_FOUND ? "" : " (multiple matches)");
+            const char* reason = "";
+            if (search_idx == CH_MULTI_PATTERN_DUP)
+                reason = " (multiple matches)";
+            else if (search_idx == CH_MULTI_PATTERN_TOO_MANY)
+                reason = " (too many patterns)";
+            CH_PAYLOAD_LOG_ERR(ctx, "failed to find static init caller in %s%s", mod_name, reason);
         }
         struct ch_pattern_info* info = &patterns_infos[search_idx];
 
@@ -362,12 +348,8 @@ void ch_iterate_datamaps(ch_send_ctx* ctx,
 
 ch_ptr ch_memmem(ch_ptr haystack, size_t haystack_len, ch_ptr needle, size_t needle_len)
 {
-    if (!haystack || !needle || haystack_len == 0 || needle_len == 0)
-        return NULL;
-    for (ch_ptr h = haystack; haystack_len >= needle_len; ++h, --haystack_len)
-        if (!memcmp(h, needle, needle_len))
-            return h;
-    return NULL;
+    size_t off = ch_memmem_find(haystack, haystack_len, needle, needle_len, 0);
+    return off == CH_MEMMEM_NOT_FOUND ? NULL : haystack + off;
 }
 
 ch_ptr ch_memmem_cb(ch_ptr haystack,
@@ -377,15 +359,10 @@ ch_ptr ch_memmem_cb(ch_ptr haystack,
                     bool (*cb)(ch_ptr match, void* user_data),
                     void* user_data)
 {
-    while (needle_len <= haystack_len) {
-        ch_ptr p = ch_memmem(haystack, haystack_len, needle, needle_len);
-        if (!p)
-            return NULL;
-        if (cb(p, user_data))
-            return p;
-        size_t diff = CH_PTR_DIFF(p, haystack) + 1;
-        haystack += diff;
-        haystack_len -= diff;
-    }
+    ch_memmem_iter it = ch_memmem_iter_init(haystack, haystack_len, needle, needle_len);
+    size_t off;
+    while (ch_memmem_next(&it, &off))
+        if (cb(haystack + off, user_data))
+            return haystack + off;
     return NULL;
 }
@@ -8,6 +8,8 @@
 #include <stdint.h>
 
 #include "ch_payload_comm_shared.h"
+#include "ch_pattern_scan.h"
+#include "ch_memmem.h"
 #include "SDK/datamap.h"
 
 // TODO remove this?
@@ -92,12 +94,6 @@ static const char* const ch_mod_sec_names[CH_SEC_COUNT] = {
     ".rdata",
 };
 
-typedef struct ch_pattern {
-    unsigned char* wildmask;
-    unsigned char* bytes;
-    size_t len;
-} ch_pattern;
-
 // create pattern from string, scratch must have enough space for all data
 void ch_parse_pattern_str(const char* str, ch_pattern* out, unsigned char* scratch, size_t scratch_size);
 
@@ -105,14 +101,19 @@ bool ch_pattern_match(ch_ptr mem, ch_mod_sec mod_sec_text, ch_pattern pattern);
 
 int ch_pattern_multi_match(ch_ptr mem, ch_mod_sec mod_sec_text, ch_pattern* patterns, size_t n_patterns);
 
+/*
+* Finds the first match of any of the patterns in a single pass over the section (see ch_pattern_scan.h). Returns
+* CH_MULTI_PATTERN_TOO_MANY if there are more than CH_SCAN_MAX_PATTERNS patterns.
+*/
 int ch_pattern_multi_search(ch_ptr* found_mem,
                             ch_mod_sec mod_sec_text,
                             ch_pattern* patterns,
                             size_t n_patterns,
                             bool ensure_unique);
 
-#define CH_MULTI_PATTERN_NOT_FOUND -1
-#define CH_MULTI_PATTERN_DUP -2
+#define CH_MULTI_PATTERN_NOT_FOUND CH_SCAN_NOT_FOUND
+#define CH_MULTI_PATTERN_DUP CH_SCAN_DUP
+#define CH_MULTI_PATTERN_TOO_MANY (-3)
 
 // fill the search content, on fail send an error
 void ch_get_module_info(struct ch_send_ctx* ctx, ch_search_ctx* sc);
@@ -142,11 +143,10 @@ ch_ptr ch_memmem_cb(ch_ptr haystack,
 // returns CH_MEM_DUP if there were duplicates
 static ch_ptr ch_memmem_unique(ch_ptr haystack, size_t haystack_len, ch_ptr needle, size_t needle_len)
 {
-    ch_ptr p = ch_memmem(haystack, haystack_len, needle, needle_len);
-    if (!p)
-        return p;
-    ch_ptr p2 = ch_memmem(p + 1, haystack_len - CH_PTR_DIFF(p, haystack) - 1, needle, needle_len);
-    if (p2)
+    size_t off = ch_memmem_find_unique(haystack, haystack_len, needle, needle_len);
+    if (off == CH_MEMMEM_NOT_FOUND)
+        return NULL;
+    if (off == CH_MEMMEM_DUP)
         return CH_MEM_DUP;
-    return p;
+    return haystack + off;
 }
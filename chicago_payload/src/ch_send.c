@@ -33,7 +33,12 @@ int ch_msg_preamble(ch_send_ctx* ctx, ch_comm_msg_type type)
 void ch_send_wave(ch_send_ctx* ctx, ch_comm_msg_type type)
 {
     assert(type == CH_MSG_HELLO || type == CH_MSG_GOODBYE);
-    if (ch_msg_preamble(ctx, type) || msgpack_pack_nil(&ctx->mp_pk))
+    if (ch_msg_preamble(ctx, type))
+        ch_clean_exit(ctx, 1);
+    // the receiver needs to know how to read everything after HELLO
+    int ret = type == CH_MSG_HELLO ? msgpack_pack_int(&ctx->mp_pk, CH_MSGPACK_FORMAT_VERSION)
+                                   : msgpack_pack_nil(&ctx->mp_pk);
+    if (ret)
         ch_clean_exit(ctx, 1);
     ch_send_msgpack(ctx);
 }
@@ -57,30 +62,28 @@ void ch_send_log_info(ch_send_ctx* ctx, const char* fmt, ...)
     va_end(vargs);
 }
 
-static inline int ch_pack_module_offset(ch_send_datamap_cb_udata* info, ch_ptr ptr)
+static inline int ch_pack_module_offset(ch_send_datamap_cb_udata* info, msgpack_packer* pk, ch_ptr ptr)
 {
     if (ptr) {
         size_t off = CH_PTR_DIFF(ptr, info->sc->mods[info->mod_idx].base);
-        return msgpack_pack_uint64(&info->send_ctx->mp_pk, off);
+        return msgpack_pack_uint64(pk, off);
     } else {
-        return msgpack_pack_nil(&info->send_ctx->mp_pk);
+        return msgpack_pack_nil(pk);
     }
 }
 
-static int ch_recurse_pack_dm(ch_send_datamap_cb_udata* info, const datamap_t* dm)
+// base & embedded maps are packed as their module offset, the receiver must already have them
+static int ch_pack_dm(ch_send_datamap_cb_udata* info, msgpack_packer* pk, const datamap_t* dm)
 {
-    msgpack_packer* pk = &info->send_ctx->mp_pk;
-    if (!dm)
-        return msgpack_pack_nil(pk);
     CH_CHK_MP_PACK(map(pk, CH_KEY_GROUP_COUNT(KEYS_DM)));
     CH_CHK_MP_PACK_CSTR(pk, CH_DM_NAME_key);
     CH_CHK_MP_PACK_CSTR(pk, dm->dataClassName);
     CH_CHK_MP_PACK_CSTR(pk, CH_DM_MODULE_key);
     CH_CHK_MP_PACK_CSTR(pk, ch_mod_names[info->mod_idx]);
     CH_CHK_MP_PACK_CSTR(pk, CH_DM_MODULE_OFF_key);
-    CH_CHK(ch_pack_module_offset(info, (ch_ptr)dm));
+    CH_CHK(ch_pack_module_offset(info, pk, (ch_ptr)dm));
     CH_CHK_MP_PACK_CSTR(pk, CH_DM_BASE_key);
-    CH_CHK(ch_recurse_pack_dm(info, dm->baseMap));
+    CH_CHK(ch_pack_module_offset(info, pk, (ch_ptr)dm->baseMap));
 
     CH_CHK_MP_PACK_CSTR(pk, CH_DM_FIELDS_key);
     typedescription_t empty_desc = {0};
@@ -110,11 +113,11 @@ static int ch_recurse_pack_dm(ch_send_datamap_cb_udata* info, const datamap_t* d
             CH_CHK_MP_PACK_CSTR(pk, CH_TD_TOTAL_SIZE_key);
             CH_CHK_MP_PACK(int(pk, desc->fieldSizeInBytes));
             CH_CHK_MP_PACK_CSTR(pk, CH_TD_RESTORE_OPS_key);
-            CH_CHK(ch_pack_module_offset(info, desc->pSaveRestoreOps));
+            CH_CHK(ch_pack_module_offset(info, pk, desc->pSaveRestoreOps));
             CH_CHK_MP_PACK_CSTR(pk, CH_TD_INPUT_FUNC_key);
-            CH_CHK(ch_pack_module_offset(info, desc->inputFunc));
+            CH_CHK(ch_pack_module_offset(info, pk, desc->inputFunc));
             CH_CHK_MP_PACK_CSTR(pk, CH_TD_EMBEDDED_key);
-            CH_CHK(ch_recurse_pack_dm(info, desc->td));
+            CH_CHK(ch_pack_module_offset(info, pk, (ch_ptr)desc->td));
             CH_CHK_MP_PACK_CSTR(pk, CH_TD_OVERRIDE_COUNT_key);
             CH_CHK_MP_PACK(int(pk, desc->override_count));
             CH_CHK_MP_PACK_CSTR(pk, CH_TD_TOL_key);
@@ -124,13 +127,52 @@ static int ch_recurse_pack_dm(ch_send_datamap_cb_udata* info, const datamap_t* d
     return 0;
 }
 
+/*
+* Most datamaps share the same base & embedded maps (e.g. the whole CBaseEntity tree), so each map is only packed the
+* first time we see it. The maps it references are batched before it so that the receiver can look them up by their
+* module offset.
+*/
+static int ch_batch_dm(ch_send_datamap_cb_udata* info, const datamap_t* dm)
+{
+    if (!dm)
+        return 0;
+    ch_send_ctx* ctx = info->send_ctx;
+    // the module offset of a map is relative to the module we found it in, so that's part of the key
+    ch_sent_dm sent = {.dm = dm, .mod_idx = info->mod_idx};
+    if (hashmap_set(ctx->sent_dms, &sent))
+        return 0;
+    if (hashmap_oom(ctx->sent_dms))
+        return -1;
+
+    CH_CHK(ch_batch_dm(info, dm->baseMap));
+    for (int i = 0; i < dm->dataNumFields; i++)
+        CH_CHK(ch_batch_dm(info, dm->dataDesc[i].td));
+
+    CH_CHK(ch_pack_dm(info, &ctx->dm_batch_pk, dm));
+    ctx->n_batched_dms++;
+    if (ctx->dm_batch_buf.size >= CH_DM_BATCH_SIZE)
+        ch_flush_datamaps(ctx);
+    return 0;
+}
+
 void ch_send_datamap_cb(const datamap_t* dm, void* vinfo)
 {
     ch_send_datamap_cb_udata* udata = vinfo;
     // ch_send_log_info(ctx, "Found datamap '%s', %d fields", dm->dataClassName, dm->dataNumFields);
-    if (ch_msg_preamble(udata->send_ctx, CH_MSG_DATAMAP) || ch_recurse_pack_dm(udata, dm))
+    if (ch_batch_dm(udata, dm))
         ch_clean_exit(udata->send_ctx, 1);
-    ch_send_msgpack(udata->send_ctx);
+}
+
+void ch_flush_datamaps(ch_send_ctx* ctx)
+{
+    if (ctx->n_batched_dms == 0)
+        return;
+    if (ch_msg_preamble(ctx, CH_MSG_DATAMAPS) || msgpack_pack_array(&ctx->mp_pk, ctx->n_batched_dms) ||
+        msgpack_sbuffer_write(&ctx->mp_buf, ctx->dm_batch_buf.data, ctx->dm_batch_buf.size))
+        ch_clean_exit(ctx, 1);
+    ch_send_msgpack(ctx);
+    msgpack_sbuffer_clear(&ctx->dm_batch_buf);
+    ctx->n_batched_dms = 0;
 }
 
 void ch_send_err_and_exit(ch_send_ctx* ctx, const char* fmt, ...)
@@ -9,12 +9,23 @@
 #include "ch_search.h"
 
 #include "thirdparty/msgpack/include/ch_msgpack.h"
+#include "thirdparty/hashmap/hashmap.h"
+
+// datamaps are flushed to the pipe in batches of about this size
+#define CH_DM_BATCH_SIZE (1024 * 64)
 
 typedef struct ch_send_ctx {
     HANDLE module_;
     HANDLE pipe;
     msgpack_sbuffer mp_buf;
     msgpack_packer mp_pk;
+
+    // the packed datamaps of the next CH_MSG_DATAMAPS message
+    msgpack_sbuffer dm_batch_buf;
+    msgpack_packer dm_batch_pk;
+    uint32_t n_batched_dms;
+    // ch_sent_dm, every datamap that's been batched so far
+    struct hashmap* sent_dms;
 } ch_send_ctx;
 
 
@@ -27,6 +38,11 @@ void ch_send_log_info(ch_send_ctx* ctx, const char* fmt, ...);
 
 int ch_msg_preamble(ch_send_ctx* ctx, ch_comm_msg_type type);
 
+typedef struct ch_sent_dm {
+    const datamap_t* dm;
+    ch_game_module mod_idx;
+} ch_sent_dm;
+
 typedef struct ch_send_datamap_cb_udata {
     ch_send_ctx* send_ctx;
     ch_search_ctx* sc;
@@ -34,5 +50,7 @@ typedef struct ch_send_datamap_cb_udata {
 } ch_send_datamap_cb_udata;
 
 void ch_send_datamap_cb(const datamap_t* dm, void* info);
+// sends the datamaps that haven't been sent yet, call after the last ch_send_datamap_cb
+void ch_flush_datamaps(ch_send_ctx* ctx);
 __declspec(noreturn) void ch_send_err_and_exit(ch_send_ctx* ctx, const char* fmt, ...);
 __declspec(noreturn) void ch_clean_exit(ch_send_ctx* ctx, DWORD exit_code);
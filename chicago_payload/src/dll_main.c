@@ -13,9 +13,28 @@ void ch_clean_exit(ch_send_ctx* ctx, DWORD exit_code)
     if (ctx->pipe != INVALID_HANDLE_VALUE)
         CloseHandle(ctx->pipe);
     msgpack_sbuffer_destroy(&ctx->mp_buf);
+    msgpack_sbuffer_destroy(&ctx->dm_batch_buf);
+    if (ctx->sent_dms)
+        hashmap_free(ctx->sent_dms);
     FreeLibraryAndExitThread(ctx->module_, exit_code);
 }
 
+static uint64_t ch_sent_dm_hash(const void* item, uint64_t seed0, uint64_t seed1)
+{
+    const ch_sent_dm* sent = item;
+    return hashmap_xxhash3(&sent->dm, sizeof sent->dm, seed0 ^ sent->mod_idx, seed1);
+}
+
+static int ch_sent_dm_compare(const void* a, const void* b, void* udata)
+{
+    (void)udata;
+    const ch_sent_dm* sa = a;
+    const ch_sent_dm* sb = b;
+    if (sa->dm != sb->dm)
+        return sa->dm < sb->dm ? -1 : 1;
+    return (int)sa->mod_idx - (int)sb->mod_idx;
+}
+
 static void ch_connect_pipe(ch_send_ctx* ctx)
 {
     if (!WaitNamedPipeA(CH_PIPE_NAME, CH_PIPE_TIMEOUT_MS)) {
@@ -39,9 +58,15 @@ void __stdcall main(HINSTANCE h_mod)
 
     msgpack_sbuffer_init(&rctx.mp_buf);
     msgpack_packer_init(&rctx.mp_pk, &rctx.mp_buf, msgpack_sbuffer_write);
+    msgpack_sbuffer_init(&rctx.dm_batch_buf);
+    msgpack_packer_init(&rctx.dm_batch_pk, &rctx.dm_batch_buf, msgpack_sbuffer_write);
 
     ch_send_ctx* ctx = &rctx;
 
+    ctx->sent_dms = hashmap_new(sizeof(ch_sent_dm), 1024, 0, 0, ch_sent_dm_hash, ch_sent_dm_compare, NULL, NULL);
+    if (!ctx->sent_dms)
+        ch_clean_exit(ctx, 1);
+
     ch_connect_pipe(ctx);
     ch_send_wave(ctx, CH_MSG_HELLO);
 
@@ -57,6 +82,7 @@ void __stdcall main(HINSTANCE h_mod)
         dm_cb.mod_idx = i;
         ch_iterate_datamaps(ctx, &sc, i, ch_send_datamap_cb, &dm_cb);
     }
+    ch_flush_datamaps(ctx);
 
     const ch_ent_factory_dict* factory = ch_find_ent_factory_dict(ctx, &sc.mods[CH_MOD_SERVER]);
     ch_send_ent_factory_kv(ctx, &sc, factory);
@@ -1,38 +1,144 @@
-import tarfile
 import brotli
-import io
 import argparse
-import os
-import os.path
-from typing import List
-
-
-def write_all_to_archive(out_path: str, in_paths: List[str]):
-    with io.BytesIO() as tar_iob:
-        print('Creating in-memory tar file...')
-        with tarfile.TarFile(fileobj=tar_iob, mode='w', dereference=True) as tf:
-            for in_path in in_paths:
-                print(f" - Adding '{in_path}'")
-                with open(in_path, mode='rb') as inpf:
-                    info = tarfile.TarInfo(os.path.basename(in_path))
-                    inpf.seek(0, io.SEEK_END)
-                    info.size = inpf.tell()
-                    info.type = tarfile.REGTYPE
-                    info.mtime = os.stat(in_path).st_mtime
-                    inpf.seek(0, io.SEEK_SET)
-                    tf.addfile(tarinfo=info, fileobj=inpf)
-        tar_iob.seek(0, io.SEEK_SET)
-        print('Compressing...')
+import struct
+from typing import List, Tuple
+
+# see ch_archive.h
+ARCHIVE_MAGIC = b'chiarch\0'
+ARCHIVE_VERSION = 2
+MAX_GAME_NAME_SIZE = 32
+COMPRESSION_NONE = 0
+COMPRESSION_BROTLI = 1
+
+HEADER_FMT = '<8sII'
+ENTRY_FMT = f'<{MAX_GAME_NAME_SIZE}s{MAX_GAME_NAME_SIZE}sQIIIIII'
+
+# see ch_dc_header in datamap.h & ch_fingerprint.h
+COLLECTION_MAGIC = b'chicago\0'
+COLLECTION_HEADER_FMT = '<8s12I'
+FINGERPRINT_BITS_PER_NAME = 16
+FINGERPRINT_N_HASHES = 6
+
+_P1 = 11400714785074694791
+_P2 = 14029467366897019727
+_P3 = 1609587929392839161
+_P4 = 9650029242287828579
+_P5 = 2870177450012600261
+_M64 = (1 << 64) - 1
+
+
+def _rotl(x: int, r: int) -> int:
+    return ((x << r) | (x >> (64 - r))) & _M64
+
+
+def _round(acc: int, val: int) -> int:
+    acc = (acc + val * _P2) & _M64
+    return (_rotl(acc, 31) * _P1) & _M64
+
+
+def xxh64(data: bytes, seed: int = 0) -> int:
+    """Same as ch_archive_hash (hashmap_xxhash3 from the hashmap lib, which is xxh64)."""
+    n = len(data)
+    p = 0
+    if n >= 32:
+        v = [(seed + _P1 + _P2) & _M64, (seed + _P2) & _M64, seed, (seed - _P1) & _M64]
+        while p <= n - 32:
+            for i in range(4):
+                v[i] = _round(v[i], struct.unpack_from('<Q', data, p + i * 8)[0])
+            p += 32
+        h = (_rotl(v[0], 1) + _rotl(v[1], 7) + _rotl(v[2], 12) + _rotl(v[3], 18)) & _M64
+        for i in range(4):
+            h ^= _round(0, v[i])
+            h = (h * _P1 + _P4) & _M64
+    else:
+        h = (seed + _P5) & _M64
+    h = (h + n) & _M64
+    while p + 8 <= n:
+        h ^= _round(0, struct.unpack_from('<Q', data, p)[0])
+        h = (_rotl(h, 27) * _P1 + _P4) & _M64
+        p += 8
+    if p + 4 <= n:
+        h ^= (struct.unpack_from('<I', data, p)[0] * _P1) & _M64
+        h = (_rotl(h, 23) * _P2 + _P3) & _M64
+        p += 4
+    while p < n:
+        h ^= (data[p] * _P5) & _M64
+        h = (_rotl(h, 11) * _P1) & _M64
+        p += 1
+    h ^= h >> 33
+    h = (h * _P2) & _M64
+    h ^= h >> 29
+    h = (h * _P3) & _M64
+    h ^= h >> 32
+    return h
+
+
+def fingerprint(collection: bytes) -> bytes:
+    """Bloom filter of all strings in a collection file, empty if the data isn't a collection."""
+    if len(collection) < struct.calcsize(COLLECTION_HEADER_FMT):
+        return b''
+    magic, _version, _file_size, *_counts, strs_size, _dms, _tds, _disps, _slots, strs_off = struct.unpack_from(
+        COLLECTION_HEADER_FMT, collection)
+    if magic != COLLECTION_MAGIC:
+        return b''
+    names = [name for name in collection[strs_off:strs_off + strs_size].split(b'\0') if name]
+    n_bits = max(len(names) * FINGERPRINT_BITS_PER_NAME // 8, 8) * 8
+    bloom = bytearray(n_bits // 8)
+    for name in names:
+        h = xxh64(name)
+        h1, h2 = h & 0xFFFFFFFF, (h >> 32) | 1
+        for i in range(FINGERPRINT_N_HASHES):
+            pos = (h1 + i * h2) % n_bits
+            bloom[pos // 8] |= 1 << (pos % 8)
+    return bytes(bloom)
+
+
+def write_all_to_archive(out_path: str, entries: List[Tuple[str, str, str]]):
+    """Each entry is (game name, game version, path) and is compressed on its own."""
+    blobs = []
+    for game_name, game_version, in_path in entries:
+        for s in (game_name, game_version):
+            if len(s.encode()) >= MAX_GAME_NAME_SIZE:
+                raise ValueError(f"'{s}' is too long (max {MAX_GAME_NAME_SIZE - 1} bytes)")
+        print(f" - Compressing '{in_path}' ({game_name} {game_version})")
+        with open(in_path, mode='rb') as inpf:
+            data = inpf.read()
         compressed = brotli.compress(
-            string=tar_iob.read(),
+            string=data,
             mode=brotli.MODE_GENERIC,
             quality=11,
             lgwin=22,
         )
-        print(f"Writing to '{out_path}'...")
-        with open(out_path, 'wb') as f:
-            f.write(compressed)
-        print('Done.')
+        compression = COMPRESSION_BROTLI
+        if len(compressed) >= len(data):
+            compressed, compression = data, COMPRESSION_NONE
+        blobs.append((game_name, game_version, data, compressed, compression, fingerprint(data)))
+
+    offset = struct.calcsize(HEADER_FMT) + struct.calcsize(ENTRY_FMT) * len(blobs)
+    index = b''
+    for game_name, game_version, data, compressed, compression, fp in blobs:
+        index += struct.pack(
+            ENTRY_FMT,
+            game_name.encode(),
+            game_version.encode(),
+            xxh64(data),
+            offset + len(fp),
+            len(compressed),
+            len(data),
+            compression,
+            offset,
+            len(fp),
+        )
+        offset += len(fp) + len(compressed)
+
+    print(f"Writing to '{out_path}'...")
+    with open(out_path, 'wb') as f:
+        f.write(struct.pack(HEADER_FMT, ARCHIVE_MAGIC, ARCHIVE_VERSION, len(blobs)))
+        f.write(index)
+        for blob in blobs:
+            f.write(blob[5])
+            f.write(blob[3])
+    print('Done.')
 
 
 if __name__ == '__main__':
@@ -41,14 +147,17 @@ if __name__ == '__main__':
         formatter_class=argparse.ArgumentDefaultsHelpFormatter,
     )
     parser.add_argument(
-        'files',
-        nargs='+',
-        help='files to compress to archive',
+        '--entry',
+        nargs=3,
+        action='append',
+        required=True,
+        metavar=('GAME_NAME', 'GAME_VERSION', 'FILE'),
+        help='a collection file to add to the archive',
     )
     parser.add_argument(
         '--output_file',
-        default='datamap_collections.tar.br',
+        default='datamap_collections.cha',
         help='the name of the output file',
     )
     args = parser.parse_args()
-    write_all_to_archive(args.output_file, args.files)
+    write_all_to_archive(args.output_file, args.entry)
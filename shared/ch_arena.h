@@ -4,6 +4,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "ch_portable.h"
+
 typedef struct ch_arena_chunk {
     struct ch_arena_chunk* prev;
 } ch_arena_chunk;
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// for CH_SCAN_SSE2 & ch_scan_ctz
+#include "ch_pattern_scan.h"
+
+/*
+* Substring search over plain bytes (e.g. looking for strings in the .rdata section of a module). Every position is
+* first checked against the first & last byte of the needle, 16 positions at a time with SSE2, and only positions
+* where both match are compared against the whole needle. Without SSE2 memchr finds the candidates for the first
+* byte instead. Overlapping matches are all reported.
+*
+* Like ch_pattern_scan.h this doesn't depend on the payload so it can be tested & benchmarked anywhere (see the
+* ch_test_memmem test & the bench-memmem command).
+*/
+
+#define CH_MEMMEM_NOT_FOUND SIZE_MAX
+#define CH_MEMMEM_DUP (SIZE_MAX - 1)
+
+// the needle must fit at off
+static inline bool ch_memmem_match_at(const unsigned char* h, const unsigned char* n, size_t n_len, size_t off)
+{
+    return h[off + n_len - 1] == n[n_len - 1] && !memcmp(h + off, n, n_len - 1);
+}
+
+// returns the offset of the first match at or after start, or CH_MEMMEM_NOT_FOUND
+static inline size_t ch_memmem_find(const void* haystack,
+                                    size_t haystack_len,
+                                    const void* needle,
+                                    size_t needle_len,
+                                    size_t start)
+{
+    const unsigned char* h = haystack;
+    const unsigned char* n = needle;
+    if (!h || !n || needle_len == 0 || needle_len > haystack_len || start > haystack_len - needle_len)
+        return CH_MEMMEM_NOT_FOUND;
+    size_t off = start;
+#ifdef CH_SCAN_SSE2
+    __m128i first = _mm_set1_epi8((char)n[0]);
+    __m128i last = _mm_set1_epi8((char)n[needle_len - 1]);
+    // the loads for the last byte of the needle must stay inside the haystack
+    for (; off <= haystack_len - needle_len && haystack_len - needle_len - off >= 15; off += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(h + off));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(h + off + needle_len - 1));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(b0, first), _mm_cmpeq_epi8(b1, last));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        while (mask) {
+            size_t pos = off + (size_t)ch_scan_ctz(mask);
+            mask &= mask - 1;
+            if (!memcmp(h + pos + 1, n + 1, needle_len - 1))
+                return pos;
+        }
+    }
+#endif
+    // the rest (or everything without SSE2)
+    while (off <= haystack_len - needle_len) {
+        const unsigned char* p = memchr(h + off, n[0], haystack_len - needle_len - off + 1);
+        if (!p)
+            break;
+        off = (size_t)(p - h);
+        if (ch_memmem_match_at(h, n, needle_len, off))
+            return off;
+        off++;
+    }
+    return CH_MEMMEM_NOT_FOUND;
+}
+
+/*
+* Returns the offset of the only match, CH_MEMMEM_NOT_FOUND, or CH_MEMMEM_DUP if there's more than one. The search
+* for a second match continues from the first one so the haystack is only scanned once.
+*/
+static inline size_t ch_memmem_find_unique(const void* haystack,
+                                           size_t haystack_len,
+                                           const void* needle,
+                                           size_t needle_len)
+{
+    size_t off = ch_memmem_find(haystack, haystack_len, needle, needle_len, 0);
+    if (off == CH_MEMMEM_NOT_FOUND)
+        return off;
+    if (ch_memmem_find(haystack, haystack_len, needle, needle_len, off + 1) != CH_MEMMEM_NOT_FOUND)
+        return CH_MEMMEM_DUP;
+    return off;
+}
+
+// iterates over all matches in order, overlapping ones included
+typedef struct ch_memmem_iter {
+    const void* haystack;
+    size_t haystack_len;
+    const void* needle;
+    size_t needle_len;
+    size_t next_off;
+} ch_memmem_iter;
+
+static inline ch_memmem_iter ch_memmem_iter_init(const void* haystack,
+                                                 size_t haystack_len,
+                                                 const void* needle,
+                                                 size_t needle_len)
+{
+    return (ch_memmem_iter){
+        .haystack = haystack,
+        .haystack_len = haystack_len,
+        .needle = needle,
+        .needle_len = needle_len,
+    };
+}
+
+static inline bool ch_memmem_next(ch_memmem_iter* it, size_t* off_out)
+{
+    size_t off = ch_memmem_find(it->haystack, it->haystack_len, it->needle, it->needle_len, it->next_off);
+    if (off == CH_MEMMEM_NOT_FOUND) {
+        it->next_off = it->haystack_len;
+        return false;
+    }
+    it->next_off = off + 1;
+    *off_out = off;
+    return true;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CH_SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+* Searches a buffer (e.g. the .text section of a module) for byte patterns with wildcards. Testing every pattern at
+* every byte is slow, so each pattern gets two anchors: its two rarest non-wildcard bytes. The scan compares 16
+* positions at a time against the anchors of every pattern, and only positions where both anchors of a pattern
+* match get compared against the whole pattern. Common x86 bytes (0x00, 0xFF, 0x8B, etc.) are almost never picked as
+* anchors, so there are very few of those.
+*
+* This only works on plain bytes so that it can be built, tested & benchmarked anywhere (see the ch_test_pattern_scan
+* test & the bench-scan command).
+*/
+
+typedef struct ch_pattern {
+    unsigned char* wildmask; // bit i is set if byte i can be anything
+    unsigned char* bytes;
+    size_t len;
+} ch_pattern;
+
+#define CH_SCAN_MAX_PATTERNS 16
+
+#define CH_SCAN_NOT_FOUND (-1)
+#define CH_SCAN_DUP (-2)
+
+typedef struct ch_pattern_scanner {
+    const ch_pattern* patterns;
+    size_t n_patterns;
+    // the offsets of the anchors in each pattern, patterns with only wildcards have none & match everywhere
+    size_t anchor_offs[CH_SCAN_MAX_PATTERNS][2];
+    unsigned char anchor_bytes[CH_SCAN_MAX_PATTERNS][2];
+    bool has_anchor[CH_SCAN_MAX_PATTERNS];
+    size_t max_anchor_off;
+} ch_pattern_scanner;
+
+// called on each match in order of offset (then pattern index), return true to stop scanning
+typedef bool (*ch_scan_match_cb)(size_t pattern_idx, size_t off, void* user_data);
+
+static inline bool ch_pattern_is_wild(const ch_pattern* pattern, size_t i)
+{
+    return pattern->wildmask[i / 8] & (1 << (i & 7));
+}
+
+// the pattern must fit in the memory
+static inline bool ch_pattern_match_at(const unsigned char* mem, const ch_pattern* pattern)
+{
+    for (size_t i = 0; i < pattern->len; i++)
+        if (pattern->bytes[i] != mem[i] && !ch_pattern_is_wild(pattern, i))
+            return false;
+    return true;
+}
+
+/*
+* A rough ranking of the most common bytes in 32 bit MSVC code (opcodes, modrm bytes, small displacements & padding),
+* most common first. Bytes that aren't listed are treated as equally rare.
+*/
+static const unsigned char ch_scan_common_bytes[] = {
+    0x00, 0xFF, 0x8B, 0x89, 0xCC, 0x45, 0x24, 0x04, 0x08, 0xE8, 0x83, 0x0C, 0x10, 0x01, 0x50, 0x85, 0xC0, 0x74,
+    0x8D, 0x4C, 0x44, 0x0F, 0x56, 0x14, 0xC4, 0x75, 0x51, 0x6A, 0x46, 0x8E, 0x18, 0x57, 0x5E, 0x4D, 0x0D, 0xC3,
+    0x55, 0x33, 0x3B, 0x68, 0x1C, 0x02, 0xEB, 0x5F, 0x4E, 0x80, 0x20, 0x06, 0x47, 0xD9, 0x03, 0xF8, 0xC7, 0x40,
+    0x5D, 0xEC, 0xE9, 0x53, 0xC6, 0x4F, 0x07, 0xFC, 0x52, 0x54, 0x7E, 0xD8, 0xF0, 0xF6, 0x0E, 0xC1, 0x5B, 0xB8,
+};
+
+static inline int ch_scan_byte_commonness(unsigned char b)
+{
+    for (size_t i = 0; i < sizeof ch_scan_common_bytes; i++)
+        if (ch_scan_common_bytes[i] == b)
+            return (int)(sizeof ch_scan_common_bytes - i);
+    return 0;
+}
+
+// the least common non-wildcard byte of the pattern which isn't at skip_off, returns false if there isn't one
+static inline bool ch_scan_pick_anchor(const ch_pattern* pattern, size_t skip_off, int same_byte, size_t* off_out)
+{
+    int best = INT32_MAX;
+    for (size_t i = 0; i < pattern->len; i++) {
+        if (i == skip_off || ch_pattern_is_wild(pattern, i))
+            continue;
+        int commonness = ch_scan_byte_commonness(pattern->bytes[i]);
+        // the same byte as the other anchor is more likely to match at the same time
+        if (pattern->bytes[i] == same_byte)
+            commonness += (int)sizeof ch_scan_common_bytes;
+        if (commonness < best) {
+            best = commonness;
+            *off_out = i;
+        }
+    }
+    return best != INT32_MAX;
+}
+
+// the patterns must outlive the scanner, returns false if there are more than CH_SCAN_MAX_PATTERNS of them
+static inline bool ch_pattern_scanner_init(ch_pattern_scanner* sc, const ch_pattern* patterns, size_t n_patterns)
+{
+    memset(sc, 0, sizeof *sc);
+    if (n_patterns > CH_SCAN_MAX_PATTERNS)
+        return false;
+    sc->patterns = patterns;
+    sc->n_patterns = n_patterns;
+    for (size_t p = 0; p < n_patterns; p++) {
+        size_t* offs = sc->anchor_offs[p];
+        sc->has_anchor[p] = ch_scan_pick_anchor(&patterns[p], SIZE_MAX, -1, &offs[0]);
+        if (!sc->has_anchor[p])
+            continue;
+        // with a single non-wildcard byte both anchors are the same
+        if (!ch_scan_pick_anchor(&patterns[p], offs[0], patterns[p].bytes[offs[0]], &offs[1]))
+            offs[1] = offs[0];
+        for (int a = 0; a < 2; a++) {
+            sc->anchor_bytes[p][a] = patterns[p].bytes[offs[a]];
+            if (offs[a] > sc->max_anchor_off)
+                sc->max_anchor_off = offs[a];
+        }
+    }
+    return true;
+}
+
+static inline int ch_scan_ctz(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return (int)idx;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// checks the candidates of the block at off, masks[p] has bit j set if both anchors of pattern p match at off + j
+static inline bool ch_scan_check_block(const ch_pattern_scanner* sc,
+                                       const unsigned char* buf,
+                                       size_t len,
+                                       size_t off,
+                                       const uint32_t* masks,
+                                       uint32_t any_mask,
+                                       ch_scan_match_cb cb,
+                                       void* user_data)
+{
+    while (any_mask) {
+        int j = ch_scan_ctz(any_mask);
+        any_mask &= any_mask - 1;
+        size_t pos = off + (size_t)j;
+        for (size_t p = 0; p < sc->n_patterns; p++) {
+            if (!(masks[p] & (1u << j)))
+                continue;
+            const ch_pattern* pattern = &sc->patterns[p];
+            if (pattern->len <= len - pos && ch_pattern_match_at(buf + pos, pattern) && cb(p, pos, user_data))
+                return true;
+        }
+    }
+    return false;
+}
+
+// calls cb on every match of every pattern in a single pass
+static inline void ch_pattern_scan(const ch_pattern_scanner* sc,
+                                   const unsigned char* buf,
+                                   size_t len,
+                                   ch_scan_match_cb cb,
+                                   void* user_data)
+{
+    uint32_t masks[CH_SCAN_MAX_PATTERNS];
+    size_t off = 0;
+#ifdef CH_SCAN_SSE2
+    __m128i anchors[CH_SCAN_MAX_PATTERNS][2];
+    for (size_t p = 0; p < sc->n_patterns; p++)
+        for (int a = 0; a < 2; a++)
+            anchors[p][a] = _mm_set1_epi8((char)sc->anchor_bytes[p][a]);
+    // the loads of the anchors of the last block must stay inside the buffer
+    for (; len >= 16 + sc->max_anchor_off && off <= len - 16 - sc->max_anchor_off; off += 16) {
+        uint32_t any_mask = 0;
+        for (size_t p = 0; p < sc->n_patterns; p++) {
+            if (!sc->has_anchor[p]) {
+                masks[p] = 0xFFFF;
+            } else {
+                __m128i b0 = _mm_loadu_si128((const __m128i*)(buf + off + sc->anchor_offs[p][0]));
+                __m128i b1 = _mm_loadu_si128((const __m128i*)(buf + off + sc->anchor_offs[p][1]));
+                __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(b0, anchors[p][0]), _mm_cmpeq_epi8(b1, anchors[p][1]));
+                masks[p] = (uint32_t)_mm_movemask_epi8(eq);
+            }
+            any_mask |= masks[p];
+        }
+        if (any_mask && ch_scan_check_block(sc, buf, len, off, masks, any_mask, cb, user_data))
+            return;
+    }
+#endif
+    // the rest (or everything without SSE2), one position at a time
+    for (; off < len; off++) {
+        uint32_t any_mask = 0;
+        for (size_t p = 0; p < sc->n_patterns; p++) {
+            masks[p] = 0;
+            if (!sc->has_anchor[p]) {
+                masks[p] = 1;
+            } else if (sc->anchor_offs[p][0] < len - off && sc->anchor_offs[p][1] < len - off) {
+                masks[p] = buf[off + sc->anchor_offs[p][0]] == sc->anchor_bytes[p][0] &&
+                           buf[off + sc->anchor_offs[p][1]] == sc->anchor_bytes[p][1];
+            }
+            any_mask |= masks[p];
+        }
+        if (any_mask && ch_scan_check_block(sc, buf, len, off, masks, any_mask, cb, user_data))
+            return;
+    }
+}
+
+typedef struct ch_scan_first_udata {
+    bool ensure_unique;
+    int pattern_idx;
+    size_t off;
+} ch_scan_first_udata;
+
+static inline bool ch_scan_first_cb(size_t pattern_idx, size_t off, void* user_data)
+{
+    ch_scan_first_udata* udata = user_data;
+    if (udata->pattern_idx == CH_SCAN_NOT_FOUND) {
+        udata->pattern_idx = (int)pattern_idx;
+        udata->off = off;
+        return !udata->ensure_unique;
+    }
+    // other patterns matching at the same offset don't count as duplicates
+    if (off == udata->off)
+        return false;
+    udata->pattern_idx = CH_SCAN_DUP;
+    return true;
+}
+
+/*
+* Returns the index of the pattern with the first match (the lowest index if several match there) & sets *off_out.
+* With ensure_unique, returns CH_SCAN_DUP if anything matches after that.
+*/
+static inline int ch_pattern_scan_first(const ch_pattern_scanner* sc,
+                                        const unsigned char* buf,
+                                        size_t len,
+                                        bool ensure_unique,
+                                        size_t* off_out)
+{
+    ch_scan_first_udata udata = {.ensure_unique = ensure_unique, .pattern_idx = CH_SCAN_NOT_FOUND};
+    ch_pattern_scan(sc, buf, len, ch_scan_first_cb, &udata);
+    if (off_out)
+        *off_out = udata.off;
+    return udata.pattern_idx;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+/*
+* The code was written against MSVC & the Windows headers which provide min/max, _stricmp & ARRAYSIZE. Everything
+* except the payload & injection should build anywhere, so other compilers get equivalents here.
+*/
+
+#ifndef _MSC_VER
+
+#include <strings.h>
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+
+#endif
+
+#if !defined(_WIN32) && !defined(ARRAYSIZE)
+#define ARRAYSIZE(a) (sizeof(a) / sizeof(*(a)))
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ch_portable.h"
+
+static inline uint32_t ch_test_rand(uint32_t* state)
+{
+    // xorshift32, the tests should be the same on every run
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
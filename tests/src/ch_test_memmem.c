@@ -0,0 +1,73 @@
+#include <stdio.h>
+
+#include "ch_test.h"
+#include "ch_memmem.h"
+
+// every match of the iterator (& ch_memmem_find_unique) must agree with a memcmp at every offset
+static bool ch_test_memmem_matches_naive(const unsigned char* hay,
+                                         size_t hay_len,
+                                         const unsigned char* needle,
+                                         size_t needle_len)
+{
+    ch_memmem_iter it = ch_memmem_iter_init(hay, hay_len, needle, needle_len);
+    size_t n_naive_matches = 0, first_off = CH_MEMMEM_NOT_FOUND;
+    for (size_t off = 0; off + needle_len <= hay_len; off++) {
+        if (memcmp(hay + off, needle, needle_len))
+            continue;
+        size_t it_off;
+        if (!ch_memmem_next(&it, &it_off) || it_off != off)
+            return false;
+        if (n_naive_matches++ == 0)
+            first_off = off;
+    }
+    size_t it_off;
+    if (ch_memmem_next(&it, &it_off))
+        return false;
+    size_t unique_off = n_naive_matches > 1 ? CH_MEMMEM_DUP : first_off;
+    return ch_memmem_find_unique(hay, hay_len, needle, needle_len) == unique_off;
+}
+
+/*
+* The cases that the big buffer of the bench-memmem command doesn't hit: haystacks shorter than a block, 1 byte
+* needles, needles at the very end, needles as long as (or longer than) the haystack. Few distinct bytes are used so
+* that there are lots of matches. Returns the haystack length of the first case that doesn't agree with the naive
+* search, or 0.
+*/
+static size_t ch_test_memmem_edge_cases(void)
+{
+    enum { MAX_HAY_LEN = 48 };
+    unsigned char hay[MAX_HAY_LEN];
+    unsigned char needle[MAX_HAY_LEN + 1];
+    uint32_t state = 0x6d656d6d;
+    for (size_t hay_len = 1; hay_len <= MAX_HAY_LEN; hay_len++) {
+        for (size_t i = 0; i < hay_len; i++)
+            hay[i] = (unsigned char)('a' + ch_test_rand(&state) % 3);
+        // 1 byte needles (including the last byte), the end of the haystack, and the whole haystack
+        for (unsigned char c = 'a'; c <= 'c'; c++)
+            if (!ch_test_memmem_matches_naive(hay, hay_len, &c, 1))
+                return hay_len;
+        for (size_t needle_len = 1; needle_len <= hay_len; needle_len++)
+            if (!ch_test_memmem_matches_naive(hay, hay_len, hay + hay_len - needle_len, needle_len))
+                return hay_len;
+        // a random needle & one that's longer than the haystack
+        for (size_t i = 0; i <= hay_len; i++)
+            needle[i] = (unsigned char)('a' + ch_test_rand(&state) % 3);
+        if (!ch_test_memmem_matches_naive(hay, hay_len, needle, min(hay_len, 3)))
+            return hay_len;
+        memcpy(needle, hay, hay_len);
+        if (!ch_test_memmem_matches_naive(hay, hay_len, needle, hay_len + 1))
+            return hay_len;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    size_t hay_len = ch_test_memmem_edge_cases();
+    if (hay_len) {
+        printf("edge cases: MISMATCH with a haystack of %zu bytes\n", hay_len);
+        return 1;
+    }
+    printf("edge cases: ok\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+
+#include "ch_test.h"
+#include "ch_pattern_scan.h"
+
+// walks the matches of the naive search in the order that ch_pattern_scan reports them
+typedef struct ch_test_scan_check {
+    const ch_pattern* patterns;
+    size_t n_patterns;
+    const unsigned char* buf;
+    size_t len;
+    size_t off, pattern_idx; // where the naive search continues from
+    bool ok;
+} ch_test_scan_check;
+
+static bool ch_test_scan_next_naive(ch_test_scan_check* c, size_t* pattern_idx, size_t* off)
+{
+    for (; c->off < c->len; c->off++, c->pattern_idx = 0) {
+        for (; c->pattern_idx < c->n_patterns; c->pattern_idx++) {
+            const ch_pattern* pattern = &c->patterns[c->pattern_idx];
+            if (pattern->len <= c->len - c->off && ch_pattern_match_at(c->buf + c->off, pattern)) {
+                *pattern_idx = c->pattern_idx++;
+                *off = c->off;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool ch_test_scan_check_cb(size_t pattern_idx, size_t off, void* user_data)
+{
+    ch_test_scan_check* c = user_data;
+    size_t naive_idx, naive_off;
+    c->ok = ch_test_scan_next_naive(c, &naive_idx, &naive_off) && naive_idx == pattern_idx && naive_off == off;
+    return !c->ok;
+}
+
+static bool ch_test_scan_matches_naive(const ch_pattern* patterns,
+                                       size_t n_patterns,
+                                       const unsigned char* buf,
+                                       size_t len)
+{
+    ch_pattern_scanner scanner;
+    if (!ch_pattern_scanner_init(&scanner, patterns, n_patterns))
+        return false;
+    ch_test_scan_check c = {.patterns = patterns, .n_patterns = n_patterns, .buf = buf, .len = len, .ok = true};
+    ch_pattern_scan(&scanner, buf, len, ch_test_scan_check_cb, &c);
+    size_t naive_idx, naive_off;
+    return c.ok && !ch_test_scan_next_naive(&c, &naive_idx, &naive_off);
+}
+
+/*
+* The cases that the big buffer of the bench-scan command doesn't hit: haystacks shorter than a block, 1 byte &
+* all-wildcard patterns, matches in the last bytes, and patterns longer than the haystack. Few distinct bytes are used
+* so that there are lots of matches. Returns the haystack length of the first case that doesn't agree with the naive
+* search, or 0.
+*/
+static size_t ch_test_scan_edge_cases(void)
+{
+    enum { MAX_HAY_LEN = 48, LONG_PATTERN_LEN = 40, N_PATTERNS = 7 };
+    static unsigned char scratch[N_PATTERNS][MAX_HAY_LEN + 1 + (MAX_HAY_LEN + 8) / 8];
+    unsigned char hay[MAX_HAY_LEN];
+    uint32_t state = 0x65646765;
+    for (size_t hay_len = 1; hay_len <= MAX_HAY_LEN; hay_len++) {
+        for (size_t i = 0; i < hay_len; i++)
+            hay[i] = (unsigned char)(0x41 + ch_test_rand(&state) % 3);
+        size_t lens[N_PATTERNS] = {1, 1, 2, min(hay_len, 3), hay_len, hay_len + 1, LONG_PATTERN_LEN};
+        ch_pattern patterns[N_PATTERNS];
+        memset(scratch, 0, sizeof scratch);
+        for (size_t p = 0; p < N_PATTERNS; p++) {
+            patterns[p] = (ch_pattern){.bytes = scratch[p], .wildmask = scratch[p] + MAX_HAY_LEN + 1, .len = lens[p]};
+            for (size_t i = 0; i < lens[p]; i++)
+                patterns[p].bytes[i] = (unsigned char)(0x41 + ch_test_rand(&state) % 3);
+        }
+        // the last byte, a single wildcard, the end of the haystack with a wildcard, and the whole haystack (+1)
+        patterns[0].bytes[0] = hay[hay_len - 1];
+        patterns[1].wildmask[0] = 1;
+        memcpy(patterns[3].bytes, hay + hay_len - lens[3], lens[3]);
+        patterns[3].wildmask[0] = lens[3] == 3 ? 2 : 0;
+        memcpy(patterns[4].bytes, hay, hay_len);
+        memcpy(patterns[5].bytes, hay, hay_len);
+
+        for (size_t p = 0; p < N_PATTERNS; p++)
+            if (!ch_test_scan_matches_naive(&patterns[p], 1, hay, hay_len))
+                return hay_len;
+        if (!ch_test_scan_matches_naive(patterns, N_PATTERNS, hay, hay_len))
+            return hay_len;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    size_t hay_len = ch_test_scan_edge_cases();
+    if (hay_len) {
+        printf("edge cases: MISMATCH with a haystack of %zu bytes\n", hay_len);
+        return 1;
+    }
+    printf("edge cases: ok\n");
+    return 0;
+}